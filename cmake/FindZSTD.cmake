@@ -0,0 +1,58 @@
+# - Try to find ZSTD
+# Once done this will define
+#
+# ZSTD_FOUND - system has ZSTD
+# ZSTD_INCLUDE_DIRS - the ZSTD include directory
+# ZSTD_LIBRARIES - Link these to use ZSTD
+#
+# The compression of the JSON update stream requires zstd 1.4.0 or newer.
+#
+
+if (ZSTD_LIBRARIES AND ZSTD_INCLUDE_DIRS)
+    # in cache already
+    set(ZSTD_FOUND TRUE)
+else (ZSTD_LIBRARIES AND ZSTD_INCLUDE_DIRS)
+
+find_path(ZSTD_INCLUDE_DIR
+    NAMES
+    zstd.h
+    PATHS
+    /usr/include
+    /usr/local/include
+    /opt/local/include
+    /sw/include
+    ${ZSTD_ROOT}/include
+    ENV{ZSTD_ROOT}/include
+)
+
+find_library(ZSTD_LIBRARY
+    NAMES
+    zstd libzstd
+    PATH
+    /usr/lib
+    /usr/local/lib
+    /opt/local/lib
+    /sw/lib
+    ${ZSTD_ROOT}/lib
+    ENV{ZSTD_ROOT}/lib
+)
+
+set(ZSTD_INCLUDE_DIRS
+    ${ZSTD_INCLUDE_DIR}
+)
+
+if (ZSTD_LIBRARY)
+    set(ZSTD_LIBRARIES
+        ${ZSTD_LIBRARIES}
+        ${ZSTD_LIBRARY}
+)
+endif (ZSTD_LIBRARY)
+
+# show the ZSTD_INCLUDE_DIRS and ZSTD_LIBRARIES variables only in the advanced view
+mark_as_advanced(FORCE ZSTD_INCLUDE_DIRS ZSTD_LIBRARIES)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(ZSTD DEFAULT_MSG ZSTD_LIBRARIES ZSTD_INCLUDE_DIRS)
+
+endif (ZSTD_LIBRARIES AND ZSTD_INCLUDE_DIRS)
+
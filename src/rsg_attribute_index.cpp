@@ -0,0 +1,295 @@
+#include "rsg_attribute_index.h"
+
+#include <brics_3d/core/Logger.h>
+
+/* libvariant is used by the JSONQueryRunner as well */
+#include <Variant/Variant.h>
+
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_INDEX_PREFIX_WILDCARD ".*"
+#define RSG_INDEX_REGEX_CHARACTERS ".[]{}()\\*+?^$|"
+
+/// Appends a JSON string literal.
+static void appendJsonString(std::ostringstream& out, const std::string& value) {
+	out << "\"";
+	for (size_t i = 0; i < value.size(); ++i) {
+		if ((value[i] == '"') || (value[i] == '\\')) {
+			out << "\\";
+		}
+		out << value[i];
+	}
+	out << "\"";
+}
+
+static bool isLiteral(const std::string& expression) {
+	return expression.find_first_of(RSG_INDEX_REGEX_CHARACTERS) == std::string::npos;
+}
+
+AttributeIndex::AttributeIndex() {
+
+}
+
+AttributeIndex::~AttributeIndex() {
+
+}
+
+void AttributeIndex::rebuild(SceneGraphFacade* scene) {
+	vector<Id> ids;
+	vector<Attribute> noConstraints;
+	scene->getNodes(noConstraints, ids); // all nodes
+
+	std::lock_guard<std::mutex> lock(mutex);
+	index.clear();
+	nodeAttributes.clear();
+	for (vector<Id>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+		vector<Attribute> attributes;
+		if(scene->getNodeAttributes(*it, attributes)) {
+			indexLocked(*it, attributes);
+		}
+	}
+	LOG(INFO) << "AttributeIndex: Indexed " << nodeAttributes.size() << " existing nodes.";
+}
+
+bool AttributeIndex::query(const std::string& query, std::string& result) {
+
+	/* Cheap pre check, so other queries are not parsed twice */
+	if((query.find("GET_NODES") == std::string::npos) || (query.find("subgraphId") != std::string::npos)) {
+		return false;
+	}
+
+	vector<Attribute> attributes;
+	std::string queryId;
+	try {
+		libvariant::Variant message = libvariant::DeserializeJSON(query);
+		if(!message.Contains("query") || (message.Get("query").AsString().compare("GET_NODES") != 0)) {
+			return false;
+		}
+		if(!message.Contains("attributes") || !message.Get("attributes").IsList()) {
+			return false;
+		}
+		libvariant::Variant attributeList = message.Get("attributes");
+		for (libvariant::Variant::ConstListIterator i(attributeList.ListBegin()), e(attributeList.ListEnd()); i != e; ++i) {
+			if(!i->Contains("key") || !i->Contains("value")) {
+				return false;
+			}
+			Attribute attribute(i->Get("key").AsString(), i->Get("value").AsString());
+			if(!isIndexable(attribute)) {
+				return false;
+			}
+			attributes.push_back(attribute);
+		}
+		if(message.Contains("queryId")) {
+			queryId = message.Get("queryId").AsString();
+		}
+	} catch (std::exception const&) {
+		return false; // The JSONQueryRunner will report the error.
+	}
+
+	if(attributes.empty()) {
+		return false;
+	}
+
+	vector<Id> ids;
+	getNodes(attributes, ids);
+
+	std::ostringstream out;
+	out << "{\"@worldmodeltype\": \"RSGQueryResult\",\"query\": \"GET_NODES\",";
+	if(!queryId.empty()) {
+		out << "\"queryId\": ";
+		appendJsonString(out, queryId);
+		out << ",";
+	}
+	out << "\"querySuccess\": true,\"ids\": [";
+	for (vector<Id>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+		if(it != ids.begin()) {
+			out << ",";
+		}
+		out << "\"" << it->toString() << "\"";
+	}
+	out << "]}";
+	result = out.str();
+
+	LOG(DEBUG) << "AttributeIndex: Answered GET_NODES query with " << ids.size() << " ids.";
+	return true;
+}
+
+void AttributeIndex::getNodes(const vector<Attribute>& attributes, vector<Id>& ids) {
+	ids.clear();
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::set<Id> matches;
+	for (vector<Attribute>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+		std::set<Id> attributeMatches;
+		lookupLocked(*it, attributeMatches);
+		if(it == attributes.begin()) {
+			matches.swap(attributeMatches);
+		} else { // A node has to have all attributes.
+			std::set<Id> intersection;
+			std::set_intersection(matches.begin(), matches.end(), attributeMatches.begin(), attributeMatches.end(),
+					std::inserter(intersection, intersection.begin()));
+			matches.swap(intersection);
+		}
+		if(matches.empty()) {
+			break;
+		}
+	}
+	ids.assign(matches.begin(), matches.end());
+}
+
+bool AttributeIndex::isIndexable(const Attribute& attribute) {
+	if(!isLiteral(attribute.key)) {
+		return false;
+	}
+	const std::string& value = attribute.value;
+	size_t wildcardLength = strlen(RSG_INDEX_PREFIX_WILDCARD);
+	if((value.size() >= wildcardLength) && (value.compare(value.size() - wildcardLength, wildcardLength, RSG_INDEX_PREFIX_WILDCARD) == 0)) {
+		return isLiteral(value.substr(0, value.size() - wildcardLength));
+	}
+	return isLiteral(value);
+}
+
+void AttributeIndex::lookupLocked(const Attribute& attribute, std::set<Id>& ids) {
+	std::map<std::string, ValueIndex>::const_iterator keyEntry = index.find(attribute.key);
+	if(keyEntry == index.end()) {
+		return;
+	}
+	const ValueIndex& values = keyEntry->second;
+
+	const std::string& value = attribute.value;
+	size_t wildcardLength = strlen(RSG_INDEX_PREFIX_WILDCARD);
+	bool isPrefix = (value.size() >= wildcardLength) && (value.compare(value.size() - wildcardLength, wildcardLength, RSG_INDEX_PREFIX_WILDCARD) == 0);
+
+	if(!isPrefix) {
+		ValueIndex::const_iterator valueEntry = values.find(value);
+		if(valueEntry != values.end()) {
+			ids.insert(valueEntry->second.begin(), valueEntry->second.end());
+		}
+		return;
+	}
+
+	/* All values with the same prefix are adjacent in the ordered map */
+	std::string prefix = value.substr(0, value.size() - wildcardLength);
+	for (ValueIndex::const_iterator it = values.lower_bound(prefix); it != values.end(); ++it) {
+		if(it->first.compare(0, prefix.size(), prefix) != 0) {
+			break;
+		}
+		ids.insert(it->second.begin(), it->second.end());
+	}
+}
+
+void AttributeIndex::indexLocked(Id id, const vector<Attribute>& attributes) {
+	unindexLocked(id);
+	for (vector<Attribute>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+		index[it->key][it->value].insert(id);
+	}
+	nodeAttributes[id] = attributes;
+}
+
+void AttributeIndex::unindexLocked(Id id) {
+	std::map<Id, vector<Attribute> >::iterator node = nodeAttributes.find(id);
+	if(node == nodeAttributes.end()) {
+		return;
+	}
+	for (vector<Attribute>::const_iterator it = node->second.begin(); it != node->second.end(); ++it) {
+		std::map<std::string, ValueIndex>::iterator keyEntry = index.find(it->key);
+		if(keyEntry == index.end()) {
+			continue;
+		}
+		ValueIndex::iterator valueEntry = keyEntry->second.find(it->value);
+		if(valueEntry == keyEntry->second.end()) {
+			continue;
+		}
+		valueEntry->second.erase(id);
+		if(valueEntry->second.empty()) {
+			keyEntry->second.erase(valueEntry);
+		}
+		if(keyEntry->second.empty()) {
+			index.erase(keyEntry);
+		}
+	}
+	nodeAttributes.erase(node);
+}
+
+/*
+ * Observer interface
+ */
+
+bool AttributeIndex::addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	indexLocked(assignedId, attributes);
+	return true;
+}
+
+bool AttributeIndex::addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	indexLocked(assignedId, attributes);
+	return true;
+}
+
+bool AttributeIndex::addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	indexLocked(assignedId, attributes);
+	return true;
+}
+
+bool AttributeIndex::addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	indexLocked(assignedId, attributes);
+	return true;
+}
+
+bool AttributeIndex::addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	indexLocked(assignedId, attributes);
+	return true;
+}
+
+bool AttributeIndex::addRemoteRootNode(Id rootId, vector<Attribute> attributes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	indexLocked(rootId, attributes);
+	return true;
+}
+
+bool AttributeIndex::addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	indexLocked(assignedId, attributes);
+	return true;
+}
+
+bool AttributeIndex::setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	indexLocked(id, newAttributes);
+	return true;
+}
+
+bool AttributeIndex::setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	return true;
+}
+
+bool AttributeIndex::setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp) {
+	return true;
+}
+
+bool AttributeIndex::deleteNode(Id id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	unindexLocked(id);
+	return true;
+}
+
+bool AttributeIndex::addParent(Id id, Id parentId) {
+	return true;
+}
+
+bool AttributeIndex::removeParent(Id id, Id parentId) {
+	return true;
+}
+
+} // namespace rsg
+} // namespace brics_3d
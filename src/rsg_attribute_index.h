@@ -0,0 +1,91 @@
+/*
+ * Inverted index from attributes to node ids.
+ *
+ * The index observes a scene graph and keeps track of the attributes of every
+ * node, so that GET_NODES queries do not need to scan the complete graph.
+ * Only queries that the index can answer exactly are handled: every attribute
+ * has a literal key and either a literal value or a literal prefix followed by
+ * ".*". All other queries (regular expressions, subgraphId, ...) are left to
+ * the JSONQueryRunner.
+ */
+
+#ifndef RSG_ATTRIBUTE_INDEX_H_
+#define RSG_ATTRIBUTE_INDEX_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace brics_3d {
+namespace rsg {
+
+class AttributeIndex : public ISceneGraphUpdateObserver {
+public:
+	AttributeIndex();
+	virtual ~AttributeIndex();
+
+	/**
+	 * Indexes all nodes that already exist in a scene. Call it before the index is
+	 * attached as observer to that scene.
+	 */
+	void rebuild(SceneGraphFacade* scene);
+
+	/**
+	 * Answers a JSON query if it is a GET_NODES query that can be resolved by the index.
+	 * @param query Complete RSGQuery message.
+	 * @param result JSON result. It has the same format as the one of the JSONQueryRunner.
+	 * @return True if the result has been set. False if the query has to be processed otherwise.
+	 */
+	bool query(const std::string& query, std::string& result);
+
+	/**
+	 * Looks up all nodes that have all of the given attributes.
+	 * An attribute value that ends with ".*" matches all values with that prefix.
+	 */
+	void getNodes(const vector<Attribute>& attributes, vector<Id>& ids);
+
+	/// Checks whether getNodes() resolves a query attribute exactly like the scene graph does.
+	static bool isIndexable(const Attribute& attribute);
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false);
+	bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false);
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false);
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes);
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false);
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0));
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+	bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp);
+	bool deleteNode(Id id);
+	bool addParent(Id id, Id parentId);
+	bool removeParent(Id id, Id parentId);
+
+private:
+
+	typedef std::map<std::string, std::set<Id> > ValueIndex;
+
+	/// Has to be called with mutex held.
+	void indexLocked(Id id, const vector<Attribute>& attributes);
+
+	/// Has to be called with mutex held.
+	void unindexLocked(Id id);
+
+	/// Has to be called with mutex held. Collects all ids for a single query attribute.
+	void lookupLocked(const Attribute& attribute, std::set<Id>& ids);
+
+	std::mutex mutex;
+	std::map<std::string, ValueIndex> index;        // key -> value -> ids
+	std::map<Id, vector<Attribute> > nodeAttributes; // Needed to remove outdated index entries.
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_ATTRIBUTE_INDEX_H_ */
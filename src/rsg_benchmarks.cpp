@@ -0,0 +1,623 @@
+/*
+ * Microbenchmarks for the update codecs of the sender and receiver blocks.
+ *
+ * Every update operation type is encoded by calling the serializer (observer)
+ * directly and the resulting messages are decoded again into a fresh world
+ * model. Per operation the time, the message size and the number of heap
+ * allocations are measured for encoding and decoding.
+ *
+ * Usage:
+ *   rsg_benchmarks [--output <file>] [--time <seconds per case>] [--filter <text>]
+ *
+ * The results are printed as table and written as JSON to the output file
+ * (default rsg_benchmarks.json). --filter only runs the cases whose
+ * "codec/operation" name contains the text, e.g. --filter json/setTransform
+ *
+ * The "restore" cases compare restoring a complete graph from a binary snapshot
+ * (rsg_snapshot.h) with applying the same graph as JSON updates. Here encoding
+ * is storing the graph and decoding is restoring it, both per node.
+ */
+
+/* BRICS_3D includes */
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/core/HomogeneousMatrix44.h>
+#include <brics_3d/core/PointCloud3D.h>
+#include <brics_3d/core/TriangleMeshExplicit.h>
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/Box.h>
+#include <brics_3d/worldModel/sceneGraph/Mesh.h>
+#include <brics_3d/worldModel/sceneGraph/PointCloud.h>
+#include <brics_3d/worldModel/sceneGraph/HDF5UpdateSerializer.h>
+#include <brics_3d/worldModel/sceneGraph/HDF5UpdateDeserializer.h>
+#include <brics_3d/worldModel/sceneGraph/SceneGraphToUpdatesTraverser.h>
+#ifdef RSG_BENCHMARKS_JSON
+#include <brics_3d/worldModel/sceneGraph/JSONSerializer.h>
+#include <brics_3d/worldModel/sceneGraph/JSONDeserializer.h>
+#endif /* RSG_BENCHMARKS_JSON */
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "rsg_binary_codec.h"
+#include "rsg_snapshot.h"
+
+using namespace brics_3d;
+using namespace brics_3d::rsg;
+
+#define BENCHMARK_DEFAULT_TIME 0.2 // [s] per case and direction
+#define BENCHMARK_MIN_ITERATIONS 10
+#define BENCHMARK_MAX_ITERATIONS 10000
+#define BENCHMARK_MAX_RETAINED_BYTES (256 * 1024 * 1024) // Encoding stops when the messages for decoding exceed this size.
+#define BENCHMARK_RESTORE_NODES 10000 // Transform nodes of the restored graph, each with a Box below.
+#define BENCHMARK_RESTORE_FILE "rsg_benchmarks_restore.rsgs"
+
+/*
+ * Allocation counting. The replacements are exported, so the allocations
+ * within the BRICS_3D libraries are counted as well.
+ */
+static std::atomic<uint64_t> allocationCount(0);
+static bool countAllocations = false;
+
+__attribute__ ((visibility("default"))) void* operator new(size_t size) {
+	if(countAllocations) {
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	void* memory = malloc(size == 0 ? 1 : size);
+	if(memory == 0) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+__attribute__ ((visibility("default"))) void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+__attribute__ ((visibility("default"))) void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+__attribute__ ((visibility("default"))) void operator delete[](void* memory) noexcept {
+	free(memory);
+}
+
+/**
+ * Keeps the encoded messages for decoding. Storing them is not counted as allocation.
+ */
+class MessageRecorder : public IOutputPort {
+public:
+	MessageRecorder() : bytes(0) {};
+	virtual ~MessageRecorder(){};
+
+	int write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+		bool counting = countAllocations;
+		countAllocations = false;
+		messages.push_back(std::string(dataBuffer, dataLength));
+		countAllocations = counting;
+		bytes += dataLength;
+		transferredBytes = dataLength;
+		return 0;
+	};
+
+	std::vector<std::string> messages;
+	uint64_t bytes;
+};
+
+/*
+ * Codecs
+ */
+
+struct Codec {
+	const char* name;
+	ISceneGraphUpdateObserver* (*createSerializer)(IOutputPort* port);
+	IOutputPort* (*createDeserializer)(WorldModel* wm);
+};
+
+static ISceneGraphUpdateObserver* createHdf5Serializer(IOutputPort* port) {
+	return new HDF5UpdateSerializer(port);
+}
+
+static IOutputPort* createHdf5Deserializer(WorldModel* wm) {
+	return new HDF5UpdateDeserializer(wm);
+}
+
+static ISceneGraphUpdateObserver* createBinarySerializer(IOutputPort* port) {
+	return new BinaryUpdateSerializer(port);
+}
+
+static IOutputPort* createBinaryDeserializer(WorldModel* wm) {
+	return new BinaryUpdateDeserializer(wm);
+}
+
+#ifdef RSG_BENCHMARKS_JSON
+static ISceneGraphUpdateObserver* createJsonSerializer(IOutputPort* port) {
+	return new JSONSerializer(port);
+}
+
+static IOutputPort* createJsonDeserializer(WorldModel* wm) {
+	return new JSONDeserializer(wm);
+}
+#endif /* RSG_BENCHMARKS_JSON */
+
+/*
+ * Cases
+ */
+
+enum BenchmarkOperation {
+	BENCHMARK_ADD_NODE,
+	BENCHMARK_ADD_TRANSFORM_NODE,
+	BENCHMARK_SET_TRANSFORM,
+	BENCHMARK_SET_NODE_ATTRIBUTES,
+	BENCHMARK_ADD_BOX,
+	BENCHMARK_ADD_MESH,
+	BENCHMARK_ADD_POINT_CLOUD,
+	BENCHMARK_ADD_CONNECTION
+};
+
+/**
+ * One benchmark case. The meaning of the payload depends on the operation:
+ * the length of every attribute value, the number of mesh triangles or the
+ * number of points of a point cloud.
+ */
+struct BenchmarkCase {
+	BenchmarkOperation operation;
+	const char* name;
+	unsigned int attributes;
+	unsigned int payload;
+};
+
+struct BenchmarkResult {
+	std::string codec;
+	BenchmarkCase benchmarkCase;
+	uint64_t iterations;
+	uint64_t messages;
+	uint64_t encodeFailures;
+	uint64_t decodeFailures;
+	double encodeNsPerOp;
+	double decodeNsPerOp;
+	double bytesPerOp;
+	double encodeAllocationsPerOp;
+	double decodeAllocationsPerOp;
+};
+
+/**
+ * Inputs of an operation. They are prepared before the measurement.
+ */
+struct BenchmarkInput {
+	vector<Attribute> attributes;
+	IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform;
+	Shape::ShapePtr shape;
+	Id existingNode;  // Target of setTransform, setNodeAttributes and source of connections
+	Id secondNode;    // Target of connections
+};
+
+static std::vector<BenchmarkCase> createCases() {
+	std::vector<BenchmarkCase> cases;
+	const unsigned int attributeCounts[] = {0, 10, 100};
+	const unsigned int valueSizes[] = {16, 1024, 65536};
+	for (unsigned int i = 0; i < sizeof(attributeCounts) / sizeof(attributeCounts[0]); ++i) {
+		for (unsigned int j = 0; j < sizeof(valueSizes) / sizeof(valueSizes[0]); ++j) {
+			if((attributeCounts[i] == 0) && (j > 0)) {
+				continue; // The value size does not matter without attributes.
+			}
+			BenchmarkCase addNode = {BENCHMARK_ADD_NODE, "addNode", attributeCounts[i], valueSizes[j]};
+			BenchmarkCase addTransformNode = {BENCHMARK_ADD_TRANSFORM_NODE, "addTransformNode", attributeCounts[i], valueSizes[j]};
+			BenchmarkCase setNodeAttributes = {BENCHMARK_SET_NODE_ATTRIBUTES, "setNodeAttributes", attributeCounts[i], valueSizes[j]};
+			BenchmarkCase addConnection = {BENCHMARK_ADD_CONNECTION, "addConnection", attributeCounts[i], valueSizes[j]};
+			cases.push_back(addNode);
+			cases.push_back(addTransformNode);
+			cases.push_back(setNodeAttributes);
+			cases.push_back(addConnection);
+		}
+	}
+	BenchmarkCase setTransform = {BENCHMARK_SET_TRANSFORM, "setTransform", 0, 0};
+	BenchmarkCase addBox = {BENCHMARK_ADD_BOX, "addGeometricNode(Box)", 1, 0};
+	cases.push_back(setTransform);
+	cases.push_back(addBox);
+	const unsigned int elementCounts[] = {100, 10000, 100000};
+	for (unsigned int i = 0; i < sizeof(elementCounts) / sizeof(elementCounts[0]); ++i) {
+		BenchmarkCase addMesh = {BENCHMARK_ADD_MESH, "addGeometricNode(Mesh)", 1, elementCounts[i]};
+		BenchmarkCase addPointCloud = {BENCHMARK_ADD_POINT_CLOUD, "addGeometricNode(PointCloud)", 1, elementCounts[i]};
+		cases.push_back(addMesh);
+		cases.push_back(addPointCloud);
+	}
+	return cases;
+}
+
+/**
+ * Deterministic ids, so all codecs encode the same messages.
+ */
+static std::vector<Id> createIds(unsigned int count) {
+	std::vector<Id> ids(count);
+	for (unsigned int i = 0; i < count; ++i) {
+		char uuid[40];
+		snprintf(uuid, sizeof(uuid), "00000000-0000-4000-8000-%012x", i + 1);
+		ids[i].fromString(uuid);
+	}
+	return ids;
+}
+
+static IHomogeneousMatrix44::IHomogeneousMatrix44Ptr createTransform(double x) {
+	IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform(new HomogeneousMatrix44(1,0,0,  	// Rotation coefficients
+			0,1,0,
+			0,0,1,
+			x,2,3)); 						// Translation coefficients
+	return transform;
+}
+
+static BenchmarkInput createInput(const BenchmarkCase& benchmarkCase, const std::vector<Id>& ids) {
+	BenchmarkInput input;
+	input.transform = createTransform(1);
+
+	if(benchmarkCase.operation < BENCHMARK_ADD_BOX || benchmarkCase.operation == BENCHMARK_ADD_CONNECTION) {
+		std::string value(benchmarkCase.payload, 'v');
+		for (unsigned int i = 0; i < benchmarkCase.attributes; ++i) {
+			char key[32];
+			snprintf(key, sizeof(key), "benchmark:key_%u", i);
+			input.attributes.push_back(Attribute(key, value));
+		}
+	} else {
+		input.attributes.push_back(Attribute("shape", benchmarkCase.name));
+	}
+
+	if(benchmarkCase.operation == BENCHMARK_ADD_BOX) {
+		input.shape.reset(new Box(1, 2, 3));
+	} else if(benchmarkCase.operation == BENCHMARK_ADD_MESH) {
+		brics_3d::TriangleMeshExplicit::TriangleMeshExplicitPtr mesh(new brics_3d::TriangleMeshExplicit());
+		for (unsigned int i = 0; i < benchmarkCase.payload; ++i) {
+			mesh->addTriangle(Point3D(i, 0, 0), Point3D(i, 1, 0), Point3D(i, 0, 1));
+		}
+		rsg::Mesh<brics_3d::TriangleMeshExplicit>::MeshPtr meshContainer(new rsg::Mesh<brics_3d::TriangleMeshExplicit>());
+		meshContainer->data = mesh;
+		input.shape = meshContainer;
+	} else if(benchmarkCase.operation == BENCHMARK_ADD_POINT_CLOUD) {
+		brics_3d::PointCloud3D::PointCloud3DPtr pointCloud(new brics_3d::PointCloud3D());
+		for (unsigned int i = 0; i < benchmarkCase.payload; ++i) {
+			pointCloud->addPoint(Point3D(i * 0.01, i * 0.02, i * 0.03));
+		}
+		rsg::PointCloud<brics_3d::PointCloud3D>::PointCloudPtr pointCloudContainer(new rsg::PointCloud<brics_3d::PointCloud3D>());
+		pointCloudContainer->data = pointCloud;
+		input.shape = pointCloudContainer;
+	}
+
+	/* Ids after the ones that are used for new nodes */
+	input.existingNode = ids[BENCHMARK_MAX_ITERATIONS];
+	input.secondNode = ids[BENCHMARK_MAX_ITERATIONS + 1];
+	return input;
+}
+
+/**
+ * Creates the nodes that the messages of a case refer to in the decoding world model.
+ */
+static void prepareDecoding(const BenchmarkCase& benchmarkCase, BenchmarkInput& input, WorldModel* wm) {
+	Id rootId = wm->getRootNodeId();
+	vector<Attribute> noAttributes;
+	if(benchmarkCase.operation == BENCHMARK_SET_TRANSFORM) {
+		wm->scene.addTransformNode(rootId, input.existingNode, noAttributes, createTransform(0), TimeStamp(0, Units::Second), true);
+	} else if(benchmarkCase.operation == BENCHMARK_SET_NODE_ATTRIBUTES || benchmarkCase.operation == BENCHMARK_ADD_CONNECTION) {
+		wm->scene.addNode(rootId, input.existingNode, noAttributes, true);
+		wm->scene.addNode(rootId, input.secondNode, noAttributes, true);
+	}
+}
+
+static bool encode(ISceneGraphUpdateObserver* serializer, const BenchmarkCase& benchmarkCase, BenchmarkInput& input, Id rootId, Id id, uint64_t iteration) {
+	TimeStamp timeStamp(1.0 + iteration * 0.001, Units::Second);
+	switch (benchmarkCase.operation) {
+	case BENCHMARK_ADD_NODE:
+		return serializer->addNode(rootId, id, input.attributes, true);
+	case BENCHMARK_ADD_TRANSFORM_NODE:
+		return serializer->addTransformNode(rootId, id, input.attributes, input.transform, timeStamp, true);
+	case BENCHMARK_SET_TRANSFORM:
+		return serializer->setTransform(input.existingNode, input.transform, timeStamp);
+	case BENCHMARK_SET_NODE_ATTRIBUTES:
+		return serializer->setNodeAttributes(input.existingNode, input.attributes, timeStamp);
+	case BENCHMARK_ADD_CONNECTION: {
+		vector<Id> sourceIds(1, input.existingNode);
+		vector<Id> targetIds(1, input.secondNode);
+		return serializer->addConnection(rootId, id, input.attributes, sourceIds, targetIds, timeStamp, timeStamp, true);
+	}
+	default:
+		return serializer->addGeometricNode(rootId, id, input.attributes, input.shape, timeStamp, true);
+	}
+}
+
+static BenchmarkResult run(const Codec& codec, const BenchmarkCase& benchmarkCase, const std::vector<Id>& ids, double seconds) {
+	BenchmarkResult result;
+	result.codec = codec.name;
+	result.benchmarkCase = benchmarkCase;
+	result.encodeFailures = 0;
+	result.decodeFailures = 0;
+
+	WorldModel* wm = new WorldModel();
+	BenchmarkInput input = createInput(benchmarkCase, ids);
+	MessageRecorder recorder;
+	ISceneGraphUpdateObserver* serializer = codec.createSerializer(&recorder);
+	IOutputPort* deserializer = codec.createDeserializer(wm);
+	prepareDecoding(benchmarkCase, input, wm);
+	Id rootId = wm->getRootNodeId();
+
+	/* Encode */
+	std::chrono::nanoseconds encodeTime(0);
+	uint64_t iterations = 0;
+	allocationCount = 0;
+	while((iterations < BENCHMARK_MIN_ITERATIONS) ||
+			((encodeTime.count() < seconds * 1e9) && (iterations < BENCHMARK_MAX_ITERATIONS) && (recorder.bytes < BENCHMARK_MAX_RETAINED_BYTES))) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		countAllocations = true;
+		bool success = encode(serializer, benchmarkCase, input, rootId, ids[iterations], iterations);
+		countAllocations = false;
+		encodeTime += std::chrono::steady_clock::now() - start;
+		if(!success) {
+			result.encodeFailures++;
+		}
+		iterations++;
+	}
+	result.iterations = iterations;
+	result.messages = recorder.messages.size();
+	result.encodeNsPerOp = static_cast<double>(encodeTime.count()) / iterations;
+	result.encodeAllocationsPerOp = static_cast<double>(allocationCount) / iterations;
+	result.bytesPerOp = static_cast<double>(recorder.bytes) / iterations;
+
+	/* Decode */
+	allocationCount = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	countAllocations = true;
+	for (size_t i = 0; i < recorder.messages.size(); ++i) {
+		int transferredBytes = 0;
+		if(deserializer->write(recorder.messages[i].data(), recorder.messages[i].size(), transferredBytes) < 0) {
+			result.decodeFailures++;
+		}
+	}
+	countAllocations = false;
+	std::chrono::nanoseconds decodeTime = std::chrono::steady_clock::now() - start;
+	result.decodeNsPerOp = recorder.messages.empty() ? 0 : static_cast<double>(decodeTime.count()) / recorder.messages.size();
+	result.decodeAllocationsPerOp = recorder.messages.empty() ? 0 : static_cast<double>(allocationCount) / recorder.messages.size();
+
+	delete deserializer;
+	delete serializer;
+	delete wm;
+	return result;
+}
+
+/*
+ * Restore
+ */
+
+/**
+ * Creates the graph that is stored and restored: transform nodes below the root with a Box each.
+ */
+static void createRestoreGraph(WorldModel* wm, unsigned int transforms) {
+	Id rootId = wm->getRootNodeId();
+	Shape::ShapePtr box(new Box(1, 2, 3));
+	for (unsigned int i = 0; i < transforms; ++i) {
+		vector<Attribute> attributes;
+		char value[32];
+		snprintf(value, sizeof(value), "%u", i);
+		attributes.push_back(Attribute("name", "benchmark_object"));
+		attributes.push_back(Attribute("benchmark:index", value));
+		TimeStamp timeStamp(1.0 + i * 0.001, Units::Second);
+		Id transformId;
+		Id boxId;
+		wm->scene.addTransformNode(rootId, transformId, attributes, createTransform(i), timeStamp);
+		wm->scene.addGeometricNode(transformId, boxId, attributes, box, timeStamp);
+	}
+}
+
+static BenchmarkResult createRestoreResult(const char* codec) {
+	BenchmarkCase restore = {BENCHMARK_ADD_NODE, "restore", 2, BENCHMARK_RESTORE_NODES};
+	BenchmarkResult result;
+	result.codec = codec;
+	result.benchmarkCase = restore;
+	result.iterations = 1;
+	result.messages = 0;
+	result.encodeFailures = 0;
+	result.decodeFailures = 0;
+	result.encodeNsPerOp = 0;
+	result.decodeNsPerOp = 0;
+	result.bytesPerOp = 0;
+	result.encodeAllocationsPerOp = 0;
+	result.decodeAllocationsPerOp = 0;
+	return result;
+}
+
+/**
+ * Stores the graph as snapshot file and restores it into a fresh world model with the SnapshotLoader.
+ */
+static BenchmarkResult runSnapshotRestore(WorldModel* source, const vector<Id>& rootIds, uint64_t nodes) {
+	BenchmarkResult result = createRestoreResult("snapshot");
+
+	allocationCount = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	countAllocations = true;
+	uint64_t bytes = 0;
+	if(!SnapshotWriter::store(&source->scene, rootIds, BENCHMARK_RESTORE_FILE, 0, bytes)) {
+		result.encodeFailures++;
+	}
+	countAllocations = false;
+	result.encodeNsPerOp = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) / nodes;
+	result.encodeAllocationsPerOp = static_cast<double>(allocationCount) / nodes;
+	result.bytesPerOp = static_cast<double>(bytes) / nodes;
+
+	WorldModel* wm = new WorldModel();
+	allocationCount = 0;
+	start = std::chrono::steady_clock::now();
+	countAllocations = true;
+	uint64_t records = 0;
+	if(!SnapshotLoader::load(wm, BENCHMARK_RESTORE_FILE, records)) {
+		result.decodeFailures++;
+	}
+	countAllocations = false;
+	result.decodeNsPerOp = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) / nodes;
+	result.decodeAllocationsPerOp = static_cast<double>(allocationCount) / nodes;
+	result.messages = records;
+
+	delete wm;
+	remove(BENCHMARK_RESTORE_FILE);
+	return result;
+}
+
+#ifdef RSG_BENCHMARKS_JSON
+/**
+ * Serializes the graph as JSON updates and applies them to a fresh world model, like the
+ * rsg_file of the rsg_scene_setup block but without reading a file.
+ */
+static BenchmarkResult runJsonRestore(WorldModel* source, Id rootId, uint64_t nodes) {
+	BenchmarkResult result = createRestoreResult("json");
+
+	MessageRecorder recorder;
+	JSONSerializer serializer(&recorder);
+	SceneGraphToUpdatesTraverser traverser(&serializer);
+	allocationCount = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	countAllocations = true;
+	source->scene.executeGraphTraverser(&traverser, rootId);
+	countAllocations = false;
+	result.encodeNsPerOp = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) / nodes;
+	result.encodeAllocationsPerOp = static_cast<double>(allocationCount) / nodes;
+	result.bytesPerOp = static_cast<double>(recorder.bytes) / nodes;
+	result.messages = recorder.messages.size();
+
+	WorldModel* wm = new WorldModel();
+	JSONDeserializer deserializer(wm);
+	deserializer.setMapUnknownParentIdsToRootId(true);
+	allocationCount = 0;
+	start = std::chrono::steady_clock::now();
+	countAllocations = true;
+	for (size_t i = 0; i < recorder.messages.size(); ++i) {
+		int transferredBytes = 0;
+		if(deserializer.write(recorder.messages[i].data(), recorder.messages[i].size(), transferredBytes) < 0) {
+			result.decodeFailures++;
+		}
+	}
+	countAllocations = false;
+	result.decodeNsPerOp = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) / nodes;
+	result.decodeAllocationsPerOp = static_cast<double>(allocationCount) / nodes;
+
+	delete wm;
+	return result;
+}
+#endif /* RSG_BENCHMARKS_JSON */
+
+static void writeJson(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+	out << "{\"benchmarks\": [" << std::endl;
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchmarkResult& result = results[i];
+		out << "  {\"codec\": \"" << result.codec << "\", "
+				<< "\"operation\": \"" << result.benchmarkCase.name << "\", "
+				<< "\"attributes\": " << result.benchmarkCase.attributes << ", "
+				<< "\"payload\": " << result.benchmarkCase.payload << ", "
+				<< "\"iterations\": " << result.iterations << ", "
+				<< "\"messages\": " << result.messages << ", "
+				<< "\"encode_ns_per_op\": " << result.encodeNsPerOp << ", "
+				<< "\"decode_ns_per_op\": " << result.decodeNsPerOp << ", "
+				<< "\"bytes_per_op\": " << result.bytesPerOp << ", "
+				<< "\"encode_allocations_per_op\": " << result.encodeAllocationsPerOp << ", "
+				<< "\"decode_allocations_per_op\": " << result.decodeAllocationsPerOp << ", "
+				<< "\"encode_failures\": " << result.encodeFailures << ", "
+				<< "\"decode_failures\": " << result.decodeFailures << "}"
+				<< ((i + 1 < results.size()) ? "," : "") << std::endl;
+	}
+	out << "]}" << std::endl;
+}
+
+static void printResult(const BenchmarkResult& result) {
+	std::cout << std::left << std::setw(8) << result.codec
+			<< std::setw(30) << result.benchmarkCase.name << std::right
+			<< std::setw(6) << result.benchmarkCase.attributes
+			<< std::setw(8) << result.benchmarkCase.payload
+			<< std::setw(14) << std::fixed << std::setprecision(0) << result.encodeNsPerOp
+			<< std::setw(14) << result.decodeNsPerOp
+			<< std::setw(12) << result.bytesPerOp
+			<< std::setw(10) << std::setprecision(1) << result.encodeAllocationsPerOp
+			<< std::setw(10) << result.decodeAllocationsPerOp;
+	if(result.messages == 0) {
+		std::cout << "  (not supported)";
+	} else if(result.encodeFailures > 0 || result.decodeFailures > 0) {
+		std::cout << "  (" << result.encodeFailures << " encode and " << result.decodeFailures << " decode failures)";
+	}
+	std::cout << std::endl;
+}
+
+int main(int argc, char **argv) {
+	std::string outputFileName = "rsg_benchmarks.json";
+	std::string filter = "";
+	double seconds = BENCHMARK_DEFAULT_TIME;
+	for (int i = 1; i < argc; ++i) {
+		if((strcmp(argv[i], "--output") == 0) && (i + 1 < argc)) {
+			outputFileName = argv[++i];
+		} else if((strcmp(argv[i], "--time") == 0) && (i + 1 < argc)) {
+			seconds = atof(argv[++i]);
+		} else if((strcmp(argv[i], "--filter") == 0) && (i + 1 < argc)) {
+			filter = argv[++i];
+		} else {
+			std::cerr << "Usage: " << argv[0] << " [--output <file>] [--time <seconds per case>] [--filter <text>]" << std::endl;
+			return 1;
+		}
+	}
+
+	/* Failed decodings are counted, there is no need to print them. */
+	brics_3d::Logger::setMinLoglevel(brics_3d::Logger::FATAL);
+
+	std::vector<Codec> codecs;
+	Codec hdf5 = {"hdf5", createHdf5Serializer, createHdf5Deserializer};
+	Codec binary = {"binary", createBinarySerializer, createBinaryDeserializer};
+	codecs.push_back(hdf5);
+	codecs.push_back(binary);
+#ifdef RSG_BENCHMARKS_JSON
+	Codec json = {"json", createJsonSerializer, createJsonDeserializer};
+	codecs.push_back(json);
+#endif /* RSG_BENCHMARKS_JSON */
+
+	std::vector<BenchmarkCase> cases = createCases();
+	std::vector<Id> ids = createIds(BENCHMARK_MAX_ITERATIONS + 2);
+	std::vector<BenchmarkResult> results;
+
+	std::cout << std::left << std::setw(8) << "codec" << std::setw(30) << "operation" << std::right
+			<< std::setw(6) << "attrs" << std::setw(8) << "payload" << std::setw(14) << "encode ns/op"
+			<< std::setw(14) << "decode ns/op" << std::setw(12) << "bytes/op" << std::setw(10) << "enc allc" << std::setw(10) << "dec allc" << std::endl;
+	for (size_t i = 0; i < codecs.size(); ++i) {
+		for (size_t j = 0; j < cases.size(); ++j) {
+			std::string name = std::string(codecs[i].name) + "/" + cases[j].name;
+			if(!filter.empty() && (name.find(filter) == std::string::npos)) {
+				continue;
+			}
+			results.push_back(run(codecs[i], cases[j], ids, seconds));
+			printResult(results.back());
+		}
+	}
+
+	/* Restoring a complete graph */
+	WorldModel* source = new WorldModel();
+	createRestoreGraph(source, BENCHMARK_RESTORE_NODES);
+	uint64_t nodes = 2 * BENCHMARK_RESTORE_NODES;
+	if(std::string("snapshot/restore").find(filter) != std::string::npos) {
+		vector<Id> rootIds(1, source->getRootNodeId());
+		results.push_back(runSnapshotRestore(source, rootIds, nodes));
+		printResult(results.back());
+	}
+#ifdef RSG_BENCHMARKS_JSON
+	if(std::string("json/restore").find(filter) != std::string::npos) {
+		results.push_back(runJsonRestore(source, source->getRootNodeId(), nodes));
+		printResult(results.back());
+	}
+#endif /* RSG_BENCHMARKS_JSON */
+	delete source;
+
+	std::ofstream output(outputFileName.c_str());
+	if(!output.is_open()) {
+		std::cerr << "Cannot write to " << outputFileName << std::endl;
+		return 1;
+	}
+	writeJson(output, results);
+	std::cout << "Results written to " << outputFileName << std::endl;
+	return 0;
+}
@@ -0,0 +1,537 @@
+#include "rsg_binary_codec.h"
+
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/core/HomogeneousMatrix44.h>
+#include <brics_3d/worldModel/sceneGraph/Box.h>
+#include <brics_3d/worldModel/sceneGraph/Sphere.h>
+#include <brics_3d/worldModel/sceneGraph/Cylinder.h>
+
+#include <string.h>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_BINARY_ID_SIZE 16
+#define RSG_BINARY_MATRIX_SIZE 16
+
+/*
+ * Serializer
+ */
+
+BinaryUpdateSerializer::BinaryUpdateSerializer(IOutputPort* port) : port(port) {
+	buffer.reserve(256); // Large enough for all pose updates.
+	hdf5Port = new Hdf5ToBinaryPort(this);
+	hdf5Serializer = new HDF5UpdateSerializer(hdf5Port);
+}
+
+BinaryUpdateSerializer::~BinaryUpdateSerializer() {
+	delete hdf5Serializer;
+	delete hdf5Port;
+}
+
+bool BinaryUpdateSerializer::addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	beginMessage(RSG_BIN_ADD_NODE);
+	writeId(parentId);
+	writeId(assignedId);
+	writeAttributes(attributes);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	beginMessage(RSG_BIN_ADD_GROUP);
+	writeId(parentId);
+	writeId(assignedId);
+	writeAttributes(attributes);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId) {
+	beginMessage(RSG_BIN_ADD_TRANSFORM_NODE);
+	writeId(parentId);
+	writeId(assignedId);
+	writeAttributes(attributes);
+	writeTransform(transform);
+	writeTimeStamp(timeStamp);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId) {
+	return hdf5Serializer->addUncertainTransformNode(parentId, assignedId, attributes, transform, uncertainty, timeStamp, forcedId);
+}
+
+bool BinaryUpdateSerializer::addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId) {
+	beginMessage(RSG_BIN_ADD_GEOMETRIC_NODE);
+	writeId(parentId);
+	writeId(assignedId);
+	writeAttributes(attributes);
+	writeTimeStamp(timeStamp);
+	if(!writeShape(shape)) { // No fixed layout for this shape type.
+		return hdf5Serializer->addGeometricNode(parentId, assignedId, attributes, shape, timeStamp, forcedId);
+	}
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::addRemoteRootNode(Id rootId, vector<Attribute> attributes) {
+	beginMessage(RSG_BIN_ADD_REMOTE_ROOT_NODE);
+	writeId(rootId);
+	writeAttributes(attributes);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId) {
+	beginMessage(RSG_BIN_ADD_CONNECTION);
+	writeId(parentId);
+	writeId(assignedId);
+	writeAttributes(attributes);
+	writeIds(sourceIds);
+	writeIds(targetIds);
+	writeTimeStamp(start);
+	writeTimeStamp(end);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp) {
+	beginMessage(RSG_BIN_SET_NODE_ATTRIBUTES);
+	writeId(id);
+	writeAttributes(newAttributes);
+	writeTimeStamp(timeStamp);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	beginMessage(RSG_BIN_SET_TRANSFORM);
+	writeId(id);
+	writeTransform(transform);
+	writeTimeStamp(timeStamp);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp) {
+	return hdf5Serializer->setUncertainTransform(id, transform, uncertainty, timeStamp);
+}
+
+bool BinaryUpdateSerializer::deleteNode(Id id) {
+	beginMessage(RSG_BIN_DELETE_NODE);
+	writeId(id);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::addParent(Id id, Id parentId) {
+	beginMessage(RSG_BIN_ADD_PARENT);
+	writeId(id);
+	writeId(parentId);
+	return sendMessage() == 0;
+}
+
+bool BinaryUpdateSerializer::removeParent(Id id, Id parentId) {
+	beginMessage(RSG_BIN_REMOVE_PARENT);
+	writeId(id);
+	writeId(parentId);
+	return sendMessage() == 0;
+}
+
+int BinaryUpdateSerializer::Hdf5ToBinaryPort::write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+	serializer->beginMessage(RSG_BIN_HDF5);
+	serializer->buffer.insert(serializer->buffer.end(), dataBuffer, dataBuffer + dataLength);
+	transferredBytes = dataLength;
+	return serializer->sendMessage();
+}
+
+void BinaryUpdateSerializer::beginMessage(RsgBinaryOperation operation) {
+	buffer.clear();
+	buffer.push_back(RSG_BINARY_MAGIC_0);
+	buffer.push_back(RSG_BINARY_MAGIC_1);
+	buffer.push_back(RSG_BINARY_VERSION);
+	buffer.push_back(static_cast<char>(operation));
+}
+
+int BinaryUpdateSerializer::sendMessage() {
+	int transferredBytes = 0;
+	return port->write(&buffer[0], static_cast<int>(buffer.size()), transferredBytes);
+}
+
+void BinaryUpdateSerializer::writeId(Id id) {
+	buffer.insert(buffer.end(), id.begin(), id.end());
+}
+
+void BinaryUpdateSerializer::writeDouble(double value) {
+	const char* bytes = reinterpret_cast<const char*>(&value);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(double));
+}
+
+void BinaryUpdateSerializer::writeVarint(uint64_t value) {
+	while(value >= 0x80) {
+		buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back(static_cast<char>(value));
+}
+
+void BinaryUpdateSerializer::writeString(const std::string& value) {
+	writeVarint(value.size());
+	buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+void BinaryUpdateSerializer::writeAttributes(const vector<Attribute>& attributes) {
+	writeVarint(attributes.size());
+	for(vector<Attribute>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+		writeString(it->key);
+		writeString(it->value);
+	}
+}
+
+void BinaryUpdateSerializer::writeIds(const vector<Id>& ids) {
+	writeVarint(ids.size());
+	for(vector<Id>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+		writeId(*it);
+	}
+}
+
+void BinaryUpdateSerializer::writeTransform(IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform) {
+	const double* matrix = transform->getRawData();
+	const char* bytes = reinterpret_cast<const char*>(matrix);
+	buffer.insert(buffer.end(), bytes, bytes + RSG_BINARY_MATRIX_SIZE * sizeof(double));
+}
+
+void BinaryUpdateSerializer::writeTimeStamp(TimeStamp timeStamp) {
+	writeDouble(timeStamp.getSeconds());
+}
+
+bool BinaryUpdateSerializer::writeShape(Shape::ShapePtr shape) {
+	Box::BoxPtr box = boost::dynamic_pointer_cast<Box>(shape);
+	if(box) {
+		buffer.push_back(RSG_BIN_SHAPE_BOX);
+		writeDouble(box->getSizeX());
+		writeDouble(box->getSizeY());
+		writeDouble(box->getSizeZ());
+		return true;
+	}
+	Sphere::SpherePtr sphere = boost::dynamic_pointer_cast<Sphere>(shape);
+	if(sphere) {
+		buffer.push_back(RSG_BIN_SHAPE_SPHERE);
+		writeDouble(sphere->getRadius());
+		return true;
+	}
+	Cylinder::CylinderPtr cylinder = boost::dynamic_pointer_cast<Cylinder>(shape);
+	if(cylinder) {
+		buffer.push_back(RSG_BIN_SHAPE_CYLINDER);
+		writeDouble(cylinder->getRadius());
+		writeDouble(cylinder->getHeight());
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Deserializer
+ */
+
+BinaryUpdateDeserializer::BinaryUpdateDeserializer(WorldModel* wm) : wm(wm), mapId(false), cursor(0), end(0) {
+	hdf5IdMapper = new IdMapper(this);
+	hdf5Deserializer = new HDF5UpdateDeserializer(wm, hdf5IdMapper);
+}
+
+BinaryUpdateDeserializer::~BinaryUpdateDeserializer() {
+	delete hdf5Deserializer;
+	delete hdf5IdMapper;
+}
+
+bool BinaryUpdateDeserializer::isBinaryUpdate(const char *dataBuffer, int dataLength) {
+	return (dataLength >= RSG_BINARY_HEADER_SIZE) &&
+		   (dataBuffer[0] == RSG_BINARY_MAGIC_0) &&
+		   (dataBuffer[1] == RSG_BINARY_MAGIC_1);
+}
+
+void BinaryUpdateDeserializer::setIdMapping(Id from, Id to) {
+	mapId = (from != to);
+	mappedFrom = from;
+	mappedTo = to;
+}
+
+int BinaryUpdateDeserializer::write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+	transferredBytes = dataLength;
+	if(!isBinaryUpdate(dataBuffer, dataLength)) {
+		LOG(ERROR) << "BinaryUpdateDeserializer: Message is not a binary update. Skipping it.";
+		return -1;
+	}
+	if(dataBuffer[2] != RSG_BINARY_VERSION) {
+		LOG(ERROR) << "BinaryUpdateDeserializer: Unsupported version " << static_cast<int>(dataBuffer[2]) << ". Skipping message.";
+		return -1;
+	}
+
+	int operation = static_cast<unsigned char>(dataBuffer[3]);
+	if(operation == RSG_BIN_HDF5) {
+		int hdf5TransferredBytes = 0;
+		return hdf5Deserializer->write(dataBuffer + RSG_BINARY_HEADER_SIZE, dataLength - RSG_BINARY_HEADER_SIZE, hdf5TransferredBytes);
+	}
+
+	cursor = dataBuffer + RSG_BINARY_HEADER_SIZE;
+	end = dataBuffer + dataLength;
+	if(!apply(operation)) {
+		LOG(ERROR) << "BinaryUpdateDeserializer: Cannot apply message with operation " << operation << ".";
+		return -1;
+	}
+	return 0;
+}
+
+bool BinaryUpdateDeserializer::apply(int operation) {
+	Id id;
+	Id parentId;
+	vector<Attribute> attributes;
+	IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform;
+	TimeStamp timeStamp;
+
+	switch (operation) {
+		case RSG_BIN_ADD_NODE:
+			return readId(parentId) && readId(id) && readAttributes(attributes) &&
+				   wm->scene.addNode(parentId, id, attributes, true);
+
+		case RSG_BIN_ADD_GROUP:
+			return readId(parentId) && readId(id) && readAttributes(attributes) &&
+				   wm->scene.addGroup(parentId, id, attributes, true);
+
+		case RSG_BIN_ADD_TRANSFORM_NODE:
+			return readId(parentId) && readId(id) && readAttributes(attributes) && readTransform(transform) && readTimeStamp(timeStamp) &&
+				   wm->scene.addTransformNode(parentId, id, attributes, transform, timeStamp, true);
+
+		case RSG_BIN_ADD_GEOMETRIC_NODE: {
+			Shape::ShapePtr shape;
+			return readId(parentId) && readId(id) && readAttributes(attributes) && readTimeStamp(timeStamp) && readShape(shape) &&
+				   wm->scene.addGeometricNode(parentId, id, attributes, shape, timeStamp, true);
+		}
+
+		case RSG_BIN_ADD_REMOTE_ROOT_NODE:
+			return readId(id) && readAttributes(attributes) &&
+				   wm->scene.addRemoteRootNode(id, attributes);
+
+		case RSG_BIN_ADD_CONNECTION: {
+			vector<Id> sourceIds;
+			vector<Id> targetIds;
+			TimeStamp start;
+			return readId(parentId) && readId(id) && readAttributes(attributes) && readIds(sourceIds) && readIds(targetIds) &&
+				   readTimeStamp(start) && readTimeStamp(timeStamp) &&
+				   wm->scene.addConnection(parentId, id, attributes, sourceIds, targetIds, start, timeStamp, true);
+		}
+
+		case RSG_BIN_SET_NODE_ATTRIBUTES:
+			return readId(id) && readAttributes(attributes) && readTimeStamp(timeStamp) &&
+				   wm->scene.setNodeAttributes(id, attributes, timeStamp);
+
+		case RSG_BIN_SET_TRANSFORM:
+			return readId(id) && readTransform(transform) && readTimeStamp(timeStamp) &&
+				   wm->scene.setTransform(id, transform, timeStamp);
+
+		case RSG_BIN_DELETE_NODE:
+			return readId(id) && wm->scene.deleteNode(id);
+
+		case RSG_BIN_ADD_PARENT:
+			return readId(id) && readId(parentId) && wm->scene.addParent(id, parentId);
+
+		case RSG_BIN_REMOVE_PARENT:
+			return readId(id) && readId(parentId) && wm->scene.removeParent(id, parentId);
+
+		default:
+			LOG(ERROR) << "BinaryUpdateDeserializer: Unknown operation " << operation << ".";
+			return false;
+	}
+}
+
+bool BinaryUpdateDeserializer::readId(Id& id) {
+	if(end - cursor < RSG_BINARY_ID_SIZE) {
+		return false;
+	}
+	memcpy(&(*id.begin()), cursor, RSG_BINARY_ID_SIZE);
+	cursor += RSG_BINARY_ID_SIZE;
+	id = map(id);
+	return true;
+}
+
+bool BinaryUpdateDeserializer::readDouble(double& value) {
+	if(end - cursor < static_cast<long>(sizeof(double))) {
+		return false;
+	}
+	memcpy(&value, cursor, sizeof(double));
+	cursor += sizeof(double);
+	return true;
+}
+
+bool BinaryUpdateDeserializer::readVarint(uint64_t& value) {
+	value = 0;
+	for(int shift = 0; (cursor < end) && (shift < 64); shift += 7) {
+		unsigned char byte = static_cast<unsigned char>(*cursor++);
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool BinaryUpdateDeserializer::readString(std::string& value) {
+	uint64_t length;
+	if(!readVarint(length) || (static_cast<uint64_t>(end - cursor) < length)) {
+		return false;
+	}
+	value.assign(cursor, length);
+	cursor += length;
+	return true;
+}
+
+bool BinaryUpdateDeserializer::readAttributes(vector<Attribute>& attributes) {
+	uint64_t count;
+	if(!readVarint(count)) {
+		return false;
+	}
+	attributes.clear();
+	std::string key;
+	std::string value;
+	for(uint64_t i = 0; i < count; ++i) {
+		if(!readString(key) || !readString(value)) {
+			return false;
+		}
+		attributes.push_back(Attribute(key, value));
+	}
+	return true;
+}
+
+bool BinaryUpdateDeserializer::readIds(vector<Id>& ids) {
+	uint64_t count;
+	if(!readVarint(count)) {
+		return false;
+	}
+	ids.clear();
+	Id id;
+	for(uint64_t i = 0; i < count; ++i) {
+		if(!readId(id)) {
+			return false;
+		}
+		ids.push_back(id);
+	}
+	return true;
+}
+
+bool BinaryUpdateDeserializer::readTransform(IHomogeneousMatrix44::IHomogeneousMatrix44Ptr& transform) {
+	if(end - cursor < static_cast<long>(RSG_BINARY_MATRIX_SIZE * sizeof(double))) {
+		return false;
+	}
+	transform.reset(new HomogeneousMatrix44());
+	memcpy(transform->setRawData(), cursor, RSG_BINARY_MATRIX_SIZE * sizeof(double));
+	cursor += RSG_BINARY_MATRIX_SIZE * sizeof(double);
+	return true;
+}
+
+bool BinaryUpdateDeserializer::readTimeStamp(TimeStamp& timeStamp) {
+	double seconds;
+	if(!readDouble(seconds)) {
+		return false;
+	}
+	timeStamp = TimeStamp(seconds, Units::Second);
+	return true;
+}
+
+bool BinaryUpdateDeserializer::readShape(Shape::ShapePtr& shape) {
+	if(cursor >= end) {
+		return false;
+	}
+	int shapeType = static_cast<unsigned char>(*cursor++);
+	double a, b, c;
+	switch (shapeType) {
+		case RSG_BIN_SHAPE_BOX:
+			if(!readDouble(a) || !readDouble(b) || !readDouble(c)) {
+				return false;
+			}
+			shape.reset(new Box(a, b, c));
+			return true;
+
+		case RSG_BIN_SHAPE_SPHERE:
+			if(!readDouble(a)) {
+				return false;
+			}
+			shape.reset(new Sphere(a));
+			return true;
+
+		case RSG_BIN_SHAPE_CYLINDER:
+			if(!readDouble(a) || !readDouble(b)) {
+				return false;
+			}
+			shape.reset(new Cylinder(a, b));
+			return true;
+
+		default:
+			LOG(ERROR) << "BinaryUpdateDeserializer: Unknown shape type " << shapeType << ".";
+			return false;
+	}
+}
+
+void BinaryUpdateDeserializer::map(vector<Id>& ids) const {
+	for(vector<Id>::iterator it = ids.begin(); it != ids.end(); ++it) {
+		*it = map(*it);
+	}
+}
+
+/*
+ * Id mapping for embedded HDF5 messages
+ */
+
+bool BinaryUpdateDeserializer::IdMapper::addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	assignedId = deserializer->map(assignedId);
+	return deserializer->wm->scene.addNode(deserializer->map(parentId), assignedId, attributes, forcedId);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	assignedId = deserializer->map(assignedId);
+	return deserializer->wm->scene.addGroup(deserializer->map(parentId), assignedId, attributes, forcedId);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId) {
+	assignedId = deserializer->map(assignedId);
+	return deserializer->wm->scene.addTransformNode(deserializer->map(parentId), assignedId, attributes, transform, timeStamp, forcedId);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId) {
+	assignedId = deserializer->map(assignedId);
+	return deserializer->wm->scene.addUncertainTransformNode(deserializer->map(parentId), assignedId, attributes, transform, uncertainty, timeStamp, forcedId);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId) {
+	assignedId = deserializer->map(assignedId);
+	return deserializer->wm->scene.addGeometricNode(deserializer->map(parentId), assignedId, attributes, shape, timeStamp, forcedId);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::addRemoteRootNode(Id rootId, vector<Attribute> attributes) {
+	return deserializer->wm->scene.addRemoteRootNode(deserializer->map(rootId), attributes);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId) {
+	assignedId = deserializer->map(assignedId);
+	deserializer->map(sourceIds);
+	deserializer->map(targetIds);
+	return deserializer->wm->scene.addConnection(deserializer->map(parentId), assignedId, attributes, sourceIds, targetIds, start, end, forcedId);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp) {
+	return deserializer->wm->scene.setNodeAttributes(deserializer->map(id), newAttributes, timeStamp);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	return deserializer->wm->scene.setTransform(deserializer->map(id), transform, timeStamp);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp) {
+	return deserializer->wm->scene.setUncertainTransform(deserializer->map(id), transform, uncertainty, timeStamp);
+}
+
+bool BinaryUpdateDeserializer::IdMapper::deleteNode(Id id) {
+	return deserializer->wm->scene.deleteNode(deserializer->map(id));
+}
+
+bool BinaryUpdateDeserializer::IdMapper::addParent(Id id, Id parentId) {
+	return deserializer->wm->scene.addParent(deserializer->map(id), deserializer->map(parentId));
+}
+
+bool BinaryUpdateDeserializer::IdMapper::removeParent(Id id, Id parentId) {
+	return deserializer->wm->scene.removeParent(deserializer->map(id), deserializer->map(parentId));
+}
+
+} // namespace rsg
+} // namespace brics_3d
@@ -0,0 +1,200 @@
+/*
+ * Compact binary wire format for Robot Scene Graph updates.
+ *
+ * Every message carries exactly one update with a fixed layout:
+ *
+ *   magic (2 bytes "RB") | version (1 byte) | operation (1 byte) | payload
+ *
+ * The payload uses raw 16 byte ids, packed 4x4 double matrices (column major,
+ * as returned by IHomogeneousMatrix44::getRawData), time stamps as double seconds
+ * and varint length prefixed strings. Numbers are stored in the byte order of the
+ * host; all currently deployed platforms are little endian.
+ * Updates that have no fixed layout (uncertain transforms, point clouds, meshes, ...)
+ * are embedded as HDF5 update messages.
+ */
+
+#ifndef RSG_BINARY_CODEC_H_
+#define RSG_BINARY_CODEC_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+#include <brics_3d/worldModel/sceneGraph/IOutputPort.h>
+#include <brics_3d/worldModel/sceneGraph/HDF5UpdateSerializer.h>
+#include <brics_3d/worldModel/sceneGraph/HDF5UpdateDeserializer.h>
+
+#include <vector>
+#include <string>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_BINARY_MAGIC_0 'R'
+#define RSG_BINARY_MAGIC_1 'B'
+#define RSG_BINARY_VERSION 1
+#define RSG_BINARY_HEADER_SIZE 4
+
+/**
+ * Operation codes of the binary wire format.
+ */
+enum RsgBinaryOperation {
+	RSG_BIN_ADD_NODE = 1,
+	RSG_BIN_ADD_GROUP = 2,
+	RSG_BIN_ADD_TRANSFORM_NODE = 3,
+	RSG_BIN_ADD_GEOMETRIC_NODE = 4,
+	RSG_BIN_ADD_REMOTE_ROOT_NODE = 5,
+	RSG_BIN_ADD_CONNECTION = 6,
+	RSG_BIN_SET_NODE_ATTRIBUTES = 7,
+	RSG_BIN_SET_TRANSFORM = 8,
+	RSG_BIN_DELETE_NODE = 9,
+	RSG_BIN_ADD_PARENT = 10,
+	RSG_BIN_REMOVE_PARENT = 11,
+	RSG_BIN_HDF5 = 12  // Payload is a complete HDF5 update message.
+};
+
+/**
+ * Shape types that have a fixed binary layout.
+ */
+enum RsgBinaryShape {
+	RSG_BIN_SHAPE_BOX = 1,
+	RSG_BIN_SHAPE_SPHERE = 2,
+	RSG_BIN_SHAPE_CYLINDER = 3
+};
+
+/**
+ * Encodes scene graph updates into the binary wire format and forwards
+ * every encoded update as a single message to an output port.
+ */
+class BinaryUpdateSerializer : public ISceneGraphUpdateObserver {
+public:
+	BinaryUpdateSerializer(IOutputPort* port);
+	virtual ~BinaryUpdateSerializer();
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false);
+	bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false);
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false);
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes);
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false);
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0));
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+	bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp);
+	bool deleteNode(Id id);
+	bool addParent(Id id, Id parentId);
+	bool removeParent(Id id, Id parentId);
+
+private:
+
+	/// Wraps HDF5 encoded updates into RSG_BIN_HDF5 messages.
+	class Hdf5ToBinaryPort : public IOutputPort {
+	public:
+		Hdf5ToBinaryPort(BinaryUpdateSerializer* serializer) : serializer(serializer) {};
+		virtual ~Hdf5ToBinaryPort(){};
+		int write(const char *dataBuffer, int dataLength, int &transferredBytes);
+	private:
+		BinaryUpdateSerializer* serializer;
+	};
+
+	void beginMessage(RsgBinaryOperation operation);
+	int sendMessage();
+
+	void writeId(Id id);
+	void writeDouble(double value);
+	void writeVarint(uint64_t value);
+	void writeString(const std::string& value);
+	void writeAttributes(const vector<Attribute>& attributes);
+	void writeIds(const vector<Id>& ids);
+	void writeTransform(IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform);
+	void writeTimeStamp(TimeStamp timeStamp);
+	bool writeShape(Shape::ShapePtr shape);
+
+	IOutputPort* port;
+	std::vector<char> buffer;        // Reused for every message.
+	Hdf5ToBinaryPort* hdf5Port;
+	HDF5UpdateSerializer* hdf5Serializer;
+};
+
+/**
+ * Decodes messages in the binary wire format and applies them to a world model.
+ */
+class BinaryUpdateDeserializer : public IOutputPort {
+public:
+	BinaryUpdateDeserializer(WorldModel* wm);
+	virtual ~BinaryUpdateDeserializer();
+
+	/**
+	 * Decodes and applies a single message.
+	 * @return 0 on success, -1 if the message is malformed or could not be applied.
+	 */
+	int write(const char *dataBuffer, int dataLength, int &transferredBytes);
+
+	/// Checks the magic bytes to tell binary messages apart from other formats.
+	static bool isBinaryUpdate(const char *dataBuffer, int dataLength);
+
+	/**
+	 * Replaces an id in all subsequent messages, e.g. to map the root id of a snapshot
+	 * to the root id of this world model. Applies to embedded HDF5 messages as well.
+	 */
+	void setIdMapping(Id from, Id to);
+
+private:
+
+	/// Applies the updates of embedded HDF5 messages to the world model with mapped ids.
+	class IdMapper : public ISceneGraphUpdateObserver {
+	public:
+		IdMapper(BinaryUpdateDeserializer* deserializer) : deserializer(deserializer) {};
+		virtual ~IdMapper(){};
+
+		/* implemetntations of observer interface */
+		bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+		bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+		bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false);
+		bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false);
+		bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false);
+		bool addRemoteRootNode(Id rootId, vector<Attribute> attributes);
+		bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false);
+		bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0));
+		bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+		bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp);
+		bool deleteNode(Id id);
+		bool addParent(Id id, Id parentId);
+		bool removeParent(Id id, Id parentId);
+	private:
+		BinaryUpdateDeserializer* deserializer;
+	};
+
+	/// Applies the id mapping to a single id.
+	Id map(Id id) const {
+		return (mapId && (id == mappedFrom)) ? mappedTo : id;
+	}
+	void map(vector<Id>& ids) const;
+
+	bool readId(Id& id);
+	bool readDouble(double& value);
+	bool readVarint(uint64_t& value);
+	bool readString(std::string& value);
+	bool readAttributes(vector<Attribute>& attributes);
+	bool readIds(vector<Id>& ids);
+	bool readTransform(IHomogeneousMatrix44::IHomogeneousMatrix44Ptr& transform);
+	bool readTimeStamp(TimeStamp& timeStamp);
+	bool readShape(Shape::ShapePtr& shape);
+
+	bool apply(int operation);
+
+	WorldModel* wm;
+	IdMapper* hdf5IdMapper;
+	HDF5UpdateDeserializer* hdf5Deserializer;
+	bool mapId;
+	Id mappedFrom;
+	Id mappedTo;
+
+	/* Read cursor for the message that is currently decoded */
+	const char* cursor;
+	const char* end;
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_BINARY_CODEC_H_ */
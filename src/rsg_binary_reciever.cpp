@@ -0,0 +1,190 @@
+#include "rsg_binary_reciever.hpp"
+
+/* microblx type for the robot scene graph */
+#include "types/rsg/types/rsg_types.h"
+
+/* BRICS_3D includes */
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/RemoteRootNodeAutoMounter.h>
+
+#include "rsg_binary_codec.h"
+#include "rsg_world_model_lock.h"
+
+using namespace brics_3d;
+using brics_3d::Logger;
+
+
+UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
+
+#define DEFAULT_BINARY_BUFFER_SIZE 20000
+
+/* define a structure for holding the block local state. By assigning an
+ * instance of this struct to the block private_data pointer (see init), this
+ * information becomes accessible within the hook functions.
+ */
+struct rsg_binary_reciever_info
+{
+        /* add custom block local data here */
+		brics_3d::WorldModel* wm;
+		brics_3d::rsg::BinaryUpdateDeserializer* wm_deserializer;
+		brics_3d::rsg::RemoteRootNodeAutoMounter* wm_auto_mounter;
+
+        /* this is to have fast access to ports for reading and writing, without
+         * needing a hash table lookup */
+        struct rsg_binary_reciever_port_cache ports;
+
+        unsigned char* input_buffer;		/* A buffer for a complete binary messgage. */
+        unsigned long input_buffer_size;	/* Buffer size in bytes. Pose updates need about 160 bytes,
+        									 * geometries that are embedded as HDF5 need considerably more.
+        									 */
+        uint32_t max_messages_per_step;     /* Message budget per step. 0 means unlimited. */
+};
+
+/* init */
+int rsg_binary_reciever_init(ubx_block_t *b)
+{
+        int ret = -1;
+        struct rsg_binary_reciever_info *inf;
+
+    	/* Configure the logger - default level won't tell us much */
+    	brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
+
+        /* allocate memory for the block local state */
+        if ((inf = (struct rsg_binary_reciever_info*)calloc(1, sizeof(struct rsg_binary_reciever_info)))==NULL) {
+                ERR("rsg_binary_reciever: failed to alloc memory");
+                ret=EOUTOFMEM;
+                return ret;
+        }
+        b->private_data=inf;
+        update_port_cache(b, &inf->ports);
+
+       	unsigned int clen;
+        rsg_wm_handle tmpWmHandle =  *((rsg_wm_handle*) ubx_config_get_data_ptr(b, "wm_handle", &clen));
+        assert(clen != 0);
+        inf->wm = reinterpret_cast<brics_3d::WorldModel*>(tmpWmHandle.wm); // We know that this pointer stores the world model type
+        if(inf->wm == 0) {
+    		LOG(ERROR) << "World model handle could not be obtained via configuration parameter."
+    					  "Creating a new world model instance instead (mostly for debugging purposes)."
+    					  "Please check your system design if this is intended!";
+    		inf->wm = new brics_3d::WorldModel();
+        }
+
+        /* Use auto mount policy */
+    	inf->wm_auto_mounter = new brics_3d::rsg::RemoteRootNodeAutoMounter(&inf->wm->scene, inf->wm->getRootNodeId()); //mount everything relative to root node
+    	inf->wm->scene.attachUpdateObserver(inf->wm_auto_mounter);
+
+        /* Attach deserializer (invoked at step function) */
+        inf->wm_deserializer = new brics_3d::rsg::BinaryUpdateDeserializer(inf->wm);
+
+        /* Setup input buffer for binary messages */
+        inf->input_buffer_size = *((uint32_t*) ubx_config_get_data_ptr(b, "buffer_len", &clen));
+    	if((clen == 0) || (inf->input_buffer_size == 0)) {
+            inf->input_buffer_size = DEFAULT_BINARY_BUFFER_SIZE;
+    		LOG(WARNING) << "Invalid or missing configuration for buffer_len. "
+    	                    "Falling back to default value buffer_len = " << DEFAULT_BINARY_BUFFER_SIZE;
+    	}
+    	LOG(DEBUG) << "Binary input buffer len set to " << inf->input_buffer_size;
+
+        if((inf->input_buffer = (unsigned char *)malloc(inf->input_buffer_size)) == NULL) {
+          ERR("failed to allocate binary input buffer");
+          return -1;
+        }
+
+        inf->max_messages_per_step = 1;
+        uint32_t* max_messages_per_step = (uint32_t*) ubx_config_get_data_ptr(b, "max_messages_per_step", &clen);
+        if(clen != 0) {
+        	inf->max_messages_per_step = *max_messages_per_step;
+        }
+        LOG(INFO) << "rsg_binary_reciever: max_messages_per_step = " << inf->max_messages_per_step;
+
+        return 0;
+}
+
+/* start */
+int rsg_binary_reciever_start(ubx_block_t *b)
+{
+        struct rsg_binary_reciever_info *inf = (struct rsg_binary_reciever_info*) b->private_data;
+        int ret = 0;
+        update_port_cache(b, &inf->ports);
+
+    	/* Set logger level */
+    	unsigned int clen;
+    	int* log_level =  ((int*) ubx_config_get_data_ptr(b, "log_level", &clen));
+    	if(clen == 0) {
+    		LOG(INFO) << "rsg_binary_reciever: No log_level configuation given.";
+    	} else {
+    		if (*log_level == 0) {
+    			LOG(INFO) << "rsg_binary_reciever: log_level set to DEBUG level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
+    		} else if (*log_level == 1) {
+    			LOG(INFO) << "rsg_binary_reciever: log_level set to INFO level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::INFO);
+    		} else if (*log_level == 2) {
+    			LOG(INFO) << "rsg_binary_reciever: log_level set to WARNING level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::WARNING);
+    		} else if (*log_level == 3) {
+    			LOG(INFO) << "rsg_binary_reciever: log_level set to LOGERROR level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGERROR);
+    		} else if (*log_level == 4) {
+    			LOG(INFO) << "rsg_binary_reciever: log_level set to FATAL level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::FATAL);
+    		} else {
+    			LOG(INFO) << "rsg_binary_reciever: unknown log_level = " << *log_level;		}
+    	}
+
+        return ret;
+}
+
+/* stop */
+void rsg_binary_reciever_stop(ubx_block_t *b)
+{
+        /* struct rsg_binary_reciever_info *inf = (struct rsg_binary_reciever_info*) b->private_data; */
+}
+
+/* cleanup */
+void rsg_binary_reciever_cleanup(ubx_block_t *b)
+{
+        struct rsg_binary_reciever_info *inf = (struct rsg_binary_reciever_info*) b->private_data;
+        if(inf->wm_deserializer) {
+        	delete inf->wm_deserializer;
+        	inf->wm_deserializer = 0;
+        }
+        free(inf->input_buffer);
+        free(b->private_data);
+}
+
+/* step */
+void rsg_binary_reciever_step(ubx_block_t *b)
+{
+
+        struct rsg_binary_reciever_info *inf = (struct rsg_binary_reciever_info*) b->private_data;
+
+		/* read data */
+		ubx_port_t* port = inf->ports.rsg_in;
+		assert(port != 0);
+		checktype(port->block->ni, port->in_type, "unsigned char", port->name, 1);
+
+		for(uint32_t processed = 0; (inf->max_messages_per_step == 0) || (processed < inf->max_messages_per_step); ++processed) {
+			ubx_data_t msg;
+			msg.type = port->in_type;
+			msg.len = inf->input_buffer_size;
+			msg.data = (void *)inf->input_buffer;
+			int readBytes = __port_read(port, &msg);
+			if(readBytes <= 0) { // No more messages
+				break;
+			}
+			if((unsigned long)readBytes >= inf->input_buffer_size) {
+				LOG(ERROR) << "rsg_binary_reciever: Incoming update exceeds buffer_len = " << inf->input_buffer_size << ". Skipping it.";
+				continue;
+			}
+
+			int transferred_bytes;
+			WorldModelWriteLock writeLock(inf->wm); // Queries of other blocks might run in parallel.
+			if(inf->wm_deserializer->write((const char *)msg.data, readBytes, transferred_bytes) != 0) {
+				LOG(WARNING) << "rsg_binary_reciever: Could not process an incoming update of " << readBytes << " bytes.";
+			}
+		}
+
+}
+
@@ -0,0 +1,262 @@
+#include "rsg_binary_sender.hpp"
+
+/* microblx type for the robot scene graph */
+#include "types/rsg/types/rsg_types.h"
+
+/* BRICS_3D includes */
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/SceneGraphToUpdatesTraverser.h>
+#include <brics_3d/worldModel/sceneGraph/FrequencyAwareUpdateFilter.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+
+#include "rsg_binary_codec.h"
+
+using namespace brics_3d;
+using brics_3d::Logger;
+using namespace brics_3d::rsg;
+
+UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
+
+/*
+ * Implementation of data transmission.
+ */
+class RsgToUbxPort : public brics_3d::rsg::IOutputPort {
+public:
+	RsgToUbxPort(ubx_port_t* port, ubx_type_t* type) : port(port), type(type){};
+	virtual ~RsgToUbxPort(){};
+
+	int write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+		assert(port != 0);
+
+		ubx_data_t msg;
+		msg.data = (void *)dataBuffer;
+		msg.len = dataLength;
+		msg.type = type;
+
+		LOG(DEBUG) << "RsgToUbxPort: Sending " << msg.len << " bytes.";
+		__port_write(port, &msg);
+		transferredBytes = dataLength;
+
+		return 0;
+	};
+
+private:
+	ubx_port_t* port;
+	ubx_type_t* type;
+};
+
+/**
+ * Triggers block b whenever a addRemoteRootNode event is detected.
+ */
+class RemoteRootNodeAdditionTrigger : public brics_3d::rsg::ISceneGraphUpdateObserver {
+public:
+
+	/**
+	 * Construrctor with block to be triggereg.
+	 */
+	RemoteRootNodeAdditionTrigger(SceneGraphFacade* observedScene, ubx_block_t *b) : observedScene(observedScene), b(b){};
+	virtual ~RemoteRootNodeAdditionTrigger(){};
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){return true;};
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){return true;};
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false){return true;};
+    bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false){return true;};
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false){return true;};
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes){
+		LOG(DEBUG) << "RemoteRootNodeAdditionTrigger: addRemoteRootNode detected";
+
+		/* Only repond to _other_ World Model Agnets, otherwise a loop is created. */
+		if(rootId != observedScene->getRootId()) {
+			LOG(DEBUG) << "RemoteRootNodeAdditionTrigger: triggering now.";
+			b->step(b); // A single step.
+		} else {
+			LOG(DEBUG) << "RemoteRootNodeAdditionTrigger: Skipping addRemoteRootNode from local graph.";
+		}
+
+		return true;
+	};
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false){return true;};
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0)){return true;};
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp){return true;};
+    bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp){return true;};
+	bool deleteNode(Id id){return true;};
+	bool addParent(Id id, Id parentId){return true;};
+    bool removeParent(Id id, Id parentId){return true;};
+
+private:
+
+    // For potentaion queries to the graph
+    SceneGraphFacade* observedScene;
+
+    // Block that gets triggerd on an addRemoteRootNode event;
+    ubx_block_t *b;
+};
+
+/* define a structure for holding the block local state. By assigning an
+ * instance of this struct to the block private_data pointer (see init), this
+ * information becomes accessible within the hook functions.
+ */
+struct rsg_binary_sender_info
+{
+        /* add custom block local data here */
+		brics_3d::WorldModel* wm;
+		brics_3d::rsg::SceneGraphToUpdatesTraverser* wm_resender;
+		brics_3d::rsg::FrequencyAwareUpdateFilter* frequency_filter;
+		brics_3d::rsg::BinaryUpdateSerializer* serializer;
+		RsgToUbxPort* ubx_port;
+		RemoteRootNodeAdditionTrigger* remote_root_trigger;
+
+        /* this is to have fast access to ports for reading and writing, without
+         * needing a hash table lookup */
+        struct rsg_binary_sender_port_cache ports;
+};
+
+/* init */
+int rsg_binary_sender_init(ubx_block_t *b)
+{
+        int ret = -1;
+        struct rsg_binary_sender_info *inf;
+
+    	/* Configure the logger - default level won't tell us much */
+    	brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
+
+        /* allocate memory for the block local state */
+        if ((inf = (struct rsg_binary_sender_info*)calloc(1, sizeof(struct rsg_binary_sender_info)))==NULL) {
+                ERR("rsg_binary_sender: failed to alloc memory");
+                ret=EOUTOFMEM;
+                return -1;
+        }
+        b->private_data=inf;
+        update_port_cache(b, &inf->ports);
+
+    	unsigned int clen;
+    	rsg_wm_handle tmpWmHandle =  *((rsg_wm_handle*) ubx_config_get_data_ptr(b, "wm_handle", &clen));
+    	assert(clen != 0);
+    	inf->wm = reinterpret_cast<brics_3d::WorldModel*>(tmpWmHandle.wm); // We know that this pointer stores the world model type
+    	if(inf->wm == 0) {
+    		LOG(ERROR) << "World model handle could not be obtained via configuration parameter."
+    					  "Creating a new world model instance instead (mostly for debugging purposes)."
+    					  "Please check your system design if this is intended!";
+    		inf->wm = new brics_3d::WorldModel();
+    	}
+
+    	float maxFreq = 1.0;
+    	float* max_freq =  ((float*) ubx_config_get_data_ptr(b, "max_freq", &clen));
+    	if(clen == 0) {
+    		LOG(WARNING) << "rsg_binary_sender: No max_freq configuration given. Setting it to " << maxFreq;
+    	} else if (*max_freq <= 0) {
+    		LOG(WARNING) << "rsg_binary_sender: max_freq <= 0. Resetting it to " << maxFreq;
+    	} else {
+    		maxFreq = *max_freq;
+    	}
+		LOG(INFO) << "rsg_binary_sender: max_freq = " << maxFreq;
+
+    	/* Attach filter */
+    	inf->frequency_filter = new brics_3d::rsg::FrequencyAwareUpdateFilter();
+    	inf->frequency_filter->setMaxGeometricNodeUpdateFrequency(0); // everything;
+    	inf->frequency_filter->setMaxTransformUpdateFrequency(maxFreq); // not more then x Hz;
+
+    	/* Attach the UBX port to the world model */
+    	ubx_type_t* type =  ubx_type_get(b->ni, "unsigned char");
+    	inf->ubx_port = new RsgToUbxPort(inf->ports.rsg_out, type);
+    	inf->serializer = new brics_3d::rsg::BinaryUpdateSerializer(inf->ubx_port);
+    	inf->wm->scene.attachUpdateObserver(inf->frequency_filter);
+    	inf->frequency_filter->attachUpdateObserver(inf->serializer);
+
+    	/* Set error policy of RSG */
+    	inf->wm->scene.setCallObserversEvenIfErrorsOccurred(false);
+
+    	/* Initialize resender that resends the complete graph, if necessary */
+    	inf->wm_resender = new brics_3d::rsg::SceneGraphToUpdatesTraverser(inf->serializer);
+
+    	/* Setup auto mount reply policy for incoming addRemoteNodes  */
+    	inf->remote_root_trigger = new RemoteRootNodeAdditionTrigger(&inf->wm->scene, b);
+    	inf->wm->scene.attachUpdateObserver(inf->remote_root_trigger);
+
+        return 0;
+}
+
+/* start */
+int rsg_binary_sender_start(ubx_block_t *b)
+{
+        /* struct rsg_binary_sender_info *inf = (struct rsg_binary_sender_info*) b->private_data; */
+        int ret = 0;
+
+    	/* Set logger level */
+    	unsigned int clen;
+    	int* log_level =  ((int*) ubx_config_get_data_ptr(b, "log_level", &clen));
+    	if(clen == 0) {
+    		LOG(INFO) << "rsg_binary_sender: No log_level configuation given.";
+    	} else {
+    		if (*log_level == 0) {
+    			LOG(INFO) << "rsg_binary_sender: log_level set to DEBUG level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
+    		} else if (*log_level == 1) {
+    			LOG(INFO) << "rsg_binary_sender: log_level set to INFO level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::INFO);
+    		} else if (*log_level == 2) {
+    			LOG(INFO) << "rsg_binary_sender: log_level set to WARNING level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::WARNING);
+    		} else if (*log_level == 3) {
+    			LOG(INFO) << "rsg_binary_sender: log_level set to LOGERROR level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGERROR);
+    		} else if (*log_level == 4) {
+    			LOG(INFO) << "rsg_binary_sender: log_level set to FATAL level.";
+    			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::FATAL);
+    		} else {
+    			LOG(INFO) << "rsg_binary_sender: unknown log_level = " << *log_level;		}
+    	}
+
+        return ret;
+}
+
+/* stop */
+void rsg_binary_sender_stop(ubx_block_t *b)
+{
+        /* struct rsg_binary_sender_info *inf = (struct rsg_binary_sender_info*) b->private_data; */
+}
+
+/* cleanup */
+void rsg_binary_sender_cleanup(ubx_block_t *b)
+{
+        struct rsg_binary_sender_info *inf = (struct rsg_binary_sender_info*) b->private_data;
+        if(inf->wm_resender) {
+        	delete inf->wm_resender;
+        	inf->wm_resender = 0;
+        }
+        if(inf->frequency_filter){
+        	delete inf->frequency_filter;
+        	inf->frequency_filter = 0;
+        }
+        if(inf->serializer){
+        	delete inf->serializer;
+        	inf->serializer = 0;
+        }
+        if(inf->ubx_port){
+        	delete inf->ubx_port;
+        	inf->ubx_port = 0;
+        }
+        if(inf->remote_root_trigger){
+        	delete inf->remote_root_trigger;
+        	inf->remote_root_trigger = 0;
+        }
+        free(b->private_data);
+}
+
+/* step */
+void rsg_binary_sender_step(ubx_block_t *b)
+{
+
+        struct rsg_binary_sender_info *inf = (struct rsg_binary_sender_info*) b->private_data;
+        brics_3d::WorldModel* wm = inf->wm;
+
+        /* Resend the complete scene graph */
+        LOG(INFO) << "rsg_binary_sender: Resending the complete RSG now.";
+        inf->wm->scene.advertiseRootNode(); // Make sure root node is always send; The graph traverser cannot handle this.
+        inf->wm_resender->reset();
+        wm->scene.executeGraphTraverser(inf->wm_resender, wm->scene.getRootId()); // Note: addRemoteRoot node is only forwarded once
+
+}
+
@@ -0,0 +1,128 @@
+#include "rsg_capture.h"
+
+#include <brics_3d/core/Logger.h>
+
+#include <string.h>
+
+namespace brics_3d {
+namespace rsg {
+
+/*
+ * Writer
+ */
+
+CaptureWriter::CaptureWriter() : file(0), records(0) {
+
+}
+
+CaptureWriter::~CaptureWriter() {
+	close();
+}
+
+bool CaptureWriter::open(const std::string& fileName) {
+	close();
+	file = fopen(fileName.c_str(), "wb");
+	if(file == 0) {
+		LOG(ERROR) << "CaptureWriter: Cannot write to file " << fileName;
+		return false;
+	}
+	setvbuf(file, 0, _IOFBF, RSG_CAPTURE_BUFFER_SIZE);
+	records = 0;
+
+	char header[RSG_CAPTURE_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header, RSG_CAPTURE_MAGIC, strlen(RSG_CAPTURE_MAGIC));
+	uint32_t version = RSG_CAPTURE_VERSION;
+	memcpy(header + RSG_CAPTURE_MAGIC_SIZE, &version, sizeof(version));
+	if(fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+		LOG(ERROR) << "CaptureWriter: Cannot write to file " << fileName;
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool CaptureWriter::append(uint64_t timeStamp, const char* data, uint32_t length) {
+	if(file == 0) {
+		return false;
+	}
+	if((fwrite(&timeStamp, 1, sizeof(timeStamp), file) != sizeof(timeStamp)) ||
+			(fwrite(&length, 1, sizeof(length), file) != sizeof(length)) ||
+			(fwrite(data, 1, length, file) != length)) {
+		return false;
+	}
+	records++;
+	return true;
+}
+
+void CaptureWriter::close() {
+	if(file != 0) {
+		fclose(file);
+		file = 0;
+	}
+}
+
+/*
+ * Reader
+ */
+
+CaptureReader::CaptureReader() : file(0) {
+
+}
+
+CaptureReader::~CaptureReader() {
+	close();
+}
+
+bool CaptureReader::open(const std::string& fileName) {
+	close();
+	file = fopen(fileName.c_str(), "rb");
+	if(file == 0) {
+		LOG(ERROR) << "CaptureReader: Cannot open file " << fileName;
+		return false;
+	}
+	setvbuf(file, 0, _IOFBF, RSG_CAPTURE_BUFFER_SIZE);
+
+	char header[RSG_CAPTURE_HEADER_SIZE];
+	uint32_t version = 0;
+	if(fread(header, 1, sizeof(header), file) == sizeof(header)) {
+		memcpy(&version, header + RSG_CAPTURE_MAGIC_SIZE, sizeof(version));
+	}
+	if((memcmp(header, RSG_CAPTURE_MAGIC, strlen(RSG_CAPTURE_MAGIC)) != 0) || (version != RSG_CAPTURE_VERSION)) {
+		LOG(ERROR) << "CaptureReader: " << fileName << " is not a capture file of version " << RSG_CAPTURE_VERSION << ".";
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool CaptureReader::next(uint64_t& timeStamp, std::vector<char>& data) {
+	if(file == 0) {
+		return false;
+	}
+	uint32_t length;
+	if((fread(&timeStamp, 1, sizeof(timeStamp), file) != sizeof(timeStamp)) ||
+			(fread(&length, 1, sizeof(length), file) != sizeof(length))) {
+		return false;
+	}
+	if(length > RSG_CAPTURE_MAX_MESSAGE_SIZE) {
+		LOG(ERROR) << "CaptureReader: Record with " << length << " bytes is corrupt. Stopping.";
+		return false;
+	}
+	data.resize(length);
+	if((length > 0) && (fread(&data[0], 1, length, file) != length)) {
+		LOG(WARNING) << "CaptureReader: The last record is truncated.";
+		return false;
+	}
+	return true;
+}
+
+void CaptureReader::close() {
+	if(file != 0) {
+		fclose(file);
+		file = 0;
+	}
+}
+
+} // namespace rsg
+} // namespace brics_3d
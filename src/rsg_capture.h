@@ -0,0 +1,82 @@
+/*
+ * Capture files of raw update streams as recorded by the rsg_recorder block
+ * and played back by the rsg_replay block.
+ *
+ * The file layout is:
+ *
+ *   magic (8 bytes "RSGCAPT\0") | version (uint32) | reserved (uint32) |
+ *   records: time stamp (uint64, [ns] since the start of the recording) |
+ *            length (uint32) | message as read from the port
+ *
+ * Numbers are stored in host byte order. The messages are not interpreted,
+ * so JSON, HDF5 and binary update streams can be captured alike.
+ */
+
+#ifndef RSG_CAPTURE_H_
+#define RSG_CAPTURE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_CAPTURE_MAGIC "RSGCAPT"
+#define RSG_CAPTURE_MAGIC_SIZE 8
+#define RSG_CAPTURE_VERSION 1
+#define RSG_CAPTURE_HEADER_SIZE (RSG_CAPTURE_MAGIC_SIZE + 4 + 4)
+#define RSG_CAPTURE_BUFFER_SIZE (1024 * 1024) // [bytes] stdio buffer of readers and writers
+#define RSG_CAPTURE_MAX_MESSAGE_SIZE (256 * 1024 * 1024) // [bytes] Larger records are considered corrupt.
+
+class CaptureWriter {
+public:
+	CaptureWriter();
+	virtual ~CaptureWriter();
+
+	/// Creates or truncates a capture file.
+	bool open(const std::string& fileName);
+
+	/**
+	 * Appends a message.
+	 * @param timeStamp Time in [ns] since the start of the recording.
+	 */
+	bool append(uint64_t timeStamp, const char* data, uint32_t length);
+
+	void close();
+
+	uint64_t getRecords() const {
+		return records;
+	}
+
+private:
+	FILE* file;
+	uint64_t records;
+};
+
+class CaptureReader {
+public:
+	CaptureReader();
+	virtual ~CaptureReader();
+
+	bool open(const std::string& fileName);
+
+	/**
+	 * Reads the next message.
+	 * @param[out] timeStamp Time in [ns] since the start of the recording.
+	 * @param[out] data The message. The vector is reused, so it only grows to the largest message.
+	 * @return False at the end of the file or if the rest of the file is truncated.
+	 */
+	bool next(uint64_t& timeStamp, std::vector<char>& data);
+
+	void close();
+
+private:
+	FILE* file;
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_CAPTURE_H_ */
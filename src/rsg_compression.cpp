@@ -0,0 +1,268 @@
+#include "rsg_compression.h"
+
+#include <brics_3d/core/Logger.h>
+
+#ifdef RSG_USE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif /* RSG_USE_ZSTD */
+
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+namespace brics_3d {
+namespace rsg {
+
+/// Magic number of a zstd frame (0xFD2FB528, little endian).
+static const unsigned char zstdMagic[4] = {0x28, 0xB5, 0x2F, 0xFD};
+
+/*
+ * Raw content dictionary. zstd finds matches in it like in previously compressed
+ * data, so it consists of the typical fragments of the JSON updates. The most
+ * frequent fragments are at the end, where offsets are cheapest.
+ */
+static const char defaultDictionary[] =
+	"{\"@worldmodeltype\":\"RSGUpdateBatch\",\"operations\":["
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"CREATE_REMOTE_ROOT_NODE\",\"node\":{\"@graphtype\":\"Node\",\"id\":\"\",\"attributes\":[]}}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"CREATE\",\"node\":{\"@graphtype\":\"Connection\",\"id\":\"\",\"attributes\":[],"
+	"\"sourceIds\":[\"\"],\"targetIds\":[\"\"],\"start\":{\"@stamptype\":\"TimeStampUTCms\",\"stamp\":0.0},\"end\":{\"@stamptype\":\"TimeStampUTCms\",\"stamp\":0.0}},\"parentId\":\"\"}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"CREATE\",\"node\":{\"@graphtype\":\"Node\",\"@semanticContext\":\"GeometricNode\",\"id\":\"\",\"attributes\":[],"
+	"\"unit\":\"m\",\"geometry\":{\"@geometrytype\":\"Box\",\"sizeX\":1.0,\"sizeY\":1.0,\"sizeZ\":1.0,\"unit\":\"m\"},\"timeStamp\":{\"@stamptype\":\"TimeStampUTCms\",\"stamp\":0.0}},\"parentId\":\"\"}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"CREATE_PARENT\",\"childId\":\"\",\"parentId\":\"\"}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"DELETE_PARENT\",\"childId\":\"\",\"parentId\":\"\"}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"DELETE_NODE\",\"node\":{\"id\":\"\"}}"
+	"{\"key\":\"osm:name\",\"value\":\"\"},{\"key\":\"osm:node_id\",\"value\":\"\"},{\"key\":\"osm:way_id\",\"value\":\"\"},{\"key\":\"osm:building\",\"value\":\"yes\"},"
+	"{\"key\":\"gis:origin\",\"value\":\"wgs84\"},{\"key\":\"geo:crs\",\"value\":\"wgs84\"},{\"key\":\"tf:type\",\"value\":\"wgs84\"},"
+	"{\"key\":\"sherpa:agent_name\",\"value\":\"\"},{\"key\":\"sherpa:observation_type\",\"value\":\"image\"},{\"key\":\"sherpa:battery_voltage\",\"value\":\"\"},"
+	"{\"key\":\"sherpa:artva_signal\",\"value\":\"\"},{\"key\":\"sherpa:origin\",\"value\":\"initial\"},{\"key\":\"rsg:agent_policy\",\"value\":\"\"},"
+	"{\"key\":\"tf:name\",\"value\":\"\"},{\"key\":\"name\",\"value\":\"\"},{\"key\":\"type\",\"value\":\"Transform\"},"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"CREATE\",\"node\":{\"@graphtype\":\"Group\",\"id\":\"\",\"attributes\":[{\"key\":\"name\",\"value\":\"\"}]},\"parentId\":\"\"}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"CREATE\",\"node\":{\"@graphtype\":\"Node\",\"id\":\"\",\"attributes\":[{\"key\":\"name\",\"value\":\"\"}]},\"parentId\":\"\"}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"UPDATE_ATTRIBUTES\",\"node\":{\"@graphtype\":\"Node\",\"id\":\"\",\"attributes\":[{\"key\":\"\",\"value\":\"\"}]}}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"CREATE\",\"node\":{\"@graphtype\":\"Connection\",\"@semanticContext\":\"Transform\",\"id\":\"\","
+	"\"attributes\":[{\"key\":\"tf:name\",\"value\":\"\"}],\"sourceIds\":[\"\"],\"targetIds\":[\"\"],\"history\":[{\"stamp\":{\"@stamptype\":\"TimeStampUTCms\",\"stamp\":1.0},"
+	"\"transform\":{\"type\":\"HomogeneousMatrix44\",\"matrix\":[[1.0,0.0,0.0,0.0],[0.0,1.0,0.0,0.0],[0.0,0.0,1.0,0.0],[0.0,0.0,0.0,1.0]],\"unit\":\"m\"}}]},\"parentId\":\"\"}"
+	"{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"UPDATE_TRANSFORM\",\"node\":{\"@graphtype\":\"Connection\",\"@semanticContext\":\"Transform\",\"id\":\"\","
+	"\"history\":[{\"stamp\":{\"@stamptype\":\"TimeStampUTCms\",\"stamp\":1.0},\"transform\":{\"type\":\"HomogeneousMatrix44\",\"matrix\":[[1,0,0,0],[0,1,0,0],[0,0,1,0],[0,0,0,1]],\"unit\":\"m\"}}]}}";
+
+bool UpdateCompression::isAvailable() {
+#ifdef RSG_USE_ZSTD
+	return true;
+#else
+	return false;
+#endif /* RSG_USE_ZSTD */
+}
+
+bool UpdateCompression::isCompressed(const char* data, size_t length) {
+	return (length >= sizeof(zstdMagic)) && (memcmp(data, zstdMagic, sizeof(zstdMagic)) == 0);
+}
+
+const std::string& UpdateCompression::getDefaultDictionary() {
+	static const std::string dictionary(defaultDictionary, sizeof(defaultDictionary) - 1);
+	return dictionary;
+}
+
+bool UpdateCompression::loadDictionary(const std::string& fileName, std::string& dictionary) {
+	if(fileName.empty()) {
+		dictionary = getDefaultDictionary();
+		return true;
+	}
+	std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+	if(!file.is_open()) {
+		LOG(ERROR) << "UpdateCompression: Cannot open the dictionary file " << fileName;
+		return false;
+	}
+	dictionary.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	if(dictionary.empty()) {
+		LOG(ERROR) << "UpdateCompression: The dictionary file " << fileName << " is empty.";
+		return false;
+	}
+	return true;
+}
+
+bool UpdateCompression::trainDictionary(const std::vector<std::string>& samples, size_t capacity, std::string& dictionary) {
+#ifdef RSG_USE_ZSTD
+	if(samples.empty()) {
+		LOG(ERROR) << "UpdateCompression: A dictionary can not be trained without samples.";
+		return false;
+	}
+	std::string samplesBuffer;
+	std::vector<size_t> sampleSizes;
+	for (std::vector<std::string>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+		samplesBuffer.append(*it);
+		sampleSizes.push_back(it->size());
+	}
+	dictionary.resize(capacity);
+	size_t size = ZDICT_trainFromBuffer(&dictionary[0], capacity, samplesBuffer.data(), &sampleSizes[0], static_cast<unsigned>(sampleSizes.size()));
+	if(ZDICT_isError(size)) {
+		LOG(ERROR) << "UpdateCompression: Training of a dictionary with " << samples.size() << " samples failed: " << ZDICT_getErrorName(size);
+		dictionary.clear();
+		return false;
+	}
+	dictionary.resize(size);
+	return true;
+#else
+	LOG(ERROR) << "UpdateCompression: Dictionaries can not be trained without zstd support. Please enable USE_ZSTD.";
+	return false;
+#endif /* RSG_USE_ZSTD */
+}
+
+/*
+ * Thin wrappers around zstd, so that the classes below are the same with and
+ * without zstd support.
+ */
+
+/// @return Size of the frame in output. 0 on failure.
+static size_t compressFrame(void* context, const char* data, size_t length, std::vector<char>& output) {
+#ifdef RSG_USE_ZSTD
+	output.resize(ZSTD_compressBound(length));
+	size_t size = ZSTD_compress2(static_cast<ZSTD_CCtx*>(context), &output[0], output.size(), data, length);
+	if(ZSTD_isError(size)) {
+		LOG(ERROR) << "UpdateCompressor: Compression of a message with " << length << " bytes failed: " << ZSTD_getErrorName(size);
+		return 0;
+	}
+	return size;
+#else
+	return 0;
+#endif /* RSG_USE_ZSTD */
+}
+
+static bool decompressFrame(void* context, void* dictionary, const char* data, size_t length, std::vector<char>& output) {
+#ifdef RSG_USE_ZSTD
+	unsigned long long size = ZSTD_getFrameContentSize(data, length);
+	if((size == ZSTD_CONTENTSIZE_ERROR) || (size == ZSTD_CONTENTSIZE_UNKNOWN) || (size > RSG_COMPRESSION_MAX_MESSAGE_SIZE)) {
+		LOG(ERROR) << "UpdateDecompressor: Invalid compressed message with " << length << " bytes.";
+		return false;
+	}
+	output.resize(size);
+	size_t decompressedSize = ZSTD_decompress_usingDDict(static_cast<ZSTD_DCtx*>(context), output.empty() ? 0 : &output[0], output.size(), data, length,
+			static_cast<ZSTD_DDict*>(dictionary));
+	if(ZSTD_isError(decompressedSize) || (decompressedSize != size)) {
+		LOG(ERROR) << "UpdateDecompressor: Decompression of a message with " << length << " bytes failed: "
+				<< (ZSTD_isError(decompressedSize) ? ZSTD_getErrorName(decompressedSize) : "size mismatch")
+				<< ". Sender and receiver might use different dictionaries.";
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif /* RSG_USE_ZSTD */
+}
+
+UpdateCompressor::UpdateCompressor(IOutputPort* next, const std::string& dictionary, uint32_t threshold, int level, BlockStats* stats)
+	: next(next), threshold(threshold), context(0), dictionary(0),
+	  bytesIn(0), bytesOut(0), compressedMessages(0), uncompressedMessages(0), ratio(0), compressedIn(0), compressedOut(0), compressTime(0) {
+	if(stats != 0) {
+		bytesIn = stats->getCounter("compression_bytes_in");
+		bytesOut = stats->getCounter("compression_bytes_out");
+		compressedMessages = stats->getCounter("compressed_messages");
+		uncompressedMessages = stats->getCounter("uncompressed_messages");
+		ratio = stats->getCounter("compression_ratio_percent");
+		compressTime = stats->getHistogram("compress");
+	}
+#ifdef RSG_USE_ZSTD
+	this->dictionary = ZSTD_createCDict(dictionary.data(), dictionary.size(), level);
+	if(this->dictionary != 0) {
+		context = ZSTD_createCCtx();
+	}
+	if(context != 0) {
+		/* The checksum detects corrupted messages, which would otherwise decompress to garbage. */
+		ZSTD_CCtx* compressionContext = static_cast<ZSTD_CCtx*>(context);
+		if(ZSTD_isError(ZSTD_CCtx_setParameter(compressionContext, ZSTD_c_checksumFlag, 1))
+				|| ZSTD_isError(ZSTD_CCtx_refCDict(compressionContext, static_cast<ZSTD_CDict*>(this->dictionary)))) {
+			ZSTD_freeCCtx(compressionContext);
+			context = 0;
+		}
+	}
+	if(context == 0) {
+		LOG(ERROR) << "UpdateCompressor: Cannot load the dictionary with " << dictionary.size() << " bytes. Messages are sent uncompressed.";
+	}
+#else
+	LOG(ERROR) << "UpdateCompressor: Messages can not be compressed without zstd support. Please enable USE_ZSTD.";
+#endif /* RSG_USE_ZSTD */
+}
+
+UpdateCompressor::~UpdateCompressor() {
+#ifdef RSG_USE_ZSTD
+	ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(context));
+	ZSTD_freeCDict(static_cast<ZSTD_CDict*>(dictionary));
+#endif /* RSG_USE_ZSTD */
+}
+
+int UpdateCompressor::write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if(bytesIn != 0) {
+		bytesIn->add(dataLength);
+	}
+
+	if((context != 0) && (dataLength > 0) && (static_cast<uint32_t>(dataLength) >= threshold)) {
+		size_t compressedSize;
+		{
+			ScopedLatency latency(compressTime);
+			compressedSize = compressFrame(context, dataBuffer, dataLength, buffer);
+		}
+		if((compressedSize > 0) && (compressedSize < static_cast<size_t>(dataLength))) {
+			compressedIn += dataLength;
+			compressedOut += compressedSize;
+			if(compressedMessages != 0) {
+				compressedMessages->add();
+				bytesOut->add(compressedSize);
+				ratio->set(compressedOut * 100 / compressedIn);
+			}
+			int result = next->write(&buffer[0], static_cast<int>(compressedSize), transferredBytes);
+			transferredBytes = dataLength;
+			return result;
+		}
+	}
+
+	if(uncompressedMessages != 0) {
+		uncompressedMessages->add();
+		bytesOut->add(dataLength);
+	}
+	return next->write(dataBuffer, dataLength, transferredBytes);
+}
+
+UpdateDecompressor::UpdateDecompressor(const std::string& dictionary, BlockStats* stats)
+	: context(0), dictionary(0), decompressedMessages(0), errors(0), decompressTime(0) {
+	if(stats != 0) {
+		decompressedMessages = stats->getCounter("decompressed_messages");
+		errors = stats->getCounter("decompression_errors");
+		decompressTime = stats->getHistogram("decompress");
+	}
+#ifdef RSG_USE_ZSTD
+	this->dictionary = ZSTD_createDDict(dictionary.data(), dictionary.size());
+	if(this->dictionary != 0) {
+		context = ZSTD_createDCtx();
+	}
+	if(context == 0) {
+		LOG(ERROR) << "UpdateDecompressor: Cannot load the dictionary with " << dictionary.size() << " bytes. Compressed messages are rejected.";
+	}
+#endif /* RSG_USE_ZSTD */
+}
+
+UpdateDecompressor::~UpdateDecompressor() {
+#ifdef RSG_USE_ZSTD
+	ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(context));
+	ZSTD_freeDDict(static_cast<ZSTD_DDict*>(dictionary));
+#endif /* RSG_USE_ZSTD */
+}
+
+bool UpdateDecompressor::decompress(const char* data, size_t length, std::vector<char>& output) {
+	bool decompressed = false;
+	if(context != 0) {
+		ScopedLatency latency(decompressTime);
+		decompressed = decompressFrame(context, dictionary, data, length, output);
+	} else {
+		LOG(ERROR) << "UpdateDecompressor: Received a compressed message, but decompression is not available. Please enable USE_ZSTD.";
+	}
+
+	StatsCounter* counter = decompressed ? decompressedMessages : errors;
+	if(counter != 0) {
+		counter->add();
+	}
+	return decompressed;
+}
+
+} // namespace rsg
+} // namespace brics_3d
@@ -0,0 +1,142 @@
+/*
+ * Optional compression of the JSON update stream with zstd and a dictionary.
+ *
+ * Every JSON update repeats the same keys, world model types, UUID layouts and
+ * attribute name spaces. With a dictionary of such content zstd compresses even
+ * single small updates well, which matters for radio links between robots.
+ *
+ * The sender compresses every message that is at least as large as a threshold
+ * into a zstd frame. Smaller messages, and messages that would not get smaller,
+ * are sent unchanged. A zstd frame never starts like a JSON message, so receivers
+ * accept compressed and uncompressed messages alike, e.g. from peers that do not
+ * compress.
+ *
+ * The dictionary is either the built-in one (raw content of typical RSGUpdate
+ * messages) or one trained with rsg_train_dictionary from capture files of a real
+ * update stream. Sender and receivers have to use the same dictionary.
+ *
+ * Requires the USE_ZSTD build option (RSG_USE_ZSTD). Without it compression can
+ * not be enabled and compressed messages are rejected.
+ */
+
+#ifndef RSG_COMPRESSION_H_
+#define RSG_COMPRESSION_H_
+
+#include <brics_3d/worldModel/sceneGraph/IOutputPort.h>
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rsg_stats.h"
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_COMPRESSION_DEFAULT_LEVEL 3
+#define RSG_COMPRESSION_DEFAULT_THRESHOLD 128 // [bytes] Smaller messages are not compressed.
+#define RSG_COMPRESSION_DEFAULT_DICTIONARY_SIZE (64 * 1024) // [bytes] for trained dictionaries
+#define RSG_COMPRESSION_MAX_MESSAGE_SIZE (256 * 1024 * 1024) // [bytes] Larger decompressed sizes are considered corrupt.
+
+class UpdateCompression {
+public:
+
+	/// True if the blocks have been built with zstd support.
+	static bool isAvailable();
+
+	/// Checks for the magic number of a zstd frame.
+	static bool isCompressed(const char* data, size_t length);
+
+	/// Raw content dictionary with typical RSGUpdate messages.
+	static const std::string& getDefaultDictionary();
+
+	/**
+	 * Loads a trained dictionary.
+	 * @param fileName Dictionary file. Empty for the default dictionary.
+	 */
+	static bool loadDictionary(const std::string& fileName, std::string& dictionary);
+
+	/**
+	 * Trains a dictionary from sample messages.
+	 * @param capacity Maximum size of the dictionary in bytes.
+	 * @return False if there are too few samples or zstd is not available.
+	 */
+	static bool trainDictionary(const std::vector<std::string>& samples, size_t capacity, std::string& dictionary);
+};
+
+/**
+ * Compresses the messages that are written to it and forwards them to the next
+ * port. Thread safe.
+ */
+class UpdateCompressor : public IOutputPort {
+public:
+
+	/**
+	 * @param next Port that receives the (compressed) messages.
+	 * @param stats Optional. Receives the compression_* counters and the compress histogram.
+	 */
+	UpdateCompressor(IOutputPort* next, const std::string& dictionary, uint32_t threshold = RSG_COMPRESSION_DEFAULT_THRESHOLD,
+			int level = RSG_COMPRESSION_DEFAULT_LEVEL, BlockStats* stats = 0);
+	virtual ~UpdateCompressor();
+
+	/// False if the dictionary could not be loaded. Messages are forwarded uncompressed then.
+	bool isValid() const {
+		return context != 0;
+	}
+
+	int write(const char *dataBuffer, int dataLength, int &transferredBytes);
+
+private:
+	IOutputPort* next;
+	uint32_t threshold;
+
+	std::mutex mutex;
+	void* context;      // ZSTD_CCtx
+	void* dictionary;   // ZSTD_CDict
+	std::vector<char> buffer;
+
+	StatsCounter* bytesIn;
+	StatsCounter* bytesOut;
+	StatsCounter* compressedMessages;
+	StatsCounter* uncompressedMessages;
+	StatsCounter* ratio; // Compressed size of all compressed messages in percent of their original size.
+	uint64_t compressedIn;
+	uint64_t compressedOut;
+	LatencyHistogram* compressTime;
+};
+
+/**
+ * Decompresses zstd frames that have been created by an UpdateCompressor with the
+ * same dictionary. Not thread safe.
+ */
+class UpdateDecompressor {
+public:
+
+	/// @param stats Optional. Receives the decompression_* counters and the decompress histogram.
+	UpdateDecompressor(const std::string& dictionary, BlockStats* stats = 0);
+	virtual ~UpdateDecompressor();
+
+	bool isValid() const {
+		return context != 0;
+	}
+
+	/**
+	 * @param output The decompressed message. The vector is reused, so it only grows to the largest message.
+	 * @return False if the frame is corrupt or has been compressed with another dictionary.
+	 */
+	bool decompress(const char* data, size_t length, std::vector<char>& output);
+
+private:
+	void* context;      // ZSTD_DCtx
+	void* dictionary;   // ZSTD_DDict
+
+	StatsCounter* decompressedMessages;
+	StatsCounter* errors;
+	LatencyHistogram* decompressTime;
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_COMPRESSION_H_ */
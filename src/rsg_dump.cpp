@@ -9,20 +9,370 @@
 #include <brics_3d/worldModel/WorldModel.h>
 #include <brics_3d/worldModel/sceneGraph/DotGraphGenerator.h>
 #include <brics_3d/worldModel/sceneGraph/HDF5UpdateSerializer.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+#include <brics_3d/worldModel/sceneGraph/SceneGraphToUpdatesTraverser.h>
+#include <brics_3d/worldModel/sceneGraph/UpdatesToSceneGraphListener.h>
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iomanip> 	//for setw and setfill
 #include <ctime>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "rsg_world_model_lock.h"
+#include "rsg_stats.h"
+#include "rsg_snapshot.h"
+#include "rsg_journal_position.h"
 
 using namespace brics_3d;
 using brics_3d::Logger;
+using namespace brics_3d::rsg;
 
 
 UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
 
+#define RSG_DUMP_FLUSH_NODES 1000 // The generated dot text is flushed to the file after this number of nodes.
+
+/**
+ * Copy of a world model. It is taken while holding the world model lock
+ * and afterwards printed without any lock. Note that taking the copy is still
+ * O(n) in the size of the graph and blocks all writers meanwhile; only the
+ * generation and the writing of the files are moved to the background.
+ */
+struct DumpSnapshot {
+	DumpSnapshot() : wm(new brics_3d::WorldModel()), hasJournalPosition(false) {};
+	~DumpSnapshot() {
+		delete wm;
+	};
+
+	brics_3d::WorldModel* wm;
+	vector<brics_3d::rsg::Id> rootIds; // Local root and remote roots of the original world model.
+	std::string fileName;
+	bool hasJournalPosition;
+	JournalPosition journalPosition; // Of the original world model when the copy was taken.
+};
+
+/**
+ * Copies the local graph and all remote graphs of a world model. Only the
+ * latest Transform data is copied. This is a deep copy of every node that
+ * runs on the caller's thread with the world model read lock held.
+ */
+static DumpSnapshot* take_snapshot(brics_3d::WorldModel* wm, const std::string& fileName)
+{
+	DumpSnapshot* snapshot = new DumpSnapshot();
+	snapshot->fileName = fileName;
+
+	brics_3d::rsg::UpdatesToSceneGraphListener copier;
+	copier.attachSceneGraph(&snapshot->wm->scene);
+	brics_3d::rsg::SceneGraphToUpdatesTraverser traverser(&copier);
+
+	WorldModelReadLock readLock(wm); // Blocks incoming updates only for the copy.
+	snapshot->hasJournalPosition = JournalCursor::get(wm)->getPosition(snapshot->journalPosition);
+	snapshot->rootIds.push_back(wm->scene.getRootId());
+	vector<brics_3d::rsg::Id> remoteRootNodeIds;
+	wm->scene.getRemoteRootNodes(remoteRootNodeIds);
+	snapshot->rootIds.insert(snapshot->rootIds.end(), remoteRootNodeIds.begin(), remoteRootNodeIds.end());
+
+	/* The roots are "remote" within the copy, so the copied subgraphs keep their original parent ids. */
+	for(vector<brics_3d::rsg::Id>::const_iterator it = snapshot->rootIds.begin(); it != snapshot->rootIds.end(); ++it) {
+		vector<brics_3d::rsg::Attribute> attributes;
+		wm->scene.getNodeAttributes(*it, attributes);
+		snapshot->wm->scene.addRemoteRootNode(*it, attributes);
+	}
+	for(vector<brics_3d::rsg::Id>::const_iterator it = snapshot->rootIds.begin(); it != snapshot->rootIds.end(); ++it) {
+		wm->scene.executeGraphTraverser(&traverser, *it);
+		traverser.reset();
+	}
+	return snapshot;
+}
+
+/**
+ * Generates a dot graph from the updates of a SceneGraphToUpdatesTraverser and
+ * writes it directly into a stream. Thus the text of a large graph is never held
+ * in memory as a whole. Used in background mode only; the format is simpler than
+ * the one of the DotGraphGenerator and Transforms only depict their latest translation.
+ */
+class DotStreamWriter : public ISceneGraphUpdateObserver {
+public:
+	DotStreamWriter(std::ostream& output) : output(output), nodes(0) {
+		output << "digraph rsg {" << std::endl;
+	};
+	virtual ~DotStreamWriter(){};
+
+	/// Closes the graph.
+	void finish() {
+		output << "}" << std::endl;
+		output.flush();
+	}
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){
+		writeNode(assignedId, "Node", attributes, "shape=ellipse");
+		writeEdge(parentId, assignedId);
+		return true;
+	};
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){
+		writeNode(assignedId, "Group", attributes, "shape=box");
+		writeEdge(parentId, assignedId);
+		return true;
+	};
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false){
+		writeNode(assignedId, "Transform", attributes, "shape=box, style=rounded", translation(transform));
+		writeEdge(parentId, assignedId);
+		return true;
+	};
+    bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false){
+		writeNode(assignedId, "UncertainTransform", attributes, "shape=box, style=rounded", translation(transform));
+		writeEdge(parentId, assignedId);
+		return true;
+    };
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false){
+		writeNode(assignedId, "GeometricNode", attributes, "shape=box, style=filled, fillcolor=lightgrey");
+		writeEdge(parentId, assignedId);
+		return true;
+	};
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes){
+		writeNode(rootId, "RootNode", attributes, "shape=doubleoctagon");
+		return true;
+	};
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false){
+		writeNode(assignedId, "Connection", attributes, "shape=diamond");
+		writeEdge(parentId, assignedId);
+		for(vector<Id>::const_iterator it = sourceIds.begin(); it != sourceIds.end(); ++it) {
+			writeEdge(assignedId, *it, "style=dashed, label=source");
+		}
+		for(vector<Id>::const_iterator it = targetIds.begin(); it != targetIds.end(); ++it) {
+			writeEdge(assignedId, *it, "style=dashed, label=target");
+		}
+		return true;
+	};
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0)){return true;};
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp){return true;};
+    bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp){return true;};
+	bool deleteNode(Id id){return true;};
+	bool addParent(Id id, Id parentId){
+		writeEdge(parentId, id);
+		return true;
+	};
+    bool removeParent(Id id, Id parentId){return true;};
+
+private:
+
+    static std::string translation(IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform) {
+    	std::stringstream text;
+    	const double* matrix = transform->getRawData();
+    	text << "x = " << matrix[12] << ", y = " << matrix[13] << ", z = " << matrix[14];
+    	return text.str();
+    }
+
+    /// Writes text as part of a quoted dot string.
+    void writeEscaped(const std::string& text) {
+    	for(std::string::const_iterator it = text.begin(); it != text.end(); ++it) {
+    		if((*it == '"') || (*it == '\\')) {
+    			output << '\\';
+    		} else if(*it == '\n') {
+    			output << "\\n";
+    			continue;
+    		}
+    		output << *it;
+    	}
+    }
+
+    void writeNode(Id id, const char* type, const vector<Attribute>& attributes, const char* style, const std::string& details = "") {
+    	output << "  \"" << id << "\" [" << style << ", label=\"" << type << " [" << id << "]";
+    	if(!details.empty()) {
+    		output << "\\n";
+    		writeEscaped(details);
+    	}
+    	for(vector<Attribute>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+    		output << "\\n";
+    		writeEscaped(it->key);
+    		output << " = ";
+    		writeEscaped(it->value);
+    	}
+    	output << "\"];" << std::endl;
+    	if(++nodes % RSG_DUMP_FLUSH_NODES == 0) {
+    		output.flush();
+    	}
+    }
+
+    void writeEdge(Id from, Id to, const char* style = 0) {
+    	output << "  \"" << from << "\" -> \"" << to << "\"";
+    	if(style) {
+    		output << " [" << style << "]";
+    	}
+    	output << ";" << std::endl;
+    }
+
+    std::ostream& output;
+    uint64_t nodes;
+};
 
+/**
+ * Writes a dot graph that has been generated by a DotGraphGenerator.
+ */
+static bool write_dot_file(const std::string& fileName, const std::string& dotGraph, StatsCounter* bytesOut)
+{
+	std::ofstream output((fileName + ".gv").c_str(), std::ios::trunc);
+	if (output.fail()) {
+		LOG(ERROR) << "rsg_dump: Cannot write to file " << fileName << ".gv";
+		return false;
+	}
+	output << dotGraph;
+	output.close();
+	if (output.fail()) {
+		LOG(ERROR) << "rsg_dump: Writing to file " << fileName << ".gv failed.";
+		return false;
+	}
+	bytesOut->add(dotGraph.size());
+	return true;
+}
+
+/**
+ * Writes a dot graph of the given root nodes and everything below them with a
+ * DotStreamWriter. The graph is written to the file during the traversal.
+ */
+static bool stream_dot_file(SceneGraphFacade* scene, const vector<Id>& rootIds, const std::string& fileName, StatsCounter* bytesOut)
+{
+	std::ofstream output((fileName + ".gv").c_str(), std::ios::trunc);
+	if (output.fail()) {
+		LOG(ERROR) << "rsg_dump: Cannot write to file " << fileName << ".gv";
+		return false;
+	}
+
+	DotStreamWriter writer(output);
+	for(vector<Id>::const_iterator it = rootIds.begin(); it != rootIds.end(); ++it) {
+		vector<Attribute> attributes;
+		scene->getNodeAttributes(*it, attributes);
+		writer.addRemoteRootNode(*it, attributes); // The graph traverser does not report the root nodes themselves.
+	}
+	SceneGraphToUpdatesTraverser traverser(&writer);
+	for(vector<Id>::const_iterator it = rootIds.begin(); it != rootIds.end(); ++it) {
+		scene->executeGraphTraverser(&traverser, *it);
+		traverser.reset();
+	}
+	writer.finish();
+
+	if (output.fail()) {
+		LOG(ERROR) << "rsg_dump: Writing to file " << fileName << ".gv failed.";
+		return false;
+	}
+	bytesOut->add(output.tellp());
+	output.close();
+	return true;
+}
+
+/**
+ * Stores a binary snapshot that can be restored with the rsg_scene_setup block.
+ * If the world model is journaled, the snapshot is tagged with the journal position
+ * and the journal is told afterwards that the segments before it are covered.
+ */
+static void write_binary_snapshot(brics_3d::rsg::SceneGraphFacade* scene, const vector<brics_3d::rsg::Id>& rootIds, const std::string& fileName,
+		JournalCursor* cursor, const JournalPosition* journalPosition, StatsCounter* bytesOut)
+{
+	uint64_t bytes = 0;
+	if(brics_3d::rsg::SnapshotWriter::store(scene, rootIds, fileName + RSG_SNAPSHOT_FILE_SUFFIX, journalPosition, bytes)) {
+		bytesOut->add(bytes);
+		if(journalPosition) {
+			cursor->setCovered(*journalPosition);
+		}
+	}
+}
+
+/**
+ * Background thread that generates and writes dumps of snapshots.
+ *
+ * At most one snapshot waits while another one is written. A newer snapshot
+ * replaces the waiting one, so repeated dumps do not pile up copies of the graph.
+ */
+class DumpWorker {
+public:
+	DumpWorker(BlockStats* stats, bool binarySnapshot, JournalCursor* cursor) : next(0), stopRequested(false), binarySnapshot(binarySnapshot), cursor(cursor) {
+		bytesOut = stats->getCounter("bytes_out");
+		pending = stats->getCounter("pending");
+		coalesced = stats->getCounter("coalesced");
+		traverseTime = stats->getHistogram("traverse");
+		writeTime = stats->getHistogram("write");
+
+		worker = new std::thread(&DumpWorker::run, this);
+	};
+
+	virtual ~DumpWorker() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopRequested = true;
+		}
+		condition.notify_all();
+		worker->join(); // A pending dump is finished first.
+		delete worker;
+	};
+
+	void enqueue(DumpSnapshot* snapshot) {
+		DumpSnapshot* replaced;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			replaced = next;
+			next = snapshot;
+			pending->set(1);
+		}
+		condition.notify_one();
+		if(replaced) {
+			LOG(WARNING) << "rsg_dump: The previous dump is still being written. " << replaced->fileName << " is skipped in favor of " << snapshot->fileName << ".";
+			coalesced->add();
+			delete replaced;
+		}
+	}
+
+private:
+
+	void run() {
+		while(true) {
+			DumpSnapshot* snapshot;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while((next == 0) && !stopRequested) {
+					condition.wait(lock);
+				}
+				if(next == 0) {
+					return;
+				}
+				snapshot = next;
+				next = 0;
+				pending->set(0);
+			}
+
+			{
+				ScopedLatency latency(traverseTime); // The dot file is written during the traversal.
+				stream_dot_file(&snapshot->wm->scene, snapshot->rootIds, snapshot->fileName, bytesOut);
+			}
+			if(binarySnapshot) {
+				ScopedLatency latency(writeTime);
+				write_binary_snapshot(&snapshot->wm->scene, snapshot->rootIds, snapshot->fileName, cursor,
+						snapshot->hasJournalPosition ? &snapshot->journalPosition : 0, bytesOut);
+			}
+			LOG(INFO) << "rsg_dump: Done with " << snapshot->fileName << ".gv";
+			delete snapshot;
+		}
+	}
+
+	std::thread* worker;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	DumpSnapshot* next; // Waiting to be written.
+	bool stopRequested;
+	bool binarySnapshot;
+	JournalCursor* cursor;
+
+	StatsCounter* bytesOut;
+	StatsCounter* pending;
+	StatsCounter* coalesced;
+	LatencyHistogram* traverseTime;
+	LatencyHistogram* writeTime;
+};
 
 /* define a structure for holding the block local state. By assigning an
  * instance of this struct to the block private_data pointer (see init), this
@@ -34,11 +384,20 @@ struct rsg_dump_info
 		brics_3d::WorldModel* wm;
 		brics_3d::rsg::DotGraphGenerator* wm_printer;
 
-		std::ofstream* output;
+		DumpWorker* worker; // Only in background mode.
 		std::string* fileNamePrefix;
 		std::string* directoryName;
 		int counter;
 
+		/* instrumentation */
+		StatsCounter* dumps;
+		StatsCounter* bytes_out;
+		LatencyHistogram* traverse_time;
+		LatencyHistogram* write_time;
+		LatencyHistogram* snapshot_time;
+
+		bool binary_snapshot; // Additionally store a binary snapshot file.
+
         /* this is to have fast access to ports for reading and writing, without
          * needing a hash table lookup */
         struct rsg_dump_port_cache ports;
@@ -71,7 +430,6 @@ int rsg_dump_init(ubx_block_t *b)
     		return -1;
     	}
 
-    	inf->output = new std::ofstream();
     	inf->fileNamePrefix = new std::string("rsg_dump");
 
 		/* retrive optional dot file prefix from config */
@@ -104,6 +462,34 @@ int rsg_dump_init(ubx_block_t *b)
 
     	inf->counter = 0;
 
+    	BlockStats* stats = BlockStats::get(b->name);
+    	inf->dumps = stats->getCounter("dumps");
+    	inf->bytes_out = stats->getCounter("bytes_out");
+    	inf->traverse_time = stats->getHistogram("traverse");
+    	inf->write_time = stats->getHistogram("write");
+    	inf->snapshot_time = stats->getHistogram("snapshot");
+
+		/* retrive optional binary snapshot mode from config */
+    	int* binary_snapshot = (int*) ubx_config_get_data_ptr(b, "binary_snapshot", &clen);
+    	if(clen == 0) {
+    		LOG(INFO) << "rsg_dump: No binary_snapshot configuration given. Turned off by default.";
+    		inf->binary_snapshot = false;
+    	} else {
+    		inf->binary_snapshot = (*binary_snapshot == 1);
+    		LOG(INFO) << "rsg_dump: binary_snapshot turned " << (inf->binary_snapshot ? "on." : "off.");
+    	}
+
+		/* retrive optional background mode from config */
+    	int* background = (int*) ubx_config_get_data_ptr(b, "background", &clen);
+    	if(clen == 0) {
+    		LOG(INFO) << "rsg_dump: No background configuration given. Dumps are generated synchronously by default.";
+    	} else if (*background == 1) {
+    		LOG(INFO) << "rsg_dump: background mode turned on.";
+    		inf->worker = new DumpWorker(stats, inf->binary_snapshot, JournalCursor::get(inf->wm));
+    	} else {
+    		LOG(INFO) << "rsg_dump: background mode turned off.";
+    	}
+
         return 0;
 }
 
@@ -137,9 +523,9 @@ void rsg_dump_cleanup(ubx_block_t *b)
 			delete inf->directoryName;
 			inf->directoryName = 0;
 		}
-		if(inf->output) {
-			delete inf->output;
-			inf->output = 0;
+		if(inf->worker) {
+			delete inf->worker;
+			inf->worker = 0;
 		}
 		free(b->private_data);
 }
@@ -176,28 +562,47 @@ void rsg_dump_step(ubx_block_t *b)
 		fileName = *inf->directoryName + *inf->fileNamePrefix + "_" + tmpFileName.str();
 		LOG(INFO) << "rsg_dump: Printing graph to file " << fileName;
 
-		/* Save a complete snapshopt relative to the root node */
-		wm->scene.executeGraphTraverser(inf->wm_printer, wm->scene.getRootId());
-		bool printRemoteRootNodes = true;
-		if(printRemoteRootNodes) {
-			vector<brics_3d::rsg::Id> remoteRootNodeIds;
-			wm->scene.getRemoteRootNodes(remoteRootNodeIds);
-			for(vector<brics_3d::rsg::Id>::const_iterator it = remoteRootNodeIds.begin(); it != remoteRootNodeIds.end(); ++it) {
-				wm->scene.executeGraphTraverser(inf->wm_printer, *it);
+		/* Only copy the graph here, the worker prints it */
+		if(inf->worker) {
+			DumpSnapshot* snapshot;
+			{
+				ScopedLatency latency(inf->snapshot_time);
+				snapshot = take_snapshot(wm, fileName);
 			}
+			inf->worker->enqueue(snapshot);
+			inf->counter++;
+			inf->dumps->add();
+			LOG(INFO) << "rsg_dump: Snapshot taken. The file will be written in the background.";
+			return;
 		}
 
-		inf->output->open((fileName + ".gv").c_str(), std::ios::trunc);
-		if (!inf->output->fail()) {
-			*inf->output << inf->wm_printer->getDotGraph();
-		} else {
-			LOG(ERROR) << "DotVisualizer: Cannot write to file " << fileName << ".gv";
+		/* Save a complete snapshopt relative to the root node and all remote root nodes */
+		{
+			WorldModelReadLock readLock(wm);
+			vector<brics_3d::rsg::Id> rootIds;
+			wm->scene.getRemoteRootNodes(rootIds);
+			rootIds.insert(rootIds.begin(), wm->scene.getRootId());
+			{
+				ScopedLatency latency(inf->traverse_time);
+				for(vector<brics_3d::rsg::Id>::const_iterator it = rootIds.begin(); it != rootIds.end(); ++it) {
+					wm->scene.executeGraphTraverser(inf->wm_printer, *it);
+				}
+			}
+			{
+				ScopedLatency latency(inf->write_time);
+				write_dot_file(fileName, inf->wm_printer->getDotGraph(), inf->bytes_out);
+			}
+			if(inf->binary_snapshot) {
+				ScopedLatency latency(inf->write_time);
+				JournalCursor* cursor = JournalCursor::get(wm);
+				JournalPosition journalPosition;
+				bool hasJournalPosition = cursor->getPosition(journalPosition);
+				write_binary_snapshot(&wm->scene, rootIds, fileName, cursor, hasJournalPosition ? &journalPosition : 0, inf->bytes_out);
+			}
 		}
-
-		inf->output->flush();
-		inf->output->close();
 		inf->wm_printer->reset();
 		inf->counter++;
+		inf->dumps->add();
 
 		LOG(INFO) << "rsg_dump: Done.";
 }
@@ -20,6 +20,10 @@ char rsg_dump_meta[] =
 ubx_config_t rsg_dump_config[] = {
         { .name="wm_handle", .type_name = "struct rsg_wm_handle", .doc="Handle to the world wodel instance. This parameter is mandatory." },
         { .name="dot_name_prefix", .type_name = "char" , .doc="Optional prefix for stored dot files." },
+        { .name="binary_snapshot", .type_name = "int" , .doc="If set to 1 a binary snapshot (.rsgs) is stored next to every dot file. It can be restored with the rsg_scene_setup block. Transforms are stored without their history. Default is 0." },
+        { .name="background", .type_name = "int" , .doc="If set to 1 a step only copies the world model. The dot file is generated and written by a background thread, so updates are not blocked while the file is written. "
+        		"The copy itself still blocks updates for a time that grows with the size of the graph. The dot file is streamed with a simpler format than the default DotGraphGenerator output. "
+        		"A dump that is still waiting when the next one is taken is skipped. Default is 0." },
         { NULL },
 };
 
@@ -0,0 +1,385 @@
+#include "rsg_journal.h"
+
+#include <brics_3d/core/Logger.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+
+#include "rsg_snapshot.h"
+
+namespace brics_3d {
+namespace rsg {
+
+/*
+ * CRC-32 (IEEE 802.3) to detect records that were only partially written.
+ */
+
+static uint32_t crcTable[256];
+
+static struct CrcTableInitializer {
+	CrcTableInitializer() {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit) {
+				crc = (crc & 1) ? (0xEDB88320 ^ (crc >> 1)) : (crc >> 1);
+			}
+			crcTable[i] = crc;
+		}
+	}
+} crcTableInitializer;
+
+static uint32_t crc32(const char* data, size_t length) {
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < length; ++i) {
+		crc = crcTable[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+
+static bool write_all(int fd, const char* data, size_t length) {
+	while(length > 0) {
+		ssize_t written = ::write(fd, data, length);
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+/*
+ * Writer
+ */
+
+JournalWriter::JournalWriter(const std::string& prefix, Id rootId, JournalCursor* cursor, uint64_t segmentSize, uint32_t syncPeriod) :
+		prefix(prefix), rootId(rootId), cursor(cursor), segmentSize(segmentSize), syncPeriod(syncPeriod), fd(-1), segmentNumber(0), appendedToSegment(0),
+		firstSegment(0), pendingBytes(0), stopRequested(false), failed(false), syncThread(0), bytesCounter(0), recordsCounter(0), syncLatency(0) {
+
+}
+
+JournalWriter::~JournalWriter() {
+	stop();
+}
+
+bool JournalWriter::openSegment() {
+	std::string fileName = JournalReplayer::getSegmentFileName(prefix, segmentNumber);
+	fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+	if(fd < 0) {
+		LOG(ERROR) << "JournalWriter: Cannot create segment " << fileName << ": " << strerror(errno);
+		return false;
+	}
+
+	char header[RSG_JOURNAL_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header, RSG_JOURNAL_MAGIC, strlen(RSG_JOURNAL_MAGIC));
+	uint32_t version = RSG_JOURNAL_VERSION;
+	memcpy(header + RSG_JOURNAL_MAGIC_SIZE, &version, sizeof(version));
+	memcpy(header + RSG_JOURNAL_MAGIC_SIZE + 8, &(*rootId.begin()), 16);
+	if(!write_all(fd, header, sizeof(header))) {
+		LOG(ERROR) << "JournalWriter: Cannot write to segment " << fileName << ": " << strerror(errno);
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	LOG(INFO) << "JournalWriter: Started segment " << fileName;
+	return true;
+}
+
+bool JournalWriter::start() {
+	std::vector<uint32_t> segments;
+	JournalReplayer::listSegments(prefix, segments);
+	segmentNumber = segments.empty() ? 0 : segments.back() + 1;
+	firstSegment = segments.empty() ? segmentNumber : segments.front();
+	if(!openSegment()) {
+		failed = true;
+		return false;
+	}
+	appendedToSegment = RSG_JOURNAL_HEADER_SIZE;
+	nextPosition = JournalPosition(segmentNumber, 0);
+	cursor->setPosition(nextPosition);
+	stopRequested = false;
+	syncThread = new std::thread(&JournalWriter::syncLoop, this);
+	return true;
+}
+
+void JournalWriter::stop() {
+	cursor->invalidate();
+	if(syncThread) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopRequested = true;
+		}
+		syncCondition.notify_all();
+		syncThread->join();
+		delete syncThread;
+		syncThread = 0;
+	}
+	if(fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+int JournalWriter::write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+	transferredBytes = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	spaceCondition.wait(lock, [this]{ return (pendingBytes < RSG_JOURNAL_MAX_PENDING) || stopRequested || failed; });
+	if(failed || (syncThread == 0)) {
+		return -1;
+	}
+
+	if(pending.empty() || pending.back().closesSegment) {
+		pending.push_back(Batch());
+	}
+	std::vector<char>& data = pending.back().data;
+	uint32_t length = dataLength;
+	uint32_t checksum = crc32(dataBuffer, dataLength);
+	data.insert(data.end(), reinterpret_cast<const char*>(&length), reinterpret_cast<const char*>(&length) + sizeof(length));
+	data.insert(data.end(), reinterpret_cast<const char*>(&checksum), reinterpret_cast<const char*>(&checksum) + sizeof(checksum));
+	data.insert(data.end(), dataBuffer, dataBuffer + dataLength);
+
+	uint64_t recordSize = RSG_JOURNAL_RECORD_HEADER_SIZE + dataLength;
+	pendingBytes += recordSize;
+	appendedToSegment += recordSize;
+	nextPosition.record++;
+	if(appendedToSegment >= segmentSize) {
+		pending.back().closesSegment = true;
+		appendedToSegment = RSG_JOURNAL_HEADER_SIZE;
+		nextPosition = JournalPosition(nextPosition.segment + 1, 0);
+	}
+	cursor->setPosition(nextPosition);
+	transferredBytes = dataLength;
+	if(recordsCounter) {
+		recordsCounter->add();
+	}
+	return 0;
+}
+
+void JournalWriter::syncLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true) {
+		syncCondition.wait_for(lock, std::chrono::milliseconds(syncPeriod), [this]{ return stopRequested; });
+		bool stopping = stopRequested;
+		std::deque<Batch> batches;
+		batches.swap(pending);
+		uint64_t bytes = pendingBytes;
+		pendingBytes = 0;
+		lock.unlock();
+		spaceCondition.notify_all();
+
+		if(!batches.empty()) {
+			flush(batches);
+			if(bytesCounter) {
+				bytesCounter->add(bytes);
+			}
+		}
+		deleteCoveredSegments();
+
+		lock.lock();
+		if(stopping && pending.empty()) {
+			break;
+		}
+	}
+}
+
+void JournalWriter::flush(std::deque<Batch>& batches) {
+	bool success = (fd >= 0);
+	for (std::deque<Batch>::iterator it = batches.begin(); success && (it != batches.end()); ++it) {
+		success = write_all(fd, &it->data[0], it->data.size());
+		if(success && it->closesSegment) {
+			success = (fdatasync(fd) == 0);
+			close(fd);
+			fd = -1;
+			segmentNumber++;
+			success = success && openSegment();
+		}
+	}
+
+	if(success) {
+		ScopedLatency latency(syncLatency);
+		success = (fdatasync(fd) == 0);
+	}
+
+	if(!success) {
+		LOG(ERROR) << "JournalWriter: Writing segment " << JournalReplayer::getSegmentFileName(prefix, segmentNumber)
+				<< " failed: " << strerror(errno) << ". Journaling is stopped.";
+		std::lock_guard<std::mutex> lock(mutex);
+		failed = true;
+		cursor->invalidate(); // Snapshots must not refer to records that are not written.
+		spaceCondition.notify_all();
+	}
+}
+
+void JournalWriter::deleteCoveredSegments() {
+	JournalPosition covered;
+	if(!cursor->getCovered(covered) || (covered.segment <= firstSegment)) {
+		return;
+	}
+	uint32_t end = std::min(covered.segment, segmentNumber); // Never the open segment.
+	for (; firstSegment < end; ++firstSegment) {
+		std::string fileName = JournalReplayer::getSegmentFileName(prefix, firstSegment);
+		if((unlink(fileName.c_str()) != 0) && (errno != ENOENT)) {
+			LOG(WARNING) << "JournalWriter: Cannot delete segment " << fileName << ": " << strerror(errno);
+		} else {
+			LOG(INFO) << "JournalWriter: Deleted segment " << fileName << ". It is covered by a snapshot.";
+		}
+	}
+}
+
+/*
+ * Replayer
+ */
+
+std::string JournalReplayer::getSegmentFileName(const std::string& prefix, uint32_t segmentNumber) {
+	char number[16];
+	snprintf(number, sizeof(number), ".%06u", segmentNumber);
+	return prefix + number + RSG_JOURNAL_FILE_SUFFIX;
+}
+
+void JournalReplayer::listSegments(const std::string& prefix, std::vector<uint32_t>& segmentNumbers) {
+	segmentNumbers.clear();
+	size_t separator = prefix.rfind('/');
+	std::string directoryName = (separator == std::string::npos) ? "." : prefix.substr(0, separator + 1);
+	std::string baseName = ((separator == std::string::npos) ? prefix : prefix.substr(separator + 1)) + ".";
+	std::string suffix(RSG_JOURNAL_FILE_SUFFIX);
+
+	DIR* directory = opendir(directoryName.c_str());
+	if(directory == 0) {
+		return;
+	}
+	struct dirent* entry;
+	while((entry = readdir(directory)) != 0) {
+		std::string name(entry->d_name);
+		if((name.size() <= baseName.size() + suffix.size()) || (name.compare(0, baseName.size(), baseName) != 0) ||
+				(name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)) {
+			continue;
+		}
+		std::string number = name.substr(baseName.size(), name.size() - baseName.size() - suffix.size());
+		if(number.find_first_not_of("0123456789") != std::string::npos) {
+			continue;
+		}
+		segmentNumbers.push_back(strtoul(number.c_str(), 0, 10));
+	}
+	closedir(directory);
+	std::sort(segmentNumbers.begin(), segmentNumbers.end());
+}
+
+bool JournalReplayer::replay(WorldModel* wm, const std::string& prefix, const std::string& snapshotFile, uint64_t& records) {
+	records = 0;
+	JournalPosition position;
+	bool hasPosition = false;
+	if(!snapshotFile.empty()) {
+		uint64_t snapshotRecords;
+		if(!SnapshotLoader::load(wm, snapshotFile, snapshotRecords, position, hasPosition)) {
+			return false;
+		}
+		if(!hasPosition) {
+			LOG(WARNING) << "JournalReplayer: Snapshot " << snapshotFile << " has no journal position. All segments are replayed.";
+		}
+	}
+
+	std::vector<uint32_t> segments;
+	listSegments(prefix, segments);
+	if(hasPosition && !segments.empty() && (segments.front() > position.segment)) {
+		LOG(ERROR) << "JournalReplayer: The snapshot ends in segment " << position.segment << " but the journal " << prefix
+				<< " starts with segment " << segments.front() << ". The updates in between are lost. Is this the newest snapshot?";
+	}
+	unsigned int skipped = 0;
+	for (std::vector<uint32_t>::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+		if(hasPosition && (*it < position.segment)) {
+			skipped++; // Everything in this segment is part of the snapshot.
+			continue;
+		}
+		uint64_t skipRecords = (hasPosition && (*it == position.segment)) ? position.record : 0;
+		replaySegment(wm, getSegmentFileName(prefix, *it), skipRecords, records);
+	}
+
+	LOG(INFO) << "JournalReplayer: Replayed " << records << " records from " << segments.size() - skipped << " segments of " << prefix
+			<< ". " << skipped << " segments are part of the snapshot.";
+	return true;
+}
+
+bool JournalReplayer::replaySegment(WorldModel* wm, const std::string& fileName, uint64_t skipRecords, uint64_t& records) {
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if(fd < 0) {
+		LOG(ERROR) << "JournalReplayer: Cannot open segment " << fileName;
+		return false;
+	}
+	struct stat fileStatus;
+	if((fstat(fd, &fileStatus) != 0) || (fileStatus.st_size < RSG_JOURNAL_HEADER_SIZE)) {
+		LOG(WARNING) << "JournalReplayer: Segment " << fileName << " has no header.";
+		close(fd);
+		return false;
+	}
+	size_t size = fileStatus.st_size;
+	void* mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED) {
+		LOG(ERROR) << "JournalReplayer: Cannot map segment " << fileName;
+		return false;
+	}
+	madvise(mapping, size, MADV_SEQUENTIAL);
+
+	const char* data = static_cast<const char*>(mapping);
+	uint32_t version;
+	memcpy(&version, data + RSG_JOURNAL_MAGIC_SIZE, sizeof(version));
+	if((memcmp(data, RSG_JOURNAL_MAGIC, strlen(RSG_JOURNAL_MAGIC)) != 0) || (version != RSG_JOURNAL_VERSION)) {
+		LOG(ERROR) << "JournalReplayer: " << fileName << " is not a journal segment of version " << RSG_JOURNAL_VERSION << ".";
+		munmap(mapping, size);
+		return false;
+	}
+	Id journalRootId;
+	memcpy(&(*journalRootId.begin()), data + RSG_JOURNAL_MAGIC_SIZE + 8, 16);
+
+	BinaryUpdateDeserializer deserializer(wm);
+	deserializer.setIdMapping(journalRootId, wm->getRootNodeId());
+
+	const char* cursor = data + RSG_JOURNAL_HEADER_SIZE;
+	const char* end = data + size;
+	bool complete = true;
+	while(cursor < end) {
+		uint32_t length;
+		uint32_t checksum;
+		if(end - cursor < RSG_JOURNAL_RECORD_HEADER_SIZE) {
+			complete = false;
+			break;
+		}
+		memcpy(&length, cursor, sizeof(length));
+		memcpy(&checksum, cursor + sizeof(length), sizeof(checksum));
+		cursor += RSG_JOURNAL_RECORD_HEADER_SIZE;
+		if((static_cast<uint64_t>(end - cursor) < length) || (crc32(cursor, length) != checksum)) {
+			complete = false;
+			break;
+		}
+		if(skipRecords > 0) { // Part of the snapshot.
+			skipRecords--;
+		} else {
+			int transferredBytes = 0;
+			deserializer.write(cursor, length, transferredBytes);
+			records++;
+		}
+		cursor += length;
+	}
+	munmap(mapping, size);
+
+	if(!complete) {
+		LOG(WARNING) << "JournalReplayer: Segment " << fileName << " ends with an incomplete record. The rest of the segment is ignored.";
+	}
+	return complete;
+}
+
+} // namespace rsg
+} // namespace brics_3d
@@ -0,0 +1,164 @@
+/*
+ * Write-ahead journal of all updates that are applied to a world model.
+ *
+ * The journal is a sequence of segment files <prefix>.<number>.rsgj. Every
+ * segment has the layout:
+ *
+ *   magic (8 bytes "RSGJRNL\0") | version (uint32) | reserved (uint32) |
+ *   root id (16 bytes) |
+ *   records: length (uint32) | crc32 of the message (uint32) | binary update message
+ *
+ * Messages use the binary wire format (see rsg_binary_codec.h). Appending a
+ * record only copies it into a memory buffer. A background thread writes the
+ * buffer and calls fdatasync once per sync period, so many records share one
+ * sync (group commit). At most one sync period of updates is lost on a crash.
+ *
+ * Every record has a position: the segment number and its index within the
+ * segment. The writer publishes the position of the next record via the
+ * JournalCursor of the world model, so a binary snapshot (see rsg_snapshot.h)
+ * stores the position of the first record it does not contain. Once such a
+ * snapshot is stored, the writer deletes all segments before the one of that
+ * position. So recovery has to use the newest snapshot.
+ *
+ * For recovery the snapshot is loaded and the journal is replayed strictly from
+ * the position of the snapshot. A record that was only partially written before
+ * a crash fails its checksum and ends the replay of its segment.
+ */
+
+#ifndef RSG_JOURNAL_H_
+#define RSG_JOURNAL_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/IOutputPort.h>
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rsg_binary_codec.h"
+#include "rsg_journal_position.h"
+#include "rsg_stats.h"
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_JOURNAL_MAGIC "RSGJRNL"
+#define RSG_JOURNAL_MAGIC_SIZE 8
+#define RSG_JOURNAL_VERSION 1
+#define RSG_JOURNAL_HEADER_SIZE (RSG_JOURNAL_MAGIC_SIZE + 4 + 4 + 16)
+#define RSG_JOURNAL_RECORD_HEADER_SIZE 8
+#define RSG_JOURNAL_FILE_SUFFIX ".rsgj"
+#define RSG_JOURNAL_MAX_PENDING (16 * 1024 * 1024) // [bytes] Appending waits if more data is not yet written.
+
+/**
+ * Appends binary update messages to the journal. Used as output port of a
+ * BinaryUpdateSerializer that observes the scene graph.
+ */
+class JournalWriter : public IOutputPort {
+public:
+
+	/**
+	 * @param prefix Path and file name prefix of the segments.
+	 * @param rootId Root id of the journaled world model.
+	 * @param cursor Cursor of the journaled world model, cf. JournalCursor::get().
+	 * @param segmentSize A new segment is started once a segment exceeds this size in bytes.
+	 * @param syncPeriod Maximum time in [ms] between appending a record and its fdatasync.
+	 */
+	JournalWriter(const std::string& prefix, Id rootId, JournalCursor* cursor, uint64_t segmentSize, uint32_t syncPeriod);
+	virtual ~JournalWriter();
+
+	/**
+	 * Opens a new segment after all existing ones and starts the sync thread.
+	 * @return False if the segment cannot be created.
+	 */
+	bool start();
+
+	/// Writes and syncs all pending records and stops the sync thread.
+	void stop();
+
+	void setStats(StatsCounter* bytes, StatsCounter* records, LatencyHistogram* syncLatency) {
+		this->bytesCounter = bytes;
+		this->recordsCounter = records;
+		this->syncLatency = syncLatency;
+	}
+
+	/// Appends one record. Thread safe.
+	int write(const char *dataBuffer, int dataLength, int &transferredBytes);
+
+private:
+
+	/// Records that end in the same segment.
+	struct Batch {
+		Batch() : closesSegment(false) {};
+		std::vector<char> data;
+		bool closesSegment;
+	};
+
+	bool openSegment();
+	void syncLoop();
+	void flush(std::deque<Batch>& batches);
+
+	/// Deletes the segments that are covered by the newest snapshot. Called by the sync thread.
+	void deleteCoveredSegments();
+
+	std::string prefix;
+	Id rootId;
+	JournalCursor* cursor;
+	uint64_t segmentSize;
+	uint32_t syncPeriod;
+
+	int fd;
+	uint32_t segmentNumber;
+	uint64_t appendedToSegment; // Bytes of the current segment including pending ones.
+	JournalPosition nextPosition; // Of the next appended record.
+	uint32_t firstSegment; // Segments before this one have been deleted.
+
+	std::mutex mutex;
+	std::condition_variable syncCondition;    // Wakes up the sync thread.
+	std::condition_variable spaceCondition;   // Wakes up writers that wait for space.
+	std::deque<Batch> pending;
+	uint64_t pendingBytes;
+	bool stopRequested;
+	bool failed;
+	std::thread* syncThread;
+
+	StatsCounter* bytesCounter;
+	StatsCounter* recordsCounter;
+	LatencyHistogram* syncLatency;
+};
+
+class JournalReplayer {
+public:
+
+	/**
+	 * Restores a world model from a snapshot and the journal.
+	 * @param wm World model to be restored. The caller has to prevent concurrent updates.
+	 * @param prefix Path and file name prefix of the journal segments.
+	 * @param snapshotFile Optional snapshot file. If given, it is loaded first and the journal
+	 *        is replayed from the position stored in the snapshot. Empty to replay all segments.
+	 * @param[out] records Number of replayed journal records.
+	 * @return False if the snapshot cannot be loaded. Missing journal segments are no error,
+	 *         but they are reported if records after the snapshot are lost.
+	 */
+	static bool replay(WorldModel* wm, const std::string& prefix, const std::string& snapshotFile, uint64_t& records);
+
+	/**
+	 * Numbers of all existing segments in ascending order.
+	 */
+	static void listSegments(const std::string& prefix, std::vector<uint32_t>& segmentNumbers);
+
+	static std::string getSegmentFileName(const std::string& prefix, uint32_t segmentNumber);
+
+private:
+	/// Replays a segment, except its first skipRecords records.
+	static bool replaySegment(WorldModel* wm, const std::string& fileName, uint64_t skipRecords, uint64_t& records);
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_JOURNAL_H_ */
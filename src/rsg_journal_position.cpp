@@ -0,0 +1,49 @@
+#include "rsg_journal_position.h"
+
+#include <map>
+
+static std::mutex registryMutex;
+static std::map<brics_3d::WorldModel*, JournalCursor*> registry;
+
+JournalCursor* JournalCursor::get(brics_3d::WorldModel* wm) {
+	std::lock_guard<std::mutex> guard(registryMutex);
+	std::map<brics_3d::WorldModel*, JournalCursor*>::iterator it = registry.find(wm);
+	if(it != registry.end()) {
+		return it->second;
+	}
+	JournalCursor* cursor = new JournalCursor();
+	registry.insert(std::make_pair(wm, cursor));
+	return cursor;
+}
+
+void JournalCursor::setPosition(const JournalPosition& position) {
+	std::lock_guard<std::mutex> lock(mutex);
+	this->position = position;
+	valid = true;
+}
+
+void JournalCursor::invalidate() {
+	std::lock_guard<std::mutex> lock(mutex);
+	valid = false;
+}
+
+bool JournalCursor::getPosition(JournalPosition& position) {
+	std::lock_guard<std::mutex> lock(mutex);
+	position = this->position;
+	return valid;
+}
+
+void JournalCursor::setCovered(const JournalPosition& position) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if(!hasCovered || (position.segment > covered.segment) ||
+			((position.segment == covered.segment) && (position.record > covered.record))) {
+		covered = position;
+	}
+	hasCovered = true;
+}
+
+bool JournalCursor::getCovered(JournalPosition& position) {
+	std::lock_guard<std::mutex> lock(mutex);
+	position = covered;
+	return hasCovered;
+}
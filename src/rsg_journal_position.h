@@ -0,0 +1,72 @@
+/*
+ * Position in the write-ahead journal of a world model (see rsg_journal.h).
+ *
+ * The journal writer publishes the position of its next record for every
+ * world model, so other blocks that share the world model (e.g. rsg_dump) can
+ * tag a snapshot with the exact journal position it corresponds to. They
+ * report stored snapshots back, so the journal writer can delete the segments
+ * that a snapshot covers.
+ */
+
+#ifndef RSG_JOURNAL_POSITION_H_
+#define RSG_JOURNAL_POSITION_H_
+
+#include <stdint.h>
+#include <mutex>
+
+#ifndef RSG_COMMON_API
+#define RSG_COMMON_API __attribute__ ((visibility("default")))
+#endif
+
+namespace brics_3d {
+	class WorldModel;
+}
+
+/**
+ * A record in the journal: the segment number and the index of the record within that segment.
+ */
+struct JournalPosition {
+	JournalPosition() : segment(0), record(0) {};
+	JournalPosition(uint32_t segment, uint64_t record) : segment(segment), record(record) {};
+	uint32_t segment;
+	uint64_t record;
+};
+
+class RSG_COMMON_API JournalCursor {
+public:
+
+	/**
+	 * Gets the cursor for a world model. It is created on first use and lives as long as the process.
+	 */
+	static JournalCursor* get(brics_3d::WorldModel* wm);
+
+	/// Position of the next record that will be appended. Set by the journal writer.
+	void setPosition(const JournalPosition& position);
+
+	/// No journal is written (any more), e.g. because it has been stopped or failed.
+	void invalidate();
+
+	/**
+	 * Gets the position of the next record. Has to be called with the world model lock
+	 * held, so it matches the state of the graph.
+	 * @return False if no journal is written.
+	 */
+	bool getPosition(JournalPosition& position);
+
+	/// A snapshot that corresponds to the given position has been stored durably.
+	void setCovered(const JournalPosition& position);
+
+	/// @return False if no snapshot has been reported yet.
+	bool getCovered(JournalPosition& position);
+
+private:
+	JournalCursor() : valid(false), hasCovered(false) {};
+
+	std::mutex mutex;
+	bool valid;
+	JournalPosition position;
+	bool hasCovered;
+	JournalPosition covered;
+};
+
+#endif /* RSG_JOURNAL_POSITION_H_ */
@@ -11,6 +11,28 @@
 #include <brics_3d/worldModel/sceneGraph/UpdatesToSceneGraphListener.h>
 #include <brics_3d/worldModel/sceneGraph/GraphConstraintUpdateFilter.h>
 
+#include <ctype.h>
+#include <stdio.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "rsg_world_model_lock.h"
+#include "rsg_attribute_index.h"
+#include "rsg_spatial_index.h"
+#include "rsg_transform_cache.h"
+#include "rsg_pose_history.h"
+#include "rsg_query_cache.h"
+#include "rsg_subscriptions.h"
+#include "rsg_stats.h"
+#include "rsg_log.h"
+
+/* libvariant is used by the JSONQueryRunner as well */
+#include <Variant/Variant.h>
 
 using namespace brics_3d;
 using brics_3d::Logger;
@@ -19,6 +41,95 @@ using brics_3d::Logger;
 UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
 
 #define DEFAULT_BUFFER_SIZE 20000
+#define DEFAULT_TRANSFORM_CACHE_RESOLUTION 100.0f // [ms]
+#define DEFAULT_POSE_HISTORY_DURATION 600.0f // [s]
+#define RSG_MIN_CHUNK_DATA_SIZE 64 // [bytes] per RSGQueryResultChunk
+
+struct rsg_json_query_info;
+static void write_result(struct rsg_json_query_info *inf, const std::string& query, std::string& result);
+static void run_query(struct rsg_json_query_info *inf, brics_3d::rsg::JSONQueryRunner* runner, std::string& query, std::string& result);
+
+/**
+ * Pool of worker threads that process read-only queries (RSGQuery) in parallel.
+ * Every worker has its own query runner and holds the shared world model lock
+ * while processing a query. Results are written as soon as they are available,
+ * so they can leave in a different order than the queries arrived. Clients
+ * correlate them via the queryId.
+ */
+class QueryWorkerPool {
+public:
+	QueryWorkerPool(struct rsg_json_query_info *inf, brics_3d::WorldModel* wm, unsigned int numberOfWorkers) : inf(inf), wm(wm), stopRequested(false) {
+		for (unsigned int i = 0; i < numberOfWorkers; ++i) {
+			runners.push_back(new brics_3d::rsg::JSONQueryRunner(wm));
+		}
+		for (unsigned int i = 0; i < numberOfWorkers; ++i) {
+			workers.push_back(new std::thread(&QueryWorkerPool::run, this, runners[i]));
+		}
+	};
+
+	virtual ~QueryWorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopRequested = true;
+		}
+		condition.notify_all();
+		for (unsigned int i = 0; i < workers.size(); ++i) {
+			workers[i]->join();
+			delete workers[i];
+			delete runners[i];
+		}
+	};
+
+	void enqueue(const std::string& query) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pendingQueries.push_back(query);
+		}
+		condition.notify_one();
+	}
+
+	size_t getPendingCount() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return pendingQueries.size();
+	}
+
+private:
+
+	void run(brics_3d::rsg::JSONQueryRunner* runner) {
+		std::string query;
+		std::string result;
+		while(true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while(pendingQueries.empty() && !stopRequested) {
+					condition.wait(lock);
+				}
+				if(stopRequested) {
+					return;
+				}
+				query.swap(pendingQueries.front());
+				pendingQueries.pop_front();
+			}
+
+			result.clear();
+			{
+				WorldModelReadLock readLock(wm);
+				run_query(inf, runner, query, result);
+			}
+			write_result(inf, query, result);
+		}
+	}
+
+	struct rsg_json_query_info *inf;
+	brics_3d::WorldModel* wm;
+	std::vector<brics_3d::rsg::JSONQueryRunner*> runners;
+	std::vector<std::thread*> workers;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<std::string> pendingQueries;
+	bool stopRequested;
+};
 
 /* define a structure for holding the block local state. By assigning ano
  * instance of this struct to the block private_data pointer (see init), this
@@ -46,6 +157,24 @@ struct rsg_json_query_info
         										 * message.
          	 	 	 	 	 	 	 	 	 	 */
 
+        uint32_t num_workers;                   /* Number of threads for read-only queries. 0 means all queries are processed within step. */
+        QueryWorkerPool* worker_pool;
+        std::mutex* result_mutex;               /* Serializes writes to the rsg_result port. */
+        brics_3d::rsg::AttributeIndex* attribute_index; /* Answers GET_NODES queries without a graph scan. 0 if disabled. */
+        brics_3d::rsg::SpatialIndex* spatial_index; /* Answers GET_NODES_IN_BOUNDING_BOX and GET_NODES_IN_RADIUS queries. 0 if disabled. */
+        brics_3d::rsg::TransformCache* transform_cache; /* Answers repeated GET_TRANSFORM queries. 0 if disabled. */
+        brics_3d::rsg::PoseHistory* pose_history; /* Answers GET_INTERPOLATED_TRANSFORM and GET_TRANSFORM_HISTORY queries. 0 if disabled. */
+        brics_3d::rsg::QueryCache* query_cache; /* Results of repeated queries. 0 if disabled. */
+        brics_3d::rsg::SubscriptionManager* subscriptions; /* Continuous queries whose updates are pushed via rsg_events. 0 if disabled. */
+
+        /* instrumentation */
+        StatsCounter* messages_in;
+        StatsCounter* bytes_in;
+        StatsCounter* messages_out;
+        StatsCounter* bytes_out;
+        StatsCounter* queue_depth;
+        LatencyHistogram* query_time;
+        BlockLogger* logger;                    /* Level of the RSG_LOG messages. */
 };
 
 /* init */
@@ -65,6 +194,7 @@ int rsg_json_query_init(ubx_block_t *b)
         }
         b->private_data=inf;
         update_port_cache(b, &inf->ports);
+        inf->logger = new BlockLogger();
 
        	unsigned int clen;
         rsg_wm_handle tmpWmHandle =  *((rsg_wm_handle*) ubx_config_get_data_ptr(b, "wm_handle", &clen));
@@ -97,6 +227,46 @@ int rsg_json_query_init(ubx_block_t *b)
 //        inf->wm_query_runner = new brics_3d::rsg::JSONQueryRunner(inf->wm); // without filter for updates
         inf->wm_query_runner = new brics_3d::rsg::JSONQueryRunner(inf->wm, inf->constraint_filter); // with filter for updates
 
+        /* Setup attribute index for GET_NODES queries */
+        int* attribute_index = (int*) ubx_config_get_data_ptr(b, "attribute_index", &clen);
+        if((clen != 0) && (*attribute_index != 0)) {
+        	LOG(INFO) << "rsg_json_query: Using an attribute index for GET_NODES queries.";
+        	inf->attribute_index = new brics_3d::rsg::AttributeIndex();
+        	inf->attribute_index->rebuild(&inf->wm->scene); // nodes that have been created before this block
+        	inf->wm->scene.attachUpdateObserver(inf->attribute_index);
+        } else {
+        	LOG(INFO) << "rsg_json_query: attribute_index disabled.";
+        }
+
+        /* Setup spatial index for GET_NODES_IN_BOUNDING_BOX and GET_NODES_IN_RADIUS queries */
+        int* spatial_index = (int*) ubx_config_get_data_ptr(b, "spatial_index", &clen);
+        if((clen != 0) && (*spatial_index != 0)) {
+        	LOG(INFO) << "rsg_json_query: Using a spatial index for GET_NODES_IN_BOUNDING_BOX and GET_NODES_IN_RADIUS queries.";
+        	inf->spatial_index = new brics_3d::rsg::SpatialIndex(&inf->wm->scene, inf->wm->getRootNodeId());
+        	inf->spatial_index->rebuild(inf->wm->now()); // nodes that have been created before this block
+        	inf->wm->scene.attachUpdateObserver(inf->spatial_index);
+        } else {
+        	LOG(INFO) << "rsg_json_query: spatial_index disabled.";
+        }
+
+        /* Setup pose history for GET_INTERPOLATED_TRANSFORM and GET_TRANSFORM_HISTORY queries */
+        uint32_t history_capacity = 0;
+        uint32_t* pose_history_capacity = (uint32_t*) ubx_config_get_data_ptr(b, "pose_history_capacity", &clen);
+        if(clen != 0) {
+        	history_capacity = *pose_history_capacity;
+        }
+        float history_duration = DEFAULT_POSE_HISTORY_DURATION;
+        float* pose_history_duration = (float*) ubx_config_get_data_ptr(b, "pose_history_duration", &clen);
+        if((clen != 0) && (*pose_history_duration > 0)) {
+        	history_duration = *pose_history_duration;
+        }
+        if(history_capacity > 0) {
+        	LOG(INFO) << "rsg_json_query: Using a pose history of " << history_capacity << " samples or " << history_duration << " s per Transform.";
+        	inf->pose_history = new brics_3d::rsg::PoseHistory(&inf->wm->scene, history_capacity, history_duration * 1000.0);
+        	inf->wm->scene.attachUpdateObserver(inf->pose_history);
+        } else {
+        	LOG(INFO) << "rsg_json_query: pose history disabled.";
+        }
 
 
         /* Setup input buffer for JSON messages */
@@ -114,21 +284,81 @@ int rsg_json_query_init(ubx_block_t *b)
           return 0;
         }
 
+        inf->num_workers = 0;
+        uint32_t* num_workers = (uint32_t*) ubx_config_get_data_ptr(b, "num_workers", &clen);
+        if(clen == 0) {
+        	LOG(INFO) << "rsg_json_query: No num_workers configuration given. All queries are processed sequentially.";
+        } else {
+        	inf->num_workers = *num_workers;
+        }
+        LOG(INFO) << "rsg_json_query: num_workers = " << inf->num_workers;
+        inf->result_mutex = new std::mutex();
+
+        BlockStats* stats = BlockStats::get(b->name);
+        inf->messages_in = stats->getCounter("messages_in");
+        inf->bytes_in = stats->getCounter("bytes_in");
+        inf->messages_out = stats->getCounter("messages_out");
+        inf->bytes_out = stats->getCounter("bytes_out");
+        inf->queue_depth = stats->getCounter("queue_depth");
+        inf->query_time = stats->getHistogram("query");
+
+        /* Setup cache for GET_TRANSFORM queries */
+        int* transform_cache = (int*) ubx_config_get_data_ptr(b, "transform_cache", &clen);
+        if((clen != 0) && (*transform_cache != 0)) {
+        	float resolution = DEFAULT_TRANSFORM_CACHE_RESOLUTION;
+        	float* transform_cache_resolution = (float*) ubx_config_get_data_ptr(b, "transform_cache_resolution", &clen);
+        	if((clen != 0) && (*transform_cache_resolution > 0)) {
+        		resolution = *transform_cache_resolution;
+        	}
+        	LOG(INFO) << "rsg_json_query: Using a transform cache for GET_TRANSFORM queries with a resolution of " << resolution << " ms.";
+        	inf->transform_cache = new brics_3d::rsg::TransformCache(&inf->wm->scene, resolution, inf->wm->now(),
+        			stats->getCounter("transform_cache_hits"), stats->getCounter("transform_cache_misses"));
+        	inf->wm->scene.attachUpdateObserver(inf->transform_cache);
+        } else {
+        	LOG(INFO) << "rsg_json_query: transform_cache disabled.";
+        }
+
+        /* Setup cache for the results of repeated queries */
+        int* query_cache = (int*) ubx_config_get_data_ptr(b, "query_cache", &clen);
+        if((clen != 0) && (*query_cache != 0)) {
+        	LOG(INFO) << "rsg_json_query: Using a cache for query results.";
+        	inf->query_cache = new brics_3d::rsg::QueryCache(stats->getCounter("query_cache_hits"), stats->getCounter("query_cache_misses"));
+        	inf->wm->scene.attachUpdateObserver(inf->query_cache);
+        } else {
+        	LOG(INFO) << "rsg_json_query: query_cache disabled.";
+        }
+
+        /* Setup subscriptions last, so the spatial index is up to date when updates are matched */
+        int* subscriptions = (int*) ubx_config_get_data_ptr(b, "subscriptions", &clen);
+        if((clen != 0) && (*subscriptions != 0)) {
+        	LOG(INFO) << "rsg_json_query: Using subscriptions with push delivery via the rsg_events port.";
+        	inf->subscriptions = new brics_3d::rsg::SubscriptionManager(&inf->wm->scene, inf->spatial_index,
+        			stats->getCounter("subscription_updates"), stats->getCounter("subscription_dropped_updates"));
+        	inf->wm->scene.attachUpdateObserver(inf->subscriptions);
+        } else {
+        	LOG(INFO) << "rsg_json_query: subscriptions disabled.";
+        }
+
         return 0;
 }
 
 /* start */
 int rsg_json_query_start(ubx_block_t *b)
 {
-        /* struct rsg_json_query_info *inf = (struct rsg_json_query_info*) b->private_data; */
+        struct rsg_json_query_info *inf = (struct rsg_json_query_info*) b->private_data;
         int ret = 0;
 
+        if(inf->num_workers > 0) {
+        	inf->worker_pool = new QueryWorkerPool(inf, inf->wm, inf->num_workers);
+        }
+
     	/* Set logger level */
     	unsigned int clen;
     	int* log_level =  ((int*) ubx_config_get_data_ptr(b, "log_level", &clen));
     	if(clen == 0) {
     		LOG(INFO) << "rsg_json_query: No log_level configuation given.";
     	} else {
+    		inf->logger->setLevel(*log_level);
     		if (*log_level == 0) {
     			LOG(INFO) << "rsg_json_query: log_level set to DEBUG level.";
     			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
@@ -148,13 +378,20 @@ int rsg_json_query_start(ubx_block_t *b)
     			LOG(INFO) << "rsg_json_query: unknown log_level = " << *log_level;		}
     	}
 
+    	LogBackend::acquire();
+
         return ret;
 }
 
 /* stop */
 void rsg_json_query_stop(ubx_block_t *b)
 {
-        /* struct rsg_json_query_info *inf = (struct rsg_json_query_info*) b->private_data; */
+        struct rsg_json_query_info *inf = (struct rsg_json_query_info*) b->private_data;
+        if(inf->worker_pool != 0) {
+        	delete inf->worker_pool;
+        	inf->worker_pool = 0;
+        }
+        LogBackend::release();
 }
 
 /* cleanup */
@@ -169,79 +406,536 @@ void rsg_json_query_cleanup(ubx_block_t *b)
 			delete inf->wm_updates_to_wm;
 			inf->wm_updates_to_wm = 0;
 		}
+		if(inf->attribute_index != 0){
+			delete inf->attribute_index;
+			inf->attribute_index = 0;
+		}
+		if(inf->spatial_index != 0){
+			delete inf->spatial_index;
+			inf->spatial_index = 0;
+		}
+		if(inf->transform_cache != 0){
+			delete inf->transform_cache;
+			inf->transform_cache = 0;
+		}
+		if(inf->pose_history != 0){
+			delete inf->pose_history;
+			inf->pose_history = 0;
+		}
+		if(inf->query_cache != 0){
+			delete inf->query_cache;
+			inf->query_cache = 0;
+		}
+		if(inf->subscriptions != 0){
+			delete inf->subscriptions;
+			inf->subscriptions = 0;
+		}
+		if(inf->result_mutex != 0){
+			delete inf->result_mutex;
+			inf->result_mutex = 0;
+		}
         free(inf->input_buffer);
+        if(inf->logger){
+        	delete inf->logger;
+        	inf->logger = 0;
+        }
         free(b->private_data);
 }
 
-/* step */
-void rsg_json_query_step(ubx_block_t *b)
+/**
+ * Extracts the value of the "@worldmodeltype" key without parsing the complete message.
+ */
+static std::string get_world_model_type(const std::string& message)
 {
+	size_t position = message.find("\"@worldmodeltype\"");
+	if(position == std::string::npos) {
+		return "";
+	}
+	position = message.find(':', position);
+	if(position == std::string::npos) {
+		return "";
+	}
+	size_t begin = message.find('"', position);
+	if(begin == std::string::npos) {
+		return "";
+	}
+	size_t end = message.find('"', begin + 1);
+	if(end == std::string::npos) {
+		return "";
+	}
+	return message.substr(begin + 1, end - begin - 1);
+}
 
-        struct rsg_json_query_info *inf = (struct rsg_json_query_info*) b->private_data;
-        //LOG(DEBUG) << "rsg_json_query: Processing an incoming update";
+/**
+ * Answers a GET_STATS query with the statistics of all rsg blocks of this process.
+ * @return False if the query is not a GET_STATS query.
+ */
+static bool run_stats_query(const std::string& query, std::string& result)
+{
+		if(query.find("GET_STATS") == std::string::npos) { // Cheap pre check
+			return false;
+		}
 
-		/*
-		 * read data
-		 */
-		ubx_port_t* port = inf->ports.rsq_query;
-		assert(port != 0);
+		std::string queryId;
+		try {
+			libvariant::Variant message = libvariant::DeserializeJSON(query);
+			if(!message.Contains("query") || (message.Get("query").AsString().compare("GET_STATS") != 0)) {
+				return false;
+			}
+			if(message.Contains("queryId")) {
+				queryId = message.Get("queryId").AsString();
+			}
+		} catch (std::exception const&) {
+			return false; // The JSONQueryRunner will report the error.
+		}
 
-		ubx_data_t msg;
-		checktype(port->block->ni, port->in_type, "unsigned char", port->name, 1);
-		msg.type = port->in_type;
-		msg.len = inf->input_buffer_size;
-		msg.data = (void *)inf->input_buffer;
-		int readBytes = __port_read(port, &msg);
-//		LOG(DEBUG) << "rsg_json_query: Port returned " << readBytes <<
-//                      " bytes, while data message length is " << msg.len <<
-//                      " bytes. Resulting size = " << data_size(&msg);
-
-		const char *dataBuffer = (char *)msg.data;
-		if ((dataBuffer!=0) && (msg.len > 1) && (readBytes > 1)) {
-			LOG(INFO) << "rsg_json_query: Port returned " << readBytes <<
-	                      " bytes, while data message length is " << msg.len <<
-	                      " bytes. Resulting size = " << data_size(&msg);
-
-			std::string query(dataBuffer, readBytes);
-			std::string result;
-			LOG(INFO) << "rsg_json_query: Processing query = " << std::endl << query;
+		std::ostringstream out;
+		out << "{\"@worldmodeltype\": \"RSGQueryResult\",\"query\": \"GET_STATS\",";
+		if(!queryId.empty()) {
+			out << "\"queryId\": \"" << queryId << "\",";
+		}
+		out << "\"querySuccess\": true,\"stats\": ";
+		BlockStats::allToJson(out);
+		out << "}";
+		result = out.str();
+		return true;
+}
 
-			/*
-			 * process query
-			 */
-			inf->wm_query_runner->query(query, result);
+/**
+ * Returns the position after the JSON value that starts at position.
+ * Strings, arrays and objects are skipped as a whole.
+ */
+static size_t skip_json_value(const std::string& json, size_t position)
+{
+		int depth = 0;
+		bool inString = false;
+		for (size_t i = position; i < json.size(); ++i) {
+			char c = json[i];
+			if(inString) {
+				if(c == '\\') {
+					++i;
+				} else if(c == '"') {
+					inString = false;
+					if(depth == 0) {
+						return i + 1;
+					}
+				}
+				continue;
+			}
+			if(c == '"') {
+				inString = true;
+			} else if((c == '[') || (c == '{')) {
+				++depth;
+			} else if((c == ']') || (c == '}')) {
+				if(depth == 0) {
+					return i; // End of the enclosing container.
+				}
+				if(--depth == 0) {
+					return i + 1;
+				}
+			} else if((depth == 0) && ((c == ',') || isspace(c))) {
+				return i;
+			}
+		}
+		return json.size();
+}
 
-			/*
-			 * write data
-			 */
-			LOG(DEBUG) << "rsg_json_query: Reply is = " << std::endl << result;
-			ubx_port_t* result_port = inf->ports.rsg_result;
-			assert(result_port != 0);
+static size_t skip_json_whitespace(const std::string& json, size_t position)
+{
+		while((position < json.size()) && isspace(json[position])) {
+			++position;
+		}
+		return position;
+}
 
-			if(result.size() > inf->input_buffer_size) {
-				LOG(ERROR) << "Result with = " << result.size() << " bytes is larger than max output buffer lenght = "
+/**
+ * Looks up a member of the top level object that is an array.
+ * @param begin Position of the '['.
+ * @param end Position after the ']'.
+ */
+static bool find_json_array(const std::string& json, const std::string& member, size_t& begin, size_t& end)
+{
+		size_t position = skip_json_whitespace(json, 0);
+		if((position >= json.size()) || (json[position] != '{')) {
+			return false;
+		}
+		++position;
+		while(true) {
+			position = skip_json_whitespace(json, position);
+			if((position >= json.size()) || (json[position] != '"')) {
+				return false;
+			}
+			size_t keyEnd = skip_json_value(json, position);
+			std::string key = json.substr(position + 1, keyEnd - position - 2);
+			position = skip_json_whitespace(json, keyEnd);
+			if((position >= json.size()) || (json[position] != ':')) {
+				return false;
+			}
+			position = skip_json_whitespace(json, position + 1);
+			size_t valueEnd = skip_json_value(json, position);
+			if((key.compare(member) == 0) && (position < json.size()) && (json[position] == '[')) {
+				begin = position;
+				end = valueEnd;
+				return true;
+			}
+			position = skip_json_whitespace(json, valueEnd);
+			if((position >= json.size()) || (json[position] != ',')) {
+				return false;
+			}
+			++position;
+		}
+}
+
+/**
+ * Applies "limit" and "offset" of a query to the "ids" or "history" list of its result.
+ * The result gets the members "offset", "limit", "totalCount" and, if there are more
+ * elements, "nextOffset" that is used as offset for the next page.
+ */
+static void page_result(const std::string& query, std::string& result)
+{
+		if(query.find("\"limit\"") == std::string::npos) { // Cheap pre check
+			return;
+		}
+
+		uint64_t limit = 0;
+		uint64_t offset = 0;
+		try {
+			libvariant::Variant message = libvariant::DeserializeJSON(query);
+			if(!message.Contains("limit") || !message.Get("limit").IsNumber()) {
+				return;
+			}
+			limit = message.Get("limit").AsUnsigned();
+			if(message.Contains("offset") && message.Get("offset").IsNumber()) {
+				offset = message.Get("offset").AsUnsigned();
+			}
+		} catch (std::exception const&) {
+			return;
+		}
+		if(limit == 0) {
+			return;
+		}
+
+		size_t begin = 0;
+		size_t end = 0;
+		if(!find_json_array(result, "ids", begin, end) && !find_json_array(result, "history", begin, end)) {
+			return; // Nothing to page.
+		}
+
+		/* Elements of the list */
+		std::vector<std::pair<size_t, size_t> > elements;
+		size_t position = skip_json_whitespace(result, begin + 1);
+		while((position < end) && (result[position] != ']')) {
+			size_t elementEnd = skip_json_value(result, position);
+			elements.push_back(std::make_pair(position, elementEnd));
+			position = skip_json_whitespace(result, elementEnd);
+			if((position < end) && (result[position] == ',')) {
+				position = skip_json_whitespace(result, position + 1);
+			}
+		}
+
+		uint64_t first = std::min<uint64_t>(offset, elements.size());
+		uint64_t last = std::min<uint64_t>(first + limit, elements.size());
+		std::ostringstream page;
+		page << result.substr(0, begin) << "[";
+		for (uint64_t i = first; i < last; ++i) {
+			if(i > first) {
+				page << ",";
+			}
+			page << result.substr(elements[i].first, elements[i].second - elements[i].first);
+		}
+		page << "]";
+		size_t close = result.find_last_of('}');
+		if((close == std::string::npos) || (close < end)) {
+			return;
+		}
+		page << result.substr(end, close - end);
+		page << ",\"offset\": " << offset << ",\"limit\": " << limit << ",\"totalCount\": " << elements.size();
+		if(last < elements.size()) {
+			page << ",\"nextOffset\": " << last;
+		}
+		page << result.substr(close);
+		result = page.str();
+}
+
+/**
+ * Answers a query via the subscriptions, the attribute index, the spatial index, the transform cache or the pose history if possible,
+ * otherwise via the query runner.
+ */
+static void answer_query(struct rsg_json_query_info *inf, brics_3d::rsg::JSONQueryRunner* runner, std::string& query, std::string& result)
+{
+		if((inf->subscriptions != 0) && inf->subscriptions->query(query, result)) {
+			return;
+		}
+		if((inf->attribute_index != 0) && inf->attribute_index->query(query, result)) {
+			return;
+		}
+		if((inf->spatial_index != 0) && inf->spatial_index->query(query, result)) {
+			return;
+		}
+		if((inf->transform_cache != 0) && inf->transform_cache->query(query, result)) {
+			return;
+		}
+		if((inf->pose_history != 0) && inf->pose_history->query(query, result)) {
+			return;
+		}
+		runner->query(query, result);
+}
+
+/**
+ * Answers a query from the query cache if possible. Has to be called with the world model lock held.
+ */
+static void run_query(struct rsg_json_query_info *inf, brics_3d::rsg::JSONQueryRunner* runner, std::string& query, std::string& result)
+{
+		ScopedLatency latency(inf->query_time);
+		if(run_stats_query(query, result)) {
+			return;
+		}
+		brics_3d::rsg::QueryCache::Request request;
+		if((inf->query_cache != 0) && inf->query_cache->lookup(query, result, request)) {
+			return;
+		}
+		answer_query(inf, runner, query, result);
+		page_result(query, result);
+		if(inf->query_cache != 0) {
+			inf->query_cache->store(request, result);
+		}
+}
+
+/**
+ * Splits a result into RSGQueryResultChunk messages that are at most max_size bytes each.
+ * The result is embedded as escaped string "data"; the concatenation of all data strings
+ * is the original result.
+ * @return False if max_size is too small for a single chunk.
+ */
+static bool split_result(const std::string& result, const std::string& queryId, size_t max_size, std::vector<std::string>& chunks)
+{
+		std::ostringstream header;
+		header << "{\"@worldmodeltype\": \"RSGQueryResultChunk\",";
+		if(!queryId.empty()) {
+			header << "\"queryId\": \"" << queryId << "\",";
+		}
+		size_t overhead = header.str().size() + std::string("\"chunk\": ,\"numberOfChunks\": ,\"data\": \"\"}").size() + 2 * 20;
+		if(max_size < overhead + RSG_MIN_CHUNK_DATA_SIZE) {
+			return false;
+		}
+		size_t budget = max_size - overhead;
+
+		std::vector<std::string> data;
+		size_t i = 0;
+		while(i < result.size()) {
+			std::string chunk;
+			while(i < result.size()) {
+				unsigned char c = result[i];
+				size_t consumed = 1;
+				std::string piece;
+				if((c == '"') || (c == '\\')) {
+					piece.push_back('\\');
+					piece.push_back(c);
+				} else if(c < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					piece = escaped;
+				} else {
+					consumed = (c >= 0xF0) ? 4 : (c >= 0xE0) ? 3 : (c >= 0xC0) ? 2 : 1; // keep UTF-8 sequences together
+					consumed = std::min(consumed, result.size() - i);
+					piece = result.substr(i, consumed);
+				}
+				if(chunk.size() + piece.size() > budget) {
+					break;
+				}
+				chunk.append(piece);
+				i += consumed;
+			}
+			data.push_back(chunk);
+		}
+
+		chunks.clear();
+		for (size_t chunk = 0; chunk < data.size(); ++chunk) {
+			std::ostringstream message;
+			message << header.str() << "\"chunk\": " << chunk << ",\"numberOfChunks\": " << data.size() << ",\"data\": \"" << data[chunk] << "\"}";
+			chunks.push_back(message.str());
+		}
+		return true;
+}
+
+/**
+ * Replaces a result that does not fit into the output buffer by an error message.
+ */
+static void create_oversize_result(struct rsg_json_query_info *inf, const std::string& queryId, std::string& result)
+{
+		std::string type = get_world_model_type(result);
+		std::string successFlag = "querySuccess";
+		if(type.compare("RSGUpdateResult") == 0) {
+			successFlag = "updateSuccess";
+		} else if(type.compare("RSGFunctionBlockResult") == 0) {
+			successFlag = "operationSuccess";
+		} else if(type.empty()) {
+			type = "RSGQueryResult";
+		}
+		std::ostringstream out;
+		out << "{\"@worldmodeltype\": \"" << type << "\",";
+		if(!queryId.empty()) {
+			out << "\"queryId\": \"" << queryId << "\",";
+		}
+		out << "\"" << successFlag << "\": false,\"resultSize\": " << result.size() << ",\"error\": \"The result has " << result.size()
+				<< " bytes, but the buffer_len is " << inf->input_buffer_size << " bytes. Use limit and offset or stream the result.\"}";
+		result = out.str();
+}
+
+/**
+ * Sends a query result. Can be called from any thread. A result that is larger than the
+ * buffer is send as sequence of chunks if the query asks for it ("stream": true).
+ */
+static void write_result(struct rsg_json_query_info *inf, const std::string& query, std::string& result)
+{
+		RSG_LOG(inf->logger, DEBUG) << "rsg_json_query: Reply is = " << std::endl << result;
+		ubx_port_t* result_port = inf->ports.rsg_result;
+		assert(result_port != 0);
+
+		/*
+		 * Warning: we actually don't have an output buffer size. Though is mostly has the same as the input one...
+		 */
+		std::vector<std::string> chunks;
+		if(result.size() > inf->input_buffer_size) {
+			std::string queryId;
+			bool stream = false;
+			try {
+				libvariant::Variant message = libvariant::DeserializeJSON(query);
+				if(message.Contains("queryId")) {
+					queryId = message.Get("queryId").AsString();
+				}
+				stream = message.Contains("stream") && message.Get("stream").AsBool();
+			} catch (std::exception const&) {
+				// The result is replaced by an error message below.
+			}
+
+			if(stream && split_result(result, queryId, inf->input_buffer_size, chunks)) {
+				RSG_LOG(inf->logger, INFO) << "Result with = " << result.size() << " bytes is send as " << chunks.size() << " chunks.";
+			} else {
+				RSG_LOG(inf->logger, ERROR) << "Result with = " << result.size() << " bytes is larger than max output buffer lenght = "
 						<< inf->input_buffer_size;
-				/*
-				 * Warning: we actually don't have an output buffer size. Though is mostly has the same as the input one...
-				 */
-				result = "{}";
+				create_oversize_result(inf, queryId, result);
 			}
+		}
+		if(chunks.empty()) {
+			chunks.push_back(std::string());
+			chunks.back().swap(result);
+		}
 
+		/* All chunks are written at once, so they are not interleaved with other results. */
+		std::lock_guard<std::mutex> lock(*inf->result_mutex);
+		for (std::vector<std::string>::const_iterator chunk = chunks.begin(); chunk != chunks.end(); ++chunk) {
 			ubx_data_t msg_result;
-			msg_result.data = (void *)result.c_str();
-			msg_result.len = result.size();
+			msg_result.data = (void *)chunk->c_str();
+			msg_result.len = chunk->size();
 			msg_result.type = result_port->out_type;
 
-			LOG(DEBUG) << "Sending " << msg_result.len << " bytes: ";
+			RSG_LOG(inf->logger, DEBUG) << "Sending " << msg_result.len << " bytes: ";
 			__port_write(result_port, &msg_result);
+			inf->messages_out->add();
+			inf->bytes_out->add(msg_result.len);
+		}
+}
 
-		} else if (dataBuffer == 0) {
-			LOG(DEBUG) << "Pointer to data buffer is zero. Aborting this update.";
-		} else {
-			//LOG(DEBUG) << "Incoming update has not enough data to be processed. Aborting this update.";
+/**
+ * Sends the pending updates of all subscriptions that are due.
+ */
+static void write_events(struct rsg_json_query_info *inf)
+{
+		if(inf->subscriptions == 0) {
+			return;
+		}
+		std::vector<std::string> messages;
+		inf->subscriptions->collect(inf->input_buffer_size, messages);
+		ubx_port_t* events_port = inf->ports.rsg_events;
+		if(messages.empty() || (events_port == 0)) {
+			return;
 		}
+		for (std::vector<std::string>::const_iterator message = messages.begin(); message != messages.end(); ++message) {
+			ubx_data_t msg_events;
+			msg_events.data = (void *)message->c_str();
+			msg_events.len = message->size();
+			msg_events.type = events_port->out_type;
+
+			RSG_LOG(inf->logger, DEBUG) << "Sending " << msg_events.len << " bytes of subscription events.";
+			__port_write(events_port, &msg_events);
+			inf->messages_out->add();
+			inf->bytes_out->add(msg_events.len);
+		}
+}
 
+/**
+ * Processes a single incoming message. Read-only queries are handed over to
+ * the worker pool (if any). Updates and function block invocations modify the
+ * world model, so they are processed right away while holding the exclusive lock.
+ */
+static void handle_query(struct rsg_json_query_info *inf, std::string query)
+{
+		RSG_LOG(inf->logger, INFO) << "rsg_json_query: Processing query = " << std::endl << query;
 
+		if((inf->worker_pool != 0) && (get_world_model_type(query).compare("RSGQuery") == 0)) {
+			inf->worker_pool->enqueue(query);
+			inf->queue_depth->set(inf->worker_pool->getPendingCount());
+			return;
+		}
 
+		std::string result;
+		{
+			WorldModelWriteLock writeLock(inf->wm);
+			run_query(inf, inf->wm_query_runner, query, result);
+		}
+		write_result(inf, query, result);
 }
 
+/* step */
+void rsg_json_query_step(ubx_block_t *b)
+{
+
+        struct rsg_json_query_info *inf = (struct rsg_json_query_info*) b->private_data;
+        //LOG(DEBUG) << "rsg_json_query: Processing an incoming update";
+
+		ubx_port_t* port = inf->ports.rsq_query;
+		assert(port != 0);
+		checktype(port->block->ni, port->in_type, "unsigned char", port->name, 1);
+
+		/*
+		 * With a worker pool all pending messages are dispatched in one step,
+		 * otherwise exactly one message is processed per step.
+		 */
+		do {
+			/*
+			 * read data
+			 */
+			ubx_data_t msg;
+			msg.type = port->in_type;
+			msg.len = inf->input_buffer_size;
+			msg.data = (void *)inf->input_buffer;
+			int readBytes = __port_read(port, &msg);
+
+			const char *dataBuffer = (char *)msg.data;
+			if ((dataBuffer!=0) && (msg.len > 1) && (readBytes > 1)) {
+				RSG_LOG(inf->logger, INFO) << "rsg_json_query: Port returned " << readBytes <<
+		                      " bytes, while data message length is " << msg.len <<
+		                      " bytes. Resulting size = " << data_size(&msg);
+
+				inf->messages_in->add();
+				inf->bytes_in->add(readBytes);
+
+				/*
+				 * process query and write data
+				 */
+				handle_query(inf, std::string(dataBuffer, readBytes));
+
+			} else if (dataBuffer == 0) {
+				RSG_LOG(inf->logger, DEBUG) << "Pointer to data buffer is zero. Aborting this update.";
+				break;
+			} else {
+				//LOG(DEBUG) << "Incoming update has not enough data to be processed. Aborting this update.";
+				break;
+			}
+		} while (inf->worker_pool != 0);
+
+		/* Updates of this and other blocks since the last step */
+		write_events(inf);
+
+}
@@ -21,6 +21,16 @@ ubx_config_t rsg_json_query_config[] = {
         { .name="wm_handle", .type_name = "struct rsg_wm_handle", .doc="Handle to the world wodel instance. This parameter is mandatory." },
     	{ .name="buffer_len", .type_name = "uint32_t", .doc="Maximum number of data elements the of the input buffer." },
         { .name="log_level", .type_name = "int", .doc="Set the log level: LOGDEBUG = 0, INFO = 1, WARNING = 2, LOGERROR = 3, FATAL = 4" },
+        { .name="num_workers", .type_name = "uint32_t", .doc="Number of worker threads that process read-only queries (RSGQuery) in parallel. Their results can be send in a different order than the queries arrived. "
+        		"Updates and function blocks are always processed sequentially. 0 processes everything sequentially within the step function. Default is 0." },
+        { .name="attribute_index", .type_name = "int", .doc="If set to 1 an index of all node attributes is maintained, so GET_NODES queries with exact or prefix (value ends with .*) matches do not scan the complete graph. Default is 0." },
+        { .name="spatial_index", .type_name = "int", .doc="If set to 1 an R-tree of the positions and geometry bounds of all nodes with respect to the root node is maintained to answer GET_NODES_IN_BOUNDING_BOX and GET_NODES_IN_RADIUS queries. Default is 0." },
+        { .name="transform_cache", .type_name = "int", .doc="If set to 1 the results of GET_TRANSFORM queries are cached until a Transform on the path is updated. Default is 0." },
+        { .name="transform_cache_resolution", .type_name = "float", .doc="Time resolution in [ms] of the transform cache. Queries for time stamps within the same interval share a result. Default is 100." },
+        { .name="query_cache", .type_name = "int", .doc="If set to 1 the results of repeated GET_ROOT_NODE, GET_NODES, GET_NODE_ATTRIBUTES, GET_NODE_PARENTS, GET_GROUP_CHILDREN, GET_GEOMETRY, GET_REMOTE_ROOT_NODES and GET_CONNECTION_*_IDS queries are cached until an update affects them. Default is 0." },
+        { .name="pose_history_capacity", .type_name = "uint32_t", .doc="Maximum number of poses per Transform that are kept for GET_INTERPOLATED_TRANSFORM and GET_TRANSFORM_HISTORY queries. Default is 0, which disables the history. 12000 covers 10 min at 20 Hz." },
+        { .name="pose_history_duration", .type_name = "float", .doc="Maximum age in [s] of the poses in the history relative to the newest pose of a Transform. Default is 600." },
+        { .name="subscriptions", .type_name = "int", .doc="If set to 1 clients can register continuous queries with SUBSCRIBE. Matching updates are pushed via the rsg_events port. Default is 0." },
     	{ NULL },
 };
 
@@ -28,6 +38,7 @@ ubx_config_t rsg_json_query_config[] = {
 ubx_port_t rsg_json_query_ports[] = {
         { .name="rsq_query", .in_type_name="unsigned char", .doc="JSON based byte stream for queries on RSG based world model."  },
         { .name="rsg_result", .out_type_name="unsigned char", .out_data_len=1, .doc="JSON based data stream for query results for RSG based world model."  },
+        { .name="rsg_events", .out_type_name="unsigned char", .out_data_len=1, .doc="JSON based data stream of the updates that match a subscription (RSGSubscriptionEvents)."  },
         { NULL },
 };
 
@@ -35,6 +46,7 @@ ubx_port_t rsg_json_query_ports[] = {
 struct rsg_json_query_port_cache {
         ubx_port_t* rsq_query;
         ubx_port_t* rsg_result;
+        ubx_port_t* rsg_events;
 };
 
 /* declare a helper function to update the port cache this is necessary
@@ -46,6 +58,7 @@ static void update_port_cache(ubx_block_t *b, struct rsg_json_query_port_cache *
 {
         pc->rsq_query = ubx_port_get(b, "rsq_query");
         pc->rsg_result = ubx_port_get(b, "rsg_result");
+        pc->rsg_events = ubx_port_get(b, "rsg_events");
 }
 
 
@@ -13,6 +13,15 @@
 #include <brics_3d/worldModel/sceneGraph/UpdatesToSceneGraphListener.h>
 #include <brics_3d/worldModel/sceneGraph/RemoteRootNodeAutoMounter.h>
 
+#include <time.h>
+
+#include "rsg_update_batch.h"
+#include "rsg_compression.h"
+#include "rsg_world_model_lock.h"
+#include "rsg_stats.h"
+#include "rsg_log.h"
+#include "rsg_update_timer.h"
+
 using namespace brics_3d;
 using brics_3d::Logger;
 
@@ -48,9 +57,79 @@ struct rsg_json_reciever_info
         										 * E.g a Kinect consumes around 10,000,000 bytes per
         										 * message.
          	 	 	 	 	 	 	 	 	 	 */
+        bool adaptive_input_buffer;                 /* If true the buffer grows on demand. */
+        unsigned long hdf_5_input_buffer_max_size; /* Upper bound for the adaptive buffer. */
+        unsigned long oversize_messages;            /* Number of messages that have been dropped
+                                                     * because they did not fit into the buffer.
+                                                     */
+
+        uint32_t max_messages_per_step;             /* Message budget per step. 0 means unlimited. */
+        uint32_t max_step_duration;                 /* Time budget per step in microseconds. 0 means unlimited. */
+
+        UpdateDecompressor* decompressor;           /* Only available with zstd support. */
+        std::vector<char>* decompress_buffer;       /* Decompressed message; grows to the largest one. */
+
+        /* instrumentation */
+        StatsCounter* messages_in;
+        StatsCounter* bytes_in;
+        StatsCounter* drops;
+        StatsCounter* input_pending;
+        LatencyHistogram* decode_time;              /* Includes applying the updates to the world model. */
+        TimedUpdateObserver* apply_timer;           /* Only available with the input filter. */
+        BlockLogger* logger;                        /* Level of the RSG_LOG messages. */
 
 };
 
+/*
+ * Resizes the input buffer to new_size bytes. The old content is discarded.
+ * One spare byte is allocated to detect messages that do not fit (cf. process_next_message).
+ * Returns true on success; on failure the old buffer is kept.
+ */
+static bool resize_input_buffer(struct rsg_json_reciever_info *inf, unsigned long new_size)
+{
+		unsigned char* new_buffer = (unsigned char *)realloc(inf->hdf_5_input_buffer, new_size + 1);
+		if(new_buffer == NULL) {
+			LOG(ERROR) << "rsg_json_reciever: Cannot grow input buffer to " << new_size << " bytes. Keeping "
+					<< inf->hdf_5_input_buffer_size << " bytes.";
+			return false;
+		}
+		inf->hdf_5_input_buffer = new_buffer;
+		inf->hdf_5_input_buffer_size = new_size;
+		return true;
+}
+
+/*
+ * Determines the largest message that can arrive at port, i.e. the maximum
+ * element_size of all connected (cyclic_raw) interaction blocks. Returns 0
+ * if nothing is known about the connected buffers.
+ */
+static unsigned long get_max_incoming_message_size(ubx_port_t* port)
+{
+		unsigned long max_size = 0;
+		if((port == 0) || (port->in_interaction == 0)) {
+			return max_size;
+		}
+
+		for(ubx_block_t** iblock = port->in_interaction; *iblock != NULL; iblock++) {
+			unsigned int clen;
+			uint32_t* element_size = (uint32_t*) ubx_config_get_data_ptr(*iblock, "element_size", &clen);
+			if((clen != 0) && (element_size != 0) && (*element_size > max_size)) {
+				max_size = *element_size;
+			}
+		}
+		return max_size;
+}
+
+/*
+ * Returns the time in microseconds that elapsed since start_time.
+ */
+static uint64_t get_elapsed_microseconds(const struct timespec* start_time)
+{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (uint64_t)(now.tv_sec - start_time->tv_sec) * 1000000 + (now.tv_nsec - start_time->tv_nsec) / 1000;
+}
+
 /* init */
 int rsg_json_reciever_init(ubx_block_t *b)
 {
@@ -68,6 +147,7 @@ int rsg_json_reciever_init(ubx_block_t *b)
         }
         b->private_data=inf;
         update_port_cache(b, &inf->ports);
+        inf->logger = new BlockLogger();
 
        	unsigned int clen;
         rsg_wm_handle tmpWmHandle =  *((rsg_wm_handle*) ubx_config_get_data_ptr(b, "wm_handle", &clen));
@@ -161,7 +241,8 @@ int rsg_json_reciever_init(ubx_block_t *b)
 //    		inf->wm_input_filter->setNameSpaceIdentifier(semanticContextIdentifier);
 //    		LOG(INFO) << "rsg_json_reciever: filter enabled for semantic context identifier = " << semanticContextIdentifier;
 //            inf->wm_deserializer = new brics_3d::rsg::JSONDeserializer(inf->wm, inf->wm_input_filter); // Make the deserializer to call update on the filter
-    		inf->constraint_filter->attachUpdateObserver(inf->wm_updates_to_wm); // handle used for updates
+    		inf->apply_timer = new TimedUpdateObserver(inf->wm_updates_to_wm, BlockStats::get(b->name)->getHistogram("apply"));
+    		inf->constraint_filter->attachUpdateObserver(inf->apply_timer); // handle used for updates
     		LOG(INFO) << "rsg_json_reciever: graph constraint filter enabled.";
             inf->wm_deserializer = new brics_3d::rsg::JSONDeserializer(inf->wm, inf->constraint_filter); // Make the deserializer to call update on the filter
 
@@ -171,6 +252,30 @@ int rsg_json_reciever_init(ubx_block_t *b)
     		inf->wm_updates_to_wm = 0;
     	}
 
+        BlockStats* stats = BlockStats::get(b->name);
+        inf->messages_in = stats->getCounter("messages_in");
+        inf->bytes_in = stats->getCounter("bytes_in");
+        inf->drops = stats->getCounter("drops");
+        inf->input_pending = stats->getCounter("input_pending");
+        inf->decode_time = stats->getHistogram("decode");
+
+        /* Compressed messages are recognized by their zstd header, so decompression is always ready */
+        if(UpdateCompression::isAvailable()) {
+        	std::string dictionaryFile = "";
+        	char* compression_dictionary = (char*) ubx_config_get_data_ptr(b, "compression_dictionary", &clen);
+        	if(clen != 0) {
+        		dictionaryFile = compression_dictionary;
+        	}
+        	std::string dictionary;
+        	if(UpdateCompression::loadDictionary(dictionaryFile, dictionary)) {
+        		inf->decompressor = new UpdateDecompressor(dictionary, stats);
+        		inf->decompress_buffer = new std::vector<char>();
+        		LOG(INFO) << "rsg_json_reciever: compression_dictionary = " << (dictionaryFile.empty() ? "built-in" : dictionaryFile);
+        	} else {
+        		LOG(WARNING) << "rsg_json_reciever: Cannot load compression_dictionary " << dictionaryFile << ". Compressed messages will be dropped.";
+        	}
+        }
+
         /* Setup input buffer for JSON messages */
         inf->hdf_5_input_buffer_size = *((uint32_t*) ubx_config_get_data_ptr(b, "buffer_len", &clen));
     	if((clen == 0) || (inf->hdf_5_input_buffer_size == 0)) {
@@ -180,7 +285,39 @@ int rsg_json_reciever_init(ubx_block_t *b)
     	}
     	LOG(DEBUG) << "JSON input buffer len set to " << inf->hdf_5_input_buffer_size;
 
-        if((inf->hdf_5_input_buffer = (unsigned char *)malloc(inf->hdf_5_input_buffer_size)) == NULL) {
+        /* Optional adaptive buffer */
+        inf->adaptive_input_buffer = false;
+        inf->hdf_5_input_buffer_max_size = inf->hdf_5_input_buffer_size;
+        uint32_t* max_buffer_len = (uint32_t*) ubx_config_get_data_ptr(b, "max_buffer_len", &clen);
+        if((clen != 0) && (*max_buffer_len > inf->hdf_5_input_buffer_size)) {
+        	inf->adaptive_input_buffer = true;
+        	inf->hdf_5_input_buffer_max_size = *max_buffer_len;
+        	LOG(INFO) << "rsg_json_reciever: adaptive input buffer enabled with max_buffer_len = " << inf->hdf_5_input_buffer_max_size;
+        } else {
+        	LOG(INFO) << "rsg_json_reciever: adaptive input buffer disabled.";
+        }
+        inf->oversize_messages = 0;
+
+        /* Per step budget for draining the input port */
+        inf->max_messages_per_step = 1;
+        uint32_t* max_messages_per_step = (uint32_t*) ubx_config_get_data_ptr(b, "max_messages_per_step", &clen);
+        if(clen == 0) {
+        	LOG(INFO) << "rsg_json_reciever: No max_messages_per_step configuration given. Processing one message per step.";
+        } else {
+        	inf->max_messages_per_step = *max_messages_per_step;
+        }
+        LOG(INFO) << "rsg_json_reciever: max_messages_per_step = " << inf->max_messages_per_step;
+
+        inf->max_step_duration = 0;
+        uint32_t* max_step_duration = (uint32_t*) ubx_config_get_data_ptr(b, "max_step_duration", &clen);
+        if(clen == 0) {
+        	LOG(INFO) << "rsg_json_reciever: No max_step_duration configuration given. Turned off by default.";
+        } else {
+        	inf->max_step_duration = *max_step_duration;
+        }
+        LOG(INFO) << "rsg_json_reciever: max_step_duration = " << inf->max_step_duration << " us";
+
+        if((inf->hdf_5_input_buffer = (unsigned char *)malloc(inf->hdf_5_input_buffer_size + 1)) == NULL) { // + 1 to detect truncated messages
           ERR("failed to allocate hdf5 input buffer");
           free(inf->hdf_5_input_buffer);
           return 0;
@@ -192,15 +329,31 @@ int rsg_json_reciever_init(ubx_block_t *b)
 /* start */
 int rsg_json_reciever_start(ubx_block_t *b)
 {
-        /* struct rsg_json_reciever_info *inf = (struct rsg_json_reciever_info*) b->private_data; */
+        struct rsg_json_reciever_info *inf = (struct rsg_json_reciever_info*) b->private_data;
         int ret = 0;
 
+        /* Connections are established by now, so the port cache and buffer size can be updated */
+        update_port_cache(b, &inf->ports);
+        if(inf->adaptive_input_buffer) {
+        	unsigned long required_size = get_max_incoming_message_size(inf->ports.rsg_in);
+        	if(required_size > inf->hdf_5_input_buffer_max_size) {
+        		LOG(WARNING) << "rsg_json_reciever: Connected buffers allow messages of " << required_size
+        				<< " bytes, but max_buffer_len = " << inf->hdf_5_input_buffer_max_size << ". Larger messages will be dropped.";
+        		required_size = inf->hdf_5_input_buffer_max_size;
+        	}
+        	if(required_size > inf->hdf_5_input_buffer_size) {
+        		resize_input_buffer(inf, required_size);
+        	}
+        	LOG(INFO) << "rsg_json_reciever: JSON input buffer len set to " << inf->hdf_5_input_buffer_size;
+        }
+
     	/* Set logger level */
     	unsigned int clen;
     	int* log_level =  ((int*) ubx_config_get_data_ptr(b, "log_level", &clen));
     	if(clen == 0) {
     		LOG(INFO) << "rsg_json_reciever: No log_level configuation given.";
     	} else {
+    		inf->logger->setLevel(*log_level);
     		if (*log_level == 0) {
     			LOG(INFO) << "rsg_json_reciever: log_level set to DEBUG level.";
     			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
@@ -220,6 +373,8 @@ int rsg_json_reciever_start(ubx_block_t *b)
     			LOG(INFO) << "rsg_json_reciever: unknown log_level = " << *log_level;		}
     	}
 
+    	LogBackend::acquire();
+
         return ret;
 }
 
@@ -227,6 +382,7 @@ int rsg_json_reciever_start(ubx_block_t *b)
 void rsg_json_reciever_stop(ubx_block_t *b)
 {
         /* struct rsg_json_reciever_info *inf = (struct rsg_json_reciever_info*) b->private_data; */
+        LogBackend::release();
 }
 
 /* cleanup */
@@ -245,17 +401,33 @@ void rsg_json_reciever_cleanup(ubx_block_t *b)
 			delete inf->wm_updates_to_wm;
 			inf->wm_updates_to_wm = 0;
 		}
+		if(inf->apply_timer != 0){
+			delete inf->apply_timer;
+			inf->apply_timer = 0;
+		}
+		if(inf->decompressor != 0){
+			delete inf->decompressor;
+			inf->decompressor = 0;
+		}
+		if(inf->decompress_buffer != 0){
+			delete inf->decompress_buffer;
+			inf->decompress_buffer = 0;
+		}
         free(inf->hdf_5_input_buffer);
+        if(inf->logger){
+        	delete inf->logger;
+        	inf->logger = 0;
+        }
         free(b->private_data);
 }
 
-/* step */
-void rsg_json_reciever_step(ubx_block_t *b)
+/*
+ * Reads and applies a single message from the rsg_in port.
+ * Returns the number of bytes read from the port, i.e. 0 if no data was available
+ * and a negative value on error.
+ */
+static int process_next_message(struct rsg_json_reciever_info *inf)
 {
-
-        struct rsg_json_reciever_info *inf = (struct rsg_json_reciever_info*) b->private_data;
-//        LOG(DEBUG) << "rsg_json_reciever: Processing an incoming update";
-
 		/* read data */
 		ubx_port_t* port = inf->ports.rsg_in;
 		assert(port != 0);
@@ -263,25 +435,125 @@ void rsg_json_reciever_step(ubx_block_t *b)
 		ubx_data_t msg;
 		checktype(port->block->ni, port->in_type, "unsigned char", port->name, 1);
 		msg.type = port->in_type;
-		msg.len = inf->hdf_5_input_buffer_size;
+		msg.len = inf->hdf_5_input_buffer_size + 1;
 		msg.data = (void *)inf->hdf_5_input_buffer;
 		int readBytes = __port_read(port, &msg);
 //		LOG(DEBUG) << "rsg_json_reciever: Port returned " << readBytes <<
 //                      " bytes, while data message length is " << msg.len <<
 //                      " bytes. Resulting size = " << data_size(&msg);
 
+		/*
+		 * The port may fill one byte more than the buffer size. If it does, the message
+		 * did not fit and has been truncated, while a message of exactly the buffer size
+		 * is complete. In adaptive mode it is reported and dropped, and the buffer grows
+		 * (up to max_buffer_len) for the next messages.
+		 */
+		if (inf->adaptive_input_buffer && (readBytes > 0) && ((unsigned long)readBytes > inf->hdf_5_input_buffer_size)) {
+			inf->oversize_messages++;
+			inf->drops->add();
+			if(inf->hdf_5_input_buffer_size < inf->hdf_5_input_buffer_max_size) {
+				unsigned long new_size = 2 * inf->hdf_5_input_buffer_size;
+				if(new_size > inf->hdf_5_input_buffer_max_size) {
+					new_size = inf->hdf_5_input_buffer_max_size;
+				}
+				RSG_LOG(inf->logger, ERROR) << "rsg_json_reciever: Incoming message with at least " << readBytes << " bytes does not fit into the input buffer. "
+						"Dropping it (" << inf->oversize_messages << " so far) and growing the buffer to " << new_size << " bytes.";
+				resize_input_buffer(inf, new_size);
+			} else {
+				RSG_LOG(inf->logger, ERROR) << "rsg_json_reciever: Incoming message with at least " << readBytes << " bytes exceeds max_buffer_len = "
+						<< inf->hdf_5_input_buffer_max_size << ". Dropping it (" << inf->oversize_messages << " so far).";
+			}
+			return readBytes;
+		}
+
+		/* __port_read copied the message into the input buffer; the deserializer works on that buffer directly. */
 		const char *dataBuffer = (char *)msg.data;
 		int transferred_bytes;
 		if ((dataBuffer!=0) && (msg.len > 1) && (readBytes > 1)) {
-			inf->wm_deserializer->write(dataBuffer, readBytes, transferred_bytes);
-			LOG(INFO) << "rsg_json_reciever: \t transferred_bytes = " << transferred_bytes;
+			inf->messages_in->add();
+			inf->bytes_in->add(readBytes);
+
+			/* Compressed messages are replaced by their decompressed content before the world model is locked. */
+			if (UpdateCompression::isCompressed(dataBuffer, readBytes)) {
+				if ((inf->decompressor == 0) || !inf->decompressor->decompress(dataBuffer, readBytes, *inf->decompress_buffer)) {
+					RSG_LOG(inf->logger, ERROR) << "rsg_json_reciever: Cannot decompress incoming message with " << readBytes << " bytes. "
+							"Is the same compression_dictionary used as by the sender? Dropping it.";
+					inf->drops->add();
+					return readBytes;
+				}
+				if (inf->decompress_buffer->size() < 2) { // Not enough data to be processed.
+					return readBytes;
+				}
+				dataBuffer = &(*inf->decompress_buffer)[0];
+				readBytes = inf->decompress_buffer->size();
+			}
+
+			WorldModelWriteLock writeLock(inf->wm); // Queries of other blocks might run in parallel.
+			ScopedLatency latency(inf->decode_time);
+			if (UpdateBatchSplitter::isBatch(dataBuffer, readBytes)) {
+				int updates = UpdateBatchSplitter::forEachOperation(dataBuffer, readBytes, inf->wm_deserializer); // Applies the complete batch within this step.
+				if(updates < 0) {
+					RSG_LOG(inf->logger, ERROR) << "rsg_json_reciever: Malformed update batch with " << readBytes << " bytes. Updates after the malformed part are skipped.";
+				} else {
+					RSG_LOG(inf->logger, DEBUG) << "rsg_json_reciever: Applied a batch of " << updates << " updates.";
+				}
+			} else {
+				inf->wm_deserializer->write(dataBuffer, readBytes, transferred_bytes);
+				RSG_LOG(inf->logger, INFO) << "rsg_json_reciever: \t transferred_bytes = " << transferred_bytes;
+			}
 		} else if (dataBuffer == 0) {
-			LOG(ERROR) << "rsg_json_reciever: Pointer to data buffer is zero. Aborting this update.";
+			RSG_LOG(inf->logger, ERROR) << "rsg_json_reciever: Pointer to data buffer is zero. Aborting this update.";
 		} else if (readBytes == 0) {
 			// Regular case if no new data is available
 		} else {
-			LOG(DEBUG) << "rsg_json_reciever: Incoming update has not enough data to be processed. Aborting this update.";
+			RSG_LOG(inf->logger, DEBUG) << "rsg_json_reciever: Incoming update has not enough data to be processed. Aborting this update.";
 		}
 
+		return readBytes;
 }
 
+/* step */
+void rsg_json_reciever_step(ubx_block_t *b)
+{
+
+        struct rsg_json_reciever_info *inf = (struct rsg_json_reciever_info*) b->private_data;
+//        LOG(DEBUG) << "rsg_json_reciever: Processing an incoming update";
+
+        /*
+         * Drain the input port until it is empty or until the per step budget
+         * (number of messages or time) is exhausted.
+         */
+        struct timespec start_time;
+        if(inf->max_step_duration > 0) {
+        	clock_gettime(CLOCK_MONOTONIC, &start_time);
+        }
+
+        uint32_t processed_messages = 0;
+        bool drained = false;
+        while(true) {
+        	if((inf->max_messages_per_step > 0) && (processed_messages >= inf->max_messages_per_step)) {
+        		break;
+        	}
+        	if((inf->max_step_duration > 0) && (processed_messages > 0) &&
+        			(get_elapsed_microseconds(&start_time) >= inf->max_step_duration)) {
+        		break;
+        	}
+        	if(process_next_message(inf) <= 0) {
+        		drained = true;
+        		break;
+        	}
+        	processed_messages++;
+        }
+
+        /*
+         * The connected buffers do not expose their fill level. So only report
+         * whether messages are left because the budget ran out first.
+         */
+        uint32_t input_pending = drained ? 0 : 1;
+        if(processed_messages > 1) {
+        	RSG_LOG(inf->logger, DEBUG) << "rsg_json_reciever: Processed " << processed_messages << " messages in one step.";
+        }
+        write_processed_messages(inf->ports.processed_messages, &processed_messages);
+        write_input_pending(inf->ports.input_pending, &input_pending);
+        inf->input_pending->set(input_pending);
+}
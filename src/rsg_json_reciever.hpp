@@ -20,22 +20,33 @@ char rsg_json_reciever_meta[] =
 ubx_config_t rsg_json_reciever_config[] = {
         { .name="wm_handle", .type_name = "struct rsg_wm_handle", .doc="Handle to the world wodel instance. This parameter is mandatory." },
     	{ .name="buffer_len", .type_name = "uint32_t", .doc="Maximum number of data elements the of the input buffer." },
+    	{ .name="max_buffer_len", .type_name = "uint32_t", .doc="Optional upper bound in bytes for an adaptive input buffer. If larger than buffer_len, "
+    			"the input buffer is sized at start to the element size of the connected buffers and grows on demand up to this value. "
+    			"Messages that do not fit are reported and dropped instead of being truncated. Default is 0 (fixed buffer of buffer_len bytes)." },
         { .name="log_level", .type_name = "int", .doc="Set the log level: LOGDEBUG = 0, INFO = 1, WARNING = 2, LOGERROR = 3, FATAL = 4" },
         { .name="enable_input_filter", .type_name = "int", .doc="If true every deserialized message gets filtered and potentially rejected. Default is false." },
         { .name="input_filter_pattern", .type_name = "char" , .doc="Pattern to exclude name spaces." },
         { .name="remote_root_auto_mount_id", .type_name = "char" , .doc="Any new remote root node will be added as child to this node. En empty string disables this feature." },
+        { .name="max_messages_per_step", .type_name = "uint32_t", .doc="Maximum number of messages processed per step. 0 drains the input port until it is empty. Default is 1." },
+        { .name="max_step_duration", .type_name = "uint32_t", .doc="Time budget for processing messages within one step in microseconds. 0 means unlimited. Default is 0." },
+        { .name="compression_dictionary", .type_name = "char" , .doc="Dictionary file for messages that have been compressed by a rsg_json_sender. Has to be the same as the one of the sender. "
+        		"Empty uses the built-in dictionary. Compressed messages are only accepted if the block has been built with USE_ZSTD." },
         { NULL },
 };
 
 /* declaration port block ports */
 ubx_port_t rsg_json_reciever_ports[] = {
         { .name="rsg_in", .in_type_name="unsigned char", .doc="JSON based byte stream for updates on RSG based world model."  },
+        { .name="processed_messages", .out_type_name="uint32_t", .out_data_len=1, .doc="Number of messages processed during the last step."  },
+        { .name="input_pending", .out_type_name="uint32_t", .out_data_len=1, .doc="1 if the step budget ran out before the input was drained during the last step, otherwise 0."  },
         { NULL },
 };
 
 /* declare a struct port_cache */
 struct rsg_json_reciever_port_cache {
         ubx_port_t* rsg_in;
+        ubx_port_t* processed_messages;
+        ubx_port_t* input_pending;
 };
 
 /* declare a helper function to update the port cache this is necessary
@@ -46,11 +57,15 @@ struct rsg_json_reciever_port_cache {
 static void update_port_cache(ubx_block_t *b, struct rsg_json_reciever_port_cache *pc)
 {
         pc->rsg_in = ubx_port_get(b, "rsg_in");
+        pc->processed_messages = ubx_port_get(b, "processed_messages");
+        pc->input_pending = ubx_port_get(b, "input_pending");
 }
 
 
 /* for each port type, declare convenience functions to read/write from ports */
 //def_read_fun(read_rsg_in, unsigned char)
+def_write_fun(write_processed_messages, uint32_t)
+def_write_fun(write_input_pending, uint32_t)
 
 /* block operation forward declarations */
 int rsg_json_reciever_init(ubx_block_t *b);
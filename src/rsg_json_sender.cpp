@@ -15,6 +15,25 @@
 #include <brics_3d/worldModel/sceneGraph/GraphConstraintUpdateFilter.h>
 #include <brics_3d/worldModel/sceneGraph/TimeStamper.h>
 
+#include "rsg_update_batch.h"
+#include "rsg_compression.h"
+#include "rsg_stats.h"
+#include "rsg_log.h"
+#include "rsg_update_timer.h"
+#include "rsg_journal.h"
+#include "rsg_world_model_lock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <time.h>
+
 
 using namespace brics_3d;
 using brics_3d::Logger;
@@ -27,11 +46,14 @@ UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
  */
 class RsgToUbxPort : public brics_3d::rsg::IOutputPort {
 public:
-	RsgToUbxPort(ubx_port_t* port, ubx_type_t* type) : port(port), type(type){};
+	RsgToUbxPort(ubx_port_t* port, ubx_type_t* type, BlockStats* stats, BlockLogger* logger) : port(port), type(type), logger(logger){
+		messagesOut = stats->getCounter("messages_out");
+		bytesOut = stats->getCounter("bytes_out");
+	};
 	virtual ~RsgToUbxPort(){};
 
 	int write(const char *dataBuffer, int dataLength, int &transferredBytes) {
-		LOG(INFO) << "RsgToUbxPort: Feeding data forwards.";
+		RSG_LOG(logger, INFO) << "RsgToUbxPort: Feeding data forwards.";
 		assert(port != 0);
 
 		ubx_data_t msg;
@@ -39,8 +61,10 @@ public:
 		msg.len = dataLength;
 		msg.type = type;
 
-		LOG(INFO) << "Sending " << msg.len << " bytes: ";
+		RSG_LOG(logger, INFO) << "Sending " << msg.len << " bytes: ";
 		__port_write(port, &msg);
+		messagesOut->add();
+		bytesOut->add(dataLength);
 
 		return 0;
 	};
@@ -48,18 +72,39 @@ public:
 private:
 	ubx_port_t* port;
 	ubx_type_t* type;
+	BlockLogger* logger;
+	StatsCounter* messagesOut;
+	StatsCounter* bytesOut;
 };
 
+/* Attribute keys used to exchange synchronization versions via the root nodes (delta_sync mode) */
+#define SYNC_VERSION_KEY "rsg:sync_version"
+#define SYNC_SEEN_KEY_PREFIX "rsg:sync_seen:"
+#define SYNC_PEER_TIMEOUT 60 // [s] Peers that did not report for a longer period are ignored for periodic syncs.
+
 /**
  * Triggers block b whenever a addRemoteRootNode event is detected.
+ *
+ * In addition it keeps track of the synchronization versions that other World Model Agents
+ * report as attributes of their root nodes. Cf. ChangeSequenceTracker.
  */
 class RemoteRootNodeAdditionTrigger : public brics_3d::rsg::ISceneGraphUpdateObserver {
 public:
 
 	/**
-	 * Construrctor with block to be triggereg.
+	 * Synchronization state of another World Model Agent.
 	 */
-	RemoteRootNodeAdditionTrigger(SceneGraphFacade* observedScene, ubx_block_t *b) : observedScene(observedScene), b(b){};
+	struct PeerSyncState {
+		std::string version;     // Version of the peer's graph, as advertised by the peer.
+		std::string seenVersion; // Version of our graph that the peer has seen. Empty if unknown.
+		time_t lastReport;
+	};
+
+	/**
+	 * Construrctor.
+	 * @param observedScene Scene whose own root node is not reported as a request.
+	 */
+	RemoteRootNodeAdditionTrigger(SceneGraphFacade* observedScene) : observedScene(observedScene), hasSyncRequest(false), resyncPending(false), waiting(true){};
 	virtual ~RemoteRootNodeAdditionTrigger(){};
 
 	/* implemetntations of observer interface */
@@ -78,8 +123,19 @@ public:
 		 * addRemoteRootNode().
 		 */
 		if(rootId != observedScene->getRootId()) {
-			LOG(DEBUG) << "RemoteRootNodeAdditionTrigger: triggering now.";
-			b->step(b); // A single step.
+			{
+				std::lock_guard<std::mutex> lock(syncMutex);
+				updatePeerState(rootId, attributes);
+				hasSyncRequest = true;
+				requestedVersion = peers[rootId].seenVersion;
+				resyncPending = true;
+			}
+			/*
+			 * The update is applied under the world model write lock of its writer (e.g. a reciever),
+			 * so the resync can not run here. It is done by the thread that waits for the request.
+			 */
+			LOG(DEBUG) << "RemoteRootNodeAdditionTrigger: requesting a resync.";
+			resyncCondition.notify_all();
 		} else {
 			LOG(DEBUG) << "RemoteRootNodeAdditionTrigger: Skipping addRemoteRootNode from local graph.";
 		}
@@ -87,20 +143,948 @@ public:
 		return true;
 	};
 	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false){return true;};
-	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0)){return true;};
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0)){
+
+		/* Other agents publish their synchronization state as attributes of their root nodes */
+		if(id != observedScene->getRootId()) {
+			std::lock_guard<std::mutex> lock(syncMutex);
+			updatePeerState(id, newAttributes);
+		}
+		return true;
+	};
 	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp){return true;};
     bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp){return true;};
 	bool deleteNode(Id id){return true;};
 	bool addParent(Id id, Id parentId){return true;};
     bool removeParent(Id id, Id parentId){return true;};
 
+    /**
+     * Retrieves the version that the most recently added remote root node
+     * reported to have seen of our graph.
+     * @param[out] seenVersion The reported version. Empty if the peer did not report one.
+     * @return True if there is a pending request. The request is cleared.
+     */
+    bool popSyncRequest(std::string& seenVersion) {
+    	std::lock_guard<std::mutex> lock(syncMutex);
+    	bool result = hasSyncRequest;
+    	seenVersion = requestedVersion;
+    	hasSyncRequest = false;
+    	requestedVersion = "";
+    	return result;
+    }
+
+    /**
+     * Blocks until a resync has been requested by a new remote root node or until waiting is stopped.
+     * @return True if a resync is pending. The request is cleared.
+     */
+    bool waitForResyncRequest() {
+    	std::unique_lock<std::mutex> lock(syncMutex);
+    	while(waiting && !resyncPending) {
+    		resyncCondition.wait(lock);
+    	}
+    	bool result = resyncPending;
+    	resyncPending = false;
+    	return result;
+    }
+
+    /**
+     * Releases or re-arms waitForResyncRequest(). Requests that arrive meanwhile are kept.
+     */
+    void setWaiting(bool enabled) {
+    	{
+    		std::lock_guard<std::mutex> lock(syncMutex);
+    		waiting = enabled;
+    	}
+    	resyncCondition.notify_all();
+    }
+
+    /**
+     * Copy of the synchronization states of all known peers.
+     */
+    void getPeers(std::map<Id, PeerSyncState>& result) {
+    	std::lock_guard<std::mutex> lock(syncMutex);
+    	result = peers;
+    }
+
 private:
 
+    /// Parses the sync attributes of a (remote) root node. Has to be called with syncMutex held.
+    void updatePeerState(Id rootId, vector<Attribute>& attributes) {
+    	std::string seenKey = SYNC_SEEN_KEY_PREFIX + observedScene->getRootId().toString();
+    	for(vector<Attribute>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+    		if(it->key.compare(SYNC_VERSION_KEY) == 0) {
+    			peers[rootId].version = it->value;
+    			peers[rootId].lastReport = time(0);
+    		} else if (it->key.compare(seenKey) == 0) {
+    			peers[rootId].seenVersion = it->value;
+    			peers[rootId].lastReport = time(0);
+    		}
+    	}
+    }
+
     // For potentaion queries to the graph
     SceneGraphFacade* observedScene;
 
-    // Block that gets triggerd on an addRemoteRootNode event;
-    ubx_block_t *b;
+    // Synchronization state of other agents
+    std::mutex syncMutex;
+    std::map<Id, PeerSyncState> peers;
+    bool hasSyncRequest;
+    std::string requestedVersion;
+
+    // Resync requests of new remote root nodes
+    std::condition_variable resyncCondition;
+    bool resyncPending;
+    bool waiting;
+};
+
+/**
+ * Assigns a monotonically increasing change sequence number to every update of the observed
+ * scene graph and remembers per node when it was created and last modified.
+ *
+ * Parent-child relations have versions of their own, so adding a parent does not mark the
+ * child as modified and only the new relations are part of a delta.
+ *
+ * Deletions and removed parent-child relations are kept in a bounded history, so a peer
+ * that reports an older version than the oldest entry in that history needs a full resync.
+ * The versions are qualified by an epoch that changes with every start, so versions of a
+ * previous run are never mixed up with the current ones. The string format is "epoch:version".
+ */
+class ChangeSequenceTracker : public brics_3d::rsg::ISceneGraphUpdateObserver {
+public:
+
+	struct NodeVersion {
+		uint64_t created;
+		uint64_t modified;
+	};
+
+	struct Tombstone {
+		uint64_t version;
+		Id id;
+		Id parentId; // nil for a deleted node, otherwise a removed parent-child relation
+	};
+
+	ChangeSequenceTracker(unsigned int maxHistoryLength) : currentVersion(0), oldestRestorableVersion(0), maxHistoryLength(maxHistoryLength) {
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		epoch = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+	};
+	virtual ~ChangeSequenceTracker(){};
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){created(assignedId, parentId); return true;};
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){created(assignedId, parentId); return true;};
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false){created(assignedId, parentId); return true;};
+    bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false){created(assignedId, parentId); return true;};
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false){created(assignedId, parentId); return true;};
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes){return true;};
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false){created(assignedId, parentId); return true;};
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0)){modified(id); return true;};
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp){modified(id); return true;};
+    bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp){modified(id); return true;};
+	bool deleteNode(Id id){
+		std::lock_guard<std::mutex> lock(mutex);
+		nodeVersions.erase(id);
+		parentVersions.erase(id);
+		addTombstone(id, Id(0));
+		return true;
+	};
+	bool addParent(Id id, Id parentId){
+		std::lock_guard<std::mutex> lock(mutex);
+		parentVersions[id][parentId] = ++currentVersion;
+		return true;
+	};
+    bool removeParent(Id id, Id parentId){
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<Id, std::map<Id, uint64_t> >::iterator it = parentVersions.find(id);
+		if(it != parentVersions.end()) {
+			it->second.erase(parentId);
+		}
+		addTombstone(id, parentId);
+		return true;
+	};
+
+    /// The current version as "epoch:version" string.
+    std::string getCurrentVersion() {
+    	std::lock_guard<std::mutex> lock(mutex);
+    	std::stringstream version;
+    	version << epoch << ":" << currentVersion;
+    	return version.str();
+    }
+
+    /**
+     * Checks if all changes since a version can be restored as delta.
+     * @param[in] versionString Version as "epoch:version" string.
+     * @param[out] version The numeric part of the version.
+     * @return False if the version is unknown, from another epoch or older than the history.
+     */
+    bool canRestoreSince(std::string versionString, uint64_t& version) {
+    	std::lock_guard<std::mutex> lock(mutex);
+    	size_t separator = versionString.find(':');
+    	if(separator == std::string::npos) {
+    		return false;
+    	}
+    	uint64_t versionEpoch = strtoull(versionString.substr(0, separator).c_str(), 0, 10);
+    	version = strtoull(versionString.substr(separator + 1).c_str(), 0, 10);
+    	return (versionEpoch == epoch) && (version >= oldestRestorableVersion) && (version <= currentVersion);
+    }
+
+    /**
+     * Gets the version at which a node was created and last modified.
+     * @return False if the node was not changed since this tracker has been attached.
+     */
+    bool getNodeVersion(Id id, NodeVersion& version) {
+    	std::lock_guard<std::mutex> lock(mutex);
+    	std::map<Id, NodeVersion>::const_iterator it = nodeVersions.find(id);
+    	if(it == nodeVersions.end()) {
+    		return false;
+    	}
+    	version = it->second;
+    	return true;
+    }
+
+    /**
+     * Gets the version at which a parent-child relation was established.
+     * @return False if the relation was not changed since this tracker has been attached.
+     */
+    bool getParentVersion(Id id, Id parentId, uint64_t& version) {
+    	std::lock_guard<std::mutex> lock(mutex);
+    	std::map<Id, std::map<Id, uint64_t> >::const_iterator it = parentVersions.find(id);
+    	if(it == parentVersions.end()) {
+    		return false;
+    	}
+    	std::map<Id, uint64_t>::const_iterator parent = it->second.find(parentId);
+    	if(parent == it->second.end()) {
+    		return false;
+    	}
+    	version = parent->second;
+    	return true;
+    }
+
+    /// All deletions and removed parent-child relations after version.
+    void getTombstonesSince(uint64_t version, std::vector<Tombstone>& result) {
+    	std::lock_guard<std::mutex> lock(mutex);
+    	result.clear();
+    	for(std::deque<Tombstone>::const_iterator it = tombstones.begin(); it != tombstones.end(); ++it) {
+    		if(it->version > version) {
+    			result.push_back(*it);
+    		}
+    	}
+    }
+
+private:
+
+    void created(Id id, Id parentId) {
+		std::lock_guard<std::mutex> lock(mutex);
+    	NodeVersion& version = nodeVersions[id];
+    	version.created = ++currentVersion;
+    	version.modified = currentVersion;
+    	parentVersions[id][parentId] = currentVersion; // The traversal might visit the node via another parent first.
+    }
+
+    void modified(Id id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<Id, NodeVersion>::iterator it = nodeVersions.find(id);
+		if(it == nodeVersions.end()) { // existed before this tracker was attached
+			NodeVersion& version = nodeVersions[id];
+			version.created = 0;
+			version.modified = ++currentVersion;
+		} else {
+			it->second.modified = ++currentVersion;
+		}
+    }
+
+    /// Has to be called with mutex held.
+    void addTombstone(Id id, Id parentId) {
+    	Tombstone tombstone;
+    	tombstone.version = ++currentVersion;
+    	tombstone.id = id;
+    	tombstone.parentId = parentId;
+    	tombstones.push_back(tombstone);
+    	while(tombstones.size() > maxHistoryLength) {
+    		oldestRestorableVersion = tombstones.front().version;
+    		tombstones.pop_front();
+    	}
+    }
+
+    std::mutex mutex;
+    uint64_t epoch;
+    uint64_t currentVersion;
+    uint64_t oldestRestorableVersion;
+    unsigned int maxHistoryLength;
+    std::map<Id, NodeVersion> nodeVersions;
+    std::map<Id, std::map<Id, uint64_t> > parentVersions; // child -> parent -> version
+    std::deque<Tombstone> tombstones;
+};
+
+/**
+ * Sits between a SceneGraphToUpdatesTraverser and the serializer and forwards only
+ * those parts of a full graph traversal that changed since a given version:
+ * Nodes created afterwards are forwarded as they are. Nodes that already existed
+ * but have been modified afterwards are translated into setNodeAttributes and
+ * setTransform updates. Parent-child relations are forwarded if they have been
+ * established afterwards. Everything else is skipped.
+ */
+class DeltaResyncFilter : public brics_3d::rsg::ISceneGraphUpdateObserver {
+public:
+	DeltaResyncFilter(ChangeSequenceTracker* tracker, ISceneGraphUpdateObserver* observer) : tracker(tracker), observer(observer), sinceVersion(0){};
+	virtual ~DeltaResyncFilter(){};
+
+	void setSinceVersion(uint64_t version) {
+		sinceVersion = version;
+	}
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){
+		switch (classify(assignedId)) {
+			case CREATED:
+				return observer->addNode(parentId, assignedId, attributes, forcedId);
+			case MODIFIED:
+				return observer->setNodeAttributes(assignedId, attributes);
+			default:
+				return true;
+		}
+	};
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){
+		switch (classify(assignedId)) {
+			case CREATED:
+				return observer->addGroup(parentId, assignedId, attributes, forcedId);
+			case MODIFIED:
+				return observer->setNodeAttributes(assignedId, attributes);
+			default:
+				return true;
+		}
+	};
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false){
+		switch (classify(assignedId)) {
+			case CREATED:
+				return observer->addTransformNode(parentId, assignedId, attributes, transform, timeStamp, forcedId);
+			case MODIFIED:
+				observer->setNodeAttributes(assignedId, attributes);
+				return observer->setTransform(assignedId, transform, timeStamp);
+			default:
+				return true;
+		}
+	};
+    bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false){
+		switch (classify(assignedId)) {
+			case CREATED:
+				return observer->addUncertainTransformNode(parentId, assignedId, attributes, transform, uncertainty, timeStamp, forcedId);
+			case MODIFIED:
+				observer->setNodeAttributes(assignedId, attributes);
+				return observer->setUncertainTransform(assignedId, transform, uncertainty, timeStamp);
+			default:
+				return true;
+		}
+    };
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false){
+		switch (classify(assignedId)) {
+			case CREATED:
+				return observer->addGeometricNode(parentId, assignedId, attributes, shape, timeStamp, forcedId);
+			case MODIFIED:
+				return observer->setNodeAttributes(assignedId, attributes);
+			default:
+				return true;
+		}
+	};
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes){
+		return observer->addRemoteRootNode(rootId, attributes);
+	};
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false){
+		switch (classify(assignedId)) {
+			case CREATED:
+				return observer->addConnection(parentId, assignedId, attributes, sourceIds, targetIds, start, end, forcedId);
+			case MODIFIED:
+				return observer->setNodeAttributes(assignedId, attributes);
+			default:
+				return true;
+		}
+	};
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0)){
+		return (classify(id) != UNCHANGED) ? observer->setNodeAttributes(id, newAttributes, timeStamp) : true;
+	};
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp){
+		return (classify(id) != UNCHANGED) ? observer->setTransform(id, transform, timeStamp) : true;
+	};
+    bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp){
+		return (classify(id) != UNCHANGED) ? observer->setUncertainTransform(id, transform, uncertainty, timeStamp) : true;
+    };
+	bool deleteNode(Id id){
+		return observer->deleteNode(id);
+	};
+	bool addParent(Id id, Id parentId){
+		uint64_t version;
+		if(tracker->getParentVersion(id, parentId, version) && (version > sinceVersion)) {
+			return observer->addParent(id, parentId);
+		}
+		return true;
+	};
+    bool removeParent(Id id, Id parentId){
+    	return observer->removeParent(id, parentId);
+    };
+
+private:
+
+    enum ChangeType {UNCHANGED, CREATED, MODIFIED};
+
+    ChangeType classify(Id id) {
+    	ChangeSequenceTracker::NodeVersion version;
+    	if(!tracker->getNodeVersion(id, version)) {
+    		return UNCHANGED;
+    	}
+    	if(version.created > sinceVersion) {
+    		return CREATED;
+    	}
+    	if(version.modified > sinceVersion) {
+    		return MODIFIED;
+    	}
+    	return UNCHANGED;
+    }
+
+    ChangeSequenceTracker* tracker;
+    ISceneGraphUpdateObserver* observer;
+    uint64_t sinceVersion;
+};
+
+/**
+ * Merges transform updates per node: Only the newest pending setTransform or
+ * setUncertainTransform of a node is kept and all pending ones are forwarded
+ * as one batch at every flush. Thus intermediate poses that would be outdated
+ * anyway are never send, while the latest pose remains exact.
+ *
+ * All other updates are forwarded immediately. Pending transforms of a node
+ * are discarded when the node gets deleted. Forwarding is serialized, so flush()
+ * can be called from another thread.
+ */
+class TransformUpdateCoalescer : public brics_3d::rsg::ISceneGraphUpdateObserver {
+public:
+	TransformUpdateCoalescer(ISceneGraphUpdateObserver* observer) : observer(observer), coalescedUpdates(0){};
+	virtual ~TransformUpdateCoalescer(){};
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->addNode(parentId, assignedId, attributes, forcedId);
+	};
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->addGroup(parentId, assignedId, attributes, forcedId);
+	};
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->addTransformNode(parentId, assignedId, attributes, transform, timeStamp, forcedId);
+	};
+    bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->addUncertainTransformNode(parentId, assignedId, attributes, transform, uncertainty, timeStamp, forcedId);
+    };
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->addGeometricNode(parentId, assignedId, attributes, shape, timeStamp, forcedId);
+	};
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->addRemoteRootNode(rootId, attributes);
+	};
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->addConnection(parentId, assignedId, attributes, sourceIds, targetIds, start, end, forcedId);
+	};
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0)){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->setNodeAttributes(id, newAttributes, timeStamp);
+	};
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp){
+		std::lock_guard<std::mutex> lock(mutex);
+		PendingTransform& pending = getPending(id);
+		pending.transform = transform;
+		pending.uncertainty.reset();
+		pending.timeStamp = timeStamp;
+		return true;
+	};
+    bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp){
+		std::lock_guard<std::mutex> lock(mutex);
+		PendingTransform& pending = getPending(id);
+		pending.transform = transform;
+		pending.uncertainty = uncertainty;
+		pending.timeStamp = timeStamp;
+		return true;
+    };
+	bool deleteNode(Id id){
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingTransforms.erase(id);
+		return observer->deleteNode(id);
+	};
+	bool addParent(Id id, Id parentId){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->addParent(id, parentId);
+	};
+    bool removeParent(Id id, Id parentId){
+		std::lock_guard<std::mutex> lock(mutex);
+		return observer->removeParent(id, parentId);
+    };
+
+    /**
+     * Forwards all pending transforms.
+     * @param batcher Optional. Bundles exactly the pending transforms into one batch.
+     * @return Number of forwarded transforms.
+     */
+    unsigned int flush(UpdateBatcher* batcher = 0) {
+    	std::lock_guard<std::mutex> lock(mutex);
+    	unsigned int count = pendingTransforms.size();
+    	if((batcher != 0) && (count > 0)) {
+    		batcher->beginBatch(); // Scope of the calling thread, so other writers are not affected.
+    	}
+    	for(std::map<Id, PendingTransform>::iterator it = pendingTransforms.begin(); it != pendingTransforms.end(); ++it) {
+    		if(it->second.uncertainty) {
+    			observer->setUncertainTransform(it->first, it->second.transform, it->second.uncertainty, it->second.timeStamp);
+    		} else {
+    			observer->setTransform(it->first, it->second.transform, it->second.timeStamp);
+    		}
+    	}
+    	pendingTransforms.clear();
+    	if((batcher != 0) && (count > 0)) {
+    		batcher->endBatch();
+    	}
+    	if(coalescedUpdates > 0) {
+    		LOG(DEBUG) << "TransformUpdateCoalescer: Forwarded " << count << " transforms, " << coalescedUpdates << " outdated ones have been skipped.";
+    		coalescedUpdates = 0;
+    	}
+    	return count;
+    }
+
+    /**
+     * Mutex that serializes all updates forwarded by this coalescer.
+     * Hold it while sending to the same observer via another path.
+     */
+    std::mutex& getMutex() {
+    	return mutex;
+    }
+
+private:
+
+    struct PendingTransform {
+    	IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform;
+    	ITransformUncertainty::ITransformUncertaintyPtr uncertainty; // optional
+    	TimeStamp timeStamp;
+    };
+
+    /// Has to be called with mutex held.
+    PendingTransform& getPending(Id id) {
+    	std::map<Id, PendingTransform>::iterator it = pendingTransforms.find(id);
+    	if(it != pendingTransforms.end()) {
+    		coalescedUpdates++;
+    		return it->second;
+    	}
+    	return pendingTransforms[id];
+    }
+
+    ISceneGraphUpdateObserver* observer;
+    std::mutex mutex;
+    std::map<Id, PendingTransform> pendingTransforms;
+    unsigned long coalescedUpdates;
+};
+
+/**
+ * Decouples the scene graph writers from the encoding of updates: Every update is
+ * only copied into a record of a bounded multi-producer/single-consumer ring buffer
+ * and a worker thread forwards the records to the observer (i.e. the serializer).
+ *
+ * Every slot of the ring has a sequence number that tells whether it is free for a
+ * given position or holds a published record (cf. D. Vyukov's bounded queue). Updates
+ * can originate from different blocks (i.e. threads); a producer claims a position with
+ * a compare-and-swap on the head, so producers do not lock each other out.
+ *
+ * If the ring is full, the producer either blocks on a condition variable until the
+ * worker frees a slot (backpressure) or, for the drop policy, discards Transform updates.
+ * Structural updates are never dropped since that would break the replicas of other agents.
+ */
+class AsyncUpdateForwarder : public brics_3d::rsg::ISceneGraphUpdateObserver {
+public:
+
+	enum QueuePolicy {
+		BACKPRESSURE = 0,
+		DROP_TRANSFORMS = 1
+	};
+
+	AsyncUpdateForwarder(ISceneGraphUpdateObserver* observer, unsigned int capacity, QueuePolicy policy) :
+		observer(observer), records(capacity), sequences(capacity), capacity(capacity), policy(policy),
+		head(0), tail(0), dropped(0), queueDepthStat(0), dropsStat(0), waitingProducers(0), consumerWaiting(false), stopRequested(false), worker(0) {
+		assert(capacity > 0);
+		for (uint64_t i = 0; i < capacity; ++i) {
+			sequences[i].store(i, std::memory_order_relaxed); // free for position i
+		}
+	};
+	virtual ~AsyncUpdateForwarder(){
+		stop();
+	};
+
+	/// Starts the worker thread.
+	void start() {
+		if(worker == 0) {
+			stopRequested = false;
+			worker = new std::thread(&AsyncUpdateForwarder::run, this);
+		}
+	}
+
+	/// Stops the worker thread after all queued updates have been forwarded.
+	void stop() {
+		if(worker != 0) {
+			{
+				std::lock_guard<std::mutex> lock(wakeupMutex);
+				stopRequested = true;
+			}
+			wakeup.notify_all();
+			worker->join();
+			delete worker;
+			worker = 0;
+		}
+	}
+
+	/**
+	 * Forwards all published updates in the calling thread instead of waiting for the worker.
+	 * Has to be called with the dispatch mutex held.
+	 */
+	void dispatchPending() {
+		while(dispatchNext()) {
+		}
+	}
+
+	/**
+	 * Mutex that is held while a record is forwarded.
+	 * Hold it while sending to the same observer via another path.
+	 */
+	std::mutex& getDispatchMutex() {
+		return dispatchMutex;
+	}
+
+	unsigned long getDroppedCount() {
+		return dropped.load(std::memory_order_relaxed);
+	}
+
+	/// Publishes the queue depth and the number of dropped updates. Call it before start().
+	void setStats(StatsCounter* queueDepth, StatsCounter* drops) {
+		queueDepthStat = queueDepth;
+		dropsStat = drops;
+	}
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){
+		UpdateRecord* record = beginRecord(UpdateRecord::ADD_NODE);
+		record->parentId = parentId;
+		record->id = assignedId;
+		record->attributes.swap(attributes);
+		record->forcedId = forcedId;
+		return commitRecord(record);
+	};
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false){
+		UpdateRecord* record = beginRecord(UpdateRecord::ADD_GROUP);
+		record->parentId = parentId;
+		record->id = assignedId;
+		record->attributes.swap(attributes);
+		record->forcedId = forcedId;
+		return commitRecord(record);
+	};
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false){
+		UpdateRecord* record = beginRecord(UpdateRecord::ADD_TRANSFORM_NODE);
+		record->parentId = parentId;
+		record->id = assignedId;
+		record->attributes.swap(attributes);
+		record->transform = transform;
+		record->timeStamp = timeStamp;
+		record->forcedId = forcedId;
+		return commitRecord(record);
+	};
+    bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false){
+		UpdateRecord* record = beginRecord(UpdateRecord::ADD_UNCERTAIN_TRANSFORM_NODE);
+		record->parentId = parentId;
+		record->id = assignedId;
+		record->attributes.swap(attributes);
+		record->transform = transform;
+		record->uncertainty = uncertainty;
+		record->timeStamp = timeStamp;
+		record->forcedId = forcedId;
+		return commitRecord(record);
+    };
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false){
+		UpdateRecord* record = beginRecord(UpdateRecord::ADD_GEOMETRIC_NODE);
+		record->parentId = parentId;
+		record->id = assignedId;
+		record->attributes.swap(attributes);
+		record->shape = shape;
+		record->timeStamp = timeStamp;
+		record->forcedId = forcedId;
+		return commitRecord(record);
+	};
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes){
+		UpdateRecord* record = beginRecord(UpdateRecord::ADD_REMOTE_ROOT_NODE);
+		record->id = rootId;
+		record->attributes.swap(attributes);
+		return commitRecord(record);
+	};
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false){
+		UpdateRecord* record = beginRecord(UpdateRecord::ADD_CONNECTION);
+		record->parentId = parentId;
+		record->id = assignedId;
+		record->attributes.swap(attributes);
+		record->sourceIds.swap(sourceIds);
+		record->targetIds.swap(targetIds);
+		record->timeStamp = start;
+		record->endTimeStamp = end;
+		record->forcedId = forcedId;
+		return commitRecord(record);
+	};
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0)){
+		UpdateRecord* record = beginRecord(UpdateRecord::SET_NODE_ATTRIBUTES);
+		record->id = id;
+		record->attributes.swap(newAttributes);
+		record->timeStamp = timeStamp;
+		return commitRecord(record);
+	};
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp){
+		UpdateRecord* record = beginRecord(UpdateRecord::SET_TRANSFORM);
+		if(record == 0) {
+			return true; // dropped
+		}
+		record->id = id;
+		record->transform = transform;
+		record->timeStamp = timeStamp;
+		return commitRecord(record);
+	};
+    bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp){
+		UpdateRecord* record = beginRecord(UpdateRecord::SET_UNCERTAIN_TRANSFORM);
+		if(record == 0) {
+			return true; // dropped
+		}
+		record->id = id;
+		record->transform = transform;
+		record->uncertainty = uncertainty;
+		record->timeStamp = timeStamp;
+		return commitRecord(record);
+    };
+	bool deleteNode(Id id){
+		UpdateRecord* record = beginRecord(UpdateRecord::DELETE_NODE);
+		record->id = id;
+		return commitRecord(record);
+	};
+	bool addParent(Id id, Id parentId){
+		UpdateRecord* record = beginRecord(UpdateRecord::ADD_PARENT);
+		record->id = id;
+		record->parentId = parentId;
+		return commitRecord(record);
+	};
+    bool removeParent(Id id, Id parentId){
+		UpdateRecord* record = beginRecord(UpdateRecord::REMOVE_PARENT);
+		record->id = id;
+		record->parentId = parentId;
+		return commitRecord(record);
+    };
+
+private:
+
+    /// Copy of the arguments of a single observer call.
+    struct UpdateRecord {
+    	enum Operation {
+    		ADD_NODE, ADD_GROUP, ADD_TRANSFORM_NODE, ADD_UNCERTAIN_TRANSFORM_NODE, ADD_GEOMETRIC_NODE,
+    		ADD_REMOTE_ROOT_NODE, ADD_CONNECTION, SET_NODE_ATTRIBUTES, SET_TRANSFORM, SET_UNCERTAIN_TRANSFORM,
+    		DELETE_NODE, ADD_PARENT, REMOVE_PARENT
+    	};
+
+    	Operation operation;
+    	Id id;
+    	Id parentId;
+    	vector<Attribute> attributes;
+    	IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform;
+    	ITransformUncertainty::ITransformUncertaintyPtr uncertainty;
+    	Shape::ShapePtr shape;
+    	vector<Id> sourceIds;
+    	vector<Id> targetIds;
+    	TimeStamp timeStamp;
+    	TimeStamp endTimeStamp;
+    	bool forcedId;
+    	uint64_t position; // Position in the ring it has been reserved for.
+    };
+
+    /**
+     * Reserves the next free record. Blocks while the ring is full, unless the update is dropped.
+     * @return The record or 0 if a Transform update has been dropped.
+     */
+    UpdateRecord* beginRecord(UpdateRecord::Operation operation) {
+    	uint64_t position = head.load(std::memory_order_relaxed);
+    	while(true) {
+    		uint64_t sequence = sequences[position % capacity].load(std::memory_order_acquire);
+    		if(sequence == position) { // free
+    			if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+    				break;
+    			}
+    		} else if(sequence < position) { // full
+    			if((policy == DROP_TRANSFORMS) && ((operation == UpdateRecord::SET_TRANSFORM) || (operation == UpdateRecord::SET_UNCERTAIN_TRANSFORM))) {
+    				if(dropsStat) {
+    					dropsStat->add();
+    				}
+    				if((dropped.fetch_add(1, std::memory_order_relaxed) % 1000) == 0) {
+    					LOG(WARNING) << "AsyncUpdateForwarder: Queue is full. Dropped " << dropped.load(std::memory_order_relaxed) << " Transform updates so far.";
+    				}
+    				return 0;
+    			}
+    			waitForSpace(position);
+    			position = head.load(std::memory_order_relaxed);
+    		} else { // Another producer claimed it meanwhile.
+    			position = head.load(std::memory_order_relaxed);
+    		}
+    	}
+    	UpdateRecord* record = &records[position % capacity];
+    	record->operation = operation;
+    	record->position = position;
+    	return record;
+    }
+
+    /// Publishes a reserved record.
+    bool commitRecord(UpdateRecord* record) {
+    	sequences[record->position % capacity].store(record->position + 1, std::memory_order_release);
+    	if(queueDepthStat) {
+    		queueDepthStat->set(head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed));
+    	}
+    	notifyConsumer();
+    	return true;
+    }
+
+    /// Blocks until the slot for the given position has been freed by the consumer.
+    void waitForSpace(uint64_t position) {
+    	std::unique_lock<std::mutex> lock(spaceMutex);
+    	waitingProducers.fetch_add(1); // Sequentially consistent with the check in dispatchNext().
+    	notifyConsumer();
+    	while(sequences[position % capacity].load() < position) {
+    		space.wait(lock);
+    	}
+    	waitingProducers.fetch_sub(1);
+    }
+
+    void notifyConsumer() {
+    	if(consumerWaiting.load(std::memory_order_acquire)) {
+    		std::lock_guard<std::mutex> lock(wakeupMutex);
+    		wakeup.notify_one();
+    	}
+    }
+
+    /// True if the record at the tail has been published.
+    bool hasPublished() {
+    	uint64_t position = tail.load(std::memory_order_relaxed);
+    	return sequences[position % capacity].load(std::memory_order_acquire) == position + 1;
+    }
+
+    /**
+     * Forwards the record at the tail, if it has been published, and frees its slot.
+     * Has to be called with the dispatch mutex held, which makes the caller the single consumer.
+     * @return False if there was nothing to forward.
+     */
+    bool dispatchNext() {
+    	uint64_t position = tail.load(std::memory_order_relaxed);
+    	if(sequences[position % capacity].load(std::memory_order_acquire) != position + 1) {
+    		return false;
+    	}
+    	UpdateRecord& record = records[position % capacity];
+    	dispatch(record);
+    	record.transform.reset(); // Do not keep the data alive longer than necessary.
+    	record.uncertainty.reset();
+    	record.shape.reset();
+    	tail.store(position + 1, std::memory_order_relaxed);
+    	sequences[position % capacity].store(position + capacity); // free for the next round
+    	if(queueDepthStat) {
+    		queueDepthStat->set(head.load(std::memory_order_relaxed) - (position + 1));
+    	}
+    	if(waitingProducers.load() > 0) {
+    		std::lock_guard<std::mutex> lock(spaceMutex);
+    		space.notify_all();
+    	}
+    	return true;
+    }
+
+    /// Worker thread
+    void run() {
+    	while(true) {
+    		if(!hasPublished()) { // empty
+    			std::unique_lock<std::mutex> lock(wakeupMutex);
+    			if(stopRequested) {
+    				return;
+    			}
+    			consumerWaiting.store(true, std::memory_order_release);
+    			if(!hasPublished()) {
+    				wakeup.wait_for(lock, std::chrono::milliseconds(10));
+    			}
+    			consumerWaiting.store(false, std::memory_order_release);
+    			continue;
+    		}
+
+    		std::lock_guard<std::mutex> lock(dispatchMutex);
+    		dispatchNext();
+    	}
+    }
+
+    void dispatch(UpdateRecord& record) {
+    	switch (record.operation) {
+    		case UpdateRecord::ADD_NODE:
+    			observer->addNode(record.parentId, record.id, record.attributes, record.forcedId);
+    			break;
+    		case UpdateRecord::ADD_GROUP:
+    			observer->addGroup(record.parentId, record.id, record.attributes, record.forcedId);
+    			break;
+    		case UpdateRecord::ADD_TRANSFORM_NODE:
+    			observer->addTransformNode(record.parentId, record.id, record.attributes, record.transform, record.timeStamp, record.forcedId);
+    			break;
+    		case UpdateRecord::ADD_UNCERTAIN_TRANSFORM_NODE:
+    			observer->addUncertainTransformNode(record.parentId, record.id, record.attributes, record.transform, record.uncertainty, record.timeStamp, record.forcedId);
+    			break;
+    		case UpdateRecord::ADD_GEOMETRIC_NODE:
+    			observer->addGeometricNode(record.parentId, record.id, record.attributes, record.shape, record.timeStamp, record.forcedId);
+    			break;
+    		case UpdateRecord::ADD_REMOTE_ROOT_NODE:
+    			observer->addRemoteRootNode(record.id, record.attributes);
+    			break;
+    		case UpdateRecord::ADD_CONNECTION:
+    			observer->addConnection(record.parentId, record.id, record.attributes, record.sourceIds, record.targetIds, record.timeStamp, record.endTimeStamp, record.forcedId);
+    			break;
+    		case UpdateRecord::SET_NODE_ATTRIBUTES:
+    			observer->setNodeAttributes(record.id, record.attributes, record.timeStamp);
+    			break;
+    		case UpdateRecord::SET_TRANSFORM:
+    			observer->setTransform(record.id, record.transform, record.timeStamp);
+    			break;
+    		case UpdateRecord::SET_UNCERTAIN_TRANSFORM:
+    			observer->setUncertainTransform(record.id, record.transform, record.uncertainty, record.timeStamp);
+    			break;
+    		case UpdateRecord::DELETE_NODE:
+    			observer->deleteNode(record.id);
+    			break;
+    		case UpdateRecord::ADD_PARENT:
+    			observer->addParent(record.id, record.parentId);
+    			break;
+    		case UpdateRecord::REMOVE_PARENT:
+    			observer->removeParent(record.id, record.parentId);
+    			break;
+    	}
+    }
+
+    ISceneGraphUpdateObserver* observer;
+    std::vector<UpdateRecord> records;
+    std::vector<std::atomic<uint64_t> > sequences; // Per slot: position it is free for or position + 1 if published.
+    uint64_t capacity;
+    QueuePolicy policy;
+
+    std::atomic<uint64_t> head;       // Next position to be claimed by a producer.
+    std::atomic<uint64_t> tail;       // Next record to be read. Only modified with dispatchMutex held.
+    std::atomic<unsigned long> dropped;
+    StatsCounter* queueDepthStat;
+    StatsCounter* dropsStat;
+
+    std::mutex dispatchMutex;
+    std::mutex spaceMutex;
+    std::condition_variable space;    // Producers that wait for a free slot.
+    std::atomic<unsigned int> waitingProducers;
+    std::mutex wakeupMutex;
+    std::condition_variable wakeup;
+    std::atomic<bool> consumerWaiting;
+    bool stopRequested;
+    std::thread* worker;
 };
 
 /**
@@ -158,11 +1142,153 @@ struct rsg_json_sender_info
 		OnErrorTrigger* error_trigger;
 		TimeStamper* time_stamper;
 
+		/* instrumentation */
+		BlockStats* stats;
+		TimedUpdateObserver* encode_timer; // Measures encoding including sending.
+		BlockLogger* logger; // Level of the RSG_LOG messages.
+
+		/* optional batching of updates into one message */
+		UpdateBatcher* batcher;
+
+		/* optional compression of every message */
+		UpdateCompressor* compressor;
+
+		/* optional asynchronous encoding */
+		AsyncUpdateForwarder* async_forwarder;
+
+		/* optional coalescing of transform updates */
+		TransformUpdateCoalescer* coalescer;
+		uint32_t coalesce_period; // [ms]
+		std::thread* coalesce_thread;
+		std::mutex* coalesce_thread_mutex;
+		std::condition_variable* coalesce_thread_condition;
+		bool coalesce_thread_stop;
+
+		/* resyncs requested by new remote root nodes */
+		std::thread* resync_thread;
+
+		/* delta_sync mode */
+		bool delta_sync;
+		ChangeSequenceTracker* change_tracker;
+		DeltaResyncFilter* delta_filter;
+		brics_3d::rsg::SceneGraphToUpdatesTraverser* wm_delta_resender;
+
+		/* optional write-ahead journal */
+		JournalWriter* journal;
+		BinaryUpdateSerializer* journal_serializer;
+
         /* this is to have fast access to ports for reading and writing, without
          * needing a hash table lookup */
         struct rsg_json_sender_port_cache ports;
 };
 
+/**
+ * Sets or adds an attribute with a given key.
+ */
+static void set_attribute(vector<Attribute>& attributes, std::string key, std::string value)
+{
+	for(vector<Attribute>::iterator it = attributes.begin(); it != attributes.end(); ++it) {
+		if(it->key.compare(key) == 0) {
+			it->value = value;
+			return;
+		}
+	}
+	attributes.push_back(Attribute(key, value));
+}
+
+/**
+ * Determines the version since which changes have to be resend.
+ * An explicit request of a newly appeared peer has precedence, otherwise the oldest
+ * version that any recently active peer has seen is used.
+ * @param[out] version The version since which changes have to be send.
+ * @return False if a complete resync is required.
+ */
+static bool get_delta_sync_version(struct rsg_json_sender_info *inf, uint64_t& version)
+{
+	std::string seenVersion;
+	if(inf->remote_root_trigger->popSyncRequest(seenVersion)) {
+		if(!inf->change_tracker->canRestoreSince(seenVersion, version)) {
+			LOG(DEBUG) << "rsg_json_sender: Peer reported version \"" << seenVersion << "\" cannot be restored as delta.";
+			return false;
+		}
+		return true;
+	}
+
+	std::map<Id, RemoteRootNodeAdditionTrigger::PeerSyncState> peers;
+	inf->remote_root_trigger->getPeers(peers);
+	time_t now = time(0);
+	bool hasActivePeer = false;
+	for(std::map<Id, RemoteRootNodeAdditionTrigger::PeerSyncState>::const_iterator it = peers.begin(); it != peers.end(); ++it) {
+		if(now - it->second.lastReport > SYNC_PEER_TIMEOUT) {
+			continue;
+		}
+		uint64_t peerVersion;
+		if(!inf->change_tracker->canRestoreSince(it->second.seenVersion, peerVersion)) {
+			return false;
+		}
+		version = hasActivePeer ? std::min(version, peerVersion) : peerVersion;
+		hasActivePeer = true;
+	}
+	return hasActivePeer;
+}
+
+/**
+ * Advertises our version and the versions we have seen of our peers as attributes of our root node.
+ * Has to be called at the end of a resync, within its batch scope.
+ *
+ * A peer echoes our version as "seen" and the next delta resync to it starts there. That is only
+ * correct if the peer applied the complete resync, not just the advertisement. The advertisement is
+ * therefore only valid if it is part of the very same message as the resync, which is delivered as
+ * a whole or not at all. Otherwise (no batcher, or the resync did not fit into one batch) an empty
+ * version is advertised: peers keep acknowledging the version they had before, which is older but
+ * complete, or fall back to a complete resync.
+ *
+ * The advertisement is written to the encoder directly; it is no change of the local graph.
+ */
+static void advertise_sync_state(struct rsg_json_sender_info *inf)
+{
+	brics_3d::WorldModel* wm = inf->wm;
+	bool atomic = (inf->batcher != 0) && (inf->batcher->getScopeMessageCount() == 0);
+
+	vector<Attribute> rootAttributes;
+	wm->scene.getNodeAttributes(wm->getRootNodeId(), rootAttributes);
+	set_attribute(rootAttributes, SYNC_VERSION_KEY, atomic ? inf->change_tracker->getCurrentVersion() : "");
+	std::map<Id, RemoteRootNodeAdditionTrigger::PeerSyncState> peers;
+	inf->remote_root_trigger->getPeers(peers);
+	for(std::map<Id, RemoteRootNodeAdditionTrigger::PeerSyncState>::const_iterator it = peers.begin(); it != peers.end(); ++it) {
+		if(!it->second.version.empty()) {
+			set_attribute(rootAttributes, SYNC_SEEN_KEY_PREFIX + it->first.toString(), it->second.version);
+		}
+	}
+	inf->encode_timer->setNodeAttributes(wm->getRootNodeId(), rootAttributes);
+
+	if(atomic && (inf->batcher->getScopeMessageCount() > 0)) { // The advertisement itself did not fit anymore.
+		set_attribute(rootAttributes, SYNC_VERSION_KEY, "");
+		inf->encode_timer->setNodeAttributes(wm->getRootNodeId(), rootAttributes);
+		atomic = false;
+	}
+	if(!atomic) {
+		LOG(DEBUG) << "rsg_json_sender: Resync was split into several messages. Peers cannot acknowledge its version.";
+		inf->stats->getCounter("sync_version_withheld")->add();
+	}
+}
+
+/**
+ * Thread function that flushes the coalesced transforms every coalesce_period.
+ */
+static void coalesce_loop(struct rsg_json_sender_info *inf)
+{
+	std::unique_lock<std::mutex> lock(*inf->coalesce_thread_mutex);
+	while(!inf->coalesce_thread_stop) {
+		inf->coalesce_thread_condition->wait_for(lock, std::chrono::milliseconds(inf->coalesce_period));
+		lock.unlock();
+		inf->coalescer->flush(inf->batcher);
+		lock.lock();
+	}
+}
+
+static void resync_loop(struct rsg_json_sender_info *inf);
+
 /* init */
 int rsg_json_sender_init(ubx_block_t *b)
 {
@@ -180,6 +1306,7 @@ int rsg_json_sender_init(ubx_block_t *b)
         }
         b->private_data=inf;
         update_port_cache(b, &inf->ports);
+        inf->logger = new BlockLogger();
 
     	unsigned int clen;
     	rsg_wm_handle tmpWmHandle =  *((rsg_wm_handle*) ubx_config_get_data_ptr(b, "wm_handle", &clen));
@@ -194,6 +1321,37 @@ int rsg_json_sender_init(ubx_block_t *b)
     		inf->wm = new brics_3d::WorldModel();
     	}
 
+    	/*
+    	 * Optionally recover the world model from the last snapshot and the journal. This happens before any
+    	 * observer of this block is attached, so the recovered updates are neither sent nor journaled again.
+    	 */
+    	std::string journalPrefix = "";
+    	char* journal_prefix = (char*) ubx_config_get_data_ptr(b, "journal_prefix", &clen);
+    	if((clen != 0) && (strcmp(journal_prefix, "") != 0)) {
+    		journalPrefix = journal_prefix;
+    	}
+    	int* journal_replay =  ((int*) ubx_config_get_data_ptr(b, "journal_replay", &clen));
+    	if(!journalPrefix.empty() && (clen != 0) && (*journal_replay == 1)) {
+    		std::string snapshotFile = "";
+    		char* journal_snapshot_file = (char*) ubx_config_get_data_ptr(b, "journal_snapshot_file", &clen);
+    		if(clen != 0) {
+    			snapshotFile = journal_snapshot_file;
+    		}
+    		LOG(INFO) << "rsg_json_sender: Recovering world model from snapshot \"" << snapshotFile << "\" and journal " << journalPrefix;
+    		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    		uint64_t records = 0;
+    		bool recovered;
+    		{
+    			WorldModelWriteLock writeLock(inf->wm);
+    			recovered = JournalReplayer::replay(inf->wm, journalPrefix, snapshotFile, records);
+    		}
+    		if(!recovered) {
+    			LOG(ERROR) << "rsg_json_sender: Recovery failed. Continuing with the current world model.";
+    		}
+    		LOG(INFO) << "rsg_json_sender: Recovery took "
+    				<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms.";
+    	}
+
 
     	/* Attach debug graph printer */
     	brics_3d::rsg::VisualizationConfiguration dotConfig;
@@ -285,21 +1443,160 @@ int rsg_json_sender_init(ubx_block_t *b)
 
     	/* Attach the UBX port to the world model */
     	ubx_type_t* type =  ubx_type_get(b->ni, "unsigned char");
-    	RsgToUbxPort* wmUpdatesUbxPort = new RsgToUbxPort(inf->ports.rsg_out, type);
-    	brics_3d::rsg::JSONSerializer* wmUpdatesToJSONSerializer = new brics_3d::rsg::JSONSerializer(wmUpdatesUbxPort);
+    	inf->stats = BlockStats::get(b->name);
+    	RsgToUbxPort* wmUpdatesUbxPort = new RsgToUbxPort(inf->ports.rsg_out, type, inf->stats, inf->logger);
+    	brics_3d::rsg::IOutputPort* wmUpdatesSendPort = wmUpdatesUbxPort;
+
+    	/* Optionally compress every message before it is sent */
+    	int* compression =  ((int*) ubx_config_get_data_ptr(b, "compression", &clen));
+    	if((clen == 0) || (*compression == 0)) {
+    		LOG(INFO) << "rsg_json_sender: No compression configuration given. Compression is turned off by default.";
+    	} else if(!UpdateCompression::isAvailable()) {
+    		LOG(WARNING) << "rsg_json_sender: compression requested, but the block has been built without zstd support (USE_ZSTD). Compression is turned off.";
+    	} else {
+    		std::string dictionaryFile = "";
+    		char* compression_dictionary = (char*) ubx_config_get_data_ptr(b, "compression_dictionary", &clen);
+    		if(clen != 0) {
+    			dictionaryFile = compression_dictionary;
+    		}
+    		uint32_t threshold = RSG_COMPRESSION_DEFAULT_THRESHOLD;
+    		uint32_t* compression_threshold =  ((uint32_t*) ubx_config_get_data_ptr(b, "compression_threshold", &clen));
+    		if(clen != 0) {
+    			threshold = *compression_threshold;
+    		}
+    		int level = RSG_COMPRESSION_DEFAULT_LEVEL;
+    		int* compression_level =  ((int*) ubx_config_get_data_ptr(b, "compression_level", &clen));
+    		if(clen != 0) {
+    			level = *compression_level;
+    		}
+    		std::string dictionary;
+    		if(UpdateCompression::loadDictionary(dictionaryFile, dictionary)) {
+    			inf->compressor = new UpdateCompressor(wmUpdatesUbxPort, dictionary, threshold, level, inf->stats);
+    			if(inf->compressor->isValid()) {
+    				LOG(INFO) << "rsg_json_sender: compression_dictionary = " << (dictionaryFile.empty() ? "built-in" : dictionaryFile)
+    						<< ", compression_threshold = " << threshold << ", compression_level = " << level;
+    				wmUpdatesSendPort = inf->compressor;
+    			}
+    		} else {
+    			LOG(WARNING) << "rsg_json_sender: Cannot load compression_dictionary " << dictionaryFile << ". Compression is turned off.";
+    		}
+    	}
+    	brics_3d::rsg::IOutputPort* wmUpdatesOutputPort = wmUpdatesSendPort;
+
+    	/* Optionally bundle the updates of a resync or of coalesced transforms into batch messages */
+    	uint32_t* batch_max_bytes =  ((uint32_t*) ubx_config_get_data_ptr(b, "batch_max_bytes", &clen));
+    	if((clen == 0) || (*batch_max_bytes == 0)) {
+    		LOG(INFO) << "rsg_json_sender: No batch_max_bytes configuration given. Batching is turned off by default.";
+    	} else {
+    		uint32_t maxUpdates = 0;
+    		uint32_t* batch_max_updates =  ((uint32_t*) ubx_config_get_data_ptr(b, "batch_max_updates", &clen));
+    		if(clen != 0) {
+    			maxUpdates = *batch_max_updates;
+    		}
+    		LOG(INFO) << "rsg_json_sender: batch_max_bytes = " << *batch_max_bytes << ", batch_max_updates = " << maxUpdates;
+    		inf->batcher = new UpdateBatcher(wmUpdatesSendPort, *batch_max_bytes, maxUpdates);
+    		wmUpdatesOutputPort = inf->batcher;
+    	}
+
+    	brics_3d::rsg::JSONSerializer* wmUpdatesToJSONSerializer = new brics_3d::rsg::JSONSerializer(wmUpdatesOutputPort);
+    	inf->encode_timer = new TimedUpdateObserver(wmUpdatesToJSONSerializer, inf->stats->getHistogram("encode"));
 //    	inf->wm->scene.attachUpdateObserver(inf->frequency_filter);
     	inf->wm->scene.attachUpdateObserver(inf->constraint_filter);
 //    	inf->frequency_filter->attachUpdateObserver(wmUpdatesToJSONSerializer);
-    	inf->constraint_filter->attachUpdateObserver(wmUpdatesToJSONSerializer);
+
+    	/* Optionally merge transform updates that are published within one coalesce_period */
+    	uint32_t* coalesce_period =  ((uint32_t*) ubx_config_get_data_ptr(b, "coalesce_period", &clen));
+    	if(clen == 0) {
+    		LOG(INFO) << "rsg_json_sender: No coalesce_period configuration given. Coalescing is turned off by default.";
+    		inf->coalesce_period = 0;
+    	} else {
+    		inf->coalesce_period = *coalesce_period;
+    	}
+    	LOG(INFO) << "rsg_json_sender: coalesce_period = " << inf->coalesce_period << " [ms]";
+    	brics_3d::rsg::ISceneGraphUpdateObserver* wmUpdatesEncoder = inf->encode_timer;
+    	if(inf->coalesce_period > 0) {
+    		inf->coalescer = new TransformUpdateCoalescer(inf->encode_timer);
+    		wmUpdatesEncoder = inf->coalescer;
+    	}
+
+    	/* Optionally encode and send the updates in a worker thread, so writers to the scene graph do not have to wait for it */
+    	uint32_t* async_queue_len =  ((uint32_t*) ubx_config_get_data_ptr(b, "async_queue_len", &clen));
+    	if((clen == 0) || (*async_queue_len == 0)) {
+    		LOG(INFO) << "rsg_json_sender: No async_queue_len configuration given. Updates are encoded synchronously by default.";
+    		inf->constraint_filter->attachUpdateObserver(wmUpdatesEncoder);
+    	} else {
+    		AsyncUpdateForwarder::QueuePolicy policy = AsyncUpdateForwarder::BACKPRESSURE;
+    		int* async_queue_policy =  ((int*) ubx_config_get_data_ptr(b, "async_queue_policy", &clen));
+    		if((clen != 0) && (*async_queue_policy == 1)) {
+    			policy = AsyncUpdateForwarder::DROP_TRANSFORMS;
+    		}
+    		LOG(INFO) << "rsg_json_sender: async_queue_len = " << *async_queue_len << ", async_queue_policy = "
+    				<< (policy == AsyncUpdateForwarder::DROP_TRANSFORMS ? "drop Transform updates" : "backpressure");
+    		inf->async_forwarder = new AsyncUpdateForwarder(wmUpdatesEncoder, *async_queue_len, policy);
+    		inf->async_forwarder->setStats(inf->stats->getCounter("queue_depth"), inf->stats->getCounter("drops"));
+    		inf->constraint_filter->attachUpdateObserver(inf->async_forwarder);
+    	}
+
+    	/* Optionally append every applied update to a write-ahead journal */
+    	if(!journalPrefix.empty()) {
+    		uint64_t segmentSize = 64 * 1024 * 1024;
+    		uint32_t* journal_segment_size =  ((uint32_t*) ubx_config_get_data_ptr(b, "journal_segment_size", &clen));
+    		if((clen != 0) && (*journal_segment_size > 0)) {
+    			segmentSize = *journal_segment_size;
+    		}
+    		uint32_t syncPeriod = 100;
+    		uint32_t* journal_sync_period =  ((uint32_t*) ubx_config_get_data_ptr(b, "journal_sync_period", &clen));
+    		if(clen != 0) {
+    			syncPeriod = *journal_sync_period;
+    		}
+    		LOG(INFO) << "rsg_json_sender: journal_prefix = " << journalPrefix << ", journal_segment_size = " << segmentSize
+    				<< ", journal_sync_period = " << syncPeriod << " [ms]";
+    		inf->journal = new JournalWriter(journalPrefix, inf->wm->getRootNodeId(), JournalCursor::get(inf->wm), segmentSize, syncPeriod);
+    		inf->journal->setStats(inf->stats->getCounter("journal_bytes"), inf->stats->getCounter("journal_records"), inf->stats->getHistogram("journal_sync"));
+    		if(inf->journal->start()) {
+    			inf->journal_serializer = new BinaryUpdateSerializer(inf->journal);
+    			inf->wm->scene.attachUpdateObserver(inf->journal_serializer);
+    		} else {
+    			LOG(ERROR) << "rsg_json_sender: Cannot start the journal. Journaling is turned off.";
+    		}
+    	} else {
+    		LOG(INFO) << "rsg_json_sender: No journal_prefix configuration given. Journaling is turned off by default.";
+    	}
 
     	/* Set error policy of RSG */
     	inf->wm->scene.setCallObserversEvenIfErrorsOccurred(false);
 
     	/* Initialize resender that resends the complete graph, if necessary */
-    	inf->wm_resender = new brics_3d::rsg::SceneGraphToUpdatesTraverser(wmUpdatesToJSONSerializer);
+    	inf->wm_resender = new brics_3d::rsg::SceneGraphToUpdatesTraverser(inf->encode_timer);
+
+    	/* Optionally keep track of changes such that a resync only has to send a delta */
+    	int* delta_sync =  ((int*) ubx_config_get_data_ptr(b, "delta_sync", &clen));
+    	if(clen == 0) {
+    		LOG(INFO) << "rsg_json_sender: No delta_sync configuration given. Turned off by default.";
+    		inf->delta_sync = false;
+    	} else {
+    		inf->delta_sync = (*delta_sync == 1);
+    		LOG(INFO) << "rsg_json_sender: delta_sync turned " << (inf->delta_sync ? "on." : "off.");
+    	}
+
+    	if(inf->delta_sync) {
+    		unsigned int syncHistoryLength = 10000;
+    		uint32_t* sync_history_len =  ((uint32_t*) ubx_config_get_data_ptr(b, "sync_history_len", &clen));
+    		if(clen == 0) {
+    			LOG(INFO) << "rsg_json_sender: No sync_history_len configuration given. Setting it to " << syncHistoryLength;
+    		} else {
+    			syncHistoryLength = *sync_history_len;
+    		}
+    		LOG(INFO) << "rsg_json_sender: sync_history_len = " << syncHistoryLength;
+
+    		inf->change_tracker = new ChangeSequenceTracker(syncHistoryLength);
+    		inf->wm->scene.attachUpdateObserver(inf->change_tracker);
+    		inf->delta_filter = new DeltaResyncFilter(inf->change_tracker, inf->encode_timer);
+    		inf->wm_delta_resender = new brics_3d::rsg::SceneGraphToUpdatesTraverser(inf->delta_filter);
+    	}
 
     	/* Setup auto mount reply policy for incoming addRemoteNodes  */
-    	inf->remote_root_trigger = new RemoteRootNodeAdditionTrigger(&inf->wm->scene, b);
+    	inf->remote_root_trigger = new RemoteRootNodeAdditionTrigger(&inf->wm->scene);
     	inf->wm->scene.attachUpdateObserver(inf->remote_root_trigger);
 
     	/* Setup error trigger */
@@ -307,7 +1604,7 @@ int rsg_json_sender_init(ubx_block_t *b)
 //    	inf->wm->scene.attachErrorObserver(inf->error_trigger);
 
     	/* Use sender port also for monitor messages */
-    	inf->wm->scene.setMonitorPort(wmUpdatesUbxPort);
+    	inf->wm->scene.setMonitorPort(wmUpdatesSendPort);
 
     	/* Benchmark tool */
     	if(doBenchmark) {
@@ -322,15 +1619,32 @@ int rsg_json_sender_init(ubx_block_t *b)
 /* start */
 int rsg_json_sender_start(ubx_block_t *b)
 {
-        /* struct rsg_json_sender_info *inf = (struct rsg_json_sender_info*) b->private_data; */
+        struct rsg_json_sender_info *inf = (struct rsg_json_sender_info*) b->private_data;
         int ret = 0;
 
+        if(inf->async_forwarder) {
+        	inf->async_forwarder->start();
+        }
+
+        /* Periodically flush coalesced transforms */
+        if(inf->coalescer) {
+        	inf->coalesce_thread_mutex = new std::mutex();
+        	inf->coalesce_thread_condition = new std::condition_variable();
+        	inf->coalesce_thread_stop = false;
+        	inf->coalesce_thread = new std::thread(coalesce_loop, inf);
+        }
+
+        /* Resend the graph whenever another agent appears */
+        inf->remote_root_trigger->setWaiting(true);
+        inf->resync_thread = new std::thread(resync_loop, inf);
+
     	/* Set logger level */
     	unsigned int clen;
     	int* log_level =  ((int*) ubx_config_get_data_ptr(b, "log_level", &clen));
     	if(clen == 0) {
     		LOG(INFO) << "rsg_json_sender: No log_level configuation given.";
     	} else {
+    		inf->logger->setLevel(*log_level);
     		if (*log_level == 0) {
     			LOG(INFO) << "rsg_json_sender: log_level set to DEBUG level.";
     			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
@@ -350,13 +1664,40 @@ int rsg_json_sender_start(ubx_block_t *b)
     			LOG(INFO) << "rsg_json_sender: unknown log_level = " << *log_level;		}
     	}
 
+    	LogBackend::acquire();
+
         return ret;
 }
 
 /* stop */
 void rsg_json_sender_stop(ubx_block_t *b)
 {
-        /* struct rsg_json_sender_info *inf = (struct rsg_json_sender_info*) b->private_data; */
+        struct rsg_json_sender_info *inf = (struct rsg_json_sender_info*) b->private_data;
+        if(inf->resync_thread) { // A pending request is served with the next start.
+        	inf->remote_root_trigger->setWaiting(false);
+        	inf->resync_thread->join();
+        	delete inf->resync_thread;
+        	inf->resync_thread = 0;
+        }
+        if(inf->async_forwarder) { // Forwards everything that is still queued
+        	inf->async_forwarder->stop();
+        }
+        if(inf->coalesce_thread) {
+        	{
+        		std::lock_guard<std::mutex> lock(*inf->coalesce_thread_mutex);
+        		inf->coalesce_thread_stop = true;
+        	}
+        	inf->coalesce_thread_condition->notify_all();
+        	inf->coalesce_thread->join();
+        	delete inf->coalesce_thread;
+        	inf->coalesce_thread = 0;
+        	delete inf->coalesce_thread_condition;
+        	inf->coalesce_thread_condition = 0;
+        	delete inf->coalesce_thread_mutex;
+        	inf->coalesce_thread_mutex = 0;
+        	inf->coalescer->flush(inf->batcher); // Do not hold back the latest poses.
+        }
+        LogBackend::release();
 }
 
 /* cleanup */
@@ -391,20 +1732,78 @@ void rsg_json_sender_cleanup(ubx_block_t *b)
         	delete inf->time_stamper;
         	inf->time_stamper = 0;
         }
+        if(inf->async_forwarder){
+        	delete inf->async_forwarder;
+        	inf->async_forwarder = 0;
+        }
+        if(inf->batcher){
+        	delete inf->batcher;
+        	inf->batcher = 0;
+        }
+        if(inf->coalescer){
+        	delete inf->coalescer;
+        	inf->coalescer = 0;
+        }
+        if(inf->compressor){
+        	delete inf->compressor;
+        	inf->compressor = 0;
+        }
+        if(inf->encode_timer){
+        	delete inf->encode_timer;
+        	inf->encode_timer = 0;
+        }
+        if(inf->wm_delta_resender){
+        	delete inf->wm_delta_resender;
+        	inf->wm_delta_resender = 0;
+        }
+        if(inf->delta_filter){
+        	delete inf->delta_filter;
+        	inf->delta_filter = 0;
+        }
+        if(inf->change_tracker){
+        	delete inf->change_tracker;
+        	inf->change_tracker = 0;
+        }
+        if(inf->journal_serializer){
+        	delete inf->journal_serializer;
+        	inf->journal_serializer = 0;
+        }
+        if(inf->journal){ // Syncs the pending records.
+        	delete inf->journal;
+        	inf->journal = 0;
+        }
+        if(inf->logger){
+        	delete inf->logger;
+        	inf->logger = 0;
+        }
         free(b->private_data);
 }
 
-/* step */
-void rsg_json_sender_step(ubx_block_t *b)
+/**
+ * Resends the complete graph or the changes that peers have not seen yet.
+ * Has to be called with the world model write lock held.
+ */
+static void resend_graph(struct rsg_json_sender_info *inf)
 {
-
-        struct rsg_json_sender_info *inf = (struct rsg_json_sender_info*) b->private_data;
         brics_3d::WorldModel* wm = inf->wm;
 
-        /* Resend the complete scene graph */
-        LOG(INFO) << "rsg_json_sender: Resending the complete RSG now.";
+        /* Decide if a delta is sufficient or if the complete scene graph has to be resend */
+        brics_3d::rsg::SceneGraphToUpdatesTraverser* resender = inf->wm_resender;
+        uint64_t sinceVersion = 0;
+        if(inf->delta_sync && get_delta_sync_version(inf, sinceVersion)) {
+        	LOG(INFO) << "rsg_json_sender: Resending changes since version " << sinceVersion << " now.";
+        	resender = inf->wm_delta_resender;
+        	inf->delta_filter->setSinceVersion(sinceVersion);
+        } else {
+        	LOG(INFO) << "rsg_json_sender: Resending the complete RSG now.";
+        }
+
+        if(inf->batcher) { // Send the resync in as few messages as possible
+        	inf->batcher->beginBatch();
+        }
+
         inf->wm->scene.advertiseRootNode(); // Make sure root node is always send; The graph traverser cannot handle this.
-        inf->wm_resender->reset();
+        resender->reset();
         Id localRootId = wm->scene.getRootId();
         /*
          * Warning a traversal that starts "above" the local root node is not guaranteed to
@@ -439,7 +1838,58 @@ void rsg_json_sender_step(ubx_block_t *b)
     		LOG(DEBUG) << "rsg_json_sender: using rootId = " << rootId << ", while localRootId = " << localRootId;
         }
 
-        wm->scene.executeGraphTraverser(inf->wm_resender, rootId); // Note: addRemoteRoot node is only forwarded once
+        std::unique_lock<std::mutex> dispatchLock;
+        if(inf->async_forwarder) { // The worker has to pause; queued updates go first and are forwarded right here.
+        	dispatchLock = std::unique_lock<std::mutex>(inf->async_forwarder->getDispatchMutex());
+        	inf->async_forwarder->dispatchPending();
+        }
+
+        std::unique_lock<std::mutex> forwardLock;
+        if(inf->coalescer) { // The resync must not interleave with flushed transforms.
+        	inf->coalescer->flush();
+        	forwardLock = std::unique_lock<std::mutex>(inf->coalescer->getMutex());
+        }
+
+        if(resender == inf->wm_delta_resender) { // Deletions are not part of a traversal, so they are send beforehand.
+        	std::vector<ChangeSequenceTracker::Tombstone> tombstones;
+        	inf->change_tracker->getTombstonesSince(sinceVersion, tombstones);
+        	for(std::vector<ChangeSequenceTracker::Tombstone>::const_iterator it = tombstones.begin(); it != tombstones.end(); ++it) {
+        		if(it->parentId.isNil()) {
+        			inf->delta_filter->deleteNode(it->id);
+        		} else {
+        			inf->delta_filter->removeParent(it->id, it->parentId);
+        		}
+        	}
+        }
+
+        wm->scene.executeGraphTraverser(resender, rootId); // Note: addRemoteRoot node is only forwarded once
+
+        if(inf->delta_sync) {
+        	advertise_sync_state(inf);
+        }
+
+        if(inf->batcher) {
+        	inf->batcher->endBatch();
+        }
+
+}
 
+/**
+ * Thread function that resends the graph when a new remote root node requested it.
+ */
+static void resync_loop(struct rsg_json_sender_info *inf)
+{
+	while(inf->remote_root_trigger->waitForResyncRequest()) {
+		LOG(DEBUG) << "rsg_json_sender: Resync requested by a new remote root node.";
+		WorldModelWriteLock writeLock(inf->wm);
+		resend_graph(inf);
+	}
 }
 
+/* step */
+void rsg_json_sender_step(ubx_block_t *b)
+{
+        struct rsg_json_sender_info *inf = (struct rsg_json_sender_info*) b->private_data;
+        WorldModelWriteLock writeLock(inf->wm); // The resync reads the whole graph and updates the root node.
+        resend_graph(inf);
+}
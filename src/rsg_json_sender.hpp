@@ -27,6 +27,32 @@ ubx_config_t rsg_json_sender_config[] = {
     	{ .name="dot_name_prefix", .type_name = "char" , .doc="Optional prefix for stored dot files." },
         { .name="log_level", .type_name = "int", .doc="Set the log level: LOGDEBUG = 0, INFO = 1, WARNING = 2, LOGERROR = 3, FATAL = 4" },
         { .name="max_freq", .type_name = "float", .doc="Defines the maximum frequency for publishing Transform updates." },
+        { .name="coalesce_period", .type_name = "uint32_t", .doc="Period in [ms] for merging Transform updates. Only the newest Transform update per node within a period is published. "
+        		"0 turns coalescing off, i.e. every Transform update that passes max_freq is published immediately. Default is 0." },
+        { .name="async_queue_len", .type_name = "uint32_t", .doc="Number of updates that can be queued for encoding and sending in a separate worker thread. "
+        		"0 turns this off, i.e. updates are encoded within the call that modifies the scene graph. Default is 0." },
+        { .name="async_queue_policy", .type_name = "int", .doc="Policy for a full async queue: 0 = the modifying call waits (backpressure), 1 = Transform updates are dropped. "
+        		"Other updates are never dropped. Default is 0." },
+        { .name="batch_max_bytes", .type_name = "uint32_t", .doc="Maximum size in bytes of a message that bundles multiple updates (RSGUpdateBatch). Batches are used for resyncs and coalesced Transform updates. "
+        		"Must not exceed the element_size of the connected buffers. 0 turns batching off. Default is 0." },
+        { .name="batch_max_updates", .type_name = "uint32_t", .doc="Maximum number of updates per batch. 0 means no limit besides batch_max_bytes. Default is 0." },
+        { .name="compression", .type_name = "int", .doc="If true every message of at least compression_threshold bytes is compressed with zstd and a dictionary. "
+        		"Requires the USE_ZSTD build option. Receivers have to use the same compression_dictionary. Default is false." },
+        { .name="compression_dictionary", .type_name = "char" , .doc="Dictionary file as created by rsg_train_dictionary. Empty uses the built-in dictionary. Default is empty." },
+        { .name="compression_threshold", .type_name = "uint32_t", .doc="Messages smaller than this number of bytes are sent uncompressed. Default is 128." },
+        { .name="compression_level", .type_name = "int", .doc="zstd compression level. Higher levels compress better but need more CPU time. Default is 3." },
+        { .name="delta_sync", .type_name = "int", .doc="If true a resync only sends the parts of the graph that changed since the version a peer reports to have seen. "
+        		"Falls back to a complete resync if that version is unknown or too old. A peer can only acknowledge a version if the resync reached it in one message, "
+        		"so this requires batch_max_bytes; with resyncs that do not fit into one batch the last acknowledged version is kept. Default is false, i.e. the complete graph is always resent." },
+        { .name="sync_history_len", .type_name = "uint32_t", .doc="Maximum number of deletions and removed parent-child relations that are remembered for delta_sync. "
+        		"Peers that are further behind receive a complete resync. Default is 10000." },
+        { .name="journal_prefix", .type_name = "char" , .doc="Path and file name prefix of a write-ahead journal that records every update applied to the world model. "
+        		"Segments are stored as <journal_prefix>.<number>.rsgj. Empty turns journaling off. Default is empty." },
+        { .name="journal_segment_size", .type_name = "uint32_t", .doc="Size in bytes after which a new journal segment is started. Default is 67108864 (64 MiB)." },
+        { .name="journal_sync_period", .type_name = "uint32_t", .doc="Period in [ms] for writing journal records to disk with fdatasync. At most this period of updates is lost on a crash. Default is 100." },
+        { .name="journal_replay", .type_name = "int", .doc="If 1 the world model is recovered from the journal_snapshot_file and the journal segments written after it, before new updates are journaled. Default is 0." },
+        { .name="journal_snapshot_file", .type_name = "char" , .doc="Binary snapshot file (.rsgs) as stored by the rsg_dump block that is loaded before the journal is replayed from the journal position stored in the snapshot. "
+        		"Journal segments covered by a newer snapshot are deleted, so this has to be the newest snapshot. Empty replays all journal segments." },
         { NULL },
 };
 
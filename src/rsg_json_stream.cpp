@@ -0,0 +1,581 @@
+#include "rsg_json_stream.h"
+
+#include <brics_3d/core/Logger.h>
+#include <Variant/Variant.h>
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <fstream>
+#include <random>
+
+namespace brics_3d {
+namespace rsg {
+
+/// Encodes a string as JSON string literal.
+static std::string quote(const std::string& text) {
+	std::string result("\"");
+	for (std::string::const_iterator it = text.begin(); it != text.end(); ++it) {
+		switch (*it) {
+		case '"':  result += "\\\""; break;
+		case '\\': result += "\\\\"; break;
+		case '\n': result += "\\n"; break;
+		case '\r': result += "\\r"; break;
+		case '\t': result += "\\t"; break;
+		default:   result += *it; break;
+		}
+	}
+	return result + "\"";
+}
+
+static bool isDelimiter(char c) {
+	return (c == ',') || (c == ':') || (c == '{') || (c == '}') || (c == '[') || (c == ']') ||
+			(c == '"') || (c == '#') || (c == '/') || (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+/*
+ * JsonStreamParser
+ */
+
+JsonStreamParser::JsonStreamParser(IJsonStreamHandler* handler) :
+		handler(handler), input(0), chunk(RSG_JSON_STREAM_CHUNK_SIZE), position(0), available(0), consumedBytes(0), nextProgress(RSG_JSON_STREAM_PROGRESS_INTERVAL) {
+
+}
+
+JsonStreamParser::~JsonStreamParser() {
+
+}
+
+bool JsonStreamParser::peekChar(char& c) {
+	if(position == available) {
+		input->read(&chunk[0], chunk.size());
+		available = input->gcount();
+		position = 0;
+		if(available == 0) {
+			return false;
+		}
+	}
+	c = chunk[position];
+	return true;
+}
+
+bool JsonStreamParser::nextChar(char& c) {
+	if(!peekChar(c)) {
+		return false;
+	}
+	position++;
+	consumedBytes++;
+	if(consumedBytes >= nextProgress) {
+		handler->progress(consumedBytes);
+		nextProgress += RSG_JSON_STREAM_PROGRESS_INTERVAL;
+	}
+	return true;
+}
+
+bool JsonStreamParser::skipWhitespaceAndComments() {
+	char c;
+	while(peekChar(c)) {
+		if((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r')) {
+			nextChar(c);
+		} else if (c == '#') {
+			while(nextChar(c) && (c != '\n')) {};
+		} else if (c == '/') {
+			nextChar(c);
+			if(!nextChar(c)) {
+				return fail("Unexpected end of file in comment.");
+			}
+			if(c == '/') {
+				while(nextChar(c) && (c != '\n')) {};
+			} else if (c == '*') {
+				char previous = 0;
+				while(true) {
+					if(!nextChar(c)) {
+						return fail("Unterminated comment.");
+					}
+					if((previous == '*') && (c == '/')) {
+						break;
+					}
+					previous = c;
+				}
+			} else {
+				return fail("Unexpected character after '/'.");
+			}
+		} else {
+			return true;
+		}
+	}
+	return true;
+}
+
+bool JsonStreamParser::readString(std::string& raw, std::string& decoded) {
+	char c;
+	raw = "\"";
+	decoded.clear();
+	nextChar(c); // opening quote
+	while(true) {
+		if(!nextChar(c)) {
+			return fail("Unterminated string.");
+		}
+		raw += c;
+		if(c == '"') {
+			return true;
+		}
+		if(c != '\\') {
+			decoded += c;
+			continue;
+		}
+		if(!nextChar(c)) {
+			return fail("Unterminated string.");
+		}
+		raw += c;
+		switch (c) {
+		case 'n': decoded += '\n'; break;
+		case 'r': decoded += '\r'; break;
+		case 't': decoded += '\t'; break;
+		case 'b': decoded += '\b'; break;
+		case 'f': decoded += '\f'; break;
+		case 'u': decoded += "\\u"; break; // Kept as is, only needed for ids and type names.
+		default:  decoded += c; break;
+		}
+	}
+}
+
+bool JsonStreamParser::readLiteral(std::string& raw) {
+	char c;
+	raw.clear();
+	while(peekChar(c) && !isDelimiter(c)) {
+		nextChar(c);
+		raw += c;
+	}
+	if(raw.empty()) {
+		peekChar(c);
+		return fail(std::string("Unexpected character '") + c + "'.");
+	}
+	return true;
+}
+
+bool JsonStreamParser::fail(const std::string& message) {
+	LOG(ERROR) << "JsonStreamParser: " << message << " At byte " << consumedBytes << ".";
+	return false;
+}
+
+bool JsonStreamParser::parse(std::istream& input) {
+	this->input = &input;
+	position = 0;
+	available = 0;
+	consumedBytes = 0;
+	nextProgress = RSG_JSON_STREAM_PROGRESS_INTERVAL;
+
+	/*
+	 * Container stack: true for objects, false for arrays. Inside an object
+	 * expectKey tells whether the next string is a member name.
+	 */
+	std::vector<bool> containers;
+	bool expectKey = false;
+	bool expectValue = true; // A value is allowed at the current position.
+	std::string raw;
+	std::string decoded;
+	char c;
+
+	while(true) {
+		if(!skipWhitespaceAndComments()) {
+			return false;
+		}
+		if(!peekChar(c)) {
+			break;
+		}
+
+		if(c == ',') {
+			nextChar(c);
+			if(containers.empty()) {
+				return fail("Unexpected ','.");
+			}
+			expectKey = containers.back();
+			expectValue = !containers.back();
+			continue;
+		}
+
+		if((c == '}') || (c == ']')) {
+			nextChar(c);
+			if(containers.empty() || (containers.back() != (c == '}'))) {
+				return fail(std::string("Unexpected '") + c + "'.");
+			}
+			containers.pop_back();
+			if(!((c == '}') ? handler->endObject() : handler->endArray())) {
+				return false;
+			}
+			expectKey = false;
+			expectValue = false;
+			if(containers.empty()) {
+				break;
+			}
+			continue;
+		}
+
+		if(expectKey) {
+			if(c != '"') {
+				return fail("Expected a member name.");
+			}
+			if(!readString(raw, decoded)) {
+				return false;
+			}
+			if(!skipWhitespaceAndComments() || !nextChar(c) || (c != ':')) {
+				return fail("Expected ':' after member name.");
+			}
+			if(!handler->key(decoded)) {
+				return false;
+			}
+			expectKey = false;
+			expectValue = true;
+			continue;
+		}
+
+		if(!expectValue) {
+			return fail(std::string("Expected ',' but found '") + c + "'.");
+		}
+		expectValue = false;
+
+		if((c == '{') || (c == '[')) {
+			nextChar(c);
+			containers.push_back(c == '{');
+			if(!((c == '{') ? handler->startObject() : handler->startArray())) {
+				return false;
+			}
+			expectKey = (c == '{');
+			expectValue = (c == '[');
+		} else if (c == '"') {
+			if(!readString(raw, decoded) || !handler->value(raw, decoded)) {
+				return false;
+			}
+		} else {
+			if(!readLiteral(raw) || !handler->value(raw, raw)) {
+				return false;
+			}
+		}
+		if(containers.empty()) {
+			break;
+		}
+	}
+
+	if(!containers.empty()) {
+		return fail("Unexpected end of file.");
+	}
+	return true;
+}
+
+/*
+ * StreamingSceneLoader
+ */
+
+StreamingSceneLoader::StreamingSceneLoader(WorldModel* wm) : wm(wm), primitives(0), failedPrimitives(0), fileSize(0) {
+	deserializer = new JSONDeserializer(wm);
+	deserializer->setMapUnknownParentIdsToRootId(true);
+}
+
+StreamingSceneLoader::~StreamingSceneLoader() {
+	delete deserializer;
+}
+
+bool StreamingSceneLoader::load(const std::string& fileName) {
+	std::ifstream inputFile(fileName.c_str(), std::ifstream::in | std::ifstream::binary);
+	if(!inputFile.is_open()) {
+		LOG(ERROR) << "StreamingSceneLoader: Cannot open file " << fileName;
+		return false;
+	}
+	struct stat fileStatus;
+	fileSize = (stat(fileName.c_str(), &fileStatus) == 0) ? fileStatus.st_size : 0;
+
+	stack.clear();
+	deferredConnections.clear();
+	primitives = 0;
+	failedPrimitives = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	JsonStreamParser parser(this);
+	bool success = parser.parse(inputFile);
+
+	/* Connections last, all nodes they refer to exist now. */
+	for (std::vector<std::string>::iterator it = deferredConnections.begin(); it != deferredConnections.end(); ++it) {
+		if(deserializer->write(*it) != 0) {
+			failedPrimitives++;
+		}
+		primitives++;
+	}
+	deferredConnections.clear();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if(seconds <= 0) {
+		seconds = 1e-9;
+	}
+	LOG(INFO) << "StreamingSceneLoader: Loaded " << primitives << " primitives (" << failedPrimitives << " failed) from "
+			<< parser.getConsumedBytes() << " bytes of " << fileName << " in " << seconds * 1000.0 << " ms ("
+			<< parser.getConsumedBytes() / seconds / (1024.0 * 1024.0) << " MiB/s, " << primitives / seconds << " primitives/s).";
+	return success;
+}
+
+void StreamingSceneLoader::progress(uint64_t bytes) {
+	if(fileSize > 0) {
+		LOG(INFO) << "StreamingSceneLoader: " << bytes << " of " << fileSize << " bytes (" << (100 * bytes) / fileSize << "%), "
+				<< primitives << " primitives, " << deferredConnections.size() << " pending connections.";
+	} else {
+		LOG(INFO) << "StreamingSceneLoader: " << bytes << " bytes, " << primitives << " primitives, "
+				<< deferredConnections.size() << " pending connections.";
+	}
+}
+
+std::string StreamingSceneLoader::generateId() {
+	static std::mt19937_64 generator((std::random_device())());
+	uint64_t high = generator();
+	uint64_t low = generator();
+	high = (high & 0xFFFFFFFFFFFF0FFFULL) | 0x0000000000004000ULL; // version 4
+	low = (low & 0x3FFFFFFFFFFFFFFFULL) | 0x8000000000000000ULL;   // variant 1
+	char buffer[37];
+	snprintf(buffer, sizeof(buffer), "%08x-%04x-%04x-%04x-%012llx",
+			static_cast<unsigned int>(high >> 32), static_cast<unsigned int>((high >> 16) & 0xFFFF), static_cast<unsigned int>(high & 0xFFFF),
+			static_cast<unsigned int>(low >> 48), static_cast<unsigned long long>(low & 0xFFFFFFFFFFFFULL));
+	return std::string(buffer);
+}
+
+std::string StreamingSceneLoader::getEnclosingId() {
+	for (std::vector<Frame>::reverse_iterator it = stack.rbegin(); it != stack.rend(); ++it) {
+		if(it->type == PRIMITIVE) {
+			if(!it->emitted) {
+				emit(*it);
+			}
+			return it->id;
+		}
+	}
+	return "";
+}
+
+bool StreamingSceneLoader::emit(Frame& primitive) {
+	if(primitive.emitted) {
+		return true;
+	}
+	primitive.emitted = true;
+	if(primitive.id.empty()) {
+		primitive.id = generateId();
+		primitive.text += std::string(primitive.hasMembers ? "," : "") + "\"id\":" + quote(primitive.id);
+		primitive.hasMembers = true;
+	}
+	primitive.text += "}";
+
+	if(primitive.role == ROOT) { // Represented by the local root node.
+		primitive.text.clear();
+		return true;
+	}
+
+	if(primitive.role == REMOTE_ROOT) {
+		Id remoteRootId;
+		if(!remoteRootId.fromString(primitive.id)) {
+			LOG(ERROR) << "StreamingSceneLoader: Invalid remote root id " << primitive.id;
+			failedPrimitives++;
+		} else {
+			vector<Attribute> attributes;
+			libvariant::Variant node = libvariant::DeserializeJSON(primitive.text);
+			if(node.Contains("attributes") && node.Get("attributes").IsList()) {
+				libvariant::Variant attributeList = node.Get("attributes");
+				for (libvariant::Variant::ConstListIterator it = attributeList.ListBegin(); it != attributeList.ListEnd(); ++it) {
+					attributes.push_back(Attribute(it->Get("key").AsString(), it->Get("value").AsString()));
+				}
+			}
+			if(!wm->scene.addRemoteRootNode(remoteRootId, attributes)) {
+				failedPrimitives++;
+			}
+		}
+		primitives++;
+		primitive.text.clear();
+		return true;
+	}
+
+	std::string message = "{\"@worldmodeltype\":\"RSGUpdate\",\"operation\":\"CREATE\",\"node\":" + primitive.text +
+			",\"parentId\":" + quote(primitive.parentId) + "}";
+	primitive.text.clear();
+
+	if(primitive.role == CONNECTION) {
+		deferredConnections.push_back(message);
+		return true;
+	}
+	if(deserializer->write(message) != 0) {
+		failedPrimitives++;
+	}
+	primitives++;
+	return true;
+}
+
+void StreamingSceneLoader::appendToCapture(const std::string& token) {
+	Frame* owner = 0;
+	for (std::vector<Frame>::reverse_iterator it = stack.rbegin(); it != stack.rend(); ++it) {
+		if(it->type == PRIMITIVE) {
+			owner = &(*it);
+			break;
+		}
+	}
+	if(owner != 0) {
+		owner->text += token;
+	}
+}
+
+bool StreamingSceneLoader::isOwnField(const Frame& primitive) {
+	return !primitive.emitted && (primitive.key != "childs") && (primitive.key != "connections");
+}
+
+bool StreamingSceneLoader::beginValue(bool isObject) {
+	if(stack.empty()) {
+		stack.push_back(Frame(isObject ? DOCUMENT : SKIP));
+		return true;
+	}
+
+	Frame& top = stack.back();
+	FrameType type = SKIP;
+	Role role = CHILD;
+
+	switch (top.type) {
+	case DOCUMENT:
+		if((top.key == "rootNode") && isObject) {
+			type = PRIMITIVE;
+			role = ROOT;
+		} else if ((top.key == "remoteRootNodes") && !isObject) {
+			type = REMOTE_ROOT_LIST;
+		}
+		break;
+	case PRIMITIVE:
+		if((top.key == "childs") && !isObject) {
+			type = CHILD_LIST;
+		} else if ((top.key == "connections") && !isObject) {
+			type = CONNECTION_LIST;
+		} else if (isOwnField(top)) {
+			type = CAPTURE;
+		}
+		break;
+	case CHILD_LIST:
+		if(isObject) {
+			type = CHILD_WRAPPER;
+		}
+		break;
+	case CHILD_WRAPPER:
+		if((top.key == "child") && isObject) {
+			type = PRIMITIVE;
+			role = CHILD;
+		}
+		break;
+	case CONNECTION_LIST:
+		if(isObject) {
+			type = PRIMITIVE;
+			role = CONNECTION;
+		}
+		break;
+	case REMOTE_ROOT_LIST:
+		if(isObject) {
+			type = PRIMITIVE;
+			role = REMOTE_ROOT;
+		}
+		break;
+	case CAPTURE:
+		type = CAPTURE;
+		break;
+	case SKIP:
+		type = SKIP;
+		break;
+	}
+
+	if((type == CHILD_LIST) || (type == CONNECTION_LIST)) {
+		std::string enclosingId = getEnclosingId(); // Emits the enclosing primitive, so it exists before its children.
+		if(enclosingId.empty()) {
+			return false;
+		}
+	}
+
+	if(type == CAPTURE) {
+		if((top.type == CAPTURE) && !top.pendingKey) {
+			appendToCapture(",");
+		}
+		top.pendingKey = false;
+		appendToCapture(isObject ? "{" : "[");
+	}
+
+	Frame frame(type);
+	if(type == PRIMITIVE) {
+		frame.role = role;
+		frame.text = "{";
+		frame.parentId = (role == CHILD || role == CONNECTION) ? getEnclosingId() : "";
+	}
+	frame.pendingKey = true; // Nothing has been written into a new capture yet.
+	stack.push_back(frame);
+	return true;
+}
+
+bool StreamingSceneLoader::startObject() {
+	return beginValue(true);
+}
+
+bool StreamingSceneLoader::startArray() {
+	return beginValue(false);
+}
+
+bool StreamingSceneLoader::endObject() {
+	Frame& top = stack.back();
+	if(top.type == PRIMITIVE) {
+		emit(top);
+	} else if (top.type == CAPTURE) {
+		appendToCapture("}");
+	}
+	stack.pop_back();
+	if(!stack.empty() && (stack.back().type == CAPTURE)) {
+		stack.back().pendingKey = false;
+	}
+	return true;
+}
+
+bool StreamingSceneLoader::endArray() {
+	if(stack.back().type == CAPTURE) {
+		appendToCapture("]");
+	}
+	stack.pop_back();
+	if(!stack.empty() && (stack.back().type == CAPTURE)) {
+		stack.back().pendingKey = false;
+	}
+	return true;
+}
+
+bool StreamingSceneLoader::key(const std::string& name) {
+	Frame& top = stack.back();
+	top.key = name;
+
+	if(top.type == PRIMITIVE) {
+		if((name == "childs") || (name == "connections")) {
+			return true; // Streamed, not part of the primitive's own fields.
+		}
+		if(top.emitted) {
+			LOG(WARNING) << "StreamingSceneLoader: Field " << name << " of " << top.id << " follows its childs or connections and is ignored.";
+			return true;
+		}
+		top.text += std::string(top.hasMembers ? "," : "") + quote(name) + ":";
+		top.hasMembers = true;
+	} else if (top.type == CAPTURE) {
+		appendToCapture(std::string(top.pendingKey ? "" : ",") + quote(name) + ":");
+		top.pendingKey = true;
+	}
+	return true;
+}
+
+bool StreamingSceneLoader::value(const std::string& raw, const std::string& decoded) {
+	Frame& top = stack.back();
+
+	if(top.type == PRIMITIVE) {
+		if(!isOwnField(top)) {
+			return true;
+		}
+		if(top.key == "id") {
+			top.id = decoded;
+		}
+		top.text += raw;
+	} else if (top.type == CAPTURE) {
+		appendToCapture(std::string(top.pendingKey ? "" : ",") + raw);
+		top.pendingKey = false;
+	}
+	return true;
+}
+
+} // namespace rsg
+} // namespace brics_3d
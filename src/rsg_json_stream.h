@@ -0,0 +1,188 @@
+/*
+ * Streaming loader for RSG-JSON model files.
+ *
+ * The JsonStreamParser reads a file in fixed size chunks and reports tokens to
+ * a handler, so a file is never kept in memory as a whole. It accepts the same
+ * relaxed syntax as the model files in examples/maps/rsg: trailing commas and
+ * comments (#, // and C style).
+ *
+ * The StreamingSceneLoader turns every graph primitive of a WorldModelAgent
+ * model into a single RSGUpdate CREATE message and applies it as soon as the
+ * primitive's own fields have been parsed, i.e. before its children. The
+ * messages are applied by the regular JSONDeserializer, so the semantics are
+ * the same as for updates that arrive over the network. Only the primitives on
+ * the current path are buffered. Connections are buffered until the end of the
+ * file because they may refer to nodes that are defined later.
+ */
+
+#ifndef RSG_JSON_STREAM_H_
+#define RSG_JSON_STREAM_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/JSONDeserializer.h>
+
+#include <stdint.h>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_JSON_STREAM_CHUNK_SIZE (64 * 1024)        // [bytes] Read size of the parser.
+#define RSG_JSON_STREAM_PROGRESS_INTERVAL (1024 * 1024) // [bytes] Progress is logged after every interval.
+
+/**
+ * Receives the tokens of a JSON document. Returning false aborts parsing.
+ */
+class IJsonStreamHandler {
+public:
+	virtual ~IJsonStreamHandler(){};
+
+	virtual bool startObject() = 0;
+	virtual bool endObject() = 0;
+	virtual bool startArray() = 0;
+	virtual bool endArray() = 0;
+
+	/// Name of the next object member, with escape sequences resolved.
+	virtual bool key(const std::string& name) = 0;
+
+	/**
+	 * A string, number or literal.
+	 * @param raw JSON text of the value (strings including quotes).
+	 * @param decoded The value without quotes and escape sequences.
+	 */
+	virtual bool value(const std::string& raw, const std::string& decoded) = 0;
+
+	/// Called regularly with the number of consumed bytes.
+	virtual void progress(uint64_t bytes) {};
+};
+
+class JsonStreamParser {
+public:
+	JsonStreamParser(IJsonStreamHandler* handler);
+	virtual ~JsonStreamParser();
+
+	/**
+	 * Parses a complete document.
+	 * @return False on a syntax error or if the handler aborted.
+	 */
+	bool parse(std::istream& input);
+
+	uint64_t getConsumedBytes() const {
+		return consumedBytes;
+	}
+
+private:
+	bool nextChar(char& c);
+	bool peekChar(char& c);
+	bool skipWhitespaceAndComments();
+	bool readString(std::string& raw, std::string& decoded);
+	bool readLiteral(std::string& raw);
+	bool fail(const std::string& message);
+
+	IJsonStreamHandler* handler;
+	std::istream* input;
+	std::vector<char> chunk;
+	size_t position;
+	size_t available;
+	uint64_t consumedBytes;
+	uint64_t nextProgress;
+};
+
+/**
+ * Applies a WorldModelAgent model file while it is parsed.
+ */
+class StreamingSceneLoader : public IJsonStreamHandler {
+public:
+	StreamingSceneLoader(WorldModel* wm);
+	virtual ~StreamingSceneLoader();
+
+	/**
+	 * Loads a model file.
+	 * @return False if the file cannot be opened or is malformed. Primitives that
+	 *         have been parsed before an error remain in the world model.
+	 */
+	bool load(const std::string& fileName);
+
+	uint64_t getPrimitiveCount() const {
+		return primitives;
+	}
+
+	/* implementation of IJsonStreamHandler */
+	bool startObject();
+	bool endObject();
+	bool startArray();
+	bool endArray();
+	bool key(const std::string& name);
+	bool value(const std::string& raw, const std::string& decoded);
+	void progress(uint64_t bytes);
+
+private:
+
+	enum FrameType {
+		DOCUMENT,          // Top level WorldModelAgent object
+		PRIMITIVE,         // Graph primitive, its own fields are collected
+		CHILD_LIST,        // "childs" array
+		CHILD_WRAPPER,     // {"@childtype": ..., "child": {...}}
+		CONNECTION_LIST,   // "connections" array
+		REMOTE_ROOT_LIST,  // "remoteRootNodes" array
+		CAPTURE,           // Nested value of a primitive field, copied verbatim
+		SKIP               // Ignored value
+	};
+
+	enum Role {
+		ROOT,
+		REMOTE_ROOT,
+		CHILD,
+		CONNECTION
+	};
+
+	struct Frame {
+		Frame(FrameType type) : type(type), role(CHILD), emitted(false), hasMembers(false), pendingKey(false) {};
+
+		FrameType type;
+		std::string key;          // Last member name of an object frame
+
+		/* PRIMITIVE only */
+		Role role;
+		std::string text;         // Own fields as JSON object without the closing brace
+		std::string id;
+		std::string parentId;
+		bool emitted;
+		bool hasMembers;
+
+		/* CAPTURE only */
+		bool pendingKey;          // A key has been written, so the next value needs no separator.
+	};
+
+	/// True if the current member of a primitive frame belongs to its node description.
+	static bool isOwnField(const Frame& primitive);
+
+	/// Starts a value that belongs to the frame on top of the stack.
+	bool beginValue(bool isObject);
+
+	/// Appends a raw token to all enclosing captures.
+	void appendToCapture(const std::string& token);
+
+	/// Emits the primitive in the given frame if this has not happened yet.
+	bool emit(Frame& primitive);
+
+	/// Id of the closest enclosing primitive, i.e. the parent for new primitives.
+	std::string getEnclosingId();
+
+	static std::string generateId();
+
+	WorldModel* wm;
+	JSONDeserializer* deserializer;
+	std::vector<Frame> stack;
+	std::vector<std::string> deferredConnections;
+	uint64_t primitives;
+	uint64_t failedPrimitives;
+	uint64_t fileSize;
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_JSON_STREAM_H_ */
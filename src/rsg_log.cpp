@@ -0,0 +1,160 @@
+#include "rsg_log.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#define RSG_LOG_DRAIN_PERIOD 5 // [ms] Sleep time of the drain thread if the ring is empty.
+
+static const char* levelNames[] = {"DEBUG", "INFO", "WARNING", "ERROR", "FATAL"};
+
+/**
+ * Bounded multi producer/multi consumer ring after D. Vyukov. Every slot has a
+ * sequence number that tells producers and consumers whether it is their turn.
+ */
+struct LogSlot {
+	std::atomic<size_t> sequence;
+	int level;
+	size_t length;
+	char text[RSG_LOG_RECORD_SIZE];
+};
+
+static LogSlot ring[RSG_LOG_RING_SIZE];
+static std::atomic<size_t> enqueuePosition(0);
+static std::atomic<size_t> dequeuePosition(0);
+static std::atomic<uint64_t> droppedRecords(0);
+
+static std::mutex backendMutex; // Guards the reference count and the thread, not the ring.
+static int references = 0;
+static std::thread* drainThread = 0;
+static std::atomic<bool> running(false);
+
+static struct RingInitializer {
+	RingInitializer() {
+		for (size_t i = 0; i < RSG_LOG_RING_SIZE; ++i) {
+			ring[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+} ringInitializer;
+
+static void print(int level, const char* text, size_t length) {
+	fprintf(stdout, "[%s] %.*s\n", levelNames[level], static_cast<int>(length), text);
+}
+
+static bool tryPush(int level, const char* text, size_t length) {
+	LogSlot* slot;
+	size_t position = enqueuePosition.load(std::memory_order_relaxed);
+	for (;;) {
+		slot = &ring[position & (RSG_LOG_RING_SIZE - 1)];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+		if(difference == 0) {
+			if(enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (difference < 0) {
+			return false; // full
+		} else {
+			position = enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+	slot->level = level;
+	slot->length = length;
+	memcpy(slot->text, text, length);
+	slot->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+/// Prints one record. Returns false if the ring is empty.
+static bool tryPrintNext() {
+	LogSlot* slot;
+	size_t position = dequeuePosition.load(std::memory_order_relaxed);
+	for (;;) {
+		slot = &ring[position & (RSG_LOG_RING_SIZE - 1)];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+		if(difference == 0) {
+			if(dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (difference < 0) {
+			return false; // empty
+		} else {
+			position = dequeuePosition.load(std::memory_order_relaxed);
+		}
+	}
+	print(slot->level, slot->text, slot->length);
+	slot->sequence.store(position + RSG_LOG_RING_SIZE, std::memory_order_release);
+	return true;
+}
+
+static void drain() {
+	bool printed = false;
+	while(tryPrintNext()) {
+		printed = true;
+	}
+	uint64_t dropped = droppedRecords.exchange(0, std::memory_order_relaxed);
+	if(dropped > 0) {
+		fprintf(stdout, "[WARNING] LogBackend: Log ring was full. Dropped %llu messages.\n", static_cast<unsigned long long>(dropped));
+		printed = true;
+	}
+	if(printed) {
+		fflush(stdout);
+	}
+}
+
+static void drainLoop() {
+	while(running.load(std::memory_order_acquire)) {
+		drain();
+		std::this_thread::sleep_for(std::chrono::milliseconds(RSG_LOG_DRAIN_PERIOD));
+	}
+	drain();
+}
+
+/*
+ * LogBackend
+ */
+
+void LogBackend::acquire() {
+	std::lock_guard<std::mutex> lock(backendMutex);
+	if(references++ == 0) {
+		running.store(true, std::memory_order_release);
+		drainThread = new std::thread(drainLoop);
+	}
+}
+
+void LogBackend::release() {
+	std::lock_guard<std::mutex> lock(backendMutex);
+	if((references > 0) && (--references == 0)) {
+		running.store(false, std::memory_order_release);
+		drainThread->join();
+		delete drainThread;
+		drainThread = 0;
+	}
+}
+
+void LogBackend::push(int level, const char* text, size_t length) {
+	if(!running.load(std::memory_order_acquire)) {
+		print(level, text, length);
+		fflush(stdout);
+		return;
+	}
+	if(!tryPush(level, text, length)) {
+		droppedRecords.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+/*
+ * LogRecord
+ */
+
+LogRecord::LogRecord(int level) : level(level), buffer(text, RSG_LOG_RECORD_SIZE), out(&buffer) {
+
+}
+
+LogRecord::~LogRecord() {
+	LogBackend::push(level, text, buffer.length());
+}
@@ -0,0 +1,121 @@
+/*
+ * Asynchronous logging for the hot paths of the rsg blocks.
+ *
+ * RSG_LOG(logger, severity) checks the level of the block before any argument
+ * is formatted. Messages that pass are formatted into a fixed size record on
+ * the stack and copied into a preallocated lock-free ring. A background thread
+ * drains the ring and prints the records. Neither step allocates memory. If the
+ * ring is full the record is dropped and counted.
+ *
+ * Usage:
+ *   RSG_LOG(inf->logger, DEBUG) << "Sending " << len << " bytes.";
+ */
+
+#ifndef RSG_LOG_H_
+#define RSG_LOG_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <ostream>
+#include <streambuf>
+
+#ifndef RSG_COMMON_API
+#define RSG_COMMON_API __attribute__ ((visibility("default")))
+#endif
+
+#define RSG_LOG_RECORD_SIZE 512  // Longer messages are truncated.
+#define RSG_LOG_RING_SIZE 1024   // Number of records. Has to be a power of two.
+
+/* Same numbering as the log_level configuration of the blocks */
+#define RSG_LOG_LEVEL_DEBUG 0
+#define RSG_LOG_LEVEL_INFO 1
+#define RSG_LOG_LEVEL_WARNING 2
+#define RSG_LOG_LEVEL_ERROR 3
+#define RSG_LOG_LEVEL_FATAL 4
+#define RSG_LOG_LEVEL_LOGDEBUG RSG_LOG_LEVEL_DEBUG
+#define RSG_LOG_LEVEL_LOGERROR RSG_LOG_LEVEL_ERROR
+
+/**
+ * Log with the same severities as LOG(), but filtered by the level of a BlockLogger.
+ * Token pasting is used, so DEBUG and ERROR are not expanded as macros.
+ */
+#define RSG_LOG(logger, severity) \
+	if(!(logger)->isEnabled(RSG_LOG_LEVEL_##severity)) {} else LogRecord(RSG_LOG_LEVEL_##severity).stream()
+
+/**
+ * Log level of a single block instance. It can be changed at any time.
+ * The default is INFO, so the DEBUG messages of the hot paths are only
+ * formatted if the log_level of the block asks for them.
+ */
+class RSG_COMMON_API BlockLogger {
+public:
+	BlockLogger() : minLevel(RSG_LOG_LEVEL_INFO) {};
+
+	/// Sets the level as given by the log_level configuration. Returns false for an unknown level.
+	bool setLevel(int level) {
+		if((level < RSG_LOG_LEVEL_DEBUG) || (level > RSG_LOG_LEVEL_FATAL)) {
+			return false;
+		}
+		minLevel.store(level, std::memory_order_relaxed);
+		return true;
+	}
+
+	int getLevel() const {
+		return minLevel.load(std::memory_order_relaxed);
+	}
+
+	bool isEnabled(int level) const {
+		return level >= minLevel.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<int> minLevel;
+};
+
+/**
+ * Process wide drain thread. Blocks acquire it in init and release it in cleanup;
+ * it runs as long as at least one block holds it. Records that are logged while
+ * it is not running are printed synchronously.
+ */
+class RSG_COMMON_API LogBackend {
+public:
+	static void acquire();
+	static void release();
+
+	/// Enqueues a record. Thread safe and lock-free.
+	static void push(int level, const char* text, size_t length);
+};
+
+/**
+ * A single log message. It is formatted into a fixed buffer and handed to the
+ * LogBackend on destruction.
+ */
+class RSG_COMMON_API LogRecord {
+public:
+	LogRecord(int level);
+	~LogRecord();
+
+	std::ostream& stream() {
+		return out;
+	}
+
+private:
+
+	/// Writes into a fixed array and silently truncates.
+	class FixedBuffer : public std::streambuf {
+	public:
+		FixedBuffer(char* begin, size_t size) {
+			setp(begin, begin + size);
+		}
+		size_t length() const {
+			return pptr() - pbase();
+		}
+	};
+
+	int level;
+	char text[RSG_LOG_RECORD_SIZE];
+	FixedBuffer buffer;
+	std::ostream out;
+};
+
+#endif /* RSG_LOG_H_ */
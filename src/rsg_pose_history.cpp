@@ -0,0 +1,533 @@
+#include "rsg_pose_history.h"
+
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/core/HomogeneousMatrix44.h>
+
+/* libvariant is used by the JSONQueryRunner as well */
+#include <Variant/Variant.h>
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <set>
+#include <sstream>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_POSE_QUERY_INTERPOLATED "GET_INTERPOLATED_TRANSFORM"
+#define RSG_POSE_QUERY_HISTORY "GET_TRANSFORM_HISTORY"
+#define RSG_POSE_MAX_DEPTH 1000 // Guards the path search against cycles.
+
+/// Appends a JSON string literal.
+static void appendJsonString(std::ostringstream& out, const std::string& value) {
+	out << "\"";
+	for (size_t i = 0; i < value.size(); ++i) {
+		if ((value[i] == '"') || (value[i] == '\\')) {
+			out << "\\";
+		}
+		out << value[i];
+	}
+	out << "\"";
+}
+
+/// Appends a transform in the same format as the JSONQueryRunner.
+static void appendTransform(std::ostringstream& out, const double matrix[16]) {
+	out << "{\"matrix\": [";
+	for (int row = 0; row < 4; ++row) {
+		if(row > 0) {
+			out << ",";
+		}
+		out << "[" << matrix[row] << "," << matrix[4 + row] << "," << matrix[8 + row] << "," << matrix[12 + row] << "]";
+	}
+	out << "],\"type\": \"HomogeneousMatrix44\",\"unit\": \"m\"}";
+}
+
+/// Reads a TimeStampUTCms or a TimeStampDate (e.g. "2015-11-09T16:16:44Z") in [ms].
+static bool parseTimeStamp(const libvariant::Variant& stamp, double& timeStamp) {
+	if(!stamp.Contains("@stamptype") || !stamp.Contains("stamp")) {
+		return false;
+	}
+	std::string type = stamp.Get("@stamptype").AsString();
+	if(type.compare("TimeStampUTCms") == 0) {
+		timeStamp = stamp.Get("stamp").AsDouble();
+		return true;
+	}
+	if(type.compare("TimeStampDate") == 0) {
+		struct tm date;
+		memset(&date, 0, sizeof(date));
+		std::string value = stamp.Get("stamp").AsString();
+		const char* end = strptime(value.c_str(), "%Y-%m-%dT%H:%M:%S", &date);
+		if((end == 0) || ((*end != 'Z') && (*end != '\0'))) {
+			return false;
+		}
+		timeStamp = static_cast<double>(timegm(&date)) * 1000.0;
+		return true;
+	}
+	return false;
+}
+
+static void setIdentity(double matrix[16]) {
+	memset(matrix, 0, 16 * sizeof(double));
+	matrix[0] = matrix[5] = matrix[10] = matrix[15] = 1.0;
+}
+
+/// result = a * b for column major 4x4 matrices.
+static void multiply(const double a[16], const double b[16], double result[16]) {
+	for (int column = 0; column < 4; ++column) {
+		for (int row = 0; row < 4; ++row) {
+			double sum = 0;
+			for (int k = 0; k < 4; ++k) {
+				sum += a[k * 4 + row] * b[column * 4 + k];
+			}
+			result[column * 4 + row] = sum;
+		}
+	}
+}
+
+/// Inverse of a rigid transform.
+static void invert(const double matrix[16], double result[16]) {
+	setIdentity(result);
+	for (int row = 0; row < 3; ++row) {
+		for (int column = 0; column < 3; ++column) {
+			result[column * 4 + row] = matrix[row * 4 + column];
+		}
+	}
+	for (int row = 0; row < 3; ++row) {
+		result[12 + row] = -(result[row] * matrix[12] + result[4 + row] * matrix[13] + result[8 + row] * matrix[14]);
+	}
+}
+
+PoseHistory::Ring::Ring(size_t capacity) :
+		capacity(std::max<size_t>(capacity, 1)), start(0), count(0) {
+
+}
+
+void PoseHistory::Ring::insert(const Sample& sample) {
+	if(count == capacity) {
+		if(sample.timeStamp < slot(0).timeStamp) {
+			return; // Older than everything we keep.
+		}
+		start = (start + 1) % samples.size();
+		count--;
+	}
+	if(count == samples.size()) { // Grow the storage up to the capacity.
+		std::rotate(samples.begin(), samples.begin() + start, samples.end());
+		start = 0;
+		samples.push_back(sample);
+	} else {
+		slot(count) = sample;
+	}
+	count++;
+
+	/* Sort in samples that arrive out of order */
+	for (size_t i = count - 1; (i > 0) && (slot(i - 1).timeStamp > slot(i).timeStamp); --i) {
+		std::swap(slot(i - 1), slot(i));
+	}
+}
+
+void PoseHistory::Ring::dropBefore(double timeStamp) {
+	size_t drop = std::min(lowerBound(timeStamp), count - 1); // Always keep the newest sample.
+	if(count == 0 || drop == 0) {
+		return;
+	}
+	start = (start + drop) % samples.size();
+	count -= drop;
+}
+
+size_t PoseHistory::Ring::lowerBound(double timeStamp) const {
+	size_t low = 0;
+	size_t high = count;
+	while(low < high) {
+		size_t middle = low + (high - low) / 2;
+		if(at(middle).timeStamp < timeStamp) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+bool PoseHistory::Ring::interpolate(double timeStamp, Sample& result) const {
+	if(count == 0) {
+		return false;
+	}
+	size_t index = lowerBound(timeStamp);
+	if(index == 0) {
+		result = at(0);
+	} else if(index == count) {
+		result = at(count - 1);
+	} else {
+		const Sample& before = at(index - 1);
+		const Sample& after = at(index);
+		double interval = after.timeStamp - before.timeStamp;
+		double ratio = (interval > 0) ? (timeStamp - before.timeStamp) / interval : 1.0;
+		PoseHistory::interpolate(before, after, ratio, result);
+	}
+	result.timeStamp = timeStamp;
+	return true;
+}
+
+PoseHistory::PoseHistory(SceneGraphFacade* scene, size_t capacity, double duration) :
+		scene(scene), capacity(capacity), duration(duration) {
+
+}
+
+PoseHistory::~PoseHistory() {
+
+}
+
+bool PoseHistory::query(const std::string& query, std::string& result) {
+
+	/* Cheap pre check, so other queries are not parsed twice */
+	bool isInterpolatedQuery = (query.find(RSG_POSE_QUERY_INTERPOLATED) != std::string::npos);
+	bool isHistoryQuery = (query.find(RSG_POSE_QUERY_HISTORY) != std::string::npos);
+	if(!isInterpolatedQuery && !isHistoryQuery) {
+		return false;
+	}
+
+	std::string queryType;
+	std::string queryId;
+	Id id;
+	Id idReferenceNode;
+	double timeStamp = 0;
+	double start = -std::numeric_limits<double>::max();
+	double end = std::numeric_limits<double>::max();
+	bool success = true;
+	try {
+		libvariant::Variant message = libvariant::DeserializeJSON(query);
+		if(!message.Contains("query")) {
+			return false;
+		}
+		queryType = message.Get("query").AsString();
+		if((queryType.compare(RSG_POSE_QUERY_INTERPOLATED) != 0) && (queryType.compare(RSG_POSE_QUERY_HISTORY) != 0)) {
+			return false;
+		}
+		if(message.Contains("queryId")) {
+			queryId = message.Get("queryId").AsString();
+		}
+		success = message.Contains("id") && message.Contains("idReferenceNode") &&
+				id.fromString(message.Get("id").AsString()) &&
+				idReferenceNode.fromString(message.Get("idReferenceNode").AsString());
+		if(success && (queryType.compare(RSG_POSE_QUERY_INTERPOLATED) == 0)) {
+			success = message.Contains("timeStamp") && parseTimeStamp(message.Get("timeStamp"), timeStamp);
+		}
+		if(success && message.Contains("timeStampStart")) {
+			success = parseTimeStamp(message.Get("timeStampStart"), start);
+		}
+		if(success && message.Contains("timeStampEnd")) {
+			success = parseTimeStamp(message.Get("timeStampEnd"), end);
+		}
+	} catch (std::exception const&) {
+		success = false;
+	}
+	if(!success) {
+		LOG(ERROR) << "PoseHistory: Malformed " << queryType << " query: " << query;
+	}
+
+	double matrix[16];
+	vector<double> timeStamps;
+	vector<double> matrices;
+	if(success) {
+		if(queryType.compare(RSG_POSE_QUERY_INTERPOLATED) == 0) {
+			success = getTransform(id, idReferenceNode, timeStamp, matrix);
+		} else {
+			success = getTransformHistory(id, idReferenceNode, start, end, timeStamps, matrices);
+		}
+	}
+
+	std::ostringstream out;
+	out << "{\"@worldmodeltype\": \"RSGQueryResult\",\"query\": ";
+	appendJsonString(out, queryType);
+	out << ",";
+	if(!queryId.empty()) {
+		out << "\"queryId\": ";
+		appendJsonString(out, queryId);
+		out << ",";
+	}
+	out << "\"querySuccess\": " << (success ? "true" : "false");
+	out << std::fixed << std::setprecision(16);
+	if(success && (queryType.compare(RSG_POSE_QUERY_INTERPOLATED) == 0)) {
+		out << ",\"transform\": ";
+		appendTransform(out, matrix);
+	} else if(success) {
+		out << ",\"history\": [";
+		for (size_t i = 0; i < timeStamps.size(); ++i) {
+			if(i > 0) {
+				out << ",";
+			}
+			out << "{\"timeStamp\": {\"@stamptype\": \"TimeStampUTCms\",\"stamp\": " << std::setprecision(3) << timeStamps[i] << std::setprecision(16) << "},\"transform\": ";
+			appendTransform(out, &matrices[i * 16]);
+			out << "}";
+		}
+		out << "]";
+	}
+	out << "}";
+	result = out.str();
+
+	LOG(DEBUG) << "PoseHistory: Answered " << queryType << " query with " << timeStamps.size() << " poses.";
+	return true;
+}
+
+bool PoseHistory::getTransform(Id id, Id idReferenceNode, double timeStamp, double matrix[16]) {
+	Path path;
+	if(!findPath(id, idReferenceNode, path)) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	composeLocked(path, timeStamp, matrix);
+	return true;
+}
+
+bool PoseHistory::getTransformHistory(Id id, Id idReferenceNode, double start, double end, vector<double>& timeStamps, vector<double>& matrices) {
+	timeStamps.clear();
+	matrices.clear();
+	Path path;
+	if(!findPath(id, idReferenceNode, path)) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<Id, Ring>::const_iterator ring = rings.find(id);
+	if(ring == rings.end()) {
+		return true; // No updates recorded.
+	}
+	for (size_t i = ring->second.lowerBound(start); (i < ring->second.size()) && (ring->second.at(i).timeStamp <= end); ++i) {
+		double stamp = ring->second.at(i).timeStamp;
+		timeStamps.push_back(stamp);
+		matrices.resize(matrices.size() + 16);
+		composeLocked(path, stamp, &matrices[matrices.size() - 16]);
+	}
+	return true;
+}
+
+bool PoseHistory::findPath(Id id, Id idReferenceNode, Path& path) {
+	vector<Id> chains[2];
+	Id nodes[2] = {id, idReferenceNode};
+	for (int i = 0; i < 2; ++i) {
+		Id current = nodes[i];
+		chains[i].push_back(current);
+		vector<Id> parents;
+		while(scene->getNodeParents(current, parents) && !parents.empty() && (chains[i].size() < RSG_POSE_MAX_DEPTH)) {
+			current = parents[0];
+			chains[i].push_back(current);
+			parents.clear();
+		}
+	}
+
+	/* Lowest common ancestor */
+	std::set<Id> referenceAncestors(chains[1].begin(), chains[1].end());
+	for (size_t i = 0; i < chains[0].size(); ++i) {
+		if(referenceAncestors.find(chains[0][i]) != referenceAncestors.end()) {
+			path.toId.assign(chains[0].begin(), chains[0].begin() + i);
+			path.toReference.assign(chains[1].begin(), std::find(chains[1].begin(), chains[1].end(), chains[0][i]));
+			return true;
+		}
+	}
+	LOG(WARNING) << "PoseHistory: There is no path between " << id.toString() << " and " << idReferenceNode.toString();
+	return false;
+}
+
+void PoseHistory::getLocalLocked(Id id, double timeStamp, double matrix[16]) {
+	std::map<Id, Ring>::const_iterator ring = rings.find(id);
+	Sample sample;
+	if((ring != rings.end()) && ring->second.interpolate(timeStamp, sample)) {
+		toMatrix(sample, matrix);
+		return;
+	}
+
+	/* Transforms that have not been updated since the history was created, Groups and Nodes */
+	IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform(new HomogeneousMatrix44());
+	if(scene->getTransform(id, TimeStamp(timeStamp, Units::MilliSecond), transform)) {
+		memcpy(matrix, transform->getRawData(), 16 * sizeof(double));
+	} else {
+		setIdentity(matrix);
+	}
+}
+
+void PoseHistory::composeLocked(const Path& path, double timeStamp, double matrix[16]) {
+	double toId[16], toReference[16], local[16], tmp[16];
+	const vector<Id>* chains[2] = {&path.toId, &path.toReference};
+	double* results[2] = {toId, toReference};
+	for (int i = 0; i < 2; ++i) {
+		setIdentity(results[i]);
+		for (vector<Id>::const_reverse_iterator it = chains[i]->rbegin(); it != chains[i]->rend(); ++it) { // top down
+			getLocalLocked(*it, timeStamp, local);
+			memcpy(tmp, results[i], sizeof(tmp));
+			multiply(tmp, local, results[i]);
+		}
+	}
+	invert(toReference, tmp);
+	multiply(tmp, toId, matrix);
+}
+
+void PoseHistory::recordLocked(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	if(!transform) {
+		return;
+	}
+	std::map<Id, Ring>::iterator ring = rings.find(id);
+	if(ring == rings.end()) {
+		ring = rings.insert(std::make_pair(id, Ring(capacity))).first;
+	}
+	Sample sample;
+	toSample(transform->getRawData(), timeStamp.getSeconds() * 1000.0, sample);
+	ring->second.insert(sample);
+	ring->second.dropBefore(ring->second.at(ring->second.size() - 1).timeStamp - duration);
+}
+
+void PoseHistory::toSample(const double matrix[16], double timeStamp, Sample& sample) {
+	sample.timeStamp = timeStamp;
+	sample.translation[0] = matrix[12];
+	sample.translation[1] = matrix[13];
+	sample.translation[2] = matrix[14];
+
+	/* Rotation matrix to quaternion; m(row, column) = matrix[column * 4 + row] */
+	double m00 = matrix[0], m11 = matrix[5], m22 = matrix[10];
+	double trace = m00 + m11 + m22;
+	double* q = sample.rotation;
+	if(trace > 0) {
+		double s = sqrt(trace + 1.0) * 2.0;
+		q[3] = 0.25 * s;
+		q[0] = (matrix[6] - matrix[9]) / s;
+		q[1] = (matrix[8] - matrix[2]) / s;
+		q[2] = (matrix[1] - matrix[4]) / s;
+	} else if((m00 > m11) && (m00 > m22)) {
+		double s = sqrt(1.0 + m00 - m11 - m22) * 2.0;
+		q[3] = (matrix[6] - matrix[9]) / s;
+		q[0] = 0.25 * s;
+		q[1] = (matrix[4] + matrix[1]) / s;
+		q[2] = (matrix[8] + matrix[2]) / s;
+	} else if(m11 > m22) {
+		double s = sqrt(1.0 + m11 - m00 - m22) * 2.0;
+		q[3] = (matrix[8] - matrix[2]) / s;
+		q[0] = (matrix[4] + matrix[1]) / s;
+		q[1] = 0.25 * s;
+		q[2] = (matrix[9] + matrix[6]) / s;
+	} else {
+		double s = sqrt(1.0 + m22 - m00 - m11) * 2.0;
+		q[3] = (matrix[1] - matrix[4]) / s;
+		q[0] = (matrix[8] + matrix[2]) / s;
+		q[1] = (matrix[9] + matrix[6]) / s;
+		q[2] = 0.25 * s;
+	}
+}
+
+void PoseHistory::toMatrix(const Sample& sample, double matrix[16]) {
+	double x = sample.rotation[0], y = sample.rotation[1], z = sample.rotation[2], w = sample.rotation[3];
+	setIdentity(matrix);
+	matrix[0] = 1 - 2 * (y * y + z * z);
+	matrix[1] = 2 * (x * y + z * w);
+	matrix[2] = 2 * (x * z - y * w);
+	matrix[4] = 2 * (x * y - z * w);
+	matrix[5] = 1 - 2 * (x * x + z * z);
+	matrix[6] = 2 * (y * z + x * w);
+	matrix[8] = 2 * (x * z + y * w);
+	matrix[9] = 2 * (y * z - x * w);
+	matrix[10] = 1 - 2 * (x * x + y * y);
+	matrix[12] = sample.translation[0];
+	matrix[13] = sample.translation[1];
+	matrix[14] = sample.translation[2];
+}
+
+void PoseHistory::interpolate(const Sample& a, const Sample& b, double ratio, Sample& result) {
+	result.timeStamp = a.timeStamp + ratio * (b.timeStamp - a.timeStamp);
+	for (int i = 0; i < 3; ++i) {
+		result.translation[i] = a.translation[i] + ratio * (b.translation[i] - a.translation[i]);
+	}
+
+	/* SLERP along the shorter arc */
+	double cosine = 0;
+	for (int i = 0; i < 4; ++i) {
+		cosine += a.rotation[i] * b.rotation[i];
+	}
+	double sign = 1.0;
+	if(cosine < 0) {
+		cosine = -cosine;
+		sign = -1.0;
+	}
+	double weightA = 1.0 - ratio;
+	double weightB = ratio;
+	if(cosine < 0.9995) { // Otherwise the linear interpolation is precise enough and avoids a division by ~0.
+		double angle = acos(cosine);
+		double sine = sin(angle);
+		weightA = sin((1.0 - ratio) * angle) / sine;
+		weightB = sin(ratio * angle) / sine;
+	}
+	double norm = 0;
+	for (int i = 0; i < 4; ++i) {
+		result.rotation[i] = weightA * a.rotation[i] + sign * weightB * b.rotation[i];
+		norm += result.rotation[i] * result.rotation[i];
+	}
+	norm = sqrt(norm);
+	for (int i = 0; i < 4; ++i) {
+		result.rotation[i] /= norm;
+	}
+}
+
+bool PoseHistory::addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	return true;
+}
+
+bool PoseHistory::addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	return true;
+}
+
+bool PoseHistory::addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	recordLocked(assignedId, transform, timeStamp);
+	return true;
+}
+
+bool PoseHistory::addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	recordLocked(assignedId, transform, timeStamp);
+	return true;
+}
+
+bool PoseHistory::addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId) {
+	return true;
+}
+
+bool PoseHistory::addRemoteRootNode(Id rootId, vector<Attribute> attributes) {
+	return true;
+}
+
+bool PoseHistory::addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId) {
+	return true;
+}
+
+bool PoseHistory::setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp) {
+	return true;
+}
+
+bool PoseHistory::setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	recordLocked(id, transform, timeStamp);
+	return true;
+}
+
+bool PoseHistory::setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	recordLocked(id, transform, timeStamp);
+	return true;
+}
+
+bool PoseHistory::deleteNode(Id id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	rings.erase(id);
+	return true;
+}
+
+bool PoseHistory::addParent(Id id, Id parentId) {
+	return true; // Paths are resolved per query.
+}
+
+bool PoseHistory::removeParent(Id id, Id parentId) {
+	return true;
+}
+
+} // namespace rsg
+} // namespace brics_3d
@@ -0,0 +1,161 @@
+/*
+ * Bounded history of the poses of all Transforms.
+ *
+ * The history observes a scene graph and stores every update of a Transform in a
+ * ring of (time stamp, translation, rotation) samples per node. The rings have a
+ * fixed capacity and a maximum duration, so the memory does not grow with the run
+ * time of the world model. Lookups use a binary search on the time stamps and
+ * interpolate between the two closest samples: translations linearly, rotations
+ * with a SLERP of their quaternions.
+ *
+ * It answers the queries GET_INTERPOLATED_TRANSFORM (a single pose, same reply as
+ * GET_TRANSFORM) and GET_TRANSFORM_HISTORY (all poses of a node within a time range
+ * in a single reply). Poses with respect to a reference node are composed along
+ * the first path of both nodes to the root node, like GET_TRANSFORM does.
+ */
+
+#ifndef RSG_POSE_HISTORY_H_
+#define RSG_POSE_HISTORY_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace brics_3d {
+namespace rsg {
+
+class PoseHistory : public ISceneGraphUpdateObserver {
+public:
+
+	/// A pose of a Transform with respect to its parent.
+	struct Sample {
+		double timeStamp;       // [ms]
+		double translation[3];
+		double rotation[4];     // Quaternion x, y, z, w.
+	};
+
+	/// Time ordered samples with a fixed capacity. The oldest samples are overwritten.
+	class Ring {
+	public:
+		Ring(size_t capacity);
+
+		/// Inserts a sample. Samples that are older than the newest one are sorted in.
+		void insert(const Sample& sample);
+
+		/// Drops all samples that are older than timeStamp.
+		void dropBefore(double timeStamp);
+
+		/**
+		 * Interpolates the pose at a time stamp. Time stamps outside of the history
+		 * are clamped to the oldest or newest sample.
+		 * @return False if the ring is empty.
+		 */
+		bool interpolate(double timeStamp, Sample& result) const;
+
+		/// Index of the first sample that is not older than timeStamp.
+		size_t lowerBound(double timeStamp) const;
+
+		const Sample& at(size_t index) const { return samples[(start + index) % samples.size()]; };
+		size_t size() const { return count; };
+
+	private:
+		Sample& slot(size_t index) { return samples[(start + index) % samples.size()]; };
+
+		vector<Sample> samples;
+		size_t capacity;
+		size_t start;
+		size_t count;
+	};
+
+	/**
+	 * @param scene Scene that provides the structure of the graph and the data of
+	 *              Transforms without history. The caller of query() has to hold the
+	 *              (shared) world model lock.
+	 * @param capacity Maximum number of samples per Transform.
+	 * @param duration Maximum age in [ms] of a sample relative to the newest sample of its Transform.
+	 */
+	PoseHistory(SceneGraphFacade* scene, size_t capacity, double duration);
+	virtual ~PoseHistory();
+
+	/**
+	 * Answers a JSON query if it is a GET_INTERPOLATED_TRANSFORM or GET_TRANSFORM_HISTORY query.
+	 * @param query Complete RSGQuery message.
+	 * @param result JSON result.
+	 * @return True if the result has been set. False if the query has to be processed otherwise.
+	 */
+	bool query(const std::string& query, std::string& result);
+
+	/**
+	 * Interpolates the pose of a node with respect to a reference node.
+	 * @param timeStamp Time in [ms].
+	 * @param matrix Column major like IHomogeneousMatrix44::getRawData().
+	 * @return False if there is no path between the nodes.
+	 */
+	bool getTransform(Id id, Id idReferenceNode, double timeStamp, double matrix[16]);
+
+	/**
+	 * Collects the poses of a node with respect to a reference node for all samples
+	 * of the node within [start, end].
+	 * @param timeStamps Time stamps of the samples in [ms].
+	 * @param matrices 16 column major values per sample.
+	 * @return False if there is no path between the nodes.
+	 */
+	bool getTransformHistory(Id id, Id idReferenceNode, double start, double end, vector<double>& timeStamps, vector<double>& matrices);
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false);
+	bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false);
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false);
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes);
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false);
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0));
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+	bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp);
+	bool deleteNode(Id id);
+	bool addParent(Id id, Id parentId);
+	bool removeParent(Id id, Id parentId);
+
+	static void toSample(const double matrix[16], double timeStamp, Sample& sample);
+	static void toMatrix(const Sample& sample, double matrix[16]);
+
+	/// Linear interpolation of the translations and SLERP of the rotations. 0 <= ratio <= 1.
+	static void interpolate(const Sample& a, const Sample& b, double ratio, Sample& result);
+
+private:
+
+	/// Transforms from the lowest common ancestor down to the id and to the reference node.
+	struct Path {
+		vector<Id> toId;
+		vector<Id> toReference;
+	};
+
+	/// Requires the world model lock. Follows the first parent of both nodes like the scene graph does.
+	bool findPath(Id id, Id idReferenceNode, Path& path);
+
+	/// Has to be called with mutex held. Pose of a single node relative to its parent.
+	void getLocalLocked(Id id, double timeStamp, double matrix[16]);
+
+	/// Has to be called with mutex held.
+	void composeLocked(const Path& path, double timeStamp, double matrix[16]);
+
+	/// Has to be called with mutex held.
+	void recordLocked(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+
+	SceneGraphFacade* scene;
+	size_t capacity;
+	double duration;
+
+	std::mutex mutex;
+	std::map<Id, Ring> rings;
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_POSE_HISTORY_H_ */
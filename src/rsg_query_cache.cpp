@@ -0,0 +1,405 @@
+#include "rsg_query_cache.h"
+
+#include <brics_3d/core/Logger.h>
+
+/* libvariant is used by the JSONQueryRunner as well */
+#include <Variant/Variant.h>
+
+#include <sstream>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_QUERY_CACHE_REGEX_CHARACTERS ".[]{}()\\*+?^$|"
+
+/// Appends a JSON string literal.
+static void appendJsonString(std::ostringstream& out, const std::string& value) {
+	out << "\"";
+	for (size_t i = 0; i < value.size(); ++i) {
+		if ((value[i] == '"') || (value[i] == '\\')) {
+			out << "\\";
+		}
+		out << value[i];
+	}
+	out << "\"";
+}
+
+/// Determines the dependencies of a query. Returns false if its result must not be cached.
+static bool getDependencies(const libvariant::Variant& message, QueryCache::Dependencies& dependencies) {
+	std::string queryType = message.Get("query").AsString();
+	if(queryType.compare("GET_ROOT_NODE") == 0) {
+		return true; // Never changes.
+	}
+	if(queryType.compare("GET_NODES") == 0) {
+		if(message.Contains("attributes") && message.Get("attributes").IsList()) {
+			libvariant::Variant attributeList = message.Get("attributes");
+			for (libvariant::Variant::ConstListIterator i(attributeList.ListBegin()), e(attributeList.ListEnd()); i != e; ++i) {
+				if(!i->Contains("key")) {
+					return false;
+				}
+				std::string key = i->Get("key").AsString();
+				if(key.find_first_of(RSG_QUERY_CACHE_REGEX_CHARACTERS) != std::string::npos) {
+					dependencies.anyAttribute = true;
+				} else {
+					dependencies.keys.insert(key);
+				}
+			}
+		}
+		if(dependencies.keys.empty()) {
+			dependencies.anyAttribute = true;
+		}
+		if(message.Contains("subgraphId")) {
+			dependencies.structure = true;
+		}
+		return true;
+	}
+	if((queryType.compare("GET_NODE_ATTRIBUTES") == 0) || (queryType.compare("GET_GEOMETRY") == 0)) {
+		Id id;
+		if(!message.Contains("id") || !id.fromString(message.Get("id").AsString())) {
+			return false;
+		}
+		dependencies.ids.insert(id);
+		return true;
+	}
+	if((queryType.compare("GET_NODE_PARENTS") == 0) ||
+	   (queryType.compare("GET_GROUP_CHILDREN") == 0) ||
+	   (queryType.compare("GET_REMOTE_ROOT_NODES") == 0) ||
+	   (queryType.compare("GET_CONNECTION_SOURCE_IDS") == 0) ||
+	   (queryType.compare("GET_CONNECTION_TARGET_IDS") == 0)) {
+		dependencies.structure = true;
+		return true;
+	}
+
+	/* Transforms, spatial queries, statistics and unknown queries */
+	return false;
+}
+
+/**
+ * Removes the "queryId" member from a result, so it can be replaced later.
+ * @return False if the result does not have the expected layout.
+ */
+static bool removeQueryId(std::string& result, const std::string& queryId, size_t& position, bool& last) {
+	std::ostringstream quoted;
+	appendJsonString(quoted, queryId);
+	size_t begin = result.find("\"queryId\"");
+	if(begin == std::string::npos) {
+		return false;
+	}
+	size_t value = result.find(quoted.str(), begin);
+	if(value == std::string::npos) {
+		return false;
+	}
+	size_t end = value + quoted.str().size();
+	size_t next = result.find_first_not_of(" \t\r\n", end);
+	if((next != std::string::npos) && (result[next] == ',')) {
+		result.erase(begin, next + 1 - begin);
+		position = begin;
+		last = false;
+		return true;
+	}
+	size_t previous = result.find_last_not_of(" \t\r\n", begin - 1);
+	if((previous != std::string::npos) && (result[previous] == ',')) {
+		result.erase(previous, end - previous);
+		position = previous;
+		last = true;
+		return true;
+	}
+	return false;
+}
+
+QueryCache::QueryCache(StatsCounter* hits, StatsCounter* misses) : hits(hits), misses(misses), generation(0) {
+
+}
+
+QueryCache::~QueryCache() {
+
+}
+
+bool QueryCache::lookup(const std::string& query, std::string& result, Request& request) {
+	request = Request();
+
+	/* Cheap pre check for updates and function blocks */
+	if(query.find("RSGQuery") == std::string::npos) {
+		return false;
+	}
+
+	try {
+		libvariant::Variant message = libvariant::DeserializeJSON(query);
+		if(!message.Contains("@worldmodeltype") || (message.Get("@worldmodeltype").AsString().compare("RSGQuery") != 0) || !message.Contains("query")) {
+			return false;
+		}
+		if(!getDependencies(message, request.dependencies)) {
+			return false;
+		}
+		if(message.Contains("queryId")) {
+			request.queryId = message.Get("queryId").AsString();
+			message.Erase("queryId");
+		}
+		request.key = libvariant::SerializeJSON(message);
+		if(!request.queryId.empty()) {
+			request.key.append("#queryId"); // The result layout differs, see removeQueryId().
+		}
+	} catch (std::exception const&) {
+		return false; // The JSONQueryRunner will report the error.
+	}
+	request.cacheable = true;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	request.generation = generation;
+	std::map<std::string, Entry>::const_iterator entry = entries.find(request.key);
+	if(entry == entries.end()) {
+		if(misses) {
+			misses->add();
+		}
+		return false;
+	}
+	if(hits) {
+		hits->add();
+	}
+	result = entry->second.result;
+	if(!request.queryId.empty()) {
+		std::ostringstream member;
+		if(entry->second.queryIdLast) {
+			member << ",";
+		}
+		member << "\"queryId\": ";
+		appendJsonString(member, request.queryId);
+		if(!entry->second.queryIdLast) {
+			member << ",";
+		}
+		result.insert(entry->second.queryIdPosition, member.str());
+	}
+	return true;
+}
+
+void QueryCache::store(const Request& request, const std::string& result) {
+	if(!request.cacheable || (result.size() > RSG_QUERY_CACHE_MAX_RESULT_SIZE)) {
+		return;
+	}
+
+	Entry entry;
+	entry.result = result;
+	entry.queryIdPosition = 0;
+	entry.queryIdLast = false;
+	entry.dependencies = request.dependencies;
+	if(!request.queryId.empty() && !removeQueryId(entry.result, request.queryId, entry.queryIdPosition, entry.queryIdLast)) {
+		LOG(DEBUG) << "QueryCache: Result has an unexpected layout. It will not be cached: " << result;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if(request.generation != generation) {
+		LOG(DEBUG) << "QueryCache: The world model has been updated during the query. The result will not be cached.";
+		return;
+	}
+	if(entries.find(request.key) != entries.end()) {
+		return; // Stored concurrently by another worker.
+	}
+	if(entries.size() >= RSG_QUERY_CACHE_MAX_ENTRIES) {
+		LOG(DEBUG) << "QueryCache: Maximum of " << RSG_QUERY_CACHE_MAX_ENTRIES << " entries reached. Clearing the cache.";
+		clearLocked();
+	}
+	entries.insert(std::make_pair(request.key, entry));
+	const Dependencies& dependencies = request.dependencies;
+	for (std::set<Id>::const_iterator it = dependencies.ids.begin(); it != dependencies.ids.end(); ++it) {
+		idDependents[*it].insert(request.key);
+	}
+	for (std::set<std::string>::const_iterator it = dependencies.keys.begin(); it != dependencies.keys.end(); ++it) {
+		keyDependents[*it].insert(request.key);
+	}
+	if(dependencies.anyAttribute) {
+		anyAttributeDependents.insert(request.key);
+	}
+	if(dependencies.structure) {
+		structureDependents.insert(request.key);
+	}
+}
+
+size_t QueryCache::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+void QueryCache::eraseLocked(const std::string& key) {
+	std::map<std::string, Entry>::iterator entry = entries.find(key);
+	if(entry == entries.end()) {
+		return;
+	}
+	const Dependencies& dependencies = entry->second.dependencies;
+	for (std::set<Id>::const_iterator it = dependencies.ids.begin(); it != dependencies.ids.end(); ++it) {
+		std::map<Id, std::set<std::string> >::iterator dependents = idDependents.find(*it);
+		if(dependents != idDependents.end()) {
+			dependents->second.erase(key);
+			if(dependents->second.empty()) {
+				idDependents.erase(dependents);
+			}
+		}
+	}
+	for (std::set<std::string>::const_iterator it = dependencies.keys.begin(); it != dependencies.keys.end(); ++it) {
+		std::map<std::string, std::set<std::string> >::iterator dependents = keyDependents.find(*it);
+		if(dependents != keyDependents.end()) {
+			dependents->second.erase(key);
+			if(dependents->second.empty()) {
+				keyDependents.erase(dependents);
+			}
+		}
+	}
+	anyAttributeDependents.erase(key);
+	structureDependents.erase(key);
+	entries.erase(entry);
+}
+
+void QueryCache::invalidateLocked(const vector<Id>& ids, const std::set<std::string>& keys, bool attributesChanged, bool structureChanged) {
+	generation++; // Results of queries that are still running must not be stored.
+	if(entries.empty()) {
+		return;
+	}
+	std::set<std::string> affected;
+	for (vector<Id>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+		std::map<Id, std::set<std::string> >::const_iterator dependents = idDependents.find(*it);
+		if(dependents != idDependents.end()) {
+			affected.insert(dependents->second.begin(), dependents->second.end());
+		}
+	}
+	for (std::set<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+		std::map<std::string, std::set<std::string> >::const_iterator dependents = keyDependents.find(*it);
+		if(dependents != keyDependents.end()) {
+			affected.insert(dependents->second.begin(), dependents->second.end());
+		}
+	}
+	if(attributesChanged) {
+		affected.insert(anyAttributeDependents.begin(), anyAttributeDependents.end());
+	}
+	if(structureChanged) {
+		affected.insert(structureDependents.begin(), structureDependents.end());
+	}
+	for (std::set<std::string>::const_iterator it = affected.begin(); it != affected.end(); ++it) {
+		eraseLocked(*it);
+	}
+}
+
+void QueryCache::addLocked(Id parentId, Id id, const vector<Attribute>& attributes) {
+	std::set<std::string> keys;
+	for (vector<Attribute>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+		keys.insert(it->key);
+	}
+	vector<Id> ids;
+	ids.push_back(parentId);
+	ids.push_back(id);
+	invalidateLocked(ids, keys, !keys.empty(), true);
+	nodeKeys[id] = keys;
+}
+
+void QueryCache::addOldKeysLocked(Id id, std::set<std::string>& keys) {
+	std::map<Id, std::set<std::string> >::const_iterator oldKeys = nodeKeys.find(id);
+	if(oldKeys != nodeKeys.end()) {
+		keys.insert(oldKeys->second.begin(), oldKeys->second.end());
+		return;
+	}
+
+	/* The node existed before the cache, so it could have any key */
+	for (std::map<std::string, std::set<std::string> >::const_iterator it = keyDependents.begin(); it != keyDependents.end(); ++it) {
+		keys.insert(it->first);
+	}
+}
+
+void QueryCache::clearLocked() {
+	entries.clear();
+	idDependents.clear();
+	keyDependents.clear();
+	anyAttributeDependents.clear();
+	structureDependents.clear();
+}
+
+bool QueryCache::addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	addLocked(parentId, assignedId, attributes);
+	return true;
+}
+
+bool QueryCache::addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	addLocked(parentId, assignedId, attributes);
+	return true;
+}
+
+bool QueryCache::addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	addLocked(parentId, assignedId, attributes);
+	return true;
+}
+
+bool QueryCache::addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	addLocked(parentId, assignedId, attributes);
+	return true;
+}
+
+bool QueryCache::addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	addLocked(parentId, assignedId, attributes);
+	return true;
+}
+
+bool QueryCache::addRemoteRootNode(Id rootId, vector<Attribute> attributes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	addLocked(rootId, rootId, attributes);
+	return true;
+}
+
+bool QueryCache::addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	addLocked(parentId, assignedId, attributes);
+	return true;
+}
+
+bool QueryCache::setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::set<std::string> keys;
+	for (vector<Attribute>::const_iterator it = newAttributes.begin(); it != newAttributes.end(); ++it) {
+		keys.insert(it->key);
+	}
+	std::set<std::string> affectedKeys(keys);
+	addOldKeysLocked(id, affectedKeys);
+	invalidateLocked(vector<Id>(1, id), affectedKeys, true, false);
+	nodeKeys[id] = keys;
+	return true;
+}
+
+bool QueryCache::setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	return true; // No cached query depends on the data of a Transform.
+}
+
+bool QueryCache::setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp) {
+	return true;
+}
+
+bool QueryCache::deleteNode(Id id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::set<std::string> keys;
+	addOldKeysLocked(id, keys);
+	nodeKeys.erase(id);
+	invalidateLocked(vector<Id>(1, id), keys, true, true);
+	return true;
+}
+
+bool QueryCache::addParent(Id id, Id parentId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	vector<Id> ids;
+	ids.push_back(id);
+	ids.push_back(parentId);
+	invalidateLocked(ids, std::set<std::string>(), false, true);
+	return true;
+}
+
+bool QueryCache::removeParent(Id id, Id parentId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	vector<Id> ids;
+	ids.push_back(id);
+	ids.push_back(parentId);
+	invalidateLocked(ids, std::set<std::string>(), false, true);
+	return true;
+}
+
+} // namespace rsg
+} // namespace brics_3d
@@ -0,0 +1,144 @@
+/*
+ * Cache for the serialized results of read-only queries.
+ *
+ * Clients like mission controllers and GUIs re-issue identical queries many times
+ * per second. The cache stores the reply of a query under its normalized form
+ * (parsed and serialized again without the queryId), so a repeated query only costs
+ * a parse and a lookup. The queryId of the new query is spliced into the stored reply.
+ *
+ * The cache observes the scene graph and knows what every entry depends on:
+ * the ids of nodes (GET_NODE_ATTRIBUTES, GET_GEOMETRY), the attribute keys of a
+ * GET_NODES query or the structure of the graph (parents, children, connections).
+ * An update only drops the entries that it can affect. Queries that depend on
+ * Transform data have their own caches and are not stored here.
+ */
+
+#ifndef RSG_QUERY_CACHE_H_
+#define RSG_QUERY_CACHE_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "rsg_stats.h"
+
+namespace brics_3d {
+namespace rsg {
+
+/// Maximum number of cached results. The cache is cleared if it is exceeded.
+#define RSG_QUERY_CACHE_MAX_ENTRIES 1000
+
+/// Results larger than this [bytes] are not cached.
+#define RSG_QUERY_CACHE_MAX_RESULT_SIZE (1024 * 1024)
+
+class QueryCache : public ISceneGraphUpdateObserver {
+public:
+
+	/// What a query result depends on.
+	struct Dependencies {
+		Dependencies() : anyAttribute(false), structure(false) {};
+		std::set<Id> ids;           // Any update of these nodes.
+		std::set<std::string> keys; // Any node that gets, changes or loses an attribute with one of these keys.
+		bool anyAttribute;          // Any attribute change.
+		bool structure;             // Any added or deleted node and any parent-child relation.
+	};
+
+	/// State of a query between lookup() and store().
+	struct Request {
+		Request() : cacheable(false), generation(0) {};
+		bool cacheable;
+		uint64_t generation; // Of the cache at lookup().
+		std::string key;
+		std::string queryId;
+		Dependencies dependencies;
+	};
+
+	/**
+	 * @param hits Optional counter for queries that are answered from the cache.
+	 * @param misses Optional counter for cacheable queries that had to be processed.
+	 */
+	QueryCache(StatsCounter* hits = 0, StatsCounter* misses = 0);
+	virtual ~QueryCache();
+
+	/**
+	 * Looks up the result of a query. Has to be called with the (shared) world model
+	 * lock held until the corresponding store(). In case an update slips through
+	 * anyway, store() discards the result.
+	 * @param query Complete JSON message.
+	 * @param result Cached result with the queryId of this query.
+	 * @param request Set up for store() in case of a miss.
+	 * @return True on a hit.
+	 */
+	bool lookup(const std::string& query, std::string& result, Request& request);
+
+	/**
+	 * Stores the result of a query after a miss. Does nothing if the query is not cacheable
+	 * or if any update has invalidated the cache since the lookup(), as the result might
+	 * already be outdated.
+	 */
+	void store(const Request& request, const std::string& result);
+
+	/// Number of cached results.
+	size_t size();
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false);
+	bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false);
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false);
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes);
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false);
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0));
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+	bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp);
+	bool deleteNode(Id id);
+	bool addParent(Id id, Id parentId);
+	bool removeParent(Id id, Id parentId);
+
+private:
+
+	struct Entry {
+		std::string result;         // Reply without the queryId.
+		size_t queryIdPosition;     // Where the queryId has been removed.
+		bool queryIdLast;           // The queryId was the last member, so it needs a leading comma.
+		Dependencies dependencies;
+	};
+
+	/// Has to be called with mutex held. Drops an entry and its reverse dependencies.
+	void eraseLocked(const std::string& key);
+
+	/// Has to be called with mutex held. Drops all entries that depend on one of the ids or keys.
+	void invalidateLocked(const vector<Id>& ids, const std::set<std::string>& keys, bool attributesChanged, bool structureChanged);
+
+	/// Has to be called with mutex held. Handles a new node.
+	void addLocked(Id parentId, Id id, const vector<Attribute>& attributes);
+
+	/// Has to be called with mutex held. Collects the attribute keys a node had before an update.
+	void addOldKeysLocked(Id id, std::set<std::string>& keys);
+
+	/// Has to be called with mutex held.
+	void clearLocked();
+
+	StatsCounter* hits;
+	StatsCounter* misses;
+
+	std::mutex mutex;
+	uint64_t generation; // Incremented by every update that could invalidate a result.
+	std::map<std::string, Entry> entries;
+	std::map<Id, std::set<std::string> > idDependents;
+	std::map<std::string, std::set<std::string> > keyDependents;
+	std::set<std::string> anyAttributeDependents;
+	std::set<std::string> structureDependents;
+	std::map<Id, std::set<std::string> > nodeKeys; // Attribute keys of every node, to know what a deleted node affects.
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_QUERY_CACHE_H_ */
@@ -10,6 +10,10 @@
 #include <brics_3d/worldModel/sceneGraph/HDF5UpdateDeserializer.h>
 #include <brics_3d/worldModel/sceneGraph/RemoteRootNodeAutoMounter.h>
 
+#include "rsg_world_model_lock.h"
+#include "rsg_stats.h"
+#include "rsg_log.h"
+
 using namespace brics_3d;
 using brics_3d::Logger;
 
@@ -30,6 +34,12 @@ struct rsg_reciever_info
 		brics_3d::rsg::HDF5UpdateDeserializer* wm_deserializer;
 		brics_3d::rsg::RemoteRootNodeAutoMounter* wm_auto_mounter;
 
+		/* instrumentation */
+		StatsCounter* messages_in;
+		StatsCounter* bytes_in;
+		LatencyHistogram* decode_time; // Includes applying the update to the world model.
+		BlockLogger* logger; // Level of the RSG_LOG messages.
+
         /* this is to have fast access to ports for reading and writing, without
          * needing a hash table lookup */
         struct rsg_reciever_port_cache ports;
@@ -62,6 +72,7 @@ int rsg_reciever_init(ubx_block_t *b)
         }
         b->private_data=inf;
         update_port_cache(b, &inf->ports);
+        inf->logger = new BlockLogger();
 
        	unsigned int clen;
         rsg_wm_handle tmpWmHandle =  *((rsg_wm_handle*) ubx_config_get_data_ptr(b, "wm_handle", &clen));
@@ -88,6 +99,11 @@ int rsg_reciever_init(ubx_block_t *b)
         /* Attach deserializer (invoked at step function) */
         inf->wm_deserializer = new brics_3d::rsg::HDF5UpdateDeserializer(inf->wm);
 
+        BlockStats* stats = BlockStats::get(b->name);
+        inf->messages_in = stats->getCounter("messages_in");
+        inf->bytes_in = stats->getCounter("bytes_in");
+        inf->decode_time = stats->getHistogram("decode");
+
         /* Setup input buffer for hdf5 messages */
         inf->hdf_5_input_buffer_size = *((uint32_t*) ubx_config_get_data_ptr(b, "buffer_len", &clen));
     	if((clen == 0) || (inf->hdf_5_input_buffer_size == 0)) {
@@ -109,7 +125,7 @@ int rsg_reciever_init(ubx_block_t *b)
 /* start */
 int rsg_reciever_start(ubx_block_t *b)
 {
-        /* struct rsg_reciever_info *inf = (struct rsg_reciever_info*) b->private_data; */
+        struct rsg_reciever_info *inf = (struct rsg_reciever_info*) b->private_data;
         int ret = 0;
 
     	/* Set logger level */
@@ -118,6 +134,7 @@ int rsg_reciever_start(ubx_block_t *b)
     	if(clen == 0) {
     		LOG(INFO) << "rsg_reciever: No log_level configuation given.";
     	} else {
+    		inf->logger->setLevel(*log_level);
     		if (*log_level == 0) {
     			LOG(INFO) << "rsg_reciever: log_level set to DEBUG level.";
     			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
@@ -137,6 +154,8 @@ int rsg_reciever_start(ubx_block_t *b)
     			LOG(INFO) << "rsg_reciever: unknown log_level = " << *log_level;		}
     	}
 
+    	LogBackend::acquire();
+
         return ret;
 }
 
@@ -144,6 +163,7 @@ int rsg_reciever_start(ubx_block_t *b)
 void rsg_reciever_stop(ubx_block_t *b)
 {
         /* struct rsg_reciever_info *inf = (struct rsg_reciever_info*) b->private_data; */
+        LogBackend::release();
 }
 
 /* cleanup */
@@ -151,6 +171,10 @@ void rsg_reciever_cleanup(ubx_block_t *b)
 {
         struct rsg_reciever_info *inf = (struct rsg_reciever_info*) b->private_data;
         free(inf->hdf_5_input_buffer);
+        if(inf->logger){
+        	delete inf->logger;
+        	inf->logger = 0;
+        }
         free(b->private_data);
 }
 
@@ -159,7 +183,7 @@ void rsg_reciever_step(ubx_block_t *b)
 {
 
         struct rsg_reciever_info *inf = (struct rsg_reciever_info*) b->private_data;
-        LOG(DEBUG) << "rsg_reciever: Processing an incoming update";
+        RSG_LOG(inf->logger, DEBUG) << "rsg_reciever: Processing an incoming update";
 
 		/* read data */
 		ubx_port_t* port = inf->ports.rsg_in;
@@ -171,19 +195,23 @@ void rsg_reciever_step(ubx_block_t *b)
 		msg.len = inf->hdf_5_input_buffer_size;
 		msg.data = (void *)inf->hdf_5_input_buffer;
 		int readBytes = __port_read(port, &msg);
-		LOG(DEBUG) << "rsg_reciever: Port returned " << readBytes <<
+		RSG_LOG(inf->logger, DEBUG) << "rsg_reciever: Port returned " << readBytes <<
                       " bytes, while data message length is " << msg.len <<
                       " bytes. Resulting size = " << data_size(&msg);
 
 		const char *dataBuffer = (char *)msg.data;
 		int transferred_bytes;
 		if ((dataBuffer!=0) && (msg.len > 1) && (readBytes > 1)) {
+			inf->messages_in->add();
+			inf->bytes_in->add(readBytes);
+			WorldModelWriteLock writeLock(inf->wm); // Queries of other blocks might run in parallel.
+			ScopedLatency latency(inf->decode_time);
 			inf->wm_deserializer->write(dataBuffer, readBytes, transferred_bytes);
-			LOG(INFO) << "rsg_reciever: \t transferred_bytes = " << transferred_bytes;
+			RSG_LOG(inf->logger, INFO) << "rsg_reciever: \t transferred_bytes = " << transferred_bytes;
 		} else if (dataBuffer == 0) {
-			LOG(ERROR) << "rsg_reciever: Pointer to data buffer is zero. Aborting this update.";
+			RSG_LOG(inf->logger, ERROR) << "rsg_reciever: Pointer to data buffer is zero. Aborting this update.";
 		} else {
-			LOG(DEBUG) << "rsg_reciever: Incoming updare has not enough data to be processed. Aborting this update.";
+			RSG_LOG(inf->logger, DEBUG) << "rsg_reciever: Incoming updare has not enough data to be processed. Aborting this update.";
 		}
 
 }
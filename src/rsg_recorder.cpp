@@ -0,0 +1,169 @@
+#include "rsg_recorder.hpp"
+
+/* BRICS_3D includes */
+#include <brics_3d/core/Logger.h>
+
+#include <chrono>
+#include <string>
+
+#include "rsg_capture.h"
+#include "rsg_stats.h"
+
+using namespace brics_3d;
+using brics_3d::Logger;
+using brics_3d::rsg::CaptureWriter;
+
+UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
+
+#define DEFAULT_RECORDER_BUFFER_SIZE 20000 // [bytes]
+
+/* define a structure for holding the block local state. By assigning an
+ * instance of this struct to the block private_data pointer (see init), this
+ * information becomes accessible within the hook functions.
+ */
+struct rsg_recorder_info
+{
+        /* add custom block local data here */
+		std::string* file_name;
+		CaptureWriter* writer;
+		char* input_buffer;
+		uint32_t input_buffer_size;
+		std::chrono::steady_clock::time_point* recording_start;
+		uint64_t truncated_messages;
+
+		/* instrumentation */
+		StatsCounter* messages_in;
+		StatsCounter* bytes_in;
+		StatsCounter* drops; // Truncated or not written messages.
+
+        /* this is to have fast access to ports for reading and writing, without
+         * needing a hash table lookup */
+        struct rsg_recorder_port_cache ports;
+};
+
+/* init */
+int rsg_recorder_init(ubx_block_t *b)
+{
+        int ret = -1;
+        struct rsg_recorder_info *inf;
+
+        /* allocate memory for the block local state */
+        if ((inf = (struct rsg_recorder_info*)calloc(1, sizeof(struct rsg_recorder_info)))==NULL) {
+                ERR("rsg_recorder: failed to alloc memory");
+                ret=EOUTOFMEM;
+                return -1;
+        }
+        b->private_data=inf;
+        update_port_cache(b, &inf->ports);
+
+    	unsigned int clen;
+    	char* chrptr = (char*) ubx_config_get_data_ptr(b, "file_name", &clen);
+    	if((clen == 0) || (strcmp(chrptr, "") == 0)) {
+    		LOG(ERROR) << "rsg_recorder: No file_name configuration given.";
+    		return -1;
+    	}
+    	inf->file_name = new std::string(chrptr);
+    	LOG(INFO) << "rsg_recorder: file_name = " << *inf->file_name;
+
+    	inf->input_buffer_size = DEFAULT_RECORDER_BUFFER_SIZE;
+    	uint32_t* buffer_len = (uint32_t*) ubx_config_get_data_ptr(b, "buffer_len", &clen);
+    	if((clen == 0) || (*buffer_len == 0)) {
+    		LOG(INFO) << "rsg_recorder: No buffer_len configuration given. Setting it to " << inf->input_buffer_size;
+    	} else {
+    		inf->input_buffer_size = *buffer_len;
+    	}
+    	LOG(INFO) << "rsg_recorder: buffer_len = " << inf->input_buffer_size;
+    	inf->input_buffer = (char*) malloc(inf->input_buffer_size);
+    	if(inf->input_buffer == 0) {
+    		ERR("rsg_recorder: failed to alloc input buffer");
+    		return -1;
+    	}
+
+    	inf->writer = new CaptureWriter();
+    	inf->recording_start = new std::chrono::steady_clock::time_point();
+
+    	BlockStats* stats = BlockStats::get(b->name);
+    	inf->messages_in = stats->getCounter("messages_in");
+    	inf->bytes_in = stats->getCounter("bytes_in");
+    	inf->drops = stats->getCounter("drops");
+
+        return 0;
+}
+
+/* start */
+int rsg_recorder_start(ubx_block_t *b)
+{
+        struct rsg_recorder_info *inf = (struct rsg_recorder_info*) b->private_data;
+        if(!inf->writer->open(*inf->file_name)) {
+        	return -1;
+        }
+        *inf->recording_start = std::chrono::steady_clock::now();
+        inf->truncated_messages = 0;
+        LOG(INFO) << "rsg_recorder: Recording to " << *inf->file_name;
+        return 0;
+}
+
+/* stop */
+void rsg_recorder_stop(ubx_block_t *b)
+{
+        struct rsg_recorder_info *inf = (struct rsg_recorder_info*) b->private_data;
+        LOG(INFO) << "rsg_recorder: Recorded " << inf->writer->getRecords() << " messages to " << *inf->file_name
+        		<< ". " << inf->truncated_messages << " of them are truncated.";
+        inf->writer->close();
+}
+
+/* cleanup */
+void rsg_recorder_cleanup(ubx_block_t *b)
+{
+        struct rsg_recorder_info *inf = (struct rsg_recorder_info*) b->private_data;
+        if(inf->writer) {
+        	delete inf->writer;
+        	inf->writer = 0;
+        }
+        if(inf->recording_start) {
+        	delete inf->recording_start;
+        	inf->recording_start = 0;
+        }
+        if(inf->file_name) {
+        	delete inf->file_name;
+        	inf->file_name = 0;
+        }
+        free(inf->input_buffer);
+        free(b->private_data);
+}
+
+/* step */
+void rsg_recorder_step(ubx_block_t *b)
+{
+        struct rsg_recorder_info *inf = (struct rsg_recorder_info*) b->private_data;
+        ubx_port_t* port = inf->ports.rsg_in;
+        assert(port != 0);
+
+        /* Drain the input, every message gets the time stamp of the step that reads it. */
+        while(true) {
+        	ubx_data_t msg;
+        	checktype(port->block->ni, port->in_type, "unsigned char", port->name, 1);
+        	msg.type = port->in_type;
+        	msg.len = inf->input_buffer_size;
+        	msg.data = (void *)inf->input_buffer;
+        	int readBytes = __port_read(port, &msg);
+        	if(readBytes <= 0) {
+        		break;
+        	}
+
+        	if((uint32_t)readBytes >= inf->input_buffer_size) {
+        		if(inf->truncated_messages++ == 0) {
+        			LOG(WARNING) << "rsg_recorder: A message does not fit into buffer_len = " << inf->input_buffer_size << " bytes and is recorded truncated.";
+        		}
+        		inf->drops->add();
+        	}
+
+        	uint64_t timeStamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - *inf->recording_start).count();
+        	if(!inf->writer->append(timeStamp, inf->input_buffer, readBytes)) {
+        		inf->drops->add();
+        		continue;
+        	}
+        	inf->messages_in->add();
+        	inf->bytes_in->add(readBytes);
+        }
+}
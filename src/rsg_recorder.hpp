@@ -0,0 +1,112 @@
+/*
+ * rsg_recorder microblx function block (autogenerated, don't edit)
+ */
+
+#include <ubx.h>
+
+/* includes types and type metadata */
+
+ubx_type_t types[] = {
+        { NULL },
+};
+
+/* block meta information */
+char rsg_recorder_meta[] =
+        " { doc='A block that records the raw byte stream of its input port with time stamps into a capture file',"
+        "   real-time=false,"
+        "}";
+
+/* declaration of block configuration */
+ubx_config_t rsg_recorder_config[] = {
+        { .name="file_name", .type_name = "char" , .doc="Name of the capture file. An existing file is overwritten when the block is started. This parameter is mandatory." },
+        { .name="buffer_len", .type_name = "uint32_t", .doc="Size in bytes of the input buffer, i.e. the largest message that can be recorded without truncation. "
+        		"It should match the element_size of the connected buffer. Default is 20000." },
+        { NULL },
+};
+
+/* declaration port block ports */
+ubx_port_t rsg_recorder_ports[] = {
+        { .name="rsg_in", .in_type_name="unsigned char", .doc="Byte stream to be recorded, e.g. from rsg_json_sender.rsg_out or rsg_sender.rsg_out."  },
+        { NULL },
+};
+
+/* declare a struct port_cache */
+struct rsg_recorder_port_cache {
+        ubx_port_t* rsg_in;
+};
+
+/* declare a helper function to update the port cache this is necessary
+ * because the port ptrs can change if ports are dynamically added or
+ * removed. This function should hence be called after all
+ * initialization is done, i.e. typically in 'start'
+ */
+static void update_port_cache(ubx_block_t *b, struct rsg_recorder_port_cache *pc)
+{
+        pc->rsg_in = ubx_port_get(b, "rsg_in");
+}
+
+
+/* for each port type, declare convenience functions to read/write from ports */
+//def_read_fun(read_rsg_in, unsigned char)
+
+/* block operation forward declarations */
+int rsg_recorder_init(ubx_block_t *b);
+int rsg_recorder_start(ubx_block_t *b);
+void rsg_recorder_stop(ubx_block_t *b);
+void rsg_recorder_cleanup(ubx_block_t *b);
+void rsg_recorder_step(ubx_block_t *b);
+
+
+/* put everything together */
+ubx_block_t rsg_recorder_block = {
+        .name = "rsg_recorder",
+        .type = BLOCK_TYPE_COMPUTATION,
+        .meta_data = rsg_recorder_meta,
+        .configs = rsg_recorder_config,
+        .ports = rsg_recorder_ports,
+
+        /* ops */
+        .init = rsg_recorder_init,
+        .start = rsg_recorder_start,
+        .stop = rsg_recorder_stop,
+        .cleanup = rsg_recorder_cleanup,
+        .step = rsg_recorder_step,
+};
+
+
+/* rsg_recorder module init and cleanup functions */
+int rsg_recorder_mod_init(ubx_node_info_t* ni)
+{
+        DBG(" ");
+        int ret = -1;
+        ubx_type_t *tptr;
+
+        for(tptr=types; tptr->name!=NULL; tptr++) {
+                if(ubx_type_register(ni, tptr) != 0) {
+                        goto out;
+                }
+        }
+
+        if(ubx_block_register(ni, &rsg_recorder_block) != 0)
+                goto out;
+
+        ret=0;
+out:
+        return ret;
+}
+
+void rsg_recorder_mod_cleanup(ubx_node_info_t *ni)
+{
+        DBG(" ");
+        const ubx_type_t *tptr;
+
+        for(tptr=types; tptr->name!=NULL; tptr++)
+                ubx_type_unregister(ni, tptr->name);
+
+        ubx_block_unregister(ni, "rsg_recorder");
+}
+
+/* declare module init and cleanup functions, so that the ubx core can
+ * find these when the module is loaded/unloaded */
+UBX_MODULE_INIT(rsg_recorder_mod_init)
+UBX_MODULE_CLEANUP(rsg_recorder_mod_cleanup)
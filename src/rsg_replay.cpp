@@ -0,0 +1,256 @@
+#include "rsg_replay.hpp"
+
+/* BRICS_3D includes */
+#include <brics_3d/core/Logger.h>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "rsg_capture.h"
+#include "rsg_stats.h"
+
+using namespace brics_3d;
+using brics_3d::Logger;
+using brics_3d::rsg::CaptureReader;
+
+UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
+
+#define DEFAULT_REPLAY_MESSAGES_PER_STEP 10
+
+/* define a structure for holding the block local state. By assigning an
+ * instance of this struct to the block private_data pointer (see init), this
+ * information becomes accessible within the hook functions.
+ */
+struct rsg_replay_info
+{
+        /* add custom block local data here */
+		std::string* file_name;
+		CaptureReader* reader;
+		float speed;
+		uint32_t max_messages_per_step;
+
+		/* playback state */
+		std::vector<char>* message;   // Next message to be sent
+		uint64_t message_time_stamp;  // [ns] since the start of the recording
+		bool has_message;
+		bool finished;
+		std::chrono::steady_clock::time_point* replay_start;
+		uint64_t messages_sent;
+		uint64_t bytes_sent;
+
+		/* receivers whose statistics are reported */
+		std::vector<std::string>* report_blocks;
+		std::vector<uint64_t>* report_baseline; // messages_in of the report_blocks at start
+
+		/* instrumentation */
+		StatsCounter* messages_out;
+		StatsCounter* bytes_out;
+		LatencyHistogram* lag; // Delay of a message with respect to its scheduled time.
+
+        /* this is to have fast access to ports for reading and writing, without
+         * needing a hash table lookup */
+        struct rsg_replay_port_cache ports;
+};
+
+/**
+ * Logs the throughput of the playback and the statistics of the receiving blocks.
+ */
+static void report(struct rsg_replay_info *inf, const char* phase)
+{
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - *inf->replay_start).count();
+	if(seconds <= 0) {
+		seconds = 1e-9;
+	}
+	LOG(INFO) << "rsg_replay: " << phase << ": Sent " << inf->messages_sent << " messages with " << inf->bytes_sent << " bytes in " << seconds << " s ("
+			<< inf->messages_sent / seconds << " messages/s, " << inf->bytes_sent / seconds / (1024.0 * 1024.0) << " MiB/s). "
+			<< "Lag p50 = " << inf->lag->getPercentile(50) << " ns, p99 = " << inf->lag->getPercentile(99) << " ns.";
+
+	for (size_t i = 0; i < inf->report_blocks->size(); ++i) {
+		BlockStats* stats = BlockStats::get(inf->report_blocks->at(i));
+		uint64_t received = stats->getCounter("messages_in")->get() - inf->report_baseline->at(i);
+		std::stringstream json;
+		stats->toJson(json);
+		LOG(INFO) << "rsg_replay: " << phase << ": " << inf->report_blocks->at(i) << " processed " << received << " messages ("
+				<< received / seconds << " messages/s). Statistics: " << json.str();
+	}
+}
+
+/* init */
+int rsg_replay_init(ubx_block_t *b)
+{
+        int ret = -1;
+        struct rsg_replay_info *inf;
+
+        /* allocate memory for the block local state */
+        if ((inf = (struct rsg_replay_info*)calloc(1, sizeof(struct rsg_replay_info)))==NULL) {
+                ERR("rsg_replay: failed to alloc memory");
+                ret=EOUTOFMEM;
+                return -1;
+        }
+        b->private_data=inf;
+        update_port_cache(b, &inf->ports);
+
+    	unsigned int clen;
+    	char* chrptr = (char*) ubx_config_get_data_ptr(b, "file_name", &clen);
+    	if((clen == 0) || (strcmp(chrptr, "") == 0)) {
+    		LOG(ERROR) << "rsg_replay: No file_name configuration given.";
+    		return -1;
+    	}
+    	inf->file_name = new std::string(chrptr);
+    	LOG(INFO) << "rsg_replay: file_name = " << *inf->file_name;
+
+    	inf->speed = 1.0;
+    	float* speed = (float*) ubx_config_get_data_ptr(b, "speed", &clen);
+    	if(clen == 0) {
+    		LOG(INFO) << "rsg_replay: No speed configuration given. Setting it to " << inf->speed;
+    	} else if (*speed < 0) {
+    		LOG(WARNING) << "rsg_replay: speed < 0. Resetting it to " << inf->speed;
+    	} else {
+    		inf->speed = *speed;
+    	}
+    	LOG(INFO) << "rsg_replay: speed = " << inf->speed << ((inf->speed == 0) ? " (as fast as possible)" : "");
+
+    	inf->max_messages_per_step = DEFAULT_REPLAY_MESSAGES_PER_STEP;
+    	uint32_t* max_messages_per_step = (uint32_t*) ubx_config_get_data_ptr(b, "max_messages_per_step", &clen);
+    	if(clen == 0) {
+    		LOG(INFO) << "rsg_replay: No max_messages_per_step configuration given. Setting it to " << inf->max_messages_per_step;
+    	} else if ((*max_messages_per_step == 0) && (inf->speed == 0)) {
+    		LOG(WARNING) << "rsg_replay: max_messages_per_step = 0 requires speed > 0. Setting it to " << inf->max_messages_per_step;
+    	} else {
+    		inf->max_messages_per_step = *max_messages_per_step;
+    	}
+    	LOG(INFO) << "rsg_replay: max_messages_per_step = " << inf->max_messages_per_step;
+
+    	inf->report_blocks = new std::vector<std::string>();
+    	inf->report_baseline = new std::vector<uint64_t>();
+    	chrptr = (char*) ubx_config_get_data_ptr(b, "report_blocks", &clen);
+    	if(clen != 0) {
+    		std::stringstream names(chrptr);
+    		std::string name;
+    		while(std::getline(names, name, ',')) {
+    			if(!name.empty()) {
+    				inf->report_blocks->push_back(name);
+    				LOG(INFO) << "rsg_replay: Reporting statistics of " << name;
+    			}
+    		}
+    	}
+
+    	inf->reader = new CaptureReader();
+    	inf->message = new std::vector<char>();
+    	inf->replay_start = new std::chrono::steady_clock::time_point();
+
+    	BlockStats* stats = BlockStats::get(b->name);
+    	inf->messages_out = stats->getCounter("messages_out");
+    	inf->bytes_out = stats->getCounter("bytes_out");
+    	inf->lag = stats->getHistogram("lag");
+
+        return 0;
+}
+
+/* start */
+int rsg_replay_start(ubx_block_t *b)
+{
+        struct rsg_replay_info *inf = (struct rsg_replay_info*) b->private_data;
+        if(!inf->reader->open(*inf->file_name)) {
+        	return -1;
+        }
+        inf->has_message = false;
+        inf->finished = false;
+        inf->messages_sent = 0;
+        inf->bytes_sent = 0;
+        inf->report_baseline->clear();
+        for (size_t i = 0; i < inf->report_blocks->size(); ++i) {
+        	inf->report_baseline->push_back(BlockStats::get(inf->report_blocks->at(i))->getCounter("messages_in")->get());
+        }
+        *inf->replay_start = std::chrono::steady_clock::now();
+        LOG(INFO) << "rsg_replay: Playing back " << *inf->file_name;
+        return 0;
+}
+
+/* stop */
+void rsg_replay_stop(ubx_block_t *b)
+{
+        struct rsg_replay_info *inf = (struct rsg_replay_info*) b->private_data;
+        report(inf, inf->finished ? "Final" : "Stopped");
+        inf->reader->close();
+}
+
+/* cleanup */
+void rsg_replay_cleanup(ubx_block_t *b)
+{
+        struct rsg_replay_info *inf = (struct rsg_replay_info*) b->private_data;
+        if(inf->reader) {
+        	delete inf->reader;
+        	inf->reader = 0;
+        }
+        if(inf->message) {
+        	delete inf->message;
+        	inf->message = 0;
+        }
+        if(inf->replay_start) {
+        	delete inf->replay_start;
+        	inf->replay_start = 0;
+        }
+        if(inf->report_blocks) {
+        	delete inf->report_blocks;
+        	inf->report_blocks = 0;
+        }
+        if(inf->report_baseline) {
+        	delete inf->report_baseline;
+        	inf->report_baseline = 0;
+        }
+        if(inf->file_name) {
+        	delete inf->file_name;
+        	inf->file_name = 0;
+        }
+        free(b->private_data);
+}
+
+/* step */
+void rsg_replay_step(ubx_block_t *b)
+{
+        struct rsg_replay_info *inf = (struct rsg_replay_info*) b->private_data;
+        if(inf->finished) {
+        	return;
+        }
+        ubx_port_t* port = inf->ports.rsg_out;
+        assert(port != 0);
+        ubx_type_t* type = ubx_type_get(b->ni, "unsigned char");
+
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - *inf->replay_start).count();
+        uint32_t sent = 0;
+        while((inf->max_messages_per_step == 0) || (sent < inf->max_messages_per_step)) {
+        	if(!inf->has_message) {
+        		if(!inf->reader->next(inf->message_time_stamp, *inf->message)) {
+        			inf->finished = true;
+        			report(inf, "End of capture");
+        			break;
+        		}
+        		inf->has_message = true;
+        	}
+
+        	/* Messages are sent with the step that follows their scheduled time. */
+        	if(inf->speed > 0) {
+        		uint64_t scheduled = inf->message_time_stamp / inf->speed;
+        		if(scheduled > elapsed) {
+        			break;
+        		}
+        		inf->lag->record(elapsed - scheduled);
+        	}
+
+        	ubx_data_t msg;
+        	msg.data = inf->message->empty() ? 0 : (void *)&(*inf->message)[0];
+        	msg.len = inf->message->size();
+        	msg.type = type;
+        	__port_write(port, &msg);
+
+        	inf->has_message = false;
+        	inf->messages_sent++;
+        	inf->bytes_sent += msg.len;
+        	inf->messages_out->add();
+        	inf->bytes_out->add(msg.len);
+        	sent++;
+        }
+}
@@ -0,0 +1,116 @@
+/*
+ * rsg_replay microblx function block (autogenerated, don't edit)
+ */
+
+#include <ubx.h>
+
+/* includes types and type metadata */
+
+ubx_type_t types[] = {
+        { NULL },
+};
+
+/* block meta information */
+char rsg_replay_meta[] =
+        " { doc='A block that plays back a capture file of the rsg_recorder block',"
+        "   real-time=false,"
+        "}";
+
+/* declaration of block configuration */
+ubx_config_t rsg_replay_config[] = {
+        { .name="file_name", .type_name = "char" , .doc="Name of the capture file. This parameter is mandatory." },
+        { .name="speed", .type_name = "float", .doc="Playback speed relative to the recording: 1.0 keeps the original timing, 2.0 is twice as fast. "
+        		"0 sends the messages as fast as possible, limited by max_messages_per_step. Default is 1.0." },
+        { .name="max_messages_per_step", .type_name = "uint32_t", .doc="Maximum number of messages that are sent per step. It must not exceed the buffer_len of the connected buffer. "
+        		"0 means no limit, which is not allowed for speed = 0. Default is 10." },
+        { .name="report_blocks", .type_name = "char" , .doc="Comma separated names of the receiving blocks, e.g. rsgjsonreciever. "
+        		"Their throughput and latency statistics are reported when the capture has been played back." },
+        { NULL },
+};
+
+/* declaration port block ports */
+ubx_port_t rsg_replay_ports[] = {
+        { .name="rsg_out", .out_type_name="unsigned char", .out_data_len=1, .doc="Recorded byte stream. Connect it to the input of a receiver, e.g. rsg_json_reciever.rsg_in."  },
+        { NULL },
+};
+
+/* declare a struct port_cache */
+struct rsg_replay_port_cache {
+        ubx_port_t* rsg_out;
+};
+
+/* declare a helper function to update the port cache this is necessary
+ * because the port ptrs can change if ports are dynamically added or
+ * removed. This function should hence be called after all
+ * initialization is done, i.e. typically in 'start'
+ */
+static void update_port_cache(ubx_block_t *b, struct rsg_replay_port_cache *pc)
+{
+        pc->rsg_out = ubx_port_get(b, "rsg_out");
+}
+
+
+/* for each port type, declare convenience functions to read/write from ports */
+//def_write_fun(write_rsg_out, unsigned char)
+
+/* block operation forward declarations */
+int rsg_replay_init(ubx_block_t *b);
+int rsg_replay_start(ubx_block_t *b);
+void rsg_replay_stop(ubx_block_t *b);
+void rsg_replay_cleanup(ubx_block_t *b);
+void rsg_replay_step(ubx_block_t *b);
+
+
+/* put everything together */
+ubx_block_t rsg_replay_block = {
+        .name = "rsg_replay",
+        .type = BLOCK_TYPE_COMPUTATION,
+        .meta_data = rsg_replay_meta,
+        .configs = rsg_replay_config,
+        .ports = rsg_replay_ports,
+
+        /* ops */
+        .init = rsg_replay_init,
+        .start = rsg_replay_start,
+        .stop = rsg_replay_stop,
+        .cleanup = rsg_replay_cleanup,
+        .step = rsg_replay_step,
+};
+
+
+/* rsg_replay module init and cleanup functions */
+int rsg_replay_mod_init(ubx_node_info_t* ni)
+{
+        DBG(" ");
+        int ret = -1;
+        ubx_type_t *tptr;
+
+        for(tptr=types; tptr->name!=NULL; tptr++) {
+                if(ubx_type_register(ni, tptr) != 0) {
+                        goto out;
+                }
+        }
+
+        if(ubx_block_register(ni, &rsg_replay_block) != 0)
+                goto out;
+
+        ret=0;
+out:
+        return ret;
+}
+
+void rsg_replay_mod_cleanup(ubx_node_info_t *ni)
+{
+        DBG(" ");
+        const ubx_type_t *tptr;
+
+        for(tptr=types; tptr->name!=NULL; tptr++)
+                ubx_type_unregister(ni, tptr->name);
+
+        ubx_block_unregister(ni, "rsg_replay");
+}
+
+/* declare module init and cleanup functions, so that the ubx core can
+ * find these when the module is loaded/unloaded */
+UBX_MODULE_INIT(rsg_replay_mod_init)
+UBX_MODULE_CLEANUP(rsg_replay_mod_cleanup)
@@ -10,6 +10,12 @@
 #include <brics_3d/worldModel/sceneGraph/DotVisualizer.h>
 #include <brics_3d/worldModel/sceneGraph/JSONDeserializer.h>
 
+#include <chrono>
+
+#include "rsg_world_model_lock.h"
+#include "rsg_snapshot.h"
+#include "rsg_json_stream.h"
+
 //#define GENERATED_SCENE_SETUP
 
 #ifdef GENERATED_SCENE_SETUP
@@ -158,13 +164,30 @@ void rsg_scene_setup_step(ubx_block_t *b)
 
         struct rsg_scene_setup_info *inf = (struct rsg_scene_setup_info*) b->private_data;
         brics_3d::WorldModel* wm = inf->wm;
+    	unsigned int clen;
+
+        /*
+         * Restore a binary snapshot as stored by the rsg_dump block.
+         */
+        bool snapshotLoaded = false;
+    	char* snapshotFile = (char*) ubx_config_get_data_ptr(b, "rsg_snapshot_file", &clen);
+    	if((clen != 0) && (strcmp(snapshotFile, "") != 0)) {
+    		LOG(INFO) << "rsg_scene_setup: Restoring binary snapshot " << snapshotFile;
+    		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    		uint64_t records = 0;
+    		{
+    			WorldModelWriteLock writeLock(wm);
+    			snapshotLoaded = brics_3d::rsg::SnapshotLoader::load(wm, snapshotFile, records);
+    		}
+    		LOG(INFO) << "rsg_scene_setup: Restored " << records << " records in "
+    				<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms.";
+    	}
 
         /*
          * Load scene based on JSON file.
          */
     	/* retrive optional dot file prefix from config */
     	string* fileName = new std::string("");
-    	unsigned int clen;
     	char* chrptr = (char*) ubx_config_get_data_ptr(b, "rsg_file", &clen);
     	if(clen == 0) {
     		LOG(INFO) << "rsg_scene_setup: No rsg_file configuation given. Selecting a default.";
@@ -179,6 +202,17 @@ void rsg_scene_setup_step(ubx_block_t *b)
     	LOG(INFO) << "rsg_scene_setup: file name = " << *fileName;
 
     	if(fileName->compare("") != 0) {
+    		int* streamRsgFile = (int*) ubx_config_get_data_ptr(b, "stream_rsg_file", &clen);
+    		if((clen != 0) && (*streamRsgFile != 0)) {
+    			LOG(INFO) << "rsg_scene_setup: Loading JSON model with the streaming loader.";
+    			WorldModelWriteLock writeLock(wm);
+    			brics_3d::rsg::StreamingSceneLoader loader(wm);
+    			if(!loader.load(*fileName)) {
+    				LOG(ERROR) << "rsg_scene_setup: Loading " << *fileName << " failed after " << loader.getPrimitiveCount() << " primitives.";
+    			}
+    			return;
+    		}
+
     		LOG(INFO) << "rsg_scene_setup: Loading JSON model.";
 
     		/* Read file */
@@ -188,18 +222,25 @@ void rsg_scene_setup_step(ubx_block_t *b)
     		serializedModel << inputFile.rdbuf();
 
     		/* Do the actual JSON parsing. */
-    		LOG(INFO) << serializedModel.str();
+    		std::string model = serializedModel.str();
+    		LOG(DEBUG) << model;
+    		WorldModelWriteLock writeLock(wm); // Queries of other blocks might run in parallel.
     		brics_3d::rsg::JSONDeserializer deserializer(wm);
     		deserializer.setMapUnknownParentIdsToRootId(true);
-    		deserializer.write(serializedModel.str());
+    		deserializer.write(model);
 
     		return;
 
     	}
 
+    	if(snapshotLoaded) {
+    		return; // The snapshot replaces the default scene.
+    	}
+
         /*
          * Hard coded CPP version below as fall back:
          */
+    	WorldModelWriteLock writeLock(wm);
 
     	/* Add group nodes */
 //    	std::vector<brics_3d::rsg::Attribute> attributes;
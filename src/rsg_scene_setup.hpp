@@ -21,6 +21,8 @@ ubx_config_t rsg_scene_setup_config[] = {
         { .name="wm_handle", .type_name = "struct rsg_wm_handle", .doc="Handle to the world wodel instance. This parameter is mandatory." },
         { .name="log_level", .type_name = "int", .doc="Set the log level: LOGDEBUG = 0, INFO = 1, WARNING = 2, LOGERROR = 3, FATAL = 4" },
         { .name="rsg_file",  .type_name = "char" , .doc="JSON file name to be loaded to RSG." },
+        { .name="stream_rsg_file", .type_name = "int", .doc="If 1 the rsg_file is parsed incrementally and every primitive is added as soon as it has been read. Memory use does not grow with the file size and progress is logged. Default is 0." },
+        { .name="rsg_snapshot_file",  .type_name = "char" , .doc="Binary snapshot file (.rsgs) as stored by the rsg_dump block. It is restored before the rsg_file is loaded." },
         { NULL },
 };
 
@@ -12,6 +12,9 @@
 #include <brics_3d/worldModel/sceneGraph/FrequencyAwareUpdateFilter.h>
 #include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
 
+#include "rsg_stats.h"
+#include "rsg_log.h"
+#include "rsg_update_timer.h"
 
 using namespace brics_3d;
 using brics_3d::Logger;
@@ -24,11 +27,14 @@ UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
  */
 class RsgToUbxPort : public brics_3d::rsg::IOutputPort {
 public:
-	RsgToUbxPort(ubx_port_t* port, ubx_type_t* type) : port(port), type(type){};
+	RsgToUbxPort(ubx_port_t* port, ubx_type_t* type, BlockStats* stats, BlockLogger* logger) : port(port), type(type), logger(logger){
+		messagesOut = stats->getCounter("messages_out");
+		bytesOut = stats->getCounter("bytes_out");
+	};
 	virtual ~RsgToUbxPort(){};
 
 	int write(const char *dataBuffer, int dataLength, int &transferredBytes) {
-		LOG(INFO) << "RsgToUbxPort: Feeding data forwards.";
+		RSG_LOG(logger, INFO) << "RsgToUbxPort: Feeding data forwards.";
 		assert(port != 0);
 
 		ubx_data_t msg;
@@ -36,8 +42,10 @@ public:
 		msg.len = dataLength;
 		msg.type = type;
 
-		LOG(INFO) << "Sending " << msg.len << " bytes: ";
+		RSG_LOG(logger, INFO) << "Sending " << msg.len << " bytes: ";
 		__port_write(port, &msg);
+		messagesOut->add();
+		bytesOut->add(dataLength);
 
 		return 0;
 	};
@@ -45,6 +53,9 @@ public:
 private:
 	ubx_port_t* port;
 	ubx_type_t* type;
+	BlockLogger* logger;
+	StatsCounter* messagesOut;
+	StatsCounter* bytesOut;
 };
 
 /**
@@ -112,6 +123,8 @@ struct rsg_sender_info
 		brics_3d::rsg::SceneGraphToUpdatesTraverser* wm_resender;
 		brics_3d::rsg::FrequencyAwareUpdateFilter* frequency_filter;
 		RemoteRootNodeAdditionTrigger* remote_root_trigger;
+		TimedUpdateObserver* encode_timer; // Measures encoding including sending.
+		BlockLogger* logger; // Level of the RSG_LOG messages.
 
         /* this is to have fast access to ports for reading and writing, without
          * needing a hash table lookup */
@@ -135,6 +148,7 @@ int rsg_sender_init(ubx_block_t *b)
         }
         b->private_data=inf;
         update_port_cache(b, &inf->ports);
+        inf->logger = new BlockLogger();
 
     	unsigned int clen;
     	rsg_wm_handle tmpWmHandle =  *((rsg_wm_handle*) ubx_config_get_data_ptr(b, "wm_handle", &clen));
@@ -208,17 +222,19 @@ int rsg_sender_init(ubx_block_t *b)
 
     	/* Attach the UBX port to the world model */
     	ubx_type_t* type =  ubx_type_get(b->ni, "unsigned char");
-    	RsgToUbxPort* wmUpdatesUbxPort = new RsgToUbxPort(inf->ports.rsg_out, type);
+    	BlockStats* stats = BlockStats::get(b->name);
+    	RsgToUbxPort* wmUpdatesUbxPort = new RsgToUbxPort(inf->ports.rsg_out, type, stats, inf->logger);
     	brics_3d::rsg::HDF5UpdateSerializer* wmUpdatesToHdf5Serializer = new brics_3d::rsg::HDF5UpdateSerializer(wmUpdatesUbxPort);
+    	inf->encode_timer = new TimedUpdateObserver(wmUpdatesToHdf5Serializer, stats->getHistogram("encode"));
     	inf->wm->scene.attachUpdateObserver(inf->frequency_filter);
-    	inf->frequency_filter->attachUpdateObserver(wmUpdatesToHdf5Serializer);
+    	inf->frequency_filter->attachUpdateObserver(inf->encode_timer);
 
 
     	/* Set error policy of RSG */
     	inf->wm->scene.setCallObserversEvenIfErrorsOccurred(false);
 
     	/* Initialize resender that resends the complete graph, if necessary */
-    	inf->wm_resender = new brics_3d::rsg::SceneGraphToUpdatesTraverser(wmUpdatesToHdf5Serializer);
+    	inf->wm_resender = new brics_3d::rsg::SceneGraphToUpdatesTraverser(inf->encode_timer);
 
     	/* Setup auto mount reply policy for incoming addRemoteNodes  */
     	inf->remote_root_trigger = new RemoteRootNodeAdditionTrigger(&inf->wm->scene, b);
@@ -230,7 +246,7 @@ int rsg_sender_init(ubx_block_t *b)
 /* start */
 int rsg_sender_start(ubx_block_t *b)
 {
-        /* struct rsg_sender_info *inf = (struct rsg_sender_info*) b->private_data; */
+        struct rsg_sender_info *inf = (struct rsg_sender_info*) b->private_data;
         int ret = 0;
 
     	/* Set logger level */
@@ -239,6 +255,7 @@ int rsg_sender_start(ubx_block_t *b)
     	if(clen == 0) {
     		LOG(INFO) << "rsg_sender: No log_level configuation given.";
     	} else {
+    		inf->logger->setLevel(*log_level);
     		if (*log_level == 0) {
     			LOG(INFO) << "rsg_sender: log_level set to DEBUG level.";
     			brics_3d::Logger::setMinLoglevel(brics_3d::Logger::LOGDEBUG);
@@ -258,6 +275,8 @@ int rsg_sender_start(ubx_block_t *b)
     			LOG(INFO) << "rsg_sender: unknown log_level = " << *log_level;		}
     	}
 
+    	LogBackend::acquire();
+
         return ret;
 }
 
@@ -265,6 +284,7 @@ int rsg_sender_start(ubx_block_t *b)
 void rsg_sender_stop(ubx_block_t *b)
 {
         /* struct rsg_sender_info *inf = (struct rsg_sender_info*) b->private_data; */
+        LogBackend::release();
 }
 
 /* cleanup */
@@ -287,6 +307,14 @@ void rsg_sender_cleanup(ubx_block_t *b)
         	delete inf->remote_root_trigger;
         	inf->remote_root_trigger = 0;
         }
+        if(inf->encode_timer){
+        	delete inf->encode_timer;
+        	inf->encode_timer = 0;
+        }
+        if(inf->logger){
+        	delete inf->logger;
+        	inf->logger = 0;
+        }
         free(b->private_data);
 }
 
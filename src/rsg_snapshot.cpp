@@ -0,0 +1,199 @@
+#include "rsg_snapshot.h"
+
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/worldModel/sceneGraph/SceneGraphToUpdatesTraverser.h>
+
+#include <chrono>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_SNAPSHOT_WRITE_BUFFER_SIZE (1024 * 1024) // [bytes]
+
+/*
+ * Writer
+ */
+
+static bool write_header(FILE* file, Id rootId, uint64_t records, const JournalPosition* journalPosition) {
+	char header[RSG_SNAPSHOT_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header, RSG_SNAPSHOT_MAGIC, strlen(RSG_SNAPSHOT_MAGIC));
+	uint32_t version = RSG_SNAPSHOT_VERSION;
+	memcpy(header + RSG_SNAPSHOT_MAGIC_SIZE, &version, sizeof(version));
+	memcpy(header + RSG_SNAPSHOT_MAGIC_SIZE + 8, &(*rootId.begin()), 16);
+	memcpy(header + RSG_SNAPSHOT_MAGIC_SIZE + 8 + 16, &records, sizeof(records));
+	if(journalPosition) {
+		uint32_t hasJournalPosition = 1;
+		memcpy(header + RSG_SNAPSHOT_HEADER_SIZE_V1, &journalPosition->segment, sizeof(journalPosition->segment));
+		memcpy(header + RSG_SNAPSHOT_HEADER_SIZE_V1 + 4, &hasJournalPosition, sizeof(hasJournalPosition));
+		memcpy(header + RSG_SNAPSHOT_HEADER_SIZE_V1 + 8, &journalPosition->record, sizeof(journalPosition->record));
+	}
+	return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+bool SnapshotWriter::store(SceneGraphFacade* scene, const vector<Id>& rootIds, const std::string& fileName,
+		const JournalPosition* journalPosition, uint64_t& bytesWritten) {
+	bytesWritten = 0;
+	if(rootIds.empty()) {
+		return false;
+	}
+
+	std::string temporaryFileName = fileName + ".tmp";
+	FILE* file = fopen(temporaryFileName.c_str(), "wb");
+	if(file == 0) {
+		LOG(ERROR) << "SnapshotWriter: Cannot write to file " << temporaryFileName;
+		return false;
+	}
+	setvbuf(file, 0, _IOFBF, RSG_SNAPSHOT_WRITE_BUFFER_SIZE);
+
+	SnapshotWriter writer(file);
+	writer.failed = !write_header(file, rootIds[0], 0, journalPosition); // The number of records is not yet known.
+	BinaryUpdateSerializer serializer(&writer);
+	SceneGraphToUpdatesTraverser traverser(&serializer);
+
+	/* Remote roots first, so all parents exist when the records are applied */
+	for(vector<Id>::const_iterator it = rootIds.begin() + 1; it != rootIds.end(); ++it) {
+		vector<Attribute> attributes;
+		scene->getNodeAttributes(*it, attributes);
+		serializer.addRemoteRootNode(*it, attributes);
+	}
+	for(vector<Id>::const_iterator it = rootIds.begin(); it != rootIds.end(); ++it) {
+		scene->executeGraphTraverser(&traverser, *it);
+		traverser.reset();
+	}
+
+	rewind(file);
+	bool success = !writer.failed && write_header(file, rootIds[0], writer.records, journalPosition);
+	success = success && (fflush(file) == 0) && (fsync(fileno(file)) == 0); // The journal it covers might be deleted afterwards.
+	success = (fclose(file) == 0) && success;
+	if(!success) {
+		LOG(ERROR) << "SnapshotWriter: Writing " << temporaryFileName << " failed.";
+		unlink(temporaryFileName.c_str());
+		return false;
+	}
+	if(rename(temporaryFileName.c_str(), fileName.c_str()) != 0) {
+		LOG(ERROR) << "SnapshotWriter: Cannot rename " << temporaryFileName << " to " << fileName;
+		unlink(temporaryFileName.c_str());
+		return false;
+	}
+
+	bytesWritten = RSG_SNAPSHOT_HEADER_SIZE + writer.bytes;
+	LOG(INFO) << "SnapshotWriter: Stored " << writer.records << " records with " << bytesWritten << " bytes in " << fileName;
+	return true;
+}
+
+int SnapshotWriter::write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+	transferredBytes = 0;
+	if(failed) {
+		return -1;
+	}
+	uint32_t length = dataLength;
+	if((fwrite(&length, 1, sizeof(length), file) != sizeof(length)) ||
+			(fwrite(dataBuffer, 1, dataLength, file) != static_cast<size_t>(dataLength))) {
+		failed = true;
+		return -1;
+	}
+	transferredBytes = dataLength;
+	records++;
+	bytes += sizeof(length) + dataLength;
+	return 0;
+}
+
+/*
+ * Loader
+ */
+
+bool SnapshotLoader::load(WorldModel* wm, const std::string& fileName, uint64_t& records) {
+	JournalPosition journalPosition;
+	bool hasJournalPosition;
+	return load(wm, fileName, records, journalPosition, hasJournalPosition);
+}
+
+bool SnapshotLoader::load(WorldModel* wm, const std::string& fileName, uint64_t& records, JournalPosition& journalPosition, bool& hasJournalPosition) {
+	records = 0;
+	hasJournalPosition = false;
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if(fd < 0) {
+		LOG(ERROR) << "SnapshotLoader: Cannot open file " << fileName;
+		return false;
+	}
+	struct stat fileStatus;
+	if((fstat(fd, &fileStatus) != 0) || (fileStatus.st_size < RSG_SNAPSHOT_HEADER_SIZE_V1)) {
+		LOG(ERROR) << "SnapshotLoader: " << fileName << " is not a snapshot file.";
+		close(fd);
+		return false;
+	}
+	size_t size = fileStatus.st_size;
+	void* mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping stays valid.
+	if(mapping == MAP_FAILED) {
+		LOG(ERROR) << "SnapshotLoader: Cannot map file " << fileName;
+		return false;
+	}
+	madvise(mapping, size, MADV_SEQUENTIAL);
+
+	const char* data = static_cast<const char*>(mapping);
+	uint32_t version;
+	memcpy(&version, data + RSG_SNAPSHOT_MAGIC_SIZE, sizeof(version));
+	size_t headerSize = (version == 1) ? RSG_SNAPSHOT_HEADER_SIZE_V1 : RSG_SNAPSHOT_HEADER_SIZE;
+	if((memcmp(data, RSG_SNAPSHOT_MAGIC, strlen(RSG_SNAPSHOT_MAGIC)) != 0) || (version < 1) || (version > RSG_SNAPSHOT_VERSION) || (size < headerSize)) {
+		LOG(ERROR) << "SnapshotLoader: " << fileName << " is not a snapshot file of version " << RSG_SNAPSHOT_VERSION << " or older.";
+		munmap(mapping, size);
+		return false;
+	}
+	Id snapshotRootId;
+	memcpy(&(*snapshotRootId.begin()), data + RSG_SNAPSHOT_MAGIC_SIZE + 8, 16);
+	uint64_t expectedRecords;
+	memcpy(&expectedRecords, data + RSG_SNAPSHOT_MAGIC_SIZE + 8 + 16, sizeof(expectedRecords));
+	if(version >= 2) {
+		uint32_t hasPosition;
+		memcpy(&journalPosition.segment, data + RSG_SNAPSHOT_HEADER_SIZE_V1, sizeof(journalPosition.segment));
+		memcpy(&hasPosition, data + RSG_SNAPSHOT_HEADER_SIZE_V1 + 4, sizeof(hasPosition));
+		memcpy(&journalPosition.record, data + RSG_SNAPSHOT_HEADER_SIZE_V1 + 8, sizeof(journalPosition.record));
+		hasJournalPosition = (hasPosition != 0);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BinaryUpdateDeserializer deserializer(wm);
+	deserializer.setIdMapping(snapshotRootId, wm->getRootNodeId());
+
+	uint64_t skipped = 0;
+	const char* cursor = data + headerSize;
+	const char* end = data + size;
+	while(end - cursor >= static_cast<long>(sizeof(uint32_t))) {
+		uint32_t length;
+		memcpy(&length, cursor, sizeof(length));
+		cursor += sizeof(length);
+		if(static_cast<uint64_t>(end - cursor) < length) {
+			LOG(ERROR) << "SnapshotLoader: " << fileName << " is truncated after " << records << " records.";
+			break;
+		}
+		int transferredBytes = 0;
+		if(deserializer.write(cursor, length, transferredBytes) != 0) {
+			skipped++;
+		}
+		cursor += length;
+		records++;
+	}
+	munmap(mapping, size);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if(records != expectedRecords) {
+		LOG(WARNING) << "SnapshotLoader: Expected " << expectedRecords << " records but found " << records << ".";
+	}
+	if(skipped > 0) {
+		LOG(ERROR) << "SnapshotLoader: " << skipped << " of " << records << " records from " << fileName << " could not be applied. The restored world model is incomplete.";
+	} else {
+		LOG(INFO) << "SnapshotLoader: Loaded " << records << " records from " << fileName << " in " << seconds * 1000 << " ms ("
+				<< (seconds > 0 ? records / seconds : 0) << " records/s).";
+	}
+	return true;
+}
+
+} // namespace rsg
+} // namespace brics_3d
@@ -0,0 +1,104 @@
+/*
+ * Binary snapshot files of a complete world model.
+ *
+ * A snapshot is a sequence of binary updates (see rsg_binary_codec.h) that
+ * recreates the graph when it is applied in order. The file layout is:
+ *
+ *   magic (8 bytes "RSGSNAP\0") | version (uint32) | reserved (uint32) |
+ *   root id (16 bytes) | number of records (uint64) |
+ *   journal segment (uint32) | has journal position (uint32) | journal record (uint64) |
+ *   records: length (uint32) | binary update message
+ *
+ * The journal position is the first journal record (see rsg_journal.h) that is
+ * not part of the snapshot. It is taken together with the copy of the graph.
+ * Version 1 files have no journal position.
+ *
+ * Numbers are stored in host byte order. The loader maps the file into
+ * memory and decodes the records in place, so no copy of the file is made.
+ *
+ * Loading is not a bulk load: every record is applied as a regular update of
+ * the scene graph, so all attached observers are notified once per node as
+ * for any other update. The gain over a JSON model comes from the cheaper
+ * decoding only (compare rsg_benchmarks --filter restore).
+ *
+ * Transforms are stored with their latest value only, i.e. the transform
+ * history of the world model is not restored.
+ */
+
+#ifndef RSG_SNAPSHOT_H_
+#define RSG_SNAPSHOT_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/IOutputPort.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "rsg_binary_codec.h"
+#include "rsg_journal_position.h"
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_SNAPSHOT_MAGIC "RSGSNAP"
+#define RSG_SNAPSHOT_MAGIC_SIZE 8
+#define RSG_SNAPSHOT_VERSION 2
+#define RSG_SNAPSHOT_HEADER_SIZE_V1 (RSG_SNAPSHOT_MAGIC_SIZE + 4 + 4 + 16 + 8)
+#define RSG_SNAPSHOT_HEADER_SIZE (RSG_SNAPSHOT_HEADER_SIZE_V1 + 4 + 4 + 8)
+#define RSG_SNAPSHOT_FILE_SUFFIX ".rsgs"
+
+class SnapshotWriter : public IOutputPort {
+public:
+
+	/**
+	 * Writes a snapshot of the given graphs. The file is written under a temporary name,
+	 * synced and renamed when complete, so readers never see a partial snapshot.
+	 * @param scene Scene graph to be stored. The caller has to prevent concurrent updates.
+	 * @param rootIds The local root id followed by all remote root ids.
+	 * @param fileName Name of the snapshot file.
+	 * @param journalPosition Optional position of the journal when the graph was in this state. Null if unknown.
+	 * @param[out] bytesWritten Size of the snapshot file.
+	 * @return True on success.
+	 */
+	static bool store(SceneGraphFacade* scene, const vector<Id>& rootIds, const std::string& fileName,
+			const JournalPosition* journalPosition, uint64_t& bytesWritten);
+
+	/// Appends one record. Used by the BinaryUpdateSerializer.
+	int write(const char *dataBuffer, int dataLength, int &transferredBytes);
+
+private:
+	SnapshotWriter(FILE* file) : file(file), records(0), bytes(0), failed(false) {};
+	virtual ~SnapshotWriter(){};
+
+	FILE* file;
+	uint64_t records;
+	uint64_t bytes;
+	bool failed;
+};
+
+class SnapshotLoader {
+public:
+
+	/**
+	 * Applies all records of a snapshot file to a world model. The root id of the
+	 * snapshot is mapped to the root id of the world model. Every record is applied
+	 * as an update of its own and notifies the observers of the scene graph.
+	 * @param[out] records Number of applied records.
+	 * @return False if the file cannot be read or is not a snapshot. Records that
+	 *         cannot be applied (e.g. forced ids that exist already) are skipped.
+	 */
+	static bool load(WorldModel* wm, const std::string& fileName, uint64_t& records);
+
+	/**
+	 * Like above, but also reports the journal position stored with the snapshot.
+	 * @param[out] hasJournalPosition False if the snapshot has no journal position.
+	 */
+	static bool load(WorldModel* wm, const std::string& fileName, uint64_t& records, JournalPosition& journalPosition, bool& hasJournalPosition);
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_SNAPSHOT_H_ */
@@ -0,0 +1,573 @@
+#include "rsg_spatial_index.h"
+
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/core/PointCloud3D.h>
+#include <brics_3d/core/TriangleMeshExplicit.h>
+#include <brics_3d/worldModel/sceneGraph/Attribute.h>
+#include <brics_3d/worldModel/sceneGraph/Box.h>
+#include <brics_3d/worldModel/sceneGraph/Sphere.h>
+#include <brics_3d/worldModel/sceneGraph/Cylinder.h>
+#include <brics_3d/worldModel/sceneGraph/Mesh.h>
+#include <brics_3d/worldModel/sceneGraph/PointCloud.h>
+
+/* libvariant is used by the JSONQueryRunner as well */
+#include <Variant/Variant.h>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <string.h>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_SPATIAL_QUERY_BOUNDING_BOX "GET_NODES_IN_BOUNDING_BOX"
+#define RSG_SPATIAL_QUERY_RADIUS "GET_NODES_IN_RADIUS"
+
+/// Appends a JSON string literal.
+static void appendJsonString(std::ostringstream& out, const std::string& value) {
+	out << "\"";
+	for (size_t i = 0; i < value.size(); ++i) {
+		if ((value[i] == '"') || (value[i] == '\\')) {
+			out << "\\";
+		}
+		out << value[i];
+	}
+	out << "\"";
+}
+
+static void setIdentity(double matrix[16]) {
+	memset(matrix, 0, 16 * sizeof(double));
+	matrix[0] = matrix[5] = matrix[10] = matrix[15] = 1.0;
+}
+
+/// result = a * b for column major 4x4 matrices.
+static void multiply(const double a[16], const double b[16], double result[16]) {
+	for (int column = 0; column < 4; ++column) {
+		for (int row = 0; row < 4; ++row) {
+			double sum = 0;
+			for (int k = 0; k < 4; ++k) {
+				sum += a[k * 4 + row] * b[column * 4 + k];
+			}
+			result[column * 4 + row] = sum;
+		}
+	}
+}
+
+/// Reads {"x": .., "y": .., "z": ..}. A missing z is set to the default value.
+static bool parsePoint(const libvariant::Variant& message, const char* name, double point[3], double defaultZ) {
+	if(!message.Contains(name)) {
+		return false;
+	}
+	libvariant::Variant value = message.Get(name);
+	if(!value.Contains("x") || !value.Contains("y")) {
+		return false;
+	}
+	point[0] = value.Get("x").AsDouble();
+	point[1] = value.Get("y").AsDouble();
+	point[2] = value.Contains("z") ? value.Get("z").AsDouble() : defaultZ;
+	return true;
+}
+
+SpatialIndex::SpatialIndex(SceneGraphFacade* scene, Id rootId) : scene(scene), rootId(rootId) {
+	SpatialNode& root = nodes[rootId];
+	updateFramesLocked(rootId, root);
+}
+
+SpatialIndex::~SpatialIndex() {
+
+}
+
+void SpatialIndex::rebuild(TimeStamp now) {
+	std::lock_guard<std::mutex> lock(mutex);
+	nodes.clear();
+	tree.clear();
+	nodes[rootId];
+
+	/* Mirror the structure of the graph below the root node */
+	vector<Id> pending(1, rootId);
+	while(!pending.empty()) {
+		Id id = pending.back();
+		pending.pop_back();
+		vector<Id> children;
+		if(!scene->getGroupChildren(id, children)) {
+			continue;
+		}
+		for (vector<Id>::const_iterator it = children.begin(); it != children.end(); ++it) {
+			bool isNew = (nodes.find(*it) == nodes.end());
+			SpatialNode& child = addLocked(id, *it);
+			if(!isNew) {
+				continue;
+			}
+			IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform;
+			if(scene->getTransform(*it, now, transform)) {
+				setTransformData(child, transform);
+			}
+			Shape::ShapePtr shape;
+			TimeStamp shapeTimeStamp;
+			if(scene->getGeometry(*it, shape, shapeTimeStamp)) {
+				setBounds(child, shape);
+			}
+			pending.push_back(*it);
+		}
+	}
+
+	updateSubgraphLocked(rootId);
+	LOG(INFO) << "SpatialIndex: Indexed " << nodes.size() << " existing nodes with " << tree.size() << " placements.";
+}
+
+bool SpatialIndex::query(const std::string& query, std::string& result) {
+
+	/* Cheap pre check, so other queries are not parsed twice */
+	bool isBoundingBoxQuery = (query.find(RSG_SPATIAL_QUERY_BOUNDING_BOX) != std::string::npos);
+	bool isRadiusQuery = (query.find(RSG_SPATIAL_QUERY_RADIUS) != std::string::npos);
+	if(!isBoundingBoxQuery && !isRadiusQuery) {
+		return false;
+	}
+
+	std::string queryType;
+	std::string queryId;
+	vector<Attribute> attributes;
+	double min[3], max[3], center[3];
+	double radius = 0;
+	bool success = true;
+	try {
+		libvariant::Variant message = libvariant::DeserializeJSON(query);
+		if(!message.Contains("query")) {
+			return false;
+		}
+		queryType = message.Get("query").AsString();
+		if(message.Contains("queryId")) {
+			queryId = message.Get("queryId").AsString();
+		}
+		if(queryType.compare(RSG_SPATIAL_QUERY_BOUNDING_BOX) == 0) {
+			success = parsePoint(message, "min", min, -std::numeric_limits<double>::max()) &&
+					  parsePoint(message, "max", max, std::numeric_limits<double>::max());
+		} else if(queryType.compare(RSG_SPATIAL_QUERY_RADIUS) == 0) {
+			success = parsePoint(message, "center", center, std::numeric_limits<double>::quiet_NaN()) && message.Contains("radius");
+			if(success) {
+				radius = message.Get("radius").AsDouble();
+			}
+		} else {
+			return false;
+		}
+		if(success && message.Contains("attributes") && message.Get("attributes").IsList()) {
+			libvariant::Variant attributeList = message.Get("attributes");
+			for (libvariant::Variant::ConstListIterator i(attributeList.ListBegin()), e(attributeList.ListEnd()); i != e; ++i) {
+				if(!i->Contains("key") || !i->Contains("value")) {
+					success = false;
+					break;
+				}
+				attributes.push_back(Attribute(i->Get("key").AsString(), i->Get("value").AsString()));
+			}
+		}
+	} catch (std::exception const&) {
+		success = false;
+	}
+
+	vector<Id> ids;
+	if(success) {
+		if(queryType.compare(RSG_SPATIAL_QUERY_BOUNDING_BOX) == 0) {
+			getNodesInBoundingBox(min, max, ids);
+		} else {
+			getNodesInRadius(center, radius, ids);
+		}
+		filterByAttributes(attributes, ids);
+	} else {
+		LOG(ERROR) << "SpatialIndex: Malformed " << queryType << " query: " << query;
+	}
+
+	std::ostringstream out;
+	out << "{\"@worldmodeltype\": \"RSGQueryResult\",\"query\": ";
+	appendJsonString(out, queryType);
+	out << ",";
+	if(!queryId.empty()) {
+		out << "\"queryId\": ";
+		appendJsonString(out, queryId);
+		out << ",";
+	}
+	out << "\"querySuccess\": " << (success ? "true" : "false") << ",\"ids\": [";
+	for (vector<Id>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+		if(it != ids.begin()) {
+			out << ",";
+		}
+		out << "\"" << it->toString() << "\"";
+	}
+	out << "]}";
+	result = out.str();
+
+	LOG(DEBUG) << "SpatialIndex: Answered " << queryType << " query with " << ids.size() << " ids.";
+	return true;
+}
+
+void SpatialIndex::getNodesInBoundingBox(const double min[3], const double max[3], vector<Id>& ids) {
+	ids.clear();
+	Box queryBox(Point(min[0], min[1], min[2]), Point(max[0], max[1], max[2]));
+	std::vector<Entry> matches;
+	std::set<Id> uniqueIds;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tree.query(boost::geometry::index::intersects(queryBox), std::back_inserter(matches));
+	}
+	for (std::vector<Entry>::const_iterator it = matches.begin(); it != matches.end(); ++it) {
+		uniqueIds.insert(it->second);
+	}
+	ids.assign(uniqueIds.begin(), uniqueIds.end());
+}
+
+void SpatialIndex::getNodesInRadius(const double center[3], double radius, vector<Id>& ids) {
+	ids.clear();
+	if(radius < 0) {
+		return;
+	}
+
+	/* A center without z considers the distance in the x-y plane only. */
+	bool planar = (center[2] != center[2]); // NaN
+	double lowZ = planar ? -std::numeric_limits<double>::max() : center[2] - radius;
+	double highZ = planar ? std::numeric_limits<double>::max() : center[2] + radius;
+	Box queryBox(Point(center[0] - radius, center[1] - radius, lowZ), Point(center[0] + radius, center[1] + radius, highZ));
+	std::vector<Entry> matches;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tree.query(boost::geometry::index::intersects(queryBox), std::back_inserter(matches));
+	}
+
+	std::set<Id> uniqueIds;
+	for (std::vector<Entry>::const_iterator it = matches.begin(); it != matches.end(); ++it) {
+
+		/* Distance from the center to the closest point of the entry */
+		const Point& low = it->first.min_corner();
+		const Point& high = it->first.max_corner();
+		double coordinates[3] = {center[0], center[1], center[2]};
+		double lowCoordinates[3] = {low.get<0>(), low.get<1>(), low.get<2>()};
+		double highCoordinates[3] = {high.get<0>(), high.get<1>(), high.get<2>()};
+		double squaredDistance = 0;
+		for (int i = 0; i < (planar ? 2 : 3); ++i) {
+			double closest = std::max(lowCoordinates[i], std::min(coordinates[i], highCoordinates[i]));
+			squaredDistance += (coordinates[i] - closest) * (coordinates[i] - closest);
+		}
+		if(squaredDistance <= radius * radius) {
+			uniqueIds.insert(it->second);
+		}
+	}
+	ids.assign(uniqueIds.begin(), uniqueIds.end());
+}
+
+bool SpatialIndex::isInBoundingBox(Id id, const double min[3], const double max[3]) {
+	Box queryBox(Point(min[0], min[1], min[2]), Point(max[0], max[1], max[2]));
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<Id, SpatialNode>::const_iterator node = nodes.find(id);
+	if(node == nodes.end()) {
+		return false;
+	}
+	for (vector<Box>::const_iterator it = node->second.entries.begin(); it != node->second.entries.end(); ++it) {
+		if(boost::geometry::intersects(*it, queryBox)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t SpatialIndex::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return tree.size();
+}
+
+void SpatialIndex::filterByAttributes(const vector<Attribute>& attributes, vector<Id>& ids) {
+	if(attributes.empty()) {
+		return;
+	}
+	vector<Id> matches;
+	for (vector<Id>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+		vector<Attribute> nodeAttributes;
+		if(!scene->getNodeAttributes(*it, nodeAttributes)) {
+			continue;
+		}
+		bool matchesAll = true;
+		for (vector<Attribute>::const_iterator attribute = attributes.begin(); attribute != attributes.end(); ++attribute) {
+			if(!attributeListContainsAttribute(nodeAttributes, *attribute)) {
+				matchesAll = false;
+				break;
+			}
+		}
+		if(matchesAll) {
+			matches.push_back(*it);
+		}
+	}
+	ids.swap(matches);
+}
+
+SpatialIndex::SpatialNode& SpatialIndex::addLocked(Id parentId, Id id) {
+	SpatialNode& node = nodes[id];
+	SpatialNode& parent = nodes[parentId]; // Unknown parents (e.g. remote root nodes) are not placed.
+	if(std::find(node.parents.begin(), node.parents.end(), parentId) == node.parents.end()) {
+		node.parents.push_back(parentId);
+		parent.children.push_back(id);
+	}
+	return node;
+}
+
+void SpatialIndex::updateSubgraphLocked(Id id) {
+	vector<Id> pending(1, id);
+	while(!pending.empty()) {
+		Id current = pending.back();
+		pending.pop_back();
+		std::map<Id, SpatialNode>::iterator node = nodes.find(current);
+		if(node == nodes.end()) {
+			continue;
+		}
+		updateFramesLocked(current, node->second);
+		pending.insert(pending.end(), node->second.children.begin(), node->second.children.end());
+	}
+}
+
+void SpatialIndex::updateFramesLocked(Id id, SpatialNode& node) {
+	node.frames.clear();
+	if(id == rootId) {
+		Frame identity;
+		setIdentity(identity.matrix);
+		identity.placed = false;
+		node.frames.push_back(identity);
+	} else {
+		for (vector<Id>::const_iterator parentId = node.parents.begin(); parentId != node.parents.end(); ++parentId) {
+			std::map<Id, SpatialNode>::const_iterator parent = nodes.find(*parentId);
+			if(parent == nodes.end()) {
+				continue;
+			}
+			for (vector<Frame>::const_iterator frame = parent->second.frames.begin(); frame != parent->second.frames.end(); ++frame) {
+				if(node.frames.size() >= RSG_SPATIAL_MAX_PLACEMENTS) {
+					break;
+				}
+				node.frames.push_back(*frame);
+			}
+		}
+	}
+
+	if(node.isTransform) {
+		for (vector<Frame>::iterator frame = node.frames.begin(); frame != node.frames.end(); ++frame) {
+			double parentMatrix[16];
+			memcpy(parentMatrix, frame->matrix, sizeof(parentMatrix));
+			multiply(parentMatrix, node.transform, frame->matrix);
+			frame->placed = true;
+		}
+	}
+
+	removeEntriesLocked(id, node);
+	for (vector<Frame>::const_iterator frame = node.frames.begin(); frame != node.frames.end(); ++frame) {
+		if(frame->placed) {
+			Box box = toWorld(*frame, node);
+			tree.insert(std::make_pair(box, id));
+			node.entries.push_back(box);
+		}
+	}
+}
+
+void SpatialIndex::removeEntriesLocked(Id id, SpatialNode& node) {
+	for (vector<Box>::const_iterator it = node.entries.begin(); it != node.entries.end(); ++it) {
+		tree.remove(std::make_pair(*it, id));
+	}
+	node.entries.clear();
+}
+
+void SpatialIndex::setTransformData(SpatialNode& node, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform) {
+	node.isTransform = true;
+	if(!transform) {
+		setIdentity(node.transform);
+		return;
+	}
+	memcpy(node.transform, transform->getRawData(), sizeof(node.transform));
+}
+
+void SpatialIndex::setBounds(SpatialNode& node, Shape::ShapePtr shape) {
+	node.hasBounds = false;
+	double low[3] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+	double high[3] = {-std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(), -std::numeric_limits<double>::max()};
+
+	rsg::Box::BoxPtr box = boost::dynamic_pointer_cast<rsg::Box>(shape);
+	rsg::Sphere::SpherePtr sphere = boost::dynamic_pointer_cast<rsg::Sphere>(shape);
+	rsg::Cylinder::CylinderPtr cylinder = boost::dynamic_pointer_cast<rsg::Cylinder>(shape);
+	rsg::PointCloud<brics_3d::PointCloud3D>::PointCloudPtr pointCloud = boost::dynamic_pointer_cast<rsg::PointCloud<brics_3d::PointCloud3D> >(shape);
+	rsg::Mesh<brics_3d::TriangleMeshExplicit>::MeshPtr mesh = boost::dynamic_pointer_cast<rsg::Mesh<brics_3d::TriangleMeshExplicit> >(shape);
+
+	if(box != 0) { // Boxes, spheres and cylinders are centered at the origin of their frame.
+		double size[3] = {box->getSizeX() / 2.0, box->getSizeY() / 2.0, box->getSizeZ() / 2.0};
+		for (int i = 0; i < 3; ++i) {
+			low[i] = -size[i];
+			high[i] = size[i];
+		}
+	} else if(sphere != 0) {
+		for (int i = 0; i < 3; ++i) {
+			low[i] = -sphere->getRadius();
+			high[i] = sphere->getRadius();
+		}
+	} else if(cylinder != 0) {
+		double size[3] = {cylinder->getRadius(), cylinder->getRadius(), cylinder->getHeight() / 2.0};
+		for (int i = 0; i < 3; ++i) {
+			low[i] = -size[i];
+			high[i] = size[i];
+		}
+	} else if((pointCloud != 0) && (pointCloud->data != 0)) {
+		std::vector<Point3D>* points = pointCloud->data->getPointCloud();
+		for (std::vector<Point3D>::iterator it = points->begin(); it != points->end(); ++it) {
+			double coordinates[3] = {it->getX(), it->getY(), it->getZ()};
+			for (int i = 0; i < 3; ++i) {
+				low[i] = std::min(low[i], coordinates[i]);
+				high[i] = std::max(high[i], coordinates[i]);
+			}
+		}
+	} else if((mesh != 0) && (mesh->data != 0)) {
+		for (int triangle = 0; triangle < mesh->data->getSize(); ++triangle) {
+			for (int vertex = 0; vertex < 3; ++vertex) {
+				Point3D* point = mesh->data->getTriangleVertex(triangle, vertex);
+				double coordinates[3] = {point->getX(), point->getY(), point->getZ()};
+				for (int i = 0; i < 3; ++i) {
+					low[i] = std::min(low[i], coordinates[i]);
+					high[i] = std::max(high[i], coordinates[i]);
+				}
+			}
+		}
+	}
+
+	if(low[0] > high[0]) { // Unknown or empty shape: the node is indexed as point.
+		return;
+	}
+	node.hasBounds = true;
+	memcpy(node.boundsMin, low, sizeof(low));
+	memcpy(node.boundsMax, high, sizeof(high));
+}
+
+SpatialIndex::Box SpatialIndex::toWorld(const Frame& frame, const SpatialNode& node) {
+	const double* m = frame.matrix;
+	if(!node.hasBounds) {
+		Point position(m[12], m[13], m[14]);
+		return Box(position, position);
+	}
+
+	/* Axis aligned bounds of all eight transformed corners */
+	double low[3] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+	double high[3] = {-std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(), -std::numeric_limits<double>::max()};
+	for (int corner = 0; corner < 8; ++corner) {
+		double x = (corner & 1) ? node.boundsMax[0] : node.boundsMin[0];
+		double y = (corner & 2) ? node.boundsMax[1] : node.boundsMin[1];
+		double z = (corner & 4) ? node.boundsMax[2] : node.boundsMin[2];
+		for (int i = 0; i < 3; ++i) {
+			double coordinate = m[i] * x + m[4 + i] * y + m[8 + i] * z + m[12 + i];
+			low[i] = std::min(low[i], coordinate);
+			high[i] = std::max(high[i], coordinate);
+		}
+	}
+	return Box(Point(low[0], low[1], low[2]), Point(high[0], high[1], high[2]));
+}
+
+/*
+ * Observer interface
+ */
+
+bool SpatialIndex::addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	updateFramesLocked(assignedId, addLocked(parentId, assignedId));
+	return true;
+}
+
+bool SpatialIndex::addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	updateFramesLocked(assignedId, addLocked(parentId, assignedId));
+	return true;
+}
+
+bool SpatialIndex::addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	SpatialNode& node = addLocked(parentId, assignedId);
+	setTransformData(node, transform);
+	updateFramesLocked(assignedId, node);
+	return true;
+}
+
+bool SpatialIndex::addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId) {
+	return addTransformNode(parentId, assignedId, attributes, transform, timeStamp, forcedId);
+}
+
+bool SpatialIndex::addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	SpatialNode& node = addLocked(parentId, assignedId);
+	setBounds(node, shape);
+	updateFramesLocked(assignedId, node);
+	return true;
+}
+
+bool SpatialIndex::addRemoteRootNode(Id rootId, vector<Attribute> attributes) {
+	return true; // Not placed unless it is mounted below the root node via addParent.
+}
+
+bool SpatialIndex::addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId) {
+	return true; // Connections have no position.
+}
+
+bool SpatialIndex::setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp) {
+	return true;
+}
+
+bool SpatialIndex::setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<Id, SpatialNode>::iterator node = nodes.find(id);
+	if((node == nodes.end()) || !node->second.isTransform) {
+		return true;
+	}
+	setTransformData(node->second, transform);
+	updateSubgraphLocked(id);
+	return true;
+}
+
+bool SpatialIndex::setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp) {
+	return setTransform(id, transform, timeStamp);
+}
+
+bool SpatialIndex::deleteNode(Id id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<Id, SpatialNode>::iterator node = nodes.find(id);
+	if((node == nodes.end()) || (id == rootId)) {
+		return true;
+	}
+	removeEntriesLocked(id, node->second);
+	for (vector<Id>::const_iterator it = node->second.parents.begin(); it != node->second.parents.end(); ++it) {
+		std::map<Id, SpatialNode>::iterator parent = nodes.find(*it);
+		if(parent != nodes.end()) {
+			parent->second.children.erase(std::remove(parent->second.children.begin(), parent->second.children.end(), id), parent->second.children.end());
+		}
+	}
+	vector<Id> children = node->second.children;
+	nodes.erase(node);
+	for (vector<Id>::const_iterator it = children.begin(); it != children.end(); ++it) {
+		std::map<Id, SpatialNode>::iterator child = nodes.find(*it);
+		if(child != nodes.end()) {
+			child->second.parents.erase(std::remove(child->second.parents.begin(), child->second.parents.end(), id), child->second.parents.end());
+			updateSubgraphLocked(*it);
+		}
+	}
+	return true;
+}
+
+bool SpatialIndex::addParent(Id id, Id parentId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	addLocked(parentId, id);
+	updateSubgraphLocked(id);
+	return true;
+}
+
+bool SpatialIndex::removeParent(Id id, Id parentId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<Id, SpatialNode>::iterator node = nodes.find(id);
+	std::map<Id, SpatialNode>::iterator parent = nodes.find(parentId);
+	if((node == nodes.end()) || (parent == nodes.end())) {
+		return true;
+	}
+	node->second.parents.erase(std::remove(node->second.parents.begin(), node->second.parents.end(), parentId), node->second.parents.end());
+	parent->second.children.erase(std::remove(parent->second.children.begin(), parent->second.children.end(), id), parent->second.children.end());
+	updateSubgraphLocked(id);
+	return true;
+}
+
+} // namespace rsg
+} // namespace brics_3d
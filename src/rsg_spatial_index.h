@@ -0,0 +1,145 @@
+/*
+ * Spatial index of the world frame positions and geometry bounds of nodes.
+ *
+ * The index observes a scene graph and mirrors its structure together with the
+ * newest data of every Transform, so it can compose the pose of every node with
+ * respect to the root node incrementally: a setTransform only updates the subgraph
+ * below that Transform. Nodes that have at least one Transform on a path to the
+ * root are stored in an R-tree as point (or as axis aligned box for GeometricNodes
+ * with a Box, Sphere, Cylinder, mesh or point cloud). Nodes that are reachable via
+ * multiple paths have multiple entries.
+ *
+ * It answers the queries GET_NODES_IN_BOUNDING_BOX and GET_NODES_IN_RADIUS.
+ * The history of Transforms is not considered; positions always refer to the
+ * newest data.
+ */
+
+#ifndef RSG_SPATIAL_INDEX_H_
+#define RSG_SPATIAL_INDEX_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace brics_3d {
+namespace rsg {
+
+/// Maximum number of world frame placements per node. It limits the effort for nodes with many paths to the root.
+#define RSG_SPATIAL_MAX_PLACEMENTS 16
+
+class SpatialIndex : public ISceneGraphUpdateObserver {
+public:
+
+	/**
+	 * @param scene Scene that is used to filter query results by attributes. The caller
+	 *              of query() has to hold the (shared) world model lock.
+	 * @param rootId Node that defines the world frame.
+	 */
+	SpatialIndex(SceneGraphFacade* scene, Id rootId);
+	virtual ~SpatialIndex();
+
+	/**
+	 * Indexes all nodes below the root node that already exist. Call it before the
+	 * index is attached as observer to the scene.
+	 */
+	void rebuild(TimeStamp now);
+
+	/**
+	 * Answers a JSON query if it is a GET_NODES_IN_BOUNDING_BOX or GET_NODES_IN_RADIUS query.
+	 * @param query Complete RSGQuery message.
+	 * @param result JSON result with the ids of all matching nodes.
+	 * @return True if the result has been set. False if the query has to be processed otherwise.
+	 */
+	bool query(const std::string& query, std::string& result);
+
+	/// Looks up all nodes that intersect with an axis aligned box in the world frame.
+	void getNodesInBoundingBox(const double min[3], const double max[3], vector<Id>& ids);
+
+	/// Looks up all nodes within a radius around a point in the world frame.
+	void getNodesInRadius(const double center[3], double radius, vector<Id>& ids);
+
+	/// Checks whether one of the placements of a node intersects with an axis aligned box in the world frame.
+	bool isInBoundingBox(Id id, const double min[3], const double max[3]);
+
+	/// Number of entries in the R-tree.
+	size_t size();
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false);
+	bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false);
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false);
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes);
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false);
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0));
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+	bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp);
+	bool deleteNode(Id id);
+	bool addParent(Id id, Id parentId);
+	bool removeParent(Id id, Id parentId);
+
+private:
+
+	typedef boost::geometry::model::point<double, 3, boost::geometry::cs::cartesian> Point;
+	typedef boost::geometry::model::box<Point> Box;
+	typedef std::pair<Box, Id> Entry;
+	typedef boost::geometry::index::rtree<Entry, boost::geometry::index::rstar<16> > Tree;
+
+	/// Pose with respect to the root node. Column major like IHomogeneousMatrix44::getRawData().
+	struct Frame {
+		double matrix[16];
+		bool placed; // True if there is at least one Transform on the path.
+	};
+
+	struct SpatialNode {
+		SpatialNode() : isTransform(false), hasBounds(false) {};
+		vector<Id> parents;
+		vector<Id> children;
+		bool isTransform;
+		double transform[16];     // Newest data of a Transform.
+		bool hasBounds;
+		double boundsMin[3];      // Bounds of the shape of a GeometricNode in its own frame.
+		double boundsMax[3];
+		vector<Frame> frames;     // All poses of this node; for Transforms including their own transform.
+		vector<Box> entries;      // Boxes in the R-tree.
+	};
+
+	/// Has to be called with mutex held. Creates the entry for a new node below a parent.
+	SpatialNode& addLocked(Id parentId, Id id);
+
+	/// Has to be called with mutex held. Recomputes the frames of a node and all nodes below it.
+	void updateSubgraphLocked(Id id);
+
+	/// Has to be called with mutex held. Recomputes the frames of a single node from the ones of its parents.
+	void updateFramesLocked(Id id, SpatialNode& node);
+
+	/// Has to be called with mutex held.
+	void removeEntriesLocked(Id id, SpatialNode& node);
+
+	static void setBounds(SpatialNode& node, Shape::ShapePtr shape);
+	static void setTransformData(SpatialNode& node, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform);
+	static Box toWorld(const Frame& frame, const SpatialNode& node);
+
+	/// Filters ids by attributes like GET_NODES does. Requires the world model lock.
+	void filterByAttributes(const vector<Attribute>& attributes, vector<Id>& ids);
+
+	SceneGraphFacade* scene;
+	Id rootId;
+	std::mutex mutex;
+	std::map<Id, SpatialNode> nodes;
+	Tree tree;
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_SPATIAL_INDEX_H_ */
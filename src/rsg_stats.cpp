@@ -0,0 +1,167 @@
+#include "rsg_stats.h"
+
+#include <algorithm>
+
+static std::mutex registryMutex;
+static std::map<std::string, BlockStats*> registry;
+
+/*
+ * LatencyHistogram
+ */
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0), max(0) {
+	for (unsigned int i = 0; i < RSG_STATS_BUCKETS; ++i) {
+		buckets[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+unsigned int LatencyHistogram::getBucketIndex(uint64_t value) {
+	if(value < (1u << RSG_STATS_SUB_BUCKET_BITS)) {
+		return static_cast<unsigned int>(value); // exact
+	}
+	unsigned int magnitude = 63 - __builtin_clzll(value);
+	if(magnitude > RSG_STATS_MAX_MAGNITUDE) {
+		return RSG_STATS_BUCKETS - 1;
+	}
+	unsigned int subBucket = (value >> (magnitude - RSG_STATS_SUB_BUCKET_BITS)) & ((1u << RSG_STATS_SUB_BUCKET_BITS) - 1);
+	return ((magnitude - RSG_STATS_SUB_BUCKET_BITS + 1) << RSG_STATS_SUB_BUCKET_BITS) + subBucket;
+}
+
+uint64_t LatencyHistogram::getBucketUpperBound(unsigned int index) {
+	if(index < (1u << RSG_STATS_SUB_BUCKET_BITS)) {
+		return index;
+	}
+	unsigned int magnitude = (index >> RSG_STATS_SUB_BUCKET_BITS) + RSG_STATS_SUB_BUCKET_BITS - 1;
+	uint64_t subBucket = index & ((1u << RSG_STATS_SUB_BUCKET_BITS) - 1);
+	uint64_t width = 1ull << (magnitude - RSG_STATS_SUB_BUCKET_BITS);
+	return (((1ull << RSG_STATS_SUB_BUCKET_BITS) + subBucket) << (magnitude - RSG_STATS_SUB_BUCKET_BITS)) + width - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+	buckets[getBucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+	uint64_t currentMax = max.load(std::memory_order_relaxed);
+	while((nanoseconds > currentMax) && !max.compare_exchange_weak(currentMax, nanoseconds, std::memory_order_relaxed)) {
+		// currentMax has been updated by compare_exchange_weak
+	}
+}
+
+uint64_t LatencyHistogram::getCount() const {
+	return count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const {
+	uint64_t total = 0;
+	for (unsigned int i = 0; i < RSG_STATS_BUCKETS; ++i) {
+		total += buckets[i].load(std::memory_order_relaxed);
+	}
+	if(total == 0) {
+		return 0;
+	}
+
+	uint64_t rank = static_cast<uint64_t>((percentile / 100.0) * total + 0.5);
+	if(rank < 1) {
+		rank = 1;
+	}
+	uint64_t cumulated = 0;
+	for (unsigned int i = 0; i < RSG_STATS_BUCKETS; ++i) {
+		cumulated += buckets[i].load(std::memory_order_relaxed);
+		if(cumulated >= rank) {
+			return std::min(getBucketUpperBound(i), max.load(std::memory_order_relaxed));
+		}
+	}
+	return max.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::toJson(std::ostream& out) const {
+	uint64_t samples = getCount();
+	out << "{\"unit\": \"ns\""
+	    << ",\"count\": " << samples
+	    << ",\"mean\": " << ((samples > 0) ? sum.load(std::memory_order_relaxed) / samples : 0)
+	    << ",\"p50\": " << getPercentile(50)
+	    << ",\"p90\": " << getPercentile(90)
+	    << ",\"p99\": " << getPercentile(99)
+	    << ",\"p999\": " << getPercentile(99.9)
+	    << ",\"max\": " << max.load(std::memory_order_relaxed)
+	    << "}";
+}
+
+/*
+ * BlockStats
+ */
+
+BlockStats* BlockStats::get(const std::string& blockName) {
+	std::lock_guard<std::mutex> guard(registryMutex);
+	std::map<std::string, BlockStats*>::iterator it = registry.find(blockName);
+	if(it != registry.end()) {
+		return it->second;
+	}
+	BlockStats* stats = new BlockStats();
+	registry.insert(std::make_pair(blockName, stats));
+	return stats;
+}
+
+void BlockStats::allToJson(std::ostream& out) {
+	std::lock_guard<std::mutex> guard(registryMutex);
+	out << "{";
+	for (std::map<std::string, BlockStats*>::iterator it = registry.begin(); it != registry.end(); ++it) {
+		if(it != registry.begin()) {
+			out << ",";
+		}
+		out << "\"" << it->first << "\": ";
+		it->second->toJson(out);
+	}
+	out << "}";
+}
+
+BlockStats::~BlockStats() {
+	for (std::map<std::string, StatsCounter*>::iterator it = counters.begin(); it != counters.end(); ++it) {
+		delete it->second;
+	}
+	for (std::map<std::string, LatencyHistogram*>::iterator it = histograms.begin(); it != histograms.end(); ++it) {
+		delete it->second;
+	}
+}
+
+StatsCounter* BlockStats::getCounter(const std::string& name) {
+	std::lock_guard<std::mutex> guard(mutex);
+	std::map<std::string, StatsCounter*>::iterator it = counters.find(name);
+	if(it != counters.end()) {
+		return it->second;
+	}
+	StatsCounter* counter = new StatsCounter();
+	counters.insert(std::make_pair(name, counter));
+	return counter;
+}
+
+LatencyHistogram* BlockStats::getHistogram(const std::string& name) {
+	std::lock_guard<std::mutex> guard(mutex);
+	std::map<std::string, LatencyHistogram*>::iterator it = histograms.find(name);
+	if(it != histograms.end()) {
+		return it->second;
+	}
+	LatencyHistogram* histogram = new LatencyHistogram();
+	histograms.insert(std::make_pair(name, histogram));
+	return histogram;
+}
+
+void BlockStats::toJson(std::ostream& out) {
+	std::lock_guard<std::mutex> guard(mutex);
+	out << "{\"counters\": {";
+	for (std::map<std::string, StatsCounter*>::iterator it = counters.begin(); it != counters.end(); ++it) {
+		if(it != counters.begin()) {
+			out << ",";
+		}
+		out << "\"" << it->first << "\": " << it->second->get();
+	}
+	out << "},\"histograms\": {";
+	for (std::map<std::string, LatencyHistogram*>::iterator it = histograms.begin(); it != histograms.end(); ++it) {
+		if(it != histograms.begin()) {
+			out << ",";
+		}
+		out << "\"" << it->first << "\": ";
+		it->second->toJson(out);
+	}
+	out << "}}";
+}
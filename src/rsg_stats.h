@@ -0,0 +1,133 @@
+/*
+ * Process wide counters and latency histograms for the rsg blocks.
+ *
+ * Every block registers its statistics under its instance name. Blocks look up
+ * their counters and histograms once (e.g. in init) and keep the pointers, so
+ * that recording on the hot path is a single atomic operation without locks.
+ * All statistics can be retrieved as JSON, e.g. with a GET_STATS query.
+ */
+
+#ifndef RSG_STATS_H_
+#define RSG_STATS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#ifndef RSG_COMMON_API
+#define RSG_COMMON_API __attribute__ ((visibility("default")))
+#endif
+
+#define RSG_STATS_SUB_BUCKET_BITS 3   // 8 sub buckets per power of two, i.e. a relative error of at most 12.5%
+#define RSG_STATS_MAX_MAGNITUDE 40    // Values >= 2^40 ns (~18 min) are counted in the last bucket.
+#define RSG_STATS_BUCKETS ((RSG_STATS_MAX_MAGNITUDE - RSG_STATS_SUB_BUCKET_BITS + 2) << RSG_STATS_SUB_BUCKET_BITS)
+
+/**
+ * Monotonically increasing counter or, via set(), a gauge.
+ */
+class RSG_COMMON_API StatsCounter {
+public:
+	StatsCounter() : value(0) {};
+
+	void add(uint64_t amount = 1) {
+		value.fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	void set(uint64_t newValue) {
+		value.store(newValue, std::memory_order_relaxed);
+	}
+
+	uint64_t get() const {
+		return value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint64_t> value;
+};
+
+/**
+ * Latency histogram with log-linear buckets (in the spirit of HdrHistogram).
+ * Values are in nanoseconds.
+ */
+class RSG_COMMON_API LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	void record(uint64_t nanoseconds);
+
+	uint64_t getCount() const;
+
+	/// Upper bound of the bucket that contains the given percentile (0..100).
+	uint64_t getPercentile(double percentile) const;
+
+	void toJson(std::ostream& out) const;
+
+private:
+	static unsigned int getBucketIndex(uint64_t value);
+	static uint64_t getBucketUpperBound(unsigned int index);
+
+	std::atomic<uint64_t> buckets[RSG_STATS_BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+};
+
+/**
+ * Statistics of a single block instance.
+ */
+class RSG_COMMON_API BlockStats {
+public:
+
+	/**
+	 * Gets the statistics for a block instance. They are created on first use and live as long as the process.
+	 */
+	static BlockStats* get(const std::string& blockName);
+
+	/**
+	 * Writes the statistics of all blocks as JSON object with the block names as keys.
+	 */
+	static void allToJson(std::ostream& out);
+
+	/// Gets or creates a counter. Keep the pointer, the look up is not lock-free.
+	StatsCounter* getCounter(const std::string& name);
+
+	/// Gets or creates a histogram. Keep the pointer, the look up is not lock-free.
+	LatencyHistogram* getHistogram(const std::string& name);
+
+	void toJson(std::ostream& out);
+
+private:
+	BlockStats() {};
+	~BlockStats();
+
+	std::mutex mutex; // Guards the maps, not the values.
+	std::map<std::string, StatsCounter*> counters;
+	std::map<std::string, LatencyHistogram*> histograms;
+};
+
+/**
+ * Records the time between construction and destruction into a histogram.
+ * A null histogram turns it into a no-op.
+ */
+class ScopedLatency {
+public:
+	ScopedLatency(LatencyHistogram* histogram) : histogram(histogram) {
+		if(histogram != 0) {
+			start = std::chrono::steady_clock::now();
+		}
+	}
+	~ScopedLatency() {
+		if(histogram != 0) {
+			histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		}
+	}
+private:
+	LatencyHistogram* histogram;
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif /* RSG_STATS_H_ */
@@ -0,0 +1,546 @@
+#include "rsg_subscriptions.h"
+
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/worldModel/sceneGraph/Attribute.h>
+
+/* libvariant is used by the JSONQueryRunner as well */
+#include <Variant/Variant.h>
+
+#include <ctype.h>
+#include <limits>
+#include <sstream>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_SUBSCRIPTION_QUERY_SUBSCRIBE "SUBSCRIBE"
+#define RSG_SUBSCRIPTION_QUERY_UNSUBSCRIBE "UNSUBSCRIBE"
+#define RSG_SUBSCRIPTION_QUERY_LIST "GET_SUBSCRIPTIONS"
+
+/* Operations of the RSGUpdate messages */
+#define RSG_OPERATION_CREATE "CREATE"
+#define RSG_OPERATION_CREATE_REMOTE_ROOT_NODE "CREATE_REMOTE_ROOT_NODE"
+#define RSG_OPERATION_CREATE_PARENT "CREATE_PARENT"
+#define RSG_OPERATION_UPDATE_ATTRIBUTES "UPDATE_ATTRIBUTES"
+#define RSG_OPERATION_UPDATE_TRANSFORM "UPDATE_TRANSFORM"
+#define RSG_OPERATION_DELETE_NODE "DELETE_NODE"
+#define RSG_OPERATION_DELETE_PARENT "DELETE_PARENT"
+
+/// Appends a JSON string literal.
+static void appendJsonString(std::ostringstream& out, const std::string& value) {
+	out << "\"";
+	for (size_t i = 0; i < value.size(); ++i) {
+		if ((value[i] == '"') || (value[i] == '\\')) {
+			out << "\\";
+		}
+		out << value[i];
+	}
+	out << "\"";
+}
+
+/// Reads {"x": .., "y": .., "z": ..}. A missing z is set to the default value.
+static bool parsePoint(const libvariant::Variant& message, const char* name, double point[3], double defaultZ) {
+	if(!message.Contains(name)) {
+		return false;
+	}
+	libvariant::Variant value = message.Get(name);
+	if(!value.Contains("x") || !value.Contains("y")) {
+		return false;
+	}
+	point[0] = value.Get("x").AsDouble();
+	point[1] = value.Get("y").AsDouble();
+	point[2] = value.Contains("z") ? value.Get("z").AsDouble() : defaultZ;
+	return true;
+}
+
+int SubscriptionManager::Capture::write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+	message.assign(dataBuffer, dataLength);
+	while(!message.empty() && ((message[message.size() - 1] == '\0') || isspace(static_cast<unsigned char>(message[message.size() - 1])))) {
+		message.erase(message.size() - 1);
+	}
+	transferredBytes = dataLength;
+	return 0;
+}
+
+SubscriptionManager::SubscriptionManager(SceneGraphFacade* scene, SpatialIndex* spatialIndex, StatsCounter* events, StatsCounter* dropped)
+	: scene(scene), spatialIndex(spatialIndex), events(events), droppedEvents(dropped), nextSubscriptionId(1), serializer(&capture) {
+
+}
+
+SubscriptionManager::~SubscriptionManager() {
+
+}
+
+bool SubscriptionManager::query(const std::string& query, std::string& result) {
+
+	/* Cheap pre check, so other queries are not parsed twice */
+	if((query.find(RSG_SUBSCRIPTION_QUERY_SUBSCRIBE) == std::string::npos) && (query.find(RSG_SUBSCRIPTION_QUERY_LIST) == std::string::npos)) {
+		return false;
+	}
+
+	std::string queryType;
+	std::string queryId;
+	std::string subscriptionId;
+	Subscription subscription;
+	bool success = true;
+	try {
+		libvariant::Variant message = libvariant::DeserializeJSON(query);
+		if(!message.Contains("query")) {
+			return false;
+		}
+		queryType = message.Get("query").AsString();
+		if((queryType.compare(RSG_SUBSCRIPTION_QUERY_SUBSCRIBE) != 0) &&
+		   (queryType.compare(RSG_SUBSCRIPTION_QUERY_UNSUBSCRIBE) != 0) &&
+		   (queryType.compare(RSG_SUBSCRIPTION_QUERY_LIST) != 0)) {
+			return false;
+		}
+		if(message.Contains("queryId")) {
+			queryId = message.Get("queryId").AsString();
+		}
+		if(message.Contains("subscriptionId")) {
+			subscriptionId = message.Get("subscriptionId").AsString();
+		}
+
+		if(queryType.compare(RSG_SUBSCRIPTION_QUERY_SUBSCRIBE) == 0) {
+			if(message.Contains("ids") && message.Get("ids").IsList()) {
+				libvariant::Variant idList = message.Get("ids");
+				for (libvariant::Variant::ConstListIterator i(idList.ListBegin()), e(idList.ListEnd()); i != e; ++i) {
+					Id id;
+					if(!id.fromString(i->AsString())) {
+						success = false;
+						break;
+					}
+					subscription.ids.insert(id);
+				}
+			}
+			if(message.Contains("attributes") && message.Get("attributes").IsList()) {
+				libvariant::Variant attributeList = message.Get("attributes");
+				for (libvariant::Variant::ConstListIterator i(attributeList.ListBegin()), e(attributeList.ListEnd()); i != e; ++i) {
+					if(!i->Contains("key") || !i->Contains("value")) {
+						success = false;
+						break;
+					}
+					subscription.attributes.push_back(Attribute(i->Get("key").AsString(), i->Get("value").AsString()));
+				}
+			}
+			if(message.Contains("subgraphId")) {
+				subscription.hasSubgraph = subscription.subgraphId.fromString(message.Get("subgraphId").AsString());
+				success = success && subscription.hasSubgraph;
+			}
+			if(message.Contains("area")) {
+				libvariant::Variant area = message.Get("area");
+				subscription.hasArea = parsePoint(area, "min", subscription.areaMin, -std::numeric_limits<double>::max()) &&
+						parsePoint(area, "max", subscription.areaMax, std::numeric_limits<double>::max());
+				success = success && subscription.hasArea && (spatialIndex != 0);
+			}
+			if(message.Contains("operations") && message.Get("operations").IsList()) {
+				libvariant::Variant operationList = message.Get("operations");
+				for (libvariant::Variant::ConstListIterator i(operationList.ListBegin()), e(operationList.ListEnd()); i != e; ++i) {
+					subscription.operations.insert(i->AsString());
+				}
+			}
+			if(message.Contains("minInterval")) {
+				double minInterval = message.Get("minInterval").AsDouble();
+				subscription.minInterval = std::chrono::milliseconds(minInterval > 0 ? static_cast<long>(minInterval) : 0);
+			}
+			if(message.Contains("coalesce")) {
+				subscription.coalesce = message.Get("coalesce").AsBool();
+			}
+		} else if(queryType.compare(RSG_SUBSCRIPTION_QUERY_UNSUBSCRIBE) == 0) {
+			success = !subscriptionId.empty();
+		}
+	} catch (std::exception const&) {
+		success = false;
+	}
+
+	std::ostringstream out;
+	out << "{\"@worldmodeltype\": \"RSGQueryResult\",\"query\": ";
+	appendJsonString(out, queryType);
+	out << ",";
+	if(!queryId.empty()) {
+		out << "\"queryId\": ";
+		appendJsonString(out, queryId);
+		out << ",";
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if(!success) {
+		LOG(ERROR) << "SubscriptionManager: Malformed " << queryType << " query: " << query;
+	} else if(queryType.compare(RSG_SUBSCRIPTION_QUERY_SUBSCRIBE) == 0) {
+		if(subscriptionId.empty()) {
+			std::ostringstream generatedId;
+			generatedId << "subscription-" << nextSubscriptionId++;
+			subscriptionId = generatedId.str();
+		}
+		subscription.lastSent = std::chrono::steady_clock::now() - subscription.minInterval;
+		subscriptions[subscriptionId] = subscription; // Replaces an existing subscription with the same id.
+		LOG(INFO) << "SubscriptionManager: Added subscription " << subscriptionId << ". There are " << subscriptions.size() << " subscriptions.";
+	} else if(queryType.compare(RSG_SUBSCRIPTION_QUERY_UNSUBSCRIBE) == 0) {
+		success = (subscriptions.erase(subscriptionId) > 0);
+		LOG(INFO) << "SubscriptionManager: Removed subscription " << subscriptionId << ". There are " << subscriptions.size() << " subscriptions.";
+	}
+
+	out << "\"querySuccess\": " << (success ? "true" : "false");
+	if(success && (queryType.compare(RSG_SUBSCRIPTION_QUERY_LIST) == 0)) {
+		out << ",\"subscriptions\": [";
+		for (std::map<std::string, Subscription>::const_iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+			if(it != subscriptions.begin()) {
+				out << ",";
+			}
+			out << "{\"subscriptionId\": ";
+			appendJsonString(out, it->first);
+			out << ",\"pendingUpdates\": " << it->second.pending.size() << ",\"droppedUpdates\": " << it->second.dropped << "}";
+		}
+		out << "]";
+	} else if(!subscriptionId.empty()) {
+		out << ",\"subscriptionId\": ";
+		appendJsonString(out, subscriptionId);
+	}
+	out << "}";
+	result = out.str();
+	return true;
+}
+
+void SubscriptionManager::collect(size_t maxSize, vector<std::string>& messages) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if(subscriptions.empty()) {
+		return;
+	}
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	for (std::map<std::string, Subscription>::iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+		Subscription& subscription = it->second;
+		if((subscription.pending.empty() && (subscription.dropped == 0)) || (now - subscription.lastSent < subscription.minInterval)) {
+			continue;
+		}
+
+		std::ostringstream header;
+		header << "{\"@worldmodeltype\": \"RSGSubscriptionEvents\",\"subscriptionId\": ";
+		appendJsonString(header, it->first);
+		header << ",\"droppedUpdates\": ";
+		std::string footer = "]}";
+		size_t overhead = header.str().size() + std::string(",\"updates\": [").size() + 20 + footer.size();
+
+		/* Updates that can not be sent at all count as dropped as well */
+		for (std::deque<std::string>::iterator update = subscription.pending.begin(); update != subscription.pending.end(); ) {
+			if(overhead + update->size() > maxSize) {
+				LOG(WARNING) << "SubscriptionManager: Dropping an update with " << update->size() << " bytes for subscription " << it->first;
+				update = subscription.pending.erase(update);
+				subscription.dropped++;
+				if(droppedEvents != 0) {
+					droppedEvents->add();
+				}
+			} else {
+				++update;
+			}
+		}
+
+		std::ostringstream message;
+		size_t updatesInMessage = 0;
+		for (std::deque<std::string>::const_iterator update = subscription.pending.begin(); update != subscription.pending.end(); ++update) {
+			if((updatesInMessage > 0) && (static_cast<size_t>(message.tellp()) + 1 + update->size() + footer.size() > maxSize)) {
+				message << footer;
+				messages.push_back(message.str());
+				message.str("");
+				updatesInMessage = 0;
+			}
+			if(updatesInMessage == 0) {
+				message << header.str() << subscription.dropped << ",\"updates\": [";
+				subscription.dropped = 0;
+			} else {
+				message << ",";
+			}
+			message << *update;
+			updatesInMessage++;
+		}
+		if(updatesInMessage == 0) { // Only dropped updates
+			message << header.str() << subscription.dropped << ",\"updates\": [";
+			subscription.dropped = 0;
+		}
+		message << footer;
+		messages.push_back(message.str());
+
+		subscription.pendingBase += subscription.pending.size();
+		subscription.pending.clear();
+		subscription.pendingSequence.clear();
+		subscription.lastSent = now;
+	}
+}
+
+size_t SubscriptionManager::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return subscriptions.size();
+}
+
+bool SubscriptionManager::matchesLocked(Subscription& subscription, Update& update) {
+	if(!subscription.operations.empty() && (subscription.operations.find(update.operation) == subscription.operations.end())) {
+		return false;
+	}
+	if(!subscription.ids.empty() && (subscription.ids.find(update.id) == subscription.ids.end())) {
+		return false;
+	}
+	if(subscription.attributes.empty() && !subscription.hasSubgraph && !subscription.hasArea) {
+		return true; // Nothing that can change over time.
+	}
+
+	bool matches = (update.operation.compare(RSG_OPERATION_DELETE_NODE) != 0);
+	if(matches && !subscription.attributes.empty()) {
+		if(!update.hasAttributes) {
+			scene->getNodeAttributes(update.id, update.attributes);
+			update.hasAttributes = true;
+		}
+		for (vector<Attribute>::const_iterator attribute = subscription.attributes.begin(); attribute != subscription.attributes.end(); ++attribute) {
+			if(!attributeListContainsAttribute(update.attributes, *attribute)) {
+				matches = false;
+				break;
+			}
+		}
+	}
+	if(matches && subscription.hasSubgraph) {
+		getAncestorsLocked(update);
+		matches = (update.ancestors.find(subscription.subgraphId) != update.ancestors.end());
+	}
+	if(matches && subscription.hasArea) {
+		matches = spatialIndex->isInBoundingBox(update.id, subscription.areaMin, subscription.areaMax);
+	}
+
+	/* A node that does not match any more (e.g. it has been deleted or moved out of the area) is reported one last time */
+	if(matches) {
+		subscription.reported.insert(update.id);
+		return true;
+	}
+	return (subscription.reported.erase(update.id) > 0);
+}
+
+bool SubscriptionManager::findSubscribersLocked(Update& update, vector<Subscription*>& subscribers) {
+	for (std::map<std::string, Subscription>::iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+		if(matchesLocked(it->second, update)) {
+			subscribers.push_back(&it->second);
+		}
+	}
+	return !subscribers.empty();
+}
+
+void SubscriptionManager::queueLocked(const Update& update, const vector<Subscription*>& subscribers) {
+	if(capture.message.empty()) {
+		return;
+	}
+	std::pair<Id, std::string> key(update.id, update.operation);
+	for (vector<Subscription*>::const_iterator it = subscribers.begin(); it != subscribers.end(); ++it) {
+		Subscription& subscription = **it;
+		if(events != 0) {
+			events->add();
+		}
+
+		/* Replace the previous update of the same kind */
+		if(subscription.coalesce) {
+			std::map<std::pair<Id, std::string>, unsigned long>::iterator previous = subscription.pendingSequence.find(key);
+			if((previous != subscription.pendingSequence.end()) && (previous->second >= subscription.pendingBase)) {
+				subscription.pending[previous->second - subscription.pendingBase] = capture.message;
+				continue;
+			}
+			subscription.pendingSequence[key] = subscription.pendingBase + subscription.pending.size();
+		}
+
+		subscription.pending.push_back(capture.message);
+		if(subscription.pending.size() > RSG_SUBSCRIPTION_MAX_PENDING) {
+			subscription.pending.pop_front();
+			subscription.pendingBase++;
+			subscription.dropped++;
+			if(droppedEvents != 0) {
+				droppedEvents->add();
+			}
+		}
+	}
+	capture.message.clear();
+}
+
+void SubscriptionManager::getAncestorsLocked(Update& update) {
+	if(update.hasAncestors) {
+		return;
+	}
+	update.hasAncestors = true;
+	vector<Id> pending(1, update.id);
+	while(!pending.empty()) {
+		Id current = pending.back();
+		pending.pop_back();
+		if(!update.ancestors.insert(current).second) {
+			continue;
+		}
+		vector<Id> parents;
+		if(scene->getNodeParents(current, parents)) {
+			pending.insert(pending.end(), parents.begin(), parents.end());
+		}
+	}
+}
+
+bool SubscriptionManager::addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(assignedId, RSG_OPERATION_CREATE);
+	update.attributes = attributes;
+	update.hasAttributes = true;
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		Id id = assignedId;
+		serializer.addNode(parentId, id, attributes, true);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(assignedId, RSG_OPERATION_CREATE);
+	update.attributes = attributes;
+	update.hasAttributes = true;
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		Id id = assignedId;
+		serializer.addGroup(parentId, id, attributes, true);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(assignedId, RSG_OPERATION_CREATE);
+	update.attributes = attributes;
+	update.hasAttributes = true;
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		Id id = assignedId;
+		serializer.addTransformNode(parentId, id, attributes, transform, timeStamp, true);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(assignedId, RSG_OPERATION_CREATE);
+	update.attributes = attributes;
+	update.hasAttributes = true;
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		Id id = assignedId;
+		serializer.addUncertainTransformNode(parentId, id, attributes, transform, uncertainty, timeStamp, true);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(assignedId, RSG_OPERATION_CREATE);
+	update.attributes = attributes;
+	update.hasAttributes = true;
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		Id id = assignedId;
+		serializer.addGeometricNode(parentId, id, attributes, shape, timeStamp, true);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::addRemoteRootNode(Id rootId, vector<Attribute> attributes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(rootId, RSG_OPERATION_CREATE_REMOTE_ROOT_NODE);
+	update.attributes = attributes;
+	update.hasAttributes = true;
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		serializer.addRemoteRootNode(rootId, attributes);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(assignedId, RSG_OPERATION_CREATE);
+	update.attributes = attributes;
+	update.hasAttributes = true;
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		Id id = assignedId;
+		serializer.addConnection(parentId, id, attributes, sourceIds, targetIds, start, end, true);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(id, RSG_OPERATION_UPDATE_ATTRIBUTES);
+	update.attributes = newAttributes;
+	update.hasAttributes = true;
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		serializer.setNodeAttributes(id, newAttributes, timeStamp);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(id, RSG_OPERATION_UPDATE_TRANSFORM);
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		serializer.setTransform(id, transform, timeStamp);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(id, RSG_OPERATION_UPDATE_TRANSFORM);
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		serializer.setUncertainTransform(id, transform, uncertainty, timeStamp);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::deleteNode(Id id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(id, RSG_OPERATION_DELETE_NODE);
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		serializer.deleteNode(id);
+		queueLocked(update, subscribers);
+	}
+	for (std::map<std::string, Subscription>::iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+		it->second.reported.erase(id); // Also if the operation is not subscribed.
+	}
+	return true;
+}
+
+bool SubscriptionManager::addParent(Id id, Id parentId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(id, RSG_OPERATION_CREATE_PARENT);
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		serializer.addParent(id, parentId);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+bool SubscriptionManager::removeParent(Id id, Id parentId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Update update(id, RSG_OPERATION_DELETE_PARENT);
+	vector<Subscription*> subscribers;
+	if(findSubscribersLocked(update, subscribers)) {
+		serializer.removeParent(id, parentId);
+		queueLocked(update, subscribers);
+	}
+	return true;
+}
+
+} // namespace rsg
+} // namespace brics_3d
@@ -0,0 +1,161 @@
+/*
+ * Server side continuous queries with push delivery.
+ *
+ * Clients register a predicate with a SUBSCRIBE query: node ids, attributes
+ * (matched like GET_NODES does), a subgraph and/or an area in the world frame.
+ * The subscriptions observe the scene graph; every update of a matching node is
+ * serialized once as RSGUpdate message and queued for all subscriptions it
+ * matches. collect() bundles the queued updates per subscription into
+ * RSGSubscriptionEvents messages, so only interested clients receive them instead
+ * of polling or listening to all updates of the world model.
+ *
+ * A subscription can limit its rate with a minimal interval between two messages.
+ * With coalescing, only the newest update per node and operation is kept while
+ * the subscription waits for its next message.
+ */
+
+#ifndef RSG_SUBSCRIPTIONS_H_
+#define RSG_SUBSCRIPTIONS_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+#include <brics_3d/worldModel/sceneGraph/IOutputPort.h>
+#include <brics_3d/worldModel/sceneGraph/JSONSerializer.h>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "rsg_spatial_index.h"
+#include "rsg_stats.h"
+
+namespace brics_3d {
+namespace rsg {
+
+/// Maximum number of queued updates per subscription. The oldest ones are dropped if it is exceeded.
+#define RSG_SUBSCRIPTION_MAX_PENDING 1000
+
+class SubscriptionManager : public ISceneGraphUpdateObserver {
+public:
+
+	/**
+	 * @param scene Scene that provides attributes and parents of updated nodes. Updates
+	 *              are observed while the world model lock is held by the writer.
+	 * @param spatialIndex Optional index to evaluate areas. Subscriptions with an area are rejected without it.
+	 * @param events Optional counter for queued updates.
+	 * @param dropped Optional counter for updates that have been dropped.
+	 */
+	SubscriptionManager(SceneGraphFacade* scene, SpatialIndex* spatialIndex = 0, StatsCounter* events = 0, StatsCounter* dropped = 0);
+	virtual ~SubscriptionManager();
+
+	/**
+	 * Answers a JSON query if it is a SUBSCRIBE, UNSUBSCRIBE or GET_SUBSCRIPTIONS query.
+	 * @param query Complete RSGQuery message.
+	 * @param result JSON result.
+	 * @return True if the result has been set. False if the query has to be processed otherwise.
+	 */
+	bool query(const std::string& query, std::string& result);
+
+	/**
+	 * Creates the RSGSubscriptionEvents messages of all subscriptions that have queued
+	 * updates and whose minimal interval has passed. Can be called from any thread.
+	 * @param maxSize Maximum size of a message. Updates of a subscription are split into multiple messages if necessary.
+	 * @param messages Messages to be sent.
+	 */
+	void collect(size_t maxSize, vector<std::string>& messages);
+
+	/// Number of subscriptions.
+	size_t size();
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false);
+	bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false);
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false);
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes);
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false);
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0));
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+	bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp);
+	bool deleteNode(Id id);
+	bool addParent(Id id, Id parentId);
+	bool removeParent(Id id, Id parentId);
+
+private:
+
+	/// Predicate and queue of a single subscription. All given criteria have to match.
+	struct Subscription {
+		Subscription() : hasSubgraph(false), hasArea(false), minInterval(0), coalesce(false), pendingBase(0), dropped(0) {};
+		std::set<Id> ids;
+		vector<Attribute> attributes;
+		bool hasSubgraph;
+		Id subgraphId;
+		bool hasArea;
+		double areaMin[3];
+		double areaMax[3];
+		std::set<std::string> operations;     // Empty for all operations.
+		std::chrono::milliseconds minInterval;
+		bool coalesce;
+
+		std::set<Id> reported;                // Nodes that matched before; the update that ends a match is reported as well.
+		std::deque<std::string> pending;      // Serialized RSGUpdate messages.
+		unsigned long pendingBase;            // Sequence number of the first pending update.
+		std::map<std::pair<Id, std::string>, unsigned long> pendingSequence; // Newest update per node and operation (coalescing).
+		unsigned long dropped;
+		std::chrono::steady_clock::time_point lastSent;
+	};
+
+	/// Captures the output of the JSONSerializer.
+	class Capture : public IOutputPort {
+	public:
+		int write(const char *dataBuffer, int dataLength, int &transferredBytes);
+		std::string message;
+	};
+
+	/// Lazily evaluated data of the updated node, shared by all subscriptions.
+	struct Update {
+		Update(Id id, const std::string& operation) : id(id), operation(operation), hasAttributes(false), hasAncestors(false) {};
+		Id id;
+		std::string operation;
+		bool hasAttributes;
+		vector<Attribute> attributes;
+		bool hasAncestors;
+		std::set<Id> ancestors;               // Including the node itself.
+	};
+
+	/// Has to be called with mutex held.
+	bool matchesLocked(Subscription& subscription, Update& update);
+
+	/**
+	 * Has to be called with mutex held. Finds all subscriptions the update matches.
+	 * @return False if no subscription is interested in the update, so it does not need to be serialized.
+	 */
+	bool findSubscribersLocked(Update& update, vector<Subscription*>& subscribers);
+
+	/// Has to be called with mutex held. Queues the captured message for the subscribers.
+	void queueLocked(const Update& update, const vector<Subscription*>& subscribers);
+
+	/// Has to be called with mutex held. Requires the world model lock.
+	void getAncestorsLocked(Update& update);
+
+	SceneGraphFacade* scene;
+	SpatialIndex* spatialIndex;
+	StatsCounter* events;
+	StatsCounter* droppedEvents;
+	unsigned long nextSubscriptionId;
+
+	std::mutex mutex;
+	std::map<std::string, Subscription> subscriptions;
+	Capture capture;
+	JSONSerializer serializer;
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_SUBSCRIPTIONS_H_ */
@@ -0,0 +1,117 @@
+/*
+ * Trains a zstd dictionary for the compression of JSON update streams.
+ *
+ * The samples are the JSON messages of capture files as recorded by the
+ * rsg_recorder block at the output of a rsg_json_sender. Messages that are
+ * not JSON (HDF5 or binary streams) or that are already compressed are skipped.
+ * The resulting dictionary is used as compression_dictionary of the
+ * rsg_json_sender and rsg_json_reciever blocks.
+ *
+ * Usage:
+ *   rsg_train_dictionary [--size <bytes>] --output <file> <capture file>...
+ *
+ * Afterwards the compression ratio and time of the samples is printed for the
+ * built-in and the trained dictionary.
+ */
+
+/* BRICS_3D includes */
+#include <brics_3d/core/Logger.h>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsg_capture.h"
+#include "rsg_compression.h"
+
+using namespace brics_3d::rsg;
+
+/// Counts the bytes of the compressed messages.
+class ByteCounter : public IOutputPort {
+public:
+	ByteCounter() : bytes(0) {};
+	int write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+		bytes += dataLength;
+		transferredBytes = dataLength;
+		return 0;
+	}
+	uint64_t bytes;
+};
+
+static void evaluate(const char* name, const std::string& dictionary, const std::vector<std::string>& samples, uint64_t sampleBytes) {
+	ByteCounter counter;
+	UpdateCompressor compressor(&counter, dictionary, 0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (std::vector<std::string>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+		int transferredBytes;
+		compressor.write(it->data(), it->size(), transferredBytes);
+	}
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	std::cout << std::left << std::setw(10) << name << std::right << std::setw(10) << dictionary.size() << " bytes dictionary: "
+			<< std::setw(12) << counter.bytes << " bytes (" << std::fixed << std::setprecision(1) << (100.0 * counter.bytes / sampleBytes) << " %), "
+			<< std::setprecision(0) << (ns / samples.size()) << " ns/message" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	std::string outputFileName = "";
+	size_t size = RSG_COMPRESSION_DEFAULT_DICTIONARY_SIZE;
+	std::vector<std::string> captureFileNames;
+	for (int i = 1; i < argc; ++i) {
+		if((strcmp(argv[i], "--output") == 0) && (i + 1 < argc)) {
+			outputFileName = argv[++i];
+		} else if((strcmp(argv[i], "--size") == 0) && (i + 1 < argc)) {
+			size = atoi(argv[++i]);
+		} else if(strncmp(argv[i], "--", 2) != 0) {
+			captureFileNames.push_back(argv[i]);
+		} else {
+			captureFileNames.clear();
+			break;
+		}
+	}
+	if(outputFileName.empty() || captureFileNames.empty() || (size == 0)) {
+		std::cerr << "Usage: " << argv[0] << " [--size <bytes>] --output <file> <capture file>..." << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> samples;
+	uint64_t sampleBytes = 0;
+	uint64_t skipped = 0;
+	for (std::vector<std::string>::const_iterator it = captureFileNames.begin(); it != captureFileNames.end(); ++it) {
+		CaptureReader reader;
+		if(!reader.open(*it)) {
+			return 1;
+		}
+		uint64_t timeStamp;
+		std::vector<char> message;
+		while(reader.next(timeStamp, message)) {
+			if(message.empty() || (message[0] != '{') || UpdateCompression::isCompressed(&message[0], message.size())) {
+				skipped++;
+				continue;
+			}
+			samples.push_back(std::string(message.begin(), message.end()));
+			sampleBytes += message.size();
+		}
+		reader.close();
+	}
+	std::cout << "Read " << samples.size() << " JSON messages with " << sampleBytes << " bytes. Skipped " << skipped << " other messages." << std::endl;
+
+	std::string dictionary;
+	if(!UpdateCompression::trainDictionary(samples, size, dictionary)) {
+		return 1;
+	}
+	std::ofstream output(outputFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	output.write(dictionary.data(), dictionary.size());
+	output.close();
+	if(!output) {
+		std::cerr << "Cannot write the dictionary to " << outputFileName << std::endl;
+		return 1;
+	}
+	std::cout << "Wrote a dictionary with " << dictionary.size() << " bytes to " << outputFileName << std::endl;
+
+	evaluate("built-in", UpdateCompression::getDefaultDictionary(), samples, sampleBytes);
+	evaluate("trained", dictionary, samples, sampleBytes);
+	return 0;
+}
@@ -0,0 +1,354 @@
+#include "rsg_transform_cache.h"
+
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/core/HomogeneousMatrix44.h>
+
+/* libvariant is used by the JSONQueryRunner as well */
+#include <Variant/Variant.h>
+
+#include <string.h>
+#include <time.h>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace brics_3d {
+namespace rsg {
+
+#define RSG_TRANSFORM_CACHE_LATEST std::numeric_limits<int64_t>::max()
+
+/// Appends a JSON string literal.
+static void appendJsonString(std::ostringstream& out, const std::string& value) {
+	out << "\"";
+	for (size_t i = 0; i < value.size(); ++i) {
+		if ((value[i] == '"') || (value[i] == '\\')) {
+			out << "\\";
+		}
+		out << value[i];
+	}
+	out << "\"";
+}
+
+static double toMilliSeconds(TimeStamp timeStamp) {
+	return timeStamp.getSeconds() * 1000.0;
+}
+
+/// Reads a TimeStampUTCms or a TimeStampDate (e.g. "2015-11-09T16:16:44Z") in [ms].
+static bool parseTimeStamp(const libvariant::Variant& stamp, double& timeStamp) {
+	if(!stamp.Contains("@stamptype") || !stamp.Contains("stamp")) {
+		return false;
+	}
+	std::string type = stamp.Get("@stamptype").AsString();
+	if(type.compare("TimeStampUTCms") == 0) {
+		timeStamp = stamp.Get("stamp").AsDouble();
+		return true;
+	}
+	if(type.compare("TimeStampDate") == 0) {
+		struct tm date;
+		memset(&date, 0, sizeof(date));
+		std::string value = stamp.Get("stamp").AsString();
+		const char* end = strptime(value.c_str(), "%Y-%m-%dT%H:%M:%S", &date);
+		if((end == 0) || ((*end != 'Z') && (*end != '\0'))) {
+			return false; // Time zone offsets are left to the JSONQueryRunner.
+		}
+		timeStamp = static_cast<double>(timegm(&date)) * 1000.0;
+		return true;
+	}
+	return false;
+}
+
+bool TransformCache::Key::operator<(const Key& other) const {
+	if(id < other.id) {
+		return true;
+	}
+	if(other.id < id) {
+		return false;
+	}
+	if(idReferenceNode < other.idReferenceNode) {
+		return true;
+	}
+	if(other.idReferenceNode < idReferenceNode) {
+		return false;
+	}
+	return bucket < other.bucket;
+}
+
+TransformCache::TransformCache(SceneGraphFacade* scene, double resolution, TimeStamp now, StatsCounter* hits, StatsCounter* misses) :
+		scene(scene), resolution(resolution), startTime(toMilliSeconds(now)), hits(hits), misses(misses) {
+	if(this->resolution <= 0) {
+		this->resolution = 1.0;
+	}
+}
+
+TransformCache::~TransformCache() {
+
+}
+
+bool TransformCache::query(const std::string& query, std::string& result) {
+
+	/* Cheap pre check, so other queries are not parsed twice */
+	if(query.find("GET_TRANSFORM") == std::string::npos) {
+		return false;
+	}
+
+	Id id;
+	Id idReferenceNode;
+	double timeStamp = 0;
+	std::string queryId;
+	try {
+		libvariant::Variant message = libvariant::DeserializeJSON(query);
+		if(!message.Contains("query") || (message.Get("query").AsString().compare("GET_TRANSFORM") != 0)) {
+			return false;
+		}
+		if(!message.Contains("id") || !message.Contains("idReferenceNode") || !message.Contains("timeStamp")) {
+			return false;
+		}
+		if(!id.fromString(message.Get("id").AsString()) || !idReferenceNode.fromString(message.Get("idReferenceNode").AsString())) {
+			return false;
+		}
+		if(!parseTimeStamp(message.Get("timeStamp"), timeStamp)) {
+			return false;
+		}
+		if(message.Contains("queryId")) {
+			queryId = message.Get("queryId").AsString();
+		}
+	} catch (std::exception const&) {
+		return false; // The JSONQueryRunner will report the error.
+	}
+
+	double matrix[16];
+	if(!getTransform(id, idReferenceNode, timeStamp, matrix)) {
+		return false; // The JSONQueryRunner will report the error.
+	}
+
+	std::ostringstream out;
+	out << "{\"@worldmodeltype\": \"RSGQueryResult\",\"query\": \"GET_TRANSFORM\",";
+	if(!queryId.empty()) {
+		out << "\"queryId\": ";
+		appendJsonString(out, queryId);
+		out << ",";
+	}
+	out << "\"querySuccess\": true,\"transform\": {\"matrix\": [";
+	out << std::fixed << std::setprecision(16);
+	for (int row = 0; row < 4; ++row) {
+		if(row > 0) {
+			out << ",";
+		}
+		out << "[" << matrix[row] << "," << matrix[4 + row] << "," << matrix[8 + row] << "," << matrix[12 + row] << "]";
+	}
+	out << "],\"type\": \"HomogeneousMatrix44\",\"unit\": \"m\"}}";
+	result = out.str();
+	return true;
+}
+
+bool TransformCache::getTransform(Id id, Id idReferenceNode, double timeStamp, double matrix[16]) {
+	Key key;
+	key.id = id;
+	key.idReferenceNode = idReferenceNode;
+	key.bucket = static_cast<int64_t>(timeStamp / resolution);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(lookupLocked(key, timeStamp, matrix)) {
+			if(hits) {
+				hits->add();
+			}
+			return true;
+		}
+	}
+	if(misses) {
+		misses->add();
+	}
+
+	/*
+	 * Compute it without holding the mutex. Updates cannot interfere, since they
+	 * require the exclusive world model lock.
+	 */
+	IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform(new HomogeneousMatrix44());
+	if(!scene->getTransformForNode(id, idReferenceNode, TimeStamp(timeStamp, Units::MilliSecond), transform)) {
+		return false;
+	}
+	memcpy(matrix, transform->getRawData(), 16 * sizeof(double));
+
+	std::set<Id> dependencies;
+	collectAncestors(id, dependencies);
+	collectAncestors(idReferenceNode, dependencies);
+
+	Entry entry;
+	memcpy(entry.matrix, matrix, sizeof(entry.matrix));
+	entry.dependencies.assign(dependencies.begin(), dependencies.end());
+
+	std::lock_guard<std::mutex> lock(mutex);
+	entry.newest = startTime;
+	for (std::set<Id>::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it) {
+		std::map<Id, double>::const_iterator newest = newestData.find(*it);
+		if((newest != newestData.end()) && (newest->second > entry.newest)) {
+			entry.newest = newest->second;
+		}
+	}
+	if(timeStamp >= entry.newest) {
+		key.bucket = RSG_TRANSFORM_CACHE_LATEST; // Same result for all later time stamps.
+	}
+	insertLocked(key, entry);
+	return true;
+}
+
+size_t TransformCache::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+void TransformCache::collectAncestors(Id id, std::set<Id>& ancestors) {
+	vector<Id> open(1, id);
+	while(!open.empty()) {
+		Id current = open.back();
+		open.pop_back();
+		if(!ancestors.insert(current).second) {
+			continue;
+		}
+		vector<Id> parents;
+		scene->getNodeParents(current, parents);
+		open.insert(open.end(), parents.begin(), parents.end());
+	}
+}
+
+bool TransformCache::lookupLocked(const Key& key, double timeStamp, double matrix[16]) {
+	Key latest = key;
+	latest.bucket = RSG_TRANSFORM_CACHE_LATEST;
+	std::map<Key, Entry>::const_iterator entry = entries.find(latest);
+	if((entry == entries.end()) || (timeStamp < entry->second.newest)) {
+		entry = entries.find(key);
+	}
+	if(entry == entries.end()) {
+		return false;
+	}
+	memcpy(matrix, entry->second.matrix, sizeof(entry->second.matrix));
+	return true;
+}
+
+void TransformCache::insertLocked(const Key& key, const Entry& entry) {
+	if(entries.size() >= RSG_TRANSFORM_CACHE_MAX_ENTRIES) {
+		LOG(DEBUG) << "TransformCache: Maximum of " << RSG_TRANSFORM_CACHE_MAX_ENTRIES << " entries reached. Clearing the cache.";
+		clearLocked();
+	}
+	std::pair<std::map<Key, Entry>::iterator, bool> inserted = entries.insert(std::make_pair(key, entry));
+	if(!inserted.second) {
+		return; // Computed concurrently by another worker.
+	}
+	for (vector<Id>::const_iterator it = entry.dependencies.begin(); it != entry.dependencies.end(); ++it) {
+		dependents[*it].insert(key);
+	}
+}
+
+void TransformCache::invalidateLocked(Id id) {
+	std::map<Id, std::set<Key> >::iterator keys = dependents.find(id);
+	if(keys == dependents.end()) {
+		return;
+	}
+	std::set<Key> affected;
+	affected.swap(keys->second);
+	dependents.erase(keys);
+
+	for (std::set<Key>::const_iterator key = affected.begin(); key != affected.end(); ++key) {
+		std::map<Key, Entry>::iterator entry = entries.find(*key);
+		if(entry == entries.end()) {
+			continue;
+		}
+		for (vector<Id>::const_iterator it = entry->second.dependencies.begin(); it != entry->second.dependencies.end(); ++it) {
+			std::map<Id, std::set<Key> >::iterator other = dependents.find(*it);
+			if(other != dependents.end()) {
+				other->second.erase(*key);
+				if(other->second.empty()) {
+					dependents.erase(other);
+				}
+			}
+		}
+		entries.erase(entry);
+	}
+}
+
+void TransformCache::updateNewestLocked(Id id, TimeStamp timeStamp) {
+	double stamp = toMilliSeconds(timeStamp);
+	std::map<Id, double>::iterator newest = newestData.find(id);
+	if(newest == newestData.end()) {
+		newestData.insert(std::make_pair(id, stamp));
+	} else if(stamp > newest->second) {
+		newest->second = stamp;
+	}
+}
+
+void TransformCache::clearLocked() {
+	entries.clear();
+	dependents.clear();
+}
+
+bool TransformCache::addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	return true; // A new leaf does not change any existing path.
+}
+
+bool TransformCache::addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId) {
+	return true;
+}
+
+bool TransformCache::addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	updateNewestLocked(assignedId, timeStamp);
+	return true;
+}
+
+bool TransformCache::addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	updateNewestLocked(assignedId, timeStamp);
+	return true;
+}
+
+bool TransformCache::addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId) {
+	return true;
+}
+
+bool TransformCache::addRemoteRootNode(Id rootId, vector<Attribute> attributes) {
+	return true;
+}
+
+bool TransformCache::addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId) {
+	return true;
+}
+
+bool TransformCache::setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp) {
+	return true;
+}
+
+bool TransformCache::setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	updateNewestLocked(id, timeStamp);
+	invalidateLocked(id);
+	return true;
+}
+
+bool TransformCache::setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp) {
+	std::lock_guard<std::mutex> lock(mutex);
+	updateNewestLocked(id, timeStamp);
+	invalidateLocked(id);
+	return true;
+}
+
+bool TransformCache::deleteNode(Id id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	newestData.erase(id);
+	clearLocked();
+	return true;
+}
+
+bool TransformCache::addParent(Id id, Id parentId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	clearLocked();
+	return true;
+}
+
+bool TransformCache::removeParent(Id id, Id parentId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	clearLocked();
+	return true;
+}
+
+} // namespace rsg
+} // namespace brics_3d
@@ -0,0 +1,134 @@
+/*
+ * Cache for the results of GET_TRANSFORM queries.
+ *
+ * Composing a transform between two nodes walks all Transforms from both nodes up
+ * to the root node, e.g. root -> GIS origin -> agent -> sensor. Repeated pose queries
+ * of the same pair of nodes (as sent by a mission controller) are therefore answered
+ * from a cache keyed by id, reference id and time stamp. The time stamp is reduced to
+ * a bucket of a configurable resolution; queries for a time stamp at or after the
+ * newest data of all Transforms on the path share a single "latest" entry.
+ *
+ * The cache observes the scene graph: an entry is dropped as soon as one of the nodes
+ * above the id or the reference node receives a setTransform. Structural updates
+ * (addParent, removeParent, deleteNode) drop all entries.
+ */
+
+#ifndef RSG_TRANSFORM_CACHE_H_
+#define RSG_TRANSFORM_CACHE_H_
+
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "rsg_stats.h"
+
+namespace brics_3d {
+namespace rsg {
+
+/// Maximum number of cached transforms. The cache is cleared if it is exceeded.
+#define RSG_TRANSFORM_CACHE_MAX_ENTRIES 10000
+
+class TransformCache : public ISceneGraphUpdateObserver {
+public:
+
+	/**
+	 * @param scene Scene that computes missing transforms. The caller of query() has
+	 *              to hold the (shared) world model lock.
+	 * @param resolution Size of the time buckets in [ms].
+	 * @param now Current time of the world model. Transforms that have not been updated
+	 *            since the cache was created are assumed to have no data after it.
+	 * @param hits Optional counter for queries that are answered from the cache.
+	 * @param misses Optional counter for queries that had to be computed.
+	 */
+	TransformCache(SceneGraphFacade* scene, double resolution, TimeStamp now, StatsCounter* hits = 0, StatsCounter* misses = 0);
+	virtual ~TransformCache();
+
+	/**
+	 * Answers a JSON query if it is a GET_TRANSFORM query with a TimeStampUTCms or TimeStampDate.
+	 * @param query Complete RSGQuery message.
+	 * @param result JSON result. It has the same format as the one of the JSONQueryRunner.
+	 * @return True if the result has been set. False if the query has to be processed otherwise.
+	 */
+	bool query(const std::string& query, std::string& result);
+
+	/**
+	 * Looks up or computes the transform of a node with respect to a reference node.
+	 * @param timeStamp Time in [ms].
+	 * @param matrix Column major like IHomogeneousMatrix44::getRawData().
+	 * @return False if there is no transform between the nodes.
+	 */
+	bool getTransform(Id id, Id idReferenceNode, double timeStamp, double matrix[16]);
+
+	/// Number of cached transforms.
+	size_t size();
+
+	/* implemetntations of observer interface */
+	bool addNode(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addGroup(Id parentId, Id& assignedId, vector<Attribute> attributes, bool forcedId = false);
+	bool addTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp, bool forcedId = false);
+	bool addUncertainTransformNode(Id parentId, Id& assignedId, vector<Attribute> attributes, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp, bool forcedId = false);
+	bool addGeometricNode(Id parentId, Id& assignedId, vector<Attribute> attributes, Shape::ShapePtr shape, TimeStamp timeStamp, bool forcedId = false);
+	bool addRemoteRootNode(Id rootId, vector<Attribute> attributes);
+	bool addConnection(Id parentId, Id& assignedId, vector<Attribute> attributes, vector<Id> sourceIds, vector<Id> targetIds, TimeStamp start, TimeStamp end, bool forcedId = false);
+	bool setNodeAttributes(Id id, vector<Attribute> newAttributes, TimeStamp timeStamp = TimeStamp(0));
+	bool setTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, TimeStamp timeStamp);
+	bool setUncertainTransform(Id id, IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, ITransformUncertainty::ITransformUncertaintyPtr uncertainty, TimeStamp timeStamp);
+	bool deleteNode(Id id);
+	bool addParent(Id id, Id parentId);
+	bool removeParent(Id id, Id parentId);
+
+private:
+
+	struct Key {
+		Id id;
+		Id idReferenceNode;
+		int64_t bucket;
+		bool operator<(const Key& other) const;
+	};
+
+	struct Entry {
+		double matrix[16];
+		double newest;              // Newest data [ms] of all Transforms on the path when the entry was computed.
+		vector<Id> dependencies;    // The id, the reference node and all nodes above them.
+	};
+
+	/// Collects a node and all nodes above it. Requires the world model lock.
+	void collectAncestors(Id id, std::set<Id>& ancestors);
+
+	/// Has to be called with mutex held.
+	bool lookupLocked(const Key& key, double timeStamp, double matrix[16]);
+
+	/// Has to be called with mutex held.
+	void insertLocked(const Key& key, const Entry& entry);
+
+	/// Has to be called with mutex held. Drops all entries that depend on a node.
+	void invalidateLocked(Id id);
+
+	/// Has to be called with mutex held.
+	void updateNewestLocked(Id id, TimeStamp timeStamp);
+
+	/// Has to be called with mutex held.
+	void clearLocked();
+
+	SceneGraphFacade* scene;
+	double resolution;
+	double startTime;                       // [ms]
+	StatsCounter* hits;
+	StatsCounter* misses;
+
+	std::mutex mutex;
+	std::map<Key, Entry> entries;
+	std::map<Id, std::set<Key> > dependents;
+	std::map<Id, double> newestData;        // [ms] per Transform that has been updated since the start.
+};
+
+} // namespace rsg
+} // namespace brics_3d
+
+#endif /* RSG_TRANSFORM_CACHE_H_ */
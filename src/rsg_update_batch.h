@@ -0,0 +1,264 @@
+/*
+ * Batch envelope for JSON based Robot Scene Graph updates.
+ *
+ * A batch bundles many serialized updates into one wire message:
+ *
+ *   {"@worldmodeltype":"RSGUpdateBatch","operations":[<update>,<update>,...]}
+ *
+ * where every <update> is exactly what the JSONSerializer emits for a single update.
+ */
+
+#ifndef RSG_UPDATE_BATCH_H_
+#define RSG_UPDATE_BATCH_H_
+
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/worldModel/sceneGraph/IOutputPort.h>
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define RSG_UPDATE_BATCH_TYPE "RSGUpdateBatch"
+#define RSG_UPDATE_BATCH_HEADER "{\"@worldmodeltype\":\"" RSG_UPDATE_BATCH_TYPE "\",\"operations\":["
+#define RSG_UPDATE_BATCH_TRAILER "]}"
+
+/**
+ * Collects updates that are written within a batch scope (cf. beginBatch() and endBatch())
+ * into one envelope and forwards it when the scope ends or when a threshold is exceeded.
+ * Updates written outside of a scope are forwarded immediately and without an envelope.
+ *
+ * Scopes are per thread: a scope only bundles the updates that the thread which opened
+ * it writes. Updates of other threads pass through unaffected meanwhile.
+ */
+class UpdateBatcher : public brics_3d::rsg::IOutputPort {
+public:
+
+	/**
+	 * @param port The port that receives the batches.
+	 * @param maxBytes Maximum size of a batch message in bytes. Updates that are larger on their own are send without envelope.
+	 * @param maxUpdates Maximum number of updates per batch. 0 means no limit.
+	 */
+	UpdateBatcher(brics_3d::rsg::IOutputPort* port, unsigned int maxBytes, unsigned int maxUpdates) :
+		port(port), maxBytes(maxBytes), maxUpdates(maxUpdates), batchCount(0) {
+	};
+	virtual ~UpdateBatcher(){};
+
+	int write(const char *dataBuffer, int dataLength, int &transferredBytes) {
+		std::lock_guard<std::mutex> lock(mutex);
+		transferredBytes = dataLength;
+
+		std::map<std::thread::id, Scope>::iterator scope = scopes.find(std::this_thread::get_id());
+		size_t length = static_cast<size_t>(dataLength);
+		size_t overhead = headerLength() + strlen(RSG_UPDATE_BATCH_TRAILER) + 1;
+		if((scope == scopes.end()) || (length + overhead > maxBytes)) {
+			if(scope != scopes.end()) {
+				flushLocked(scope->second); // Preserve the order of the updates of this thread.
+				scope->second.messageCount++;
+			}
+			int sentBytes;
+			return port->write(dataBuffer, dataLength, sentBytes);
+		}
+
+		Scope& batch = scope->second;
+		if((batch.updateCount > 0) && (batch.buffer.size() + 1 + length + strlen(RSG_UPDATE_BATCH_TRAILER) > maxBytes)) {
+			flushLocked(batch);
+		}
+		if(batch.updateCount > 0) {
+			batch.buffer.push_back(',');
+		}
+		batch.buffer.append(dataBuffer, dataLength);
+		batch.updateCount++;
+
+		if((maxUpdates > 0) && (batch.updateCount >= maxUpdates)) {
+			flushLocked(batch);
+		}
+		return 0;
+	};
+
+	/// Starts a batch scope of the calling thread. Scopes can be nested; the batch is send when the outermost one ends.
+	void beginBatch() {
+		std::lock_guard<std::mutex> lock(mutex);
+		Scope& scope = scopes[std::this_thread::get_id()];
+		if(scope.depth == 0) {
+			scope.buffer.reserve(maxBytes);
+			scope.buffer.append(RSG_UPDATE_BATCH_HEADER);
+		}
+		scope.depth++;
+	}
+
+	/// Ends a batch scope of the calling thread.
+	void endBatch() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::thread::id, Scope>::iterator scope = scopes.find(std::this_thread::get_id());
+		if(scope == scopes.end()) {
+			return;
+		}
+		scope->second.depth--;
+		if(scope->second.depth == 0) {
+			flushLocked(scope->second);
+			scopes.erase(scope);
+		}
+	}
+
+	/**
+	 * Number of messages that the open scope of the calling thread has already forwarded.
+	 * 0 means everything written within the scope so far is going to be send as one message.
+	 */
+	unsigned int getScopeMessageCount() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::thread::id, Scope>::iterator scope = scopes.find(std::this_thread::get_id());
+		if(scope == scopes.end()) {
+			return 0;
+		}
+		return scope->second.messageCount;
+	}
+
+	/// Number of envelopes that have been send so far.
+	unsigned long getBatchCount() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return batchCount;
+	}
+
+private:
+
+	/// Open batch of one thread.
+	struct Scope {
+		Scope() : depth(0), updateCount(0), messageCount(0) {};
+		unsigned int depth;
+		unsigned int updateCount;
+		unsigned int messageCount; // Messages forwarded since the scope was opened.
+		std::string buffer;
+	};
+
+	size_t headerLength() {
+		return strlen(RSG_UPDATE_BATCH_HEADER);
+	}
+
+	/// Has to be called with mutex held.
+	void flushLocked(Scope& scope) {
+		if(scope.updateCount == 0) {
+			return;
+		}
+
+		int sentBytes;
+		if(scope.updateCount == 1) { // An envelope does not pay off.
+			port->write(scope.buffer.data() + headerLength(), scope.buffer.size() - headerLength(), sentBytes);
+		} else {
+			scope.buffer.append(RSG_UPDATE_BATCH_TRAILER);
+			port->write(scope.buffer.data(), scope.buffer.size(), sentBytes);
+			batchCount++;
+			LOG(DEBUG) << "UpdateBatcher: Send " << scope.updateCount << " updates with " << scope.buffer.size() << " bytes in one batch.";
+		}
+
+		scope.buffer.resize(headerLength());
+		scope.updateCount = 0;
+		scope.messageCount++;
+	}
+
+	brics_3d::rsg::IOutputPort* port;
+	unsigned int maxBytes;
+	unsigned int maxUpdates;
+
+	std::mutex mutex;
+	std::map<std::thread::id, Scope> scopes; // Threads that currently have a scope open.
+	unsigned long batchCount;
+};
+
+/**
+ * Splits a received batch into its individual updates.
+ */
+class UpdateBatchSplitter {
+public:
+
+	/**
+	 * Checks whether a message is a batch envelope. Only the beginning of the message is inspected.
+	 */
+	static bool isBatch(const char *dataBuffer, int dataLength) {
+		const char* type = "\"" RSG_UPDATE_BATCH_TYPE "\"";
+		int searchLength = dataLength < 64 ? dataLength : 64;
+		std::string head(dataBuffer, searchLength);
+		return head.find(type) != std::string::npos;
+	}
+
+	/**
+	 * Forwards every update of the "operations" array to a target with an IOutputPort like
+	 * write() function (e.g. a JSONDeserializer), without copying them.
+	 * @return Number of forwarded updates or -1 if the envelope is malformed.
+	 */
+	template <class Target>
+	static int forEachOperation(const char *dataBuffer, int dataLength, Target* target) {
+		const char* end = dataBuffer + dataLength;
+		const char* operationsKey = "\"operations\"";
+		const char* cursor = std::search(dataBuffer, end, operationsKey, operationsKey + strlen(operationsKey));
+		if(cursor == end) {
+			return -1;
+		}
+		cursor = std::find(cursor, end, '[');
+		if(cursor == end) {
+			return -1;
+		}
+		cursor++;
+
+		int count = 0;
+		while(cursor < end) {
+			if(*cursor == ']') {
+				return count;
+			}
+			if(*cursor != '{') { // whitespace or separating comma
+				cursor++;
+				continue;
+			}
+			const char* elementEnd = findObjectEnd(cursor, end);
+			if(elementEnd == 0) {
+				return -1;
+			}
+			int transferredBytes;
+			target->write(cursor, elementEnd - cursor, transferredBytes);
+			count++;
+			cursor = elementEnd;
+		}
+		return -1; // Missing closing bracket
+	}
+
+private:
+
+	/// Finds the end (one past the closing brace) of the JSON object that starts at begin.
+	static const char* findObjectEnd(const char* begin, const char* end) {
+		int depth = 0;
+		bool inString = false;
+		for(const char* cursor = begin; cursor < end; ++cursor) {
+			if(inString) {
+				if(*cursor == '\\') {
+					cursor++; // skip escaped character
+				} else if(*cursor == '"') {
+					inString = false;
+				}
+				continue;
+			}
+			switch (*cursor) {
+				case '"':
+					inString = true;
+					break;
+				case '{':
+				case '[':
+					depth++;
+					break;
+				case '}':
+				case ']':
+					depth--;
+					if(depth == 0) {
+						return cursor + 1;
+					}
+					break;
+				default:
+					break;
+			}
+		}
+		return 0;
+	}
+};
+
+#endif /* RSG_UPDATE_BATCH_H_ */
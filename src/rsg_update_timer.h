@@ -0,0 +1,82 @@
+/*
+ * Scene graph update observer that measures how long another observer takes.
+ */
+
+#ifndef RSG_UPDATE_TIMER_H_
+#define RSG_UPDATE_TIMER_H_
+
+#include <brics_3d/worldModel/sceneGraph/ISceneGraphUpdateObserver.h>
+
+#include <vector>
+
+#include "rsg_stats.h"
+
+/**
+ * Forwards every update to an observer (e.g. a serializer) and records the
+ * duration of the call in a histogram.
+ */
+class TimedUpdateObserver : public brics_3d::rsg::ISceneGraphUpdateObserver {
+public:
+	TimedUpdateObserver(brics_3d::rsg::ISceneGraphUpdateObserver* observer, LatencyHistogram* histogram) : observer(observer), histogram(histogram) {};
+	virtual ~TimedUpdateObserver(){};
+
+	/* implemetntations of observer interface */
+	bool addNode(brics_3d::rsg::Id parentId, brics_3d::rsg::Id& assignedId, std::vector<brics_3d::rsg::Attribute> attributes, bool forcedId = false) {
+		ScopedLatency latency(histogram);
+		return observer->addNode(parentId, assignedId, attributes, forcedId);
+	};
+	bool addGroup(brics_3d::rsg::Id parentId, brics_3d::rsg::Id& assignedId, std::vector<brics_3d::rsg::Attribute> attributes, bool forcedId = false) {
+		ScopedLatency latency(histogram);
+		return observer->addGroup(parentId, assignedId, attributes, forcedId);
+	};
+	bool addTransformNode(brics_3d::rsg::Id parentId, brics_3d::rsg::Id& assignedId, std::vector<brics_3d::rsg::Attribute> attributes, brics_3d::IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, brics_3d::rsg::TimeStamp timeStamp, bool forcedId = false) {
+		ScopedLatency latency(histogram);
+		return observer->addTransformNode(parentId, assignedId, attributes, transform, timeStamp, forcedId);
+	};
+	bool addUncertainTransformNode(brics_3d::rsg::Id parentId, brics_3d::rsg::Id& assignedId, std::vector<brics_3d::rsg::Attribute> attributes, brics_3d::IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, brics_3d::rsg::ITransformUncertainty::ITransformUncertaintyPtr uncertainty, brics_3d::rsg::TimeStamp timeStamp, bool forcedId = false) {
+		ScopedLatency latency(histogram);
+		return observer->addUncertainTransformNode(parentId, assignedId, attributes, transform, uncertainty, timeStamp, forcedId);
+	};
+	bool addGeometricNode(brics_3d::rsg::Id parentId, brics_3d::rsg::Id& assignedId, std::vector<brics_3d::rsg::Attribute> attributes, brics_3d::rsg::Shape::ShapePtr shape, brics_3d::rsg::TimeStamp timeStamp, bool forcedId = false) {
+		ScopedLatency latency(histogram);
+		return observer->addGeometricNode(parentId, assignedId, attributes, shape, timeStamp, forcedId);
+	};
+	bool addRemoteRootNode(brics_3d::rsg::Id rootId, std::vector<brics_3d::rsg::Attribute> attributes) {
+		ScopedLatency latency(histogram);
+		return observer->addRemoteRootNode(rootId, attributes);
+	};
+	bool addConnection(brics_3d::rsg::Id parentId, brics_3d::rsg::Id& assignedId, std::vector<brics_3d::rsg::Attribute> attributes, std::vector<brics_3d::rsg::Id> sourceIds, std::vector<brics_3d::rsg::Id> targetIds, brics_3d::rsg::TimeStamp start, brics_3d::rsg::TimeStamp end, bool forcedId = false) {
+		ScopedLatency latency(histogram);
+		return observer->addConnection(parentId, assignedId, attributes, sourceIds, targetIds, start, end, forcedId);
+	};
+	bool setNodeAttributes(brics_3d::rsg::Id id, std::vector<brics_3d::rsg::Attribute> newAttributes, brics_3d::rsg::TimeStamp timeStamp = brics_3d::rsg::TimeStamp(0)) {
+		ScopedLatency latency(histogram);
+		return observer->setNodeAttributes(id, newAttributes, timeStamp);
+	};
+	bool setTransform(brics_3d::rsg::Id id, brics_3d::IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, brics_3d::rsg::TimeStamp timeStamp) {
+		ScopedLatency latency(histogram);
+		return observer->setTransform(id, transform, timeStamp);
+	};
+	bool setUncertainTransform(brics_3d::rsg::Id id, brics_3d::IHomogeneousMatrix44::IHomogeneousMatrix44Ptr transform, brics_3d::rsg::ITransformUncertainty::ITransformUncertaintyPtr uncertainty, brics_3d::rsg::TimeStamp timeStamp) {
+		ScopedLatency latency(histogram);
+		return observer->setUncertainTransform(id, transform, uncertainty, timeStamp);
+	};
+	bool deleteNode(brics_3d::rsg::Id id) {
+		ScopedLatency latency(histogram);
+		return observer->deleteNode(id);
+	};
+	bool addParent(brics_3d::rsg::Id id, brics_3d::rsg::Id parentId) {
+		ScopedLatency latency(histogram);
+		return observer->addParent(id, parentId);
+	};
+	bool removeParent(brics_3d::rsg::Id id, brics_3d::rsg::Id parentId) {
+		ScopedLatency latency(histogram);
+		return observer->removeParent(id, parentId);
+	};
+
+private:
+	brics_3d::rsg::ISceneGraphUpdateObserver* observer;
+	LatencyHistogram* histogram;
+};
+
+#endif /* RSG_UPDATE_TIMER_H_ */
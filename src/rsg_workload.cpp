@@ -0,0 +1,565 @@
+#include "rsg_workload.hpp"
+
+/* microblx type for the robot scene graph */
+#include "types/rsg/types/rsg_types.h"
+
+/* BRICS_3D includes */
+#include <brics_3d/core/Logger.h>
+#include <brics_3d/core/HomogeneousMatrix44.h>
+#include <brics_3d/worldModel/WorldModel.h>
+#include <brics_3d/worldModel/sceneGraph/JSONQueryRunner.h>
+
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "rsg_world_model_lock.h"
+#include "rsg_stats.h"
+
+using namespace brics_3d;
+using brics_3d::Logger;
+
+UBX_MODULE_LICENSE_SPDX(BSD-3-Clause)
+
+#define DEFAULT_WORKLOAD_AGENTS 1
+#define DEFAULT_WORKLOAD_TRANSFORM_FREQ 10.0 // [Hz] per agent
+#define DEFAULT_WORKLOAD_OBSERVATION_FREQ 0.2 // [Hz] per agent
+#define DEFAULT_WORKLOAD_ARTVA_FREQ 1.0 // [Hz] per agent
+#define DEFAULT_WORKLOAD_QUERY_FREQ 1.0 // [Hz] per agent
+#define DEFAULT_WORKLOAD_MAX_OBSERVATIONS 100
+#define DEFAULT_WORKLOAD_REPORT_PERIOD 5000 // [ms]
+
+/**
+ * Nodes of a simulated agent. The layout follows the SHERPA examples in examples/json_api:
+ * a geo pose Transform below the wgs84 origin, an ARTVA node below the pose and
+ * an observations group with image nodes.
+ */
+struct WorkloadAgent {
+	std::string name;
+	rsg::Id group;
+	rsg::Id geoPose;
+	rsg::Id artva;
+	rsg::Id observations;
+	std::deque<rsg::Id> observationIds; // Oldest first
+	uint64_t poseUpdates;
+};
+
+enum WorkloadOperationType {
+	WORKLOAD_TRANSFORM = 0,
+	WORKLOAD_OBSERVATION,
+	WORKLOAD_ARTVA,
+	WORKLOAD_QUERY,
+	WORKLOAD_OPERATION_COUNT
+};
+
+/**
+ * Generator for one type of operation. All agents share the rate: operation i is
+ * executed for agent i % num_agents.
+ */
+struct WorkloadOperation {
+	const char* name;
+	float freq;                 // [Hz] per agent
+	uint64_t issued;            // Operations executed since start
+	uint64_t issued_at_report;  // Operations executed at the last report
+	StatsCounter* counter;
+	StatsCounter* failures;
+	LatencyHistogram* latency;
+};
+
+/* define a structure for holding the block local state. By assigning an
+ * instance of this struct to the block private_data pointer (see init), this
+ * information becomes accessible within the hook functions.
+ */
+struct rsg_workload_info
+{
+        /* add custom block local data here */
+		brics_3d::WorldModel* wm;
+		brics_3d::rsg::JSONQueryRunner* query_runner;
+
+		uint32_t num_agents;
+		uint32_t image_size;
+		uint32_t max_observations;
+		uint32_t report_period;
+
+		std::vector<WorkloadAgent>* agents;
+		rsg::Id origin;
+		std::string* image_data;
+		WorkloadOperation operations[WORKLOAD_OPERATION_COUNT];
+
+		std::chrono::steady_clock::time_point* workload_start;
+		std::chrono::steady_clock::time_point* last_report;
+		std::chrono::steady_clock::time_point* last_step;
+
+		/* blocks whose statistics are reported */
+		std::vector<std::string>* report_blocks;
+		std::vector<uint64_t>* report_messages_in;  // messages_in of the report_blocks at the last report
+		std::vector<uint64_t>* report_messages_out; // messages_out of the report_blocks at the last report
+
+		/* instrumentation */
+		LatencyHistogram* step_time;
+
+        /* this is to have fast access to ports for reading and writing, without
+         * needing a hash table lookup */
+        struct rsg_workload_port_cache ports;
+};
+
+/**
+ * Time stamp as used by the TimeStampDate of the JSON API.
+ */
+static std::string get_date_stamp()
+{
+	char stamp[32];
+	time_t now = time(0);
+	struct tm utc;
+	gmtime_r(&now, &utc);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &utc);
+	return std::string(stamp);
+}
+
+/**
+ * Pose of an agent that flies a circle around the origin. Every agent has its own circle.
+ */
+static brics_3d::IHomogeneousMatrix44::IHomogeneousMatrix44Ptr get_agent_pose(uint32_t agentIndex, uint64_t poseUpdates)
+{
+	double angle = 0.01 * poseUpdates;
+	double radius = 10.0 + agentIndex;
+	brics_3d::IHomogeneousMatrix44::IHomogeneousMatrix44Ptr pose(new brics_3d::HomogeneousMatrix44(
+			cos(angle), -sin(angle), 0,  	// Rotation coefficients
+			sin(angle), cos(angle), 0,
+			0, 0, 1,
+			radius * cos(angle), radius * sin(angle), 20.0)); // Translation coefficients
+	return pose;
+}
+
+/**
+ * Creates the origin and the nodes of all agents.
+ */
+static bool create_agents(struct rsg_workload_info *inf)
+{
+	brics_3d::WorldModel* wm = inf->wm;
+	WorldModelWriteLock writeLock(wm);
+
+	std::vector<rsg::Attribute> attributes;
+	attributes.push_back(rsg::Attribute("gis:origin", "wgs84"));
+	attributes.push_back(rsg::Attribute("name", "workload_origin"));
+	if(!wm->scene.addGroup(wm->getRootNodeId(), inf->origin, attributes)) {
+		LOG(ERROR) << "rsg_workload: Cannot add the origin.";
+		return false;
+	}
+
+	inf->agents->clear();
+	inf->agents->resize(inf->num_agents);
+	for (uint32_t i = 0; i < inf->num_agents; ++i) {
+		WorkloadAgent& agent = inf->agents->at(i);
+		std::stringstream name;
+		name << "workload_agent_" << i;
+		agent.name = name.str();
+		agent.poseUpdates = 0;
+
+		attributes.clear();
+		attributes.push_back(rsg::Attribute("sherpa:agent_name", agent.name));
+		bool success = wm->scene.addGroup(wm->getRootNodeId(), agent.group, attributes);
+
+		attributes.clear();
+		attributes.push_back(rsg::Attribute("tf:type", "wgs84"));
+		attributes.push_back(rsg::Attribute("name", agent.name + "_geopose"));
+		success = success && wm->scene.addTransformNode(inf->origin, agent.geoPose, attributes, get_agent_pose(i, 0), wm->now());
+
+		attributes.clear();
+		attributes.push_back(rsg::Attribute("sherpa:artva_signal", "0"));
+		attributes.push_back(rsg::Attribute("sherpa:stamp", get_date_stamp()));
+		success = success && wm->scene.addNode(agent.geoPose, agent.artva, attributes);
+
+		attributes.clear();
+		attributes.push_back(rsg::Attribute("name", "observations"));
+		success = success && wm->scene.addGroup(agent.group, agent.observations, attributes);
+
+		if(!success) {
+			LOG(ERROR) << "rsg_workload: Cannot add the nodes of agent " << agent.name;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Deletes the origin and the nodes of all agents again, so consecutive runs start from the same graph.
+ */
+static void delete_agents(struct rsg_workload_info *inf)
+{
+	brics_3d::WorldModel* wm = inf->wm;
+	WorldModelWriteLock writeLock(wm);
+	for (size_t i = 0; i < inf->agents->size(); ++i) {
+		WorkloadAgent& agent = inf->agents->at(i);
+		for (size_t j = 0; j < agent.observationIds.size(); ++j) {
+			wm->scene.deleteNode(agent.observationIds[j]);
+		}
+		wm->scene.deleteNode(agent.observations);
+		wm->scene.deleteNode(agent.artva);
+		wm->scene.deleteNode(agent.geoPose);
+		wm->scene.deleteNode(agent.group);
+	}
+	wm->scene.deleteNode(inf->origin);
+	inf->agents->clear();
+}
+
+static bool update_transform(struct rsg_workload_info *inf, uint32_t agentIndex)
+{
+	WorkloadAgent& agent = inf->agents->at(agentIndex);
+	agent.poseUpdates++;
+	WorldModelWriteLock writeLock(inf->wm);
+	return inf->wm->scene.setTransform(agent.geoPose, get_agent_pose(agentIndex, agent.poseUpdates), inf->wm->now());
+}
+
+static bool add_observation(struct rsg_workload_info *inf, uint32_t agentIndex, uint64_t observationIndex)
+{
+	WorkloadAgent& agent = inf->agents->at(agentIndex);
+	std::stringstream uri;
+	uri << "file://workload/" << agent.name << "/image_" << observationIndex << ".jpg";
+
+	std::vector<rsg::Attribute> attributes;
+	attributes.push_back(rsg::Attribute("sherpa:observation_type", "image"));
+	attributes.push_back(rsg::Attribute("sherpa:uri", uri.str()));
+	attributes.push_back(rsg::Attribute("sherpa:stamp", get_date_stamp()));
+	attributes.push_back(rsg::Attribute("sherpa:author", agent.name));
+	if(inf->image_size > 0) {
+		attributes.push_back(rsg::Attribute("sherpa:image_data", *inf->image_data));
+	}
+
+	WorldModelWriteLock writeLock(inf->wm);
+	rsg::Id observationId;
+	if(!inf->wm->scene.addNode(agent.observations, observationId, attributes)) {
+		return false;
+	}
+	agent.observationIds.push_back(observationId);
+	if((inf->max_observations > 0) && (agent.observationIds.size() > inf->max_observations)) {
+		inf->wm->scene.deleteNode(agent.observationIds.front());
+		agent.observationIds.pop_front();
+	}
+	return true;
+}
+
+static bool update_artva(struct rsg_workload_info *inf, uint32_t agentIndex, uint64_t signalIndex)
+{
+	WorkloadAgent& agent = inf->agents->at(agentIndex);
+	std::stringstream signal;
+	signal << (signalIndex * 7) % 100;
+
+	std::vector<rsg::Attribute> attributes;
+	attributes.push_back(rsg::Attribute("sherpa:artva_signal", signal.str()));
+	attributes.push_back(rsg::Attribute("sherpa:stamp", get_date_stamp()));
+
+	WorldModelWriteLock writeLock(inf->wm);
+	return inf->wm->scene.setNodeAttributes(agent.artva, attributes, inf->wm->now());
+}
+
+/**
+ * Runs one of the queries of examples/json_api. The queries are used in turns.
+ */
+static bool run_query(struct rsg_workload_info *inf, uint32_t agentIndex, uint64_t queryIndex)
+{
+	WorkloadAgent& agent = inf->agents->at(agentIndex);
+	std::stringstream query;
+	query << "{\"@worldmodeltype\": \"RSGQuery\", ";
+	switch (queryIndex % 4) {
+	case 0:
+		query << "\"query\": \"GET_NODES\", \"attributes\": [{\"key\": \"sherpa:observation_type\", \"value\": \"image\"}]}";
+		break;
+	case 1:
+		query << "\"query\": \"GET_TRANSFORM\", \"id\": \"" << agent.geoPose.toString() << "\", \"idReferenceNode\": \"" << inf->origin.toString()
+			  << "\", \"timeStamp\": {\"@stamptype\": \"TimeStampDate\", \"stamp\": \"" << get_date_stamp() << "\"}}";
+		break;
+	case 2:
+		query << "\"query\": \"GET_NODE_ATTRIBUTES\", \"id\": \"" << agent.artva.toString() << "\"}";
+		break;
+	default:
+		query << "\"query\": \"GET_GROUP_CHILDREN\", \"id\": \"" << agent.observations.toString() << "\"}";
+		break;
+	}
+
+	std::string queryString = query.str();
+	std::string result;
+	WorldModelReadLock readLock(inf->wm);
+	return inf->query_runner->query(queryString, result);
+}
+
+static bool execute(struct rsg_workload_info *inf, int type, uint32_t agentIndex, uint64_t operationIndex)
+{
+	switch (type) {
+	case WORKLOAD_TRANSFORM:
+		return update_transform(inf, agentIndex);
+	case WORKLOAD_OBSERVATION:
+		return add_observation(inf, agentIndex, operationIndex);
+	case WORKLOAD_ARTVA:
+		return update_artva(inf, agentIndex, operationIndex);
+	default:
+		return run_query(inf, agentIndex, operationIndex);
+	}
+}
+
+/**
+ * Logs the achieved rates against the target rates since the last report, and the
+ * statistics of the report_blocks. An achieved rate that stays below its target
+ * means the world model including its synchronous observers (e.g. rsg_json_sender)
+ * is saturated.
+ */
+static void report(struct rsg_workload_info *inf, const char* phase)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(now - *inf->last_report).count();
+	double elapsed = std::chrono::duration<double>(now - *inf->workload_start).count();
+	if(seconds <= 0) {
+		seconds = 1e-9;
+	}
+
+	for (int i = 0; i < WORKLOAD_OPERATION_COUNT; ++i) {
+		WorkloadOperation& operation = inf->operations[i];
+		if(operation.freq <= 0) {
+			continue;
+		}
+		double target = operation.freq * inf->num_agents;
+		uint64_t due = static_cast<uint64_t>(elapsed * target);
+		LOG(INFO) << "rsg_workload: " << phase << ": " << operation.name << ": " << (operation.issued - operation.issued_at_report) / seconds
+				<< " ops/s of " << target << " ops/s (" << inf->num_agents << " agents x " << operation.freq << " Hz), "
+				<< ((due > operation.issued) ? (due - operation.issued) : 0) << " behind schedule, "
+				<< operation.failures->get() << " failed. Latency p50 = " << operation.latency->getPercentile(50)
+				<< " ns, p99 = " << operation.latency->getPercentile(99) << " ns.";
+		operation.issued_at_report = operation.issued;
+	}
+
+	for (size_t i = 0; i < inf->report_blocks->size(); ++i) {
+		BlockStats* stats = BlockStats::get(inf->report_blocks->at(i));
+		uint64_t messagesIn = stats->getCounter("messages_in")->get();
+		uint64_t messagesOut = stats->getCounter("messages_out")->get();
+		std::stringstream json;
+		stats->toJson(json);
+		LOG(INFO) << "rsg_workload: " << phase << ": " << inf->report_blocks->at(i) << ": "
+				<< (messagesIn - inf->report_messages_in->at(i)) / seconds << " messages/s in, "
+				<< (messagesOut - inf->report_messages_out->at(i)) / seconds << " messages/s out. Statistics: " << json.str();
+		inf->report_messages_in->at(i) = messagesIn;
+		inf->report_messages_out->at(i) = messagesOut;
+	}
+	*inf->last_report = now;
+}
+
+static float get_frequency_config(ubx_block_t *b, const char* name, float defaultValue)
+{
+	unsigned int clen;
+	float* freq = (float*) ubx_config_get_data_ptr(b, name, &clen);
+	if(clen == 0) {
+		LOG(INFO) << "rsg_workload: No " << name << " configuration given. Setting it to " << defaultValue;
+		return defaultValue;
+	}
+	if(*freq < 0) {
+		LOG(WARNING) << "rsg_workload: " << name << " < 0. Resetting it to " << defaultValue;
+		return defaultValue;
+	}
+	LOG(INFO) << "rsg_workload: " << name << " = " << *freq;
+	return *freq;
+}
+
+static uint32_t get_uint_config(ubx_block_t *b, const char* name, uint32_t defaultValue)
+{
+	unsigned int clen;
+	uint32_t* value = (uint32_t*) ubx_config_get_data_ptr(b, name, &clen);
+	if(clen == 0) {
+		LOG(INFO) << "rsg_workload: No " << name << " configuration given. Setting it to " << defaultValue;
+		return defaultValue;
+	}
+	LOG(INFO) << "rsg_workload: " << name << " = " << *value;
+	return *value;
+}
+
+/* init */
+int rsg_workload_init(ubx_block_t *b)
+{
+        int ret = -1;
+        struct rsg_workload_info *inf;
+
+        /* allocate memory for the block local state */
+        if ((inf = (struct rsg_workload_info*)calloc(1, sizeof(struct rsg_workload_info)))==NULL) {
+                ERR("rsg_workload: failed to alloc memory");
+                ret=EOUTOFMEM;
+                return -1;
+        }
+        b->private_data=inf;
+        update_port_cache(b, &inf->ports);
+
+    	unsigned int clen;
+    	rsg_wm_handle tmpWmHandle =  *((rsg_wm_handle*) ubx_config_get_data_ptr(b, "wm_handle", &clen));
+    	assert(clen != 0);
+    	inf->wm = reinterpret_cast<brics_3d::WorldModel*>(tmpWmHandle.wm); // We know that this pointer stores the world model type
+    	if(inf->wm == 0) {
+    		LOG(FATAL) << "rsg_workload: World model handle could not be initialized.";
+    		return -1;
+    	}
+
+    	inf->num_agents = get_uint_config(b, "num_agents", DEFAULT_WORKLOAD_AGENTS);
+    	if(inf->num_agents == 0) {
+    		LOG(ERROR) << "rsg_workload: num_agents must be at least 1.";
+    		return -1;
+    	}
+    	inf->image_size = get_uint_config(b, "image_size", 0);
+    	inf->max_observations = get_uint_config(b, "max_observations", DEFAULT_WORKLOAD_MAX_OBSERVATIONS);
+    	inf->report_period = get_uint_config(b, "report_period", DEFAULT_WORKLOAD_REPORT_PERIOD);
+
+    	const char* operationNames[WORKLOAD_OPERATION_COUNT] = {"transform", "observation", "artva", "query"};
+    	inf->operations[WORKLOAD_TRANSFORM].freq = get_frequency_config(b, "transform_freq", DEFAULT_WORKLOAD_TRANSFORM_FREQ);
+    	inf->operations[WORKLOAD_OBSERVATION].freq = get_frequency_config(b, "observation_freq", DEFAULT_WORKLOAD_OBSERVATION_FREQ);
+    	inf->operations[WORKLOAD_ARTVA].freq = get_frequency_config(b, "artva_freq", DEFAULT_WORKLOAD_ARTVA_FREQ);
+    	inf->operations[WORKLOAD_QUERY].freq = get_frequency_config(b, "query_freq", DEFAULT_WORKLOAD_QUERY_FREQ);
+
+    	BlockStats* stats = BlockStats::get(b->name);
+    	for (int i = 0; i < WORKLOAD_OPERATION_COUNT; ++i) {
+    		std::string name(operationNames[i]);
+    		inf->operations[i].name = operationNames[i];
+    		inf->operations[i].counter = stats->getCounter(name);
+    		inf->operations[i].failures = stats->getCounter(name + "_failures");
+    		inf->operations[i].latency = stats->getHistogram(name);
+    	}
+    	inf->step_time = stats->getHistogram("step");
+
+    	inf->report_blocks = new std::vector<std::string>();
+    	inf->report_messages_in = new std::vector<uint64_t>();
+    	inf->report_messages_out = new std::vector<uint64_t>();
+    	char* chrptr = (char*) ubx_config_get_data_ptr(b, "report_blocks", &clen);
+    	if(clen != 0) {
+    		std::stringstream names(chrptr);
+    		std::string name;
+    		while(std::getline(names, name, ',')) {
+    			if(!name.empty()) {
+    				inf->report_blocks->push_back(name);
+    				LOG(INFO) << "rsg_workload: Reporting statistics of " << name;
+    			}
+    		}
+    	}
+
+    	inf->image_data = new std::string(inf->image_size, 'x');
+    	inf->agents = new std::vector<WorkloadAgent>();
+    	inf->query_runner = new brics_3d::rsg::JSONQueryRunner(inf->wm);
+    	inf->workload_start = new std::chrono::steady_clock::time_point();
+    	inf->last_report = new std::chrono::steady_clock::time_point();
+    	inf->last_step = new std::chrono::steady_clock::time_point();
+
+        return 0;
+}
+
+/* start */
+int rsg_workload_start(ubx_block_t *b)
+{
+        struct rsg_workload_info *inf = (struct rsg_workload_info*) b->private_data;
+        if(!create_agents(inf)) {
+        	return -1;
+        }
+        for (int i = 0; i < WORKLOAD_OPERATION_COUNT; ++i) {
+        	inf->operations[i].issued = 0;
+        	inf->operations[i].issued_at_report = 0;
+        }
+        inf->report_messages_in->clear();
+        inf->report_messages_out->clear();
+        for (size_t i = 0; i < inf->report_blocks->size(); ++i) {
+        	BlockStats* stats = BlockStats::get(inf->report_blocks->at(i));
+        	inf->report_messages_in->push_back(stats->getCounter("messages_in")->get());
+        	inf->report_messages_out->push_back(stats->getCounter("messages_out")->get());
+        }
+        *inf->workload_start = std::chrono::steady_clock::now();
+        *inf->last_report = *inf->workload_start;
+        *inf->last_step = *inf->workload_start;
+        LOG(INFO) << "rsg_workload: Started workload with " << inf->num_agents << " agents.";
+        return 0;
+}
+
+/* stop */
+void rsg_workload_stop(ubx_block_t *b)
+{
+        struct rsg_workload_info *inf = (struct rsg_workload_info*) b->private_data;
+        report(inf, "Stopped");
+        delete_agents(inf);
+}
+
+/* cleanup */
+void rsg_workload_cleanup(ubx_block_t *b)
+{
+        struct rsg_workload_info *inf = (struct rsg_workload_info*) b->private_data;
+        if(inf->query_runner) {
+        	delete inf->query_runner;
+        	inf->query_runner = 0;
+        }
+        if(inf->agents) {
+        	delete inf->agents;
+        	inf->agents = 0;
+        }
+        if(inf->image_data) {
+        	delete inf->image_data;
+        	inf->image_data = 0;
+        }
+        if(inf->workload_start) {
+        	delete inf->workload_start;
+        	inf->workload_start = 0;
+        }
+        if(inf->last_report) {
+        	delete inf->last_report;
+        	inf->last_report = 0;
+        }
+        if(inf->last_step) {
+        	delete inf->last_step;
+        	inf->last_step = 0;
+        }
+        if(inf->report_blocks) {
+        	delete inf->report_blocks;
+        	inf->report_blocks = 0;
+        }
+        if(inf->report_messages_in) {
+        	delete inf->report_messages_in;
+        	inf->report_messages_in = 0;
+        }
+        if(inf->report_messages_out) {
+        	delete inf->report_messages_out;
+        	inf->report_messages_out = 0;
+        }
+        free(b->private_data);
+}
+
+/* step */
+void rsg_workload_step(ubx_block_t *b)
+{
+        struct rsg_workload_info *inf = (struct rsg_workload_info*) b->private_data;
+        ScopedLatency stepLatency(inf->step_time);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - *inf->workload_start).count();
+        double interval = std::chrono::duration<double>(now - *inf->last_step).count();
+        *inf->last_step = now;
+
+        /*
+         * Every step executes the operations that became due since the last one, but at most
+         * as many as the schedule allows for one step interval. If a step cannot keep up, the
+         * remaining backlog is carried over to the next steps and shows up in the report.
+         */
+        for (int i = 0; i < WORKLOAD_OPERATION_COUNT; ++i) {
+        	WorkloadOperation& operation = inf->operations[i];
+        	double rate = operation.freq * inf->num_agents;
+        	uint64_t due = static_cast<uint64_t>(elapsed * rate);
+        	uint64_t limit = operation.issued + static_cast<uint64_t>(ceil(interval * rate));
+        	while((operation.issued < due) && (operation.issued < limit)) {
+        		bool success;
+        		{
+        			ScopedLatency latency(operation.latency);
+        			success = execute(inf, i, operation.issued % inf->num_agents, operation.issued / inf->num_agents);
+        		}
+        		if(!success) {
+        			operation.failures->add();
+        		}
+        		operation.counter->add();
+        		operation.issued++;
+        	}
+        }
+
+        if((inf->report_period > 0) &&
+        		(std::chrono::duration_cast<std::chrono::milliseconds>(now - *inf->last_report).count() >= inf->report_period)) {
+        	report(inf, "Running");
+        }
+}
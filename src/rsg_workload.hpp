@@ -0,0 +1,114 @@
+/*
+ * rsg_workload microblx function block (autogenerated, don't edit)
+ */
+
+#include <ubx.h>
+
+/* includes types and type metadata */
+
+ubx_type_t types[] = {
+        { NULL },
+};
+
+/* block meta information */
+char rsg_workload_meta[] =
+        " { doc='A block that generates a synthetic SHERPA-like multi-agent workload on a world model for capacity planning',"
+        "   real-time=false,"
+        "}";
+
+/* declaration of block configuration */
+ubx_config_t rsg_workload_config[] = {
+        { .name="wm_handle", .type_name = "struct rsg_wm_handle", .doc="Handle to the world wodel instance. This parameter is mandatory." },
+        { .name="num_agents", .type_name = "uint32_t", .doc="Number of simulated agents. Every agent has a geo pose Transform, an ARTVA node and an observations group. Default is 1." },
+        { .name="transform_freq", .type_name = "float", .doc="Frequency in [Hz] of pose updates per agent. Default is 10." },
+        { .name="observation_freq", .type_name = "float", .doc="Frequency in [Hz] of new image observation nodes per agent. Default is 0.2." },
+        { .name="artva_freq", .type_name = "float", .doc="Frequency in [Hz] of ARTVA signal attribute updates per agent. Default is 1." },
+        { .name="query_freq", .type_name = "float", .doc="Frequency in [Hz] of JSON queries per agent. The queries cycle through GET_NODES, GET_TRANSFORM, "
+        		"GET_NODE_ATTRIBUTES and GET_GROUP_CHILDREN like the examples in examples/json_api. Default is 1." },
+        { .name="image_size", .type_name = "uint32_t", .doc="Size in bytes of the image payload attribute of an observation node. 0 only adds the meta data. Default is 0." },
+        { .name="max_observations", .type_name = "uint32_t", .doc="Number of observations per agent that are kept. Older ones are deleted. 0 keeps all. Default is 100." },
+        { .name="report_period", .type_name = "uint32_t", .doc="Period in [ms] for logging the achieved rates. 0 only reports on stop. Default is 5000." },
+        { .name="report_blocks", .type_name = "char" , .doc="Comma separated names of blocks whose statistics are reported along with the achieved rates, e.g. rsgjsonsender,rsgjsonreciever." },
+        { NULL },
+};
+
+/* declaration port block ports */
+ubx_port_t rsg_workload_ports[] = {
+        { NULL },
+};
+
+/* declare a struct port_cache */
+struct rsg_workload_port_cache {
+};
+
+/* declare a helper function to update the port cache this is necessary
+ * because the port ptrs can change if ports are dynamically added or
+ * removed. This function should hence be called after all
+ * initialization is done, i.e. typically in 'start'
+ */
+static void update_port_cache(ubx_block_t *b, struct rsg_workload_port_cache *pc)
+{
+}
+
+
+/* block operation forward declarations */
+int rsg_workload_init(ubx_block_t *b);
+int rsg_workload_start(ubx_block_t *b);
+void rsg_workload_stop(ubx_block_t *b);
+void rsg_workload_cleanup(ubx_block_t *b);
+void rsg_workload_step(ubx_block_t *b);
+
+
+/* put everything together */
+ubx_block_t rsg_workload_block = {
+        .name = "rsg_workload",
+        .type = BLOCK_TYPE_COMPUTATION,
+        .meta_data = rsg_workload_meta,
+        .configs = rsg_workload_config,
+        .ports = rsg_workload_ports,
+
+        /* ops */
+        .init = rsg_workload_init,
+        .start = rsg_workload_start,
+        .stop = rsg_workload_stop,
+        .cleanup = rsg_workload_cleanup,
+        .step = rsg_workload_step,
+};
+
+
+/* rsg_workload module init and cleanup functions */
+int rsg_workload_mod_init(ubx_node_info_t* ni)
+{
+        DBG(" ");
+        int ret = -1;
+        ubx_type_t *tptr;
+
+        for(tptr=types; tptr->name!=NULL; tptr++) {
+                if(ubx_type_register(ni, tptr) != 0) {
+                        goto out;
+                }
+        }
+
+        if(ubx_block_register(ni, &rsg_workload_block) != 0)
+                goto out;
+
+        ret=0;
+out:
+        return ret;
+}
+
+void rsg_workload_mod_cleanup(ubx_node_info_t *ni)
+{
+        DBG(" ");
+        const ubx_type_t *tptr;
+
+        for(tptr=types; tptr->name!=NULL; tptr++)
+                ubx_type_unregister(ni, tptr->name);
+
+        ubx_block_unregister(ni, "rsg_workload");
+}
+
+/* declare module init and cleanup functions, so that the ubx core can
+ * find these when the module is loaded/unloaded */
+UBX_MODULE_INIT(rsg_workload_mod_init)
+UBX_MODULE_CLEANUP(rsg_workload_mod_cleanup)
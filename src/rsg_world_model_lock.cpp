@@ -0,0 +1,46 @@
+#include "rsg_world_model_lock.h"
+
+#include <map>
+#include <mutex>
+
+static std::mutex registryMutex;
+static std::map<brics_3d::WorldModel*, WorldModelLock*> registry;
+
+WorldModelLock* WorldModelLock::get(brics_3d::WorldModel* wm) {
+	std::lock_guard<std::mutex> guard(registryMutex);
+	std::map<brics_3d::WorldModel*, WorldModelLock*>::iterator it = registry.find(wm);
+	if(it != registry.end()) {
+		return it->second;
+	}
+	WorldModelLock* lock = new WorldModelLock();
+	registry.insert(std::make_pair(wm, lock));
+	return lock;
+}
+
+WorldModelLock::WorldModelLock() {
+	pthread_rwlockattr_t attributes;
+	pthread_rwlockattr_init(&attributes);
+	pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	pthread_rwlock_init(&lock, &attributes);
+	pthread_rwlockattr_destroy(&attributes);
+}
+
+WorldModelLock::~WorldModelLock() {
+	pthread_rwlock_destroy(&lock);
+}
+
+void WorldModelLock::lockShared() {
+	pthread_rwlock_rdlock(&lock);
+}
+
+void WorldModelLock::unlockShared() {
+	pthread_rwlock_unlock(&lock);
+}
+
+void WorldModelLock::lockExclusive() {
+	pthread_rwlock_wrlock(&lock);
+}
+
+void WorldModelLock::unlockExclusive() {
+	pthread_rwlock_unlock(&lock);
+}
@@ -0,0 +1,75 @@
+/*
+ * Process wide reader/writer locks for shared world model instances.
+ *
+ * All blocks that share a world model via the same wm_handle obtain the same
+ * lock. Blocks that modify the world model from their own thread take the
+ * exclusive lock, blocks that only read (e.g. parallel queries) the shared one.
+ * The locks are not recursive: observers that are invoked while an update is
+ * applied must not lock the same world model again.
+ */
+
+#ifndef RSG_WORLD_MODEL_LOCK_H_
+#define RSG_WORLD_MODEL_LOCK_H_
+
+#include <pthread.h>
+
+#define RSG_COMMON_API __attribute__ ((visibility("default")))
+
+namespace brics_3d {
+	class WorldModel;
+}
+
+/**
+ * Reader/writer lock that prefers writers, so a stream of queries cannot starve incoming updates.
+ */
+class RSG_COMMON_API WorldModelLock {
+public:
+
+	/**
+	 * Gets the lock for a world model. It is created on first use and lives as long as the process.
+	 */
+	static WorldModelLock* get(brics_3d::WorldModel* wm);
+
+	void lockShared();
+	void unlockShared();
+	void lockExclusive();
+	void unlockExclusive();
+
+private:
+	WorldModelLock();
+	~WorldModelLock();
+
+	pthread_rwlock_t lock;
+};
+
+/**
+ * Scoped shared (reader) lock.
+ */
+class WorldModelReadLock {
+public:
+	WorldModelReadLock(brics_3d::WorldModel* wm) : lock(WorldModelLock::get(wm)) {
+		lock->lockShared();
+	}
+	~WorldModelReadLock() {
+		lock->unlockShared();
+	}
+private:
+	WorldModelLock* lock;
+};
+
+/**
+ * Scoped exclusive (writer) lock.
+ */
+class WorldModelWriteLock {
+public:
+	WorldModelWriteLock(brics_3d::WorldModel* wm) : lock(WorldModelLock::get(wm)) {
+		lock->lockExclusive();
+	}
+	~WorldModelWriteLock() {
+		lock->unlockExclusive();
+	}
+private:
+	WorldModelLock* lock;
+};
+
+#endif /* RSG_WORLD_MODEL_LOCK_H_ */